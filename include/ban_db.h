@@ -0,0 +1,94 @@
+/************************************************************************
+ *   IRC - Internet Relay Chat, include/ban_db.h
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 1, or (at your option)
+ *   any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ * "ban_db.h". - compiled kline.conf/dline.conf images
+ *
+ * $Id$
+ */
+#ifndef INCLUDED_ban_db_h
+#define INCLUDED_ban_db_h
+
+/*
+ * tools/mkbandb compiles kline.conf or dline.conf into an image,
+ * kline.conf.db or dline.conf.db, of the K and D lines already split
+ * up, collapsed and with their ip/mask worked out, and without the
+ * duplicates the server would otherwise look for one by one on its
+ * list of unsortable K lines. The server maps it read only and the
+ * conf lines point at its strings, nothing is parsed or copied. The
+ * image records how much of the text file it was made from, and a
+ * hash of that; lines added to the text since (by /KLINE or /DLINE)
+ * are read from the text as usual, and if the text is otherwise
+ * changed the image isn't used at all.
+ *
+ * The image is in the byte order and int size of the machine that
+ * made it, it is meant to be made where it is used.
+ */
+#define BAN_DB_MAGIC    0x42616e44      /* "BanD" */
+#define BAN_DB_VERSION  1
+#define BAN_DB_SUFFIX   ".db"
+
+/* FNV-1a, for the hash of the text file */
+#define BAN_DB_HASH_INIT        2166136261U
+#define BAN_DB_HASH(h, c)       ((((h) ^ (unsigned char) (c)) * 16777619U) \
+                                 & 0xffffffffU)
+
+struct BanDbHeader {
+  unsigned int  magic;
+  unsigned int  version;
+  unsigned int  text_size;      /* bytes of the text compiled */
+  unsigned int  text_hash;      /* BAN_DB_HASH of those bytes */
+  unsigned int  count;          /* records, after the header */
+  unsigned int  strings;        /* offset of the strings */
+  unsigned int  size;           /* of the whole image */
+};
+
+/* what a record is */
+#define BAN_DB_KLINE    0       /* K line by host, for the mtrie */
+#define BAN_DB_IP_KLINE 1       /* K line by ip/mask */
+#define BAN_DB_DLINE    2       /* D line */
+#define BAN_DB_ELINE    3       /* d line, exempt from D lines */
+
+struct BanDbRecord {
+  unsigned int  kind;           /* BAN_DB_ */
+  unsigned int  ip;             /* host order, already masked */
+  unsigned int  ip_mask;
+  int           port;
+  unsigned int  has_class;      /* there was a class field */
+  unsigned int  host;           /* offsets in the strings, 0 for none */
+  unsigned int  passwd;
+  unsigned int  user;
+};
+
+#ifndef BAN_DB_TOOL
+/* a mapped image */
+struct BanDb {
+  struct BanDb*             next;
+  char*                     base;
+  unsigned int              size;
+  const struct BanDbHeader* head;
+  const struct BanDbRecord* rec;
+  const char*               strings;
+};
+
+extern struct BanDb* ban_db_map(const char* textname, const char** why);
+extern void          ban_db_unmap(struct BanDb* db);
+
+/* string off of a record in db, NULL for none */
+#define ban_db_string(db, off)  ((off) ? (db)->strings + (off) : (const char*) 0)
+#endif
+
+#endif /* INCLUDED_ban_db_h */
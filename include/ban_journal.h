@@ -0,0 +1,50 @@
+/************************************************************************
+ *   IRC - Internet Relay Chat, include/ban_journal.h
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 1, or (at your option)
+ *   any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ * "ban_journal.h". - /KLINE and /DLINE written behind
+ *
+ * $Id$
+ */
+#ifndef INCLUDED_ban_journal_h
+#define INCLUDED_ban_journal_h
+#ifndef INCLUDED_config_h
+#include "config.h"
+#endif
+
+#ifdef BAN_JOURNAL
+/*
+ * The lines of a /KLINE or /DLINE are queued by journal_write() and
+ * appended by a helper thread to kline.conf.journal (or
+ * dline.conf.journal), a batch at a time. Every BAN_JOURNAL_COMPACT
+ * seconds the journal is appended to kline.conf and removed, unless
+ * kline.conf is being edited. Until then the bans in it are read
+ * along with kline.conf on a rehash, which holds the writer off both
+ * files until it has read them.
+ */
+#define BAN_JOURNAL_SUFFIX      ".journal"
+
+extern void        journal_init(const char* kfilename, const char* dfilename);
+extern const char* journal_name(const char* filename);
+extern void        journal_write(const char* filename, const char* text);
+extern void        journal_flush(void);
+extern int         journal_fold(const char* filename);
+extern void        journal_hold(void);
+extern void        journal_release(void);
+extern void        journal_collect(void);
+#endif
+
+#endif /* INCLUDED_ban_journal_h */
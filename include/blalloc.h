@@ -22,14 +22,17 @@
 
 /* 
  * Block contains status information for an allocated block in our
- * heap.
+ * heap. It sits at the start of the block, which is aligned on its
+ * size, so an element's block is found from the element's address.
  */
 struct Block {
-  void*          elems;                 /* Points to allocated memory */
-  void*          endElem;               /* Points to last elem for boundck */
-  int            freeElems;             /* Number of available elems */
-  struct Block*  next;                  /* Next in our chain of blocks */
-  unsigned long* allocMap;              /* Bitmap of allocated blocks */
+  struct Block*     next;               /* Next in our chain of blocks */
+  struct Block*     prev;               /* Previous in the chain */
+  struct BlockHeap* heap;               /* Heap the block belongs to */
+  void*             freeList;           /* Freed elems, linked through them */
+  char*             unused;             /* Elems from here on never used */
+  int               freeElems;          /* Number of available elems */
+  void*             mem;                /* What to hand back to the system */
 };
 
 typedef struct Block Block;
@@ -41,11 +44,12 @@ typedef struct Block Block;
  */
 struct BlockHeap {
    size_t  elemSize;                    /* Size of each element to be stored */
+   size_t  blockSize;                   /* Bytes per block, a power of two */
    int     elemsPerBlock;               /* Number of elements per block */
-   int     numlongs;                    /* Size of Block's allocMap array */
    int     blocksAllocated;             /* Number of blocks allocated */
    int     freeElems;                   /* Number of free elements */
-   Block*  base;                        /* Pointer to first block */
+   Block*  base;                        /* Blocks with free elems first */
+   Block*  last;                        /* Last block, full ones at the end */
 };
 
 typedef struct BlockHeap BlockHeap;
@@ -63,7 +67,7 @@ extern void*      BlockHeapAlloc(BlockHeap *bh);
 extern int        BlockHeapFree(BlockHeap *bh, void *ptr);
 extern int        BlockHeapGarbageCollect(BlockHeap *);
 extern void	  initBlockHeap(void);
-extern void       BlockHeapCountMemory(BlockHeap *bh,int *, int *);
+extern void       BlockHeapCountMemory(BlockHeap *bh,int *, int *, int *);
 
 #define BlockHeapALLOC(bh, type)  ((type*) BlockHeapAlloc(bh))
 
@@ -0,0 +1,41 @@
+/************************************************************************
+ *   IRC - Internet Relay Chat, include/chanban.h
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 1, or (at your option)
+ *   any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ * "chanban.h". - compiled channel ban/exception/invex lists
+ *
+ * $Id$
+ */
+#ifndef INCLUDED_chanban_h
+#define INCLUDED_chanban_h
+
+struct SLink;
+struct BanIndex;
+
+/*
+ * Each of a channel's +b/+e/+I lists keeps a BanIndex next to its
+ * Link chain. The chain stays the authoritative list (it is what gets
+ * sent to clients and servers), the index only makes matching a client
+ * against the list cheap.
+ */
+extern void          ban_index_add(struct BanIndex **, struct SLink *);
+extern void          ban_index_del(struct BanIndex **, struct SLink *);
+extern void          ban_index_free(struct BanIndex **);
+extern struct SLink* ban_index_match(struct BanIndex *, const char *,
+                                     const char *);
+extern unsigned long ban_index_memory(struct BanIndex *);
+
+#endif /* INCLUDED_chanban_h */
@@ -35,6 +35,7 @@
 
 struct SLink;
 struct Client;
+struct BanIndex;
 
 
 /* mode structure for channels */
@@ -60,12 +61,33 @@ struct Channel
   time_t          topic_time;
 #endif
   int             users;
-  struct SLink*   members;
+  /*
+   * members, as a compact array of their links (flags in lp->flags,
+   * client in lp->value.cptr), in no particular order. memberh is an
+   * open addressed hash of client pointer to memberv index, -1 marks
+   * an empty slot. Use find_member_link() to look a member up.
+   */
+  struct SLink**  memberv;
+  int*            memberh;
+  int             memberc;      /* members in memberv */
+  int             memberv_size; /* entries allocated in memberv */
+  int             memberh_size; /* slots in memberh, a power of 2 */
   struct SLink*   invites;
   struct SLink*   banlist;
   struct SLink*   exceptlist;
   struct SLink*   invexlist;
   int             num_bed;  /* number of bans+exceptions+denies */
+  struct BanIndex* banindex;    /* the lists above, compiled */
+  struct BanIndex* exceptindex;
+  struct BanIndex* invexindex;
+  unsigned long   ban_serial;   /* changed on every change to the lists */
+  unsigned long   serial;       /* order put on the channel list */
+  time_t          burst_topic;  /* last TOPIC kept off a burst */
+  struct Channel** listnext;    /* links in the LIST index, see m_list.c */
+  int             listlevel;    /* entries in listnext */
+  unsigned long   split_serial; /* last netsplit to touch it, and */
+  int             split_local;  /* its staying local members there, */
+  int             split_nlocal; /* see remove_split_users() */
 #ifdef JUPE_CHANNEL
   int		  juped;
 #endif  
@@ -98,7 +120,9 @@ extern  struct  Channel *channel;
 
 extern struct Channel* find_channel (char *, struct Channel *);
 extern struct SLink*   find_channel_link(struct SLink *, struct Channel *);
+extern struct SLink*   find_member_link(struct Channel *, struct Client *);
 extern void    remove_user_from_channel(struct Client *,struct Channel *,int);
+extern void    remove_split_users(struct Client **, int, const char *);
 extern void    del_invite (struct Client *, struct Channel *);
 extern void    send_user_joins (struct Client *, struct Client *);
 extern int     can_send (struct Client *, struct Channel *);
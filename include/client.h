@@ -47,6 +47,9 @@
 #ifndef INCLUDED_dbuf_h
 #include "dbuf.h"
 #endif
+#ifndef INCLUDED_s_timer_h
+#include "s_timer.h"
+#endif
 
 #define HOSTIPLEN       16      /* Length of dotted quad form of IP        */
                                 /* - Dianora                               */
@@ -63,11 +66,28 @@ struct fludbot;
 struct Zdata;
 struct DNSReply;
 struct Listener;
+struct ListTask;
 struct Client;
+struct Channel;
 
 /*
  * Client structures
  */
+
+/*
+ * a local client's last is_banned()/is_invex() answers for a channel,
+ * good for as long as the channel's ban_serial stays the same
+ */
+#define BAN_CACHE_SIZE 4
+
+struct BanVerdict
+{
+  struct Channel* chptr;
+  unsigned long   serial;       /* chptr->ban_serial when cached */
+  int             banned;       /* is_banned() answer, -1 if unknown */
+  int             invex;        /* is_invex() answer, -1 if unknown */
+};
+
 struct User
 {
   struct User*   next;          /* chain of anUser structures */
@@ -91,6 +111,8 @@ struct User
   */
 };
 
+struct Channel;
+
 struct Server
 {
   struct User*     user;        /* who activated this connection */
@@ -102,6 +124,8 @@ struct Server
   struct Client*   users;       /* Users on this server */
   int		   tsversion;   /* ts version sent in SVINFO */
   unsigned int     usercnt;     /* total number of users on this server */
+  struct Client*   burst_client; /* next client the connect burst sends */
+  struct Channel*  burst_chan;  /* then the next channel, see burst_run() */
 };
 
 struct Client
@@ -144,10 +168,11 @@ struct Client
   int               fd;         /* >= 0, for local clients */
   int               hopcount;   /* number of servers to this 0 = local */
   unsigned short    status;     /* Client type */
-  char              nicksent;
+  unsigned long     serial;     /* order put on the client list */
   unsigned char     local_flag; /* if this is 1 this client is local */
-  short    listprogress;        /* where were we when the /list blocked? */
-  int      listprogress2;       /* where in the current bucket were we? */
+  struct ListTask*  listtask;   /* a LIST in progress, see list_run() */
+  struct Client*    udomnext;   /* next user in the user domain bucket */
+  struct Client**   udomprev;   /* what points at us, NULL if not indexed */
 
   /*
    * client->name is the unique name for a client nick or host
@@ -203,6 +228,12 @@ struct Client
   int               received_number_of_privmsgs;
   int               drone_noticed;
 #endif
+  struct BanVerdict ban_cache[BAN_CACHE_SIZE];
+  struct Timer      timer;      /* ping, registration and idle timeouts */
+  struct Client*    ipnext;     /* next local client in the /24 bucket */
+  struct Client**   ipprev;     /* what points at us, NULL if not indexed */
+  struct Client*    domnext;    /* next local client in the domain bucket */
+  struct Client**   domprev;    /* what points at us, NULL if not indexed */
   char  buffer[CLIENT_BUFSIZE]; /* Incoming message buffer */
 #ifdef ZIP_LINKS
   struct Zdata*     zip;        /* zip data */
@@ -321,6 +352,7 @@ struct Client
 #define FLAGS_NORMALEX     0x0400 /* Client exited normally */
 #define FLAGS_SENDQEX      0x0800 /* Sendq exceeded */
 #define FLAGS_IPHASH       0x1000 /* iphashed this client */
+#define FLAGS_SPLIT        0x2000 /* leaving in a netsplit */
 
 /* umodes, settable flags */
 #define FLAGS_SERVNOTICE   0x000001 /* server notices such as kill */
@@ -389,7 +421,6 @@ struct Client
 #define FLAGS2_ZIPFIRST      0x8000  /* start of zip (ignore any CR/LF) */
 #define FLAGS2_CBURST       0x10000  /* connection burst being sent */
 
-#define FLAGS2_DOINGLIST    0x20000  /* client is doing a list */
 #ifdef IDLE_CHECK
 #define FLAGS2_IDLE_LINED   0x40000
 #endif
@@ -397,7 +428,6 @@ struct Client
 #define FLAGS2_IP_SPOOFING      0x100000        /* client IP is spoofed */
 #define FLAGS2_IP_HIDDEN        0x200000        /* client IP should be hidden
                                                    from non opers */
-#define FLAGS2_SENDQ_POP  0x400000  /* sendq exceeded (during list) */
 
 
 #define SEND_UMODES  (FLAGS_INVISIBLE | FLAGS_OPER | FLAGS_WALLOP)
@@ -492,12 +522,6 @@ struct Client
  */
 #define IsRestricted(x)         ((x)->flags2 & FLAGS2_RESTRICTED)
 #define SetRestricted(x)        ((x)->flags2 |= FLAGS2_RESTRICTED)
-#define ClearDoingList(x)       ((x)->flags2 &= ~FLAGS2_DOINGLIST)
-#define SetDoingList(x)         ((x)->flags2 |= FLAGS2_DOINGLIST)
-#define IsDoingList(x)          ((x)->flags2 & FLAGS2_DOINGLIST)
-#define ClearSendqPop(x)        ((x)->flags2 &= ~FLAGS2_SENDQ_POP)
-#define SetSendqPop(x)          ((x)->flags2 |= FLAGS2_SENDQ_POP)
-#define IsSendqPopped(x)        ((x)->flags2 & FLAGS2_SENDQ_POP)
 #define IsElined(x)             ((x)->flags2 & FLAGS2_E_LINED)
 #define SetElined(x)            ((x)->flags2 |= FLAGS2_E_LINED)
 #define IsBlined(x)             ((x)->flags2 & FLAGS2_B_LINED)
@@ -567,7 +591,10 @@ struct Client
 #define SHOW_IP 1
 #define MASK_IP 2
 
-extern time_t         check_pings(time_t current);
+extern void           check_klines(void);
+extern void           check_new_ban(const char *, unsigned long,
+                                    unsigned long, int);
+extern void           set_client_timer(struct Client *);
 extern const char*    get_client_name(struct Client* client, int show_ip);
 extern const char*    get_client_host(struct Client* client);
 extern void           release_client_dns_reply(struct Client* client);
@@ -576,6 +603,7 @@ extern void           clean_client_heap(void);
 extern struct Client* make_client(struct Client* from);
 extern void           _free_client(struct Client* client);
 extern void           add_client_to_list(struct Client* client);
+extern void           relink_client(struct Client *);
 extern void           remove_client_from_list(struct Client *);
 extern void           add_client_to_llist(struct Client** list, 
                                           struct Client* client);
@@ -584,8 +612,8 @@ extern void           del_client_from_llist(struct Client** list,
 extern int            exit_client(struct Client*, struct Client*, 
                                   struct Client*, const char* comment);
 
-extern void     count_local_client_memory(int *, int *);
-extern void     count_remote_client_memory(int *, int *);
+extern void     count_local_client_memory(int *, int *, int *);
+extern void     count_remote_client_memory(int *, int *, int *);
 extern  int     check_registered (struct Client *);
 extern  int     check_registered_user (struct Client *);
 
@@ -604,4 +632,16 @@ extern struct Client* next_client_double(struct Client* next,
  */
 #define UNKNOWN_TIME 20
 
+/*
+ * Most local clients a rehash's K/D-line sweep looks at per pass of
+ * the main loop, so a big server keeps doing I/O while it runs.
+ */
+#define KLINE_SWEEP_SLICE 256
+
+/*
+ * Most new K/D/G-lines queued for check_klines() to try one by one,
+ * past that it sweeps everybody instead.
+ */
+#define NEW_BAN_MAX 64
+
 #endif /* INCLUDED_client_h */
@@ -446,6 +446,61 @@
  */
 #define ZIP_LEVEL 2
 
+/* ZIP_THREADS - compress and uncompress zipped links on worker threads
+ * Deflating a connect burst to several servers at once can keep the
+ * main loop from everything else. With this many worker threads the
+ * main loop only hands the data over and picks up the result; each
+ * link is worked on by one thread at a time, so its data stays in
+ * order. Define it to the number of threads, 2 is a good start;
+ * undefined, zipping stays in the main loop. Needs pthreads.
+ */
+#undef  ZIP_THREADS
+
+/* ZIP_ADAPTIVE - let the compression level of zipped links follow the load
+ * Every few seconds each zipped link gets its level picked again: 1
+ * while the ircd is short of CPU or the link is bursting, 9 while there
+ * is CPU to spare and the link's sendQ is backing up, and ZIP_LEVEL
+ * the rest of the time.
+ */
+#undef  ZIP_ADAPTIVE
+
+/* REHASH_THREAD - load the K-line and D-line files on a helper thread
+ * With a hundred thousand K-lines, rebuilding the ban indexes holds
+ * up everything else for seconds on each /REHASH. With this defined,
+ * the I, K and D-line indexes are built anew on a helper thread while
+ * the old ones stay in use, and swapped in from the main loop once
+ * complete; only the bans that are new since the last load are then
+ * checked against the clients. Needs pthreads.
+ */
+#undef  REHASH_THREAD
+
+/* BAN_DB - load K-lines and D-lines from a compiled image when there is one
+ * tools/mkbandb compiles kline.conf into kline.conf.db (and dline.conf
+ * likewise), with each line already split and its ip/mask worked out.
+ * The image is mapped in read only and its lines used as they are, so
+ * only lines added to the text file since it was compiled get parsed.
+ * If the text file was otherwise changed (by UNKLINE, or an edit) the
+ * image is out of date and the whole text file is read, as without it.
+ * Needs mmap().
+ */
+#undef  BAN_DB
+
+/* BAN_JOURNAL - write /KLINE and /DLINE bans to a journal off the main loop
+ * Each ban is queued in memory and a helper thread appends it to
+ * kline.conf.journal (dline.conf.journal), taking in one write all the
+ * bans that came in within BAN_JOURNAL_DELAY milliseconds of the first.
+ * Every BAN_JOURNAL_COMPACT seconds the journal is folded into
+ * kline.conf, unless that is being edited; the journal is read along
+ * with kline.conf, so bans set meanwhile aren't lost on a rehash. With
+ * BAN_JOURNAL_SYNC 1 each batch is fsync()ed before the next, with 0 it
+ * is left to the OS. Bans set in the last BAN_JOURNAL_DELAY before a
+ * SIGTERM or crash can be lost. Needs pthreads.
+ */
+#undef  BAN_JOURNAL
+#define BAN_JOURNAL_DELAY       100
+#define BAN_JOURNAL_SYNC        1
+#define BAN_JOURNAL_COMPACT     300
+
 /*
  * ADMIN_UMODES OPER_UMODES LOCOP_UMODES - set these to be the initial umode
  * when OPER'in These can be over-ridden in ircd.conf file, with flags in
@@ -527,6 +582,15 @@
 
 #endif /* USE_SYSLOG */
 
+/* LOG_THREAD - write ilog() messages to the log file on a helper thread
+ * The main loop then only copies each message into a ring buffer, and
+ * the helper thread writes them out a batch at a time (and passes them
+ * to syslog()), so a slow disk doesn't hold up the server. If the ring
+ * fills up, messages are counted as lost instead of waited for, and
+ * the count goes in the log. Needs pthreads and gcc (or clang).
+ */
+#undef  LOG_THREAD
+
 /* CRYPT_OPER_PASSWORD - use crypted oper passwords in the ircd.conf
  * define this if you want to use crypted passwords for operators in your
  * ircd.conf file.
@@ -570,6 +634,14 @@
  */
 #define NOISY_HTM YES
 
+/* LATENCY_STATS - time the main loop and every command
+ * Keeps histograms of how long each pass of the main loop, its parts,
+ * and the handler of each command take, from a monotonic clock. Opers
+ * see the percentiles with STATS W, and kill -USR2 writes them to the
+ * log. Costs two clock reads per command parsed.
+ */
+#undef  LATENCY_STATS
+
 /* JUPE_CHANNEL - jupes a channel from being joined on this server only
  * if added to Q lines e.g. Q:\#packet_channel:Tired of packets.
  * This also enables local channel mode +j.
@@ -869,6 +941,14 @@
  */
 #define MAXBUFFERS
 
+/* USE_EPOLL - use the Linux epoll interface for socket readiness
+ * Sockets are registered once when they are opened instead of having
+ * the whole descriptor set rebuilt and rescanned on every read_message()
+ * call. Only descriptors the kernel reports as ready are visited.
+ * Needs Linux 2.6 or later, it is ignored on other systems.
+ */
+#undef  USE_EPOLL
+
 /* PORTNUM - default port that ircd uses to connect to remote servers, if
  * a port is not specified in the M: line.
  */
@@ -937,6 +1017,23 @@
  */
 #define AUTH_CONNECTTIMEOUT 30 /* Recommended value: 30 */
 
+/* AUTH_CACHE - remember recent reverse DNS and ident results by IP
+ * When a netsplit heals or a bouncer farm restarts, the same IPs
+ * reconnect by the thousand within seconds, and each would otherwise
+ * redo its PTR lookup and ident connect. With this defined, hostnames
+ * whose forward lookup matched are kept for their DNS TTL, but no
+ * longer than DNS_CACHE_MAXTTL seconds. Lookups that found no usable
+ * name are kept for DNS_CACHE_NEGTTL. An IP with no identd is not
+ * asked again for IDENT_CACHE_TTL. Up to AUTH_CACHE_SIZE IPs are
+ * remembered, and the least recently used one makes room for a new
+ * one. /REHASH DNS empties the cache. Hit counts are in STATS T.
+ */
+#undef  AUTH_CACHE
+#define AUTH_CACHE_SIZE   8192  /* Recommended value: 8192 */
+#define DNS_CACHE_MAXTTL  3600  /* Recommended value: 3600 */
+#define DNS_CACHE_NEGTTL  300   /* Recommended value: 300 */
+#define IDENT_CACHE_TTL   120   /* Recommended value: 120 */
+
 /* KILLCHASETIMELIMIT -
  * Max time from the nickname change that still causes KILL
  * automatically to switch for the current nick of that user. (seconds)
@@ -1093,10 +1190,38 @@
 #error CLIENT_FLOOD undefined.
 #endif
 
+#if defined(USE_EPOLL) && !defined(__linux__)
+#undef USE_EPOLL
+#endif
+
 #if !defined(HAVE_LIBZ) && defined(ZIP_LINKS)
 #error ZIP_LINKS defined put ZLIB not found.  Undef ZIP_LINKS or install ZLIB
 #endif
 
+#if defined(ZIP_THREADS) && (!defined(ZIP_LINKS) || !defined(HAVE_LIBPTHREAD))
+#undef ZIP_THREADS
+#endif
+
+#if defined(ZIP_ADAPTIVE) && !defined(ZIP_LINKS)
+#undef ZIP_ADAPTIVE
+#endif
+
+#if defined(REHASH_THREAD) && !defined(HAVE_LIBPTHREAD)
+#undef REHASH_THREAD
+#endif
+
+#if defined(BAN_DB) && !defined(HAVE_MMAP)
+#undef BAN_DB
+#endif
+
+#if defined(BAN_JOURNAL) && !defined(HAVE_LIBPTHREAD)
+#undef BAN_JOURNAL
+#endif
+
+#if defined(LOG_THREAD) && (!defined(HAVE_LIBPTHREAD) || !defined(__GNUC__))
+#undef LOG_THREAD
+#endif
+
 #if (NICKNAMEHISTORYLENGTH == 0)
 #error NICKNAMEHISTORYLENGTH cannot be set to 0
 #endif
@@ -26,6 +26,10 @@
 #include <sys/types.h>
 #define INCLUDED_sys_types_h
 #endif
+#ifndef INCLUDED_sys_uio_h
+#include <sys/uio.h>         /* struct iovec */
+#define INCLUDED_sys_uio_h
+#endif
 
 /*
 ** dbuf is a collection of functions which can be used to
@@ -35,6 +39,7 @@
 ** this package maintaining the buffer on disk, either]
 */
 struct DBufBuffer;
+struct DBufBlock;
 
 /*
 ** These structure definitions are only here to be used
@@ -63,6 +68,28 @@ extern int DBufUsedCount;
 */
 extern int dbuf_put(struct DBuf* dyn, const char* buf, size_t len);
 
+/*
+** dbuf_block_make, dbuf_put_block, dbuf_block_release
+**      Queue the same message on many buffers without copying it.
+**      dbuf_block_make copies the message once into an immutable,
+**      reference counted block, dbuf_put_block appends a reference
+**      to it, and the block is freed when the creator has called
+**      dbuf_block_release and every buffer has deleted its part.
+**      dbuf_map and dbuf_delete don't care which kind of data
+**      they are looking at.
+**
+**      Example use:
+**
+**              block = dbuf_block_make(line, len);
+**              for (each recipient)
+**                dbuf_put_block(&recipient->sendQ, block);
+**              dbuf_block_release(block);
+*/
+extern struct DBufBlock* dbuf_block_make(const char* buf, size_t len);
+extern int               dbuf_put_block(struct DBuf* dyn,
+                                        struct DBufBlock* block);
+extern void              dbuf_block_release(struct DBufBlock* block);
+
 /*
 ** dbuf_get
 **      Remove number of bytes from the buffer, releasing dynamic
@@ -111,6 +138,17 @@ extern size_t dbuf_get(struct DBuf* dbuf, char* buf, size_t len);
 extern const char* dbuf_map(const struct DBuf* dyn, size_t* len);
 extern void        dbuf_delete(struct DBuf* dyn, size_t len);
 
+/*
+** dbuf_map_iov
+**      Like dbuf_map, but maps up to 'max' sections from the front
+**      of the buffer into 'iov' for a single writev(). Returns the
+**      number of sections filled in and the total number of bytes
+**      they hold in 'len'. What actually got written is removed
+**      with dbuf_delete as usual.
+*/
+extern int         dbuf_map_iov(const struct DBuf* dyn, struct iovec* iov,
+                                int max, size_t* len);
+
 /*
 ** DBufLength
 **      Return the current number of bytes stored into the buffer.
@@ -129,5 +167,7 @@ extern void        dbuf_delete(struct DBuf* dyn, size_t len);
 extern int  dbuf_getmsg(struct DBuf* dyn, char* buf, size_t len);
 extern void dbuf_init(void);
 extern void count_dbuf_memory(size_t* allocated, size_t* used);
+extern void count_dbuf_shared(int* blocks, size_t* block_memory,
+                              int* refs, size_t* ref_memory);
 
 #endif /* INCLUDED_dbuf_h */
@@ -8,6 +8,7 @@
 
 struct Client;
 struct ConfItem;
+struct DlineConf;
 
 extern void clear_Dline_table(void);
 extern void zap_Dlines(void);
@@ -18,6 +19,13 @@ extern void add_ip_Eline(struct ConfItem *);
 
 extern void add_dline(struct ConfItem *);
 
+extern struct DlineConf *new_dline_conf(void);
+extern struct DlineConf *use_dline_conf(struct DlineConf *);
+extern void free_dline_conf(struct DlineConf *);
+extern void add_Dline_to(struct DlineConf *, struct ConfItem *);
+extern void add_dline_to(struct DlineConf *, struct ConfItem *);
+extern void add_ip_Kline_to(struct DlineConf *, struct ConfItem *);
+
 extern struct ConfItem *match_Dline(unsigned long);
 extern struct ConfItem *match_ip_Kline(unsigned long, const char *);
 
@@ -9,6 +9,9 @@
 #include <sys/types.h>         /* time_t */
 #define INCLUDED_sys_types_h
 #endif
+#ifndef INCLUDED_config_h
+#include "config.h"            /* USE_EPOLL */
+#endif
 
 extern unsigned char GlobalFDList[];
 
@@ -26,5 +29,25 @@ void fdlist_delete(int fd, unsigned char mask);
 void fdlist_init(void);
 void fdlist_check(time_t now);
 
+#define FDLISTCHKFREQ  2       /* seconds between fdlist_check() runs */
+
+#ifdef USE_EPOLL
+/*
+ * readiness state kept for the epoll engine, a descriptor with any of
+ * these set sits on the ready list of its priority class
+ */
+#define FDR_READ     0x01      /* data waiting on the socket */
+#define FDR_WRITE    0x02      /* socket has become writable */
+#define FDR_PARSE    0x04      /* complete lines waiting in the recvQ */
+#define FDR_HUP      0x08      /* peer shut down, read on until EOF */
+
+extern unsigned char GlobalFDReady[];
+
+void fdlist_set_ready(int fd, unsigned char flags);
+void fdlist_clear_ready(int fd, unsigned char flags);
+int  fdlist_has_ready(unsigned char mask);
+int  fdlist_get_ready(int* fds, int max, unsigned char mask);
+#endif
+
 #endif /* INCLUDED_fdlist_h */
 
@@ -69,5 +69,9 @@ extern int     fbputs(const char* str, FBFILE* fb);
  * return the status of the file associated with fb, see fstat(3)
  */
 extern int     fbstat(struct stat* sb, FBFILE* fb);
+/*
+ * move a file opened for reading to offset, see lseek(3)
+ */
+extern int     fbseek(FBFILE* fb, long offset);
 
 #endif /* INCLUDED_fileio_h */
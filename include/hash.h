@@ -26,18 +26,40 @@
 #endif
 
 /* 
- * Client hash table size
+ * Client hash table size to begin with; it doubles as it fills, and
+ * halves back down to this as it empties
  *
- * used in hash.c, s_debug.c
+ * used in hash.c
  */
-#define U_MAX 65536
+#define U_MAX 1024
 
 /* 
- * Channel hash table size
+ * Channel hash table size to begin with, likewise
  *
- * used in hash.c, s_debug.c
+ * used in hash.c
  */
-#define CH_MAX 16384
+#define CH_MAX 512
+
+/*
+ * buckets moved into the new table by each add or delete while a
+ * table is being resized; at least 8, so each move is done before
+ * the next one can be due
+ */
+#define HASH_REHASH_STEP 8
+
+/*
+ * local clients by the /24 their address is in and by the last two
+ * labels of their host, so a new K/D-line need only be tried on the
+ * clients it could hit
+ */
+#define IP_BLOCK_MAX 4096
+#define DOMAIN_MAX   4096
+
+/*
+ * every user, local or remote, by the last two labels of their host,
+ * so WHO can look at only those a host mask could match
+ */
+#define USER_DOMAIN_MAX 16384
 
 struct Client;
 struct Channel;
@@ -49,7 +71,6 @@ struct HashEntry {
 };
 
 
-extern struct HashEntry hash_get_channel_block(int i);
 extern size_t hash_get_client_table_size(void);
 extern size_t hash_get_channel_table_size(void);
 extern void   init_hash(void);
@@ -68,6 +89,17 @@ extern struct Client* hash_find_client(const char* name,
 extern struct Client* hash_find_server(const char* name);
 extern unsigned int hash_nick_name(const char* name);
 extern unsigned int hash_channel_name(const char* name);
+extern void   add_to_ip_block_table(struct Client* client);
+extern void   del_from_ip_block_table(struct Client* client);
+extern void   add_to_domain_table(struct Client* client);
+extern void   del_from_domain_table(struct Client* client);
+extern struct Client* hash_find_ip_block(unsigned long ip);
+extern struct Client* hash_find_domain(const char* host);
+extern void   add_to_user_domain_table(struct Client* client);
+extern void   del_from_user_domain_table(struct Client* client);
+extern struct Client* hash_find_user_domain(const char* host);
+extern const char* host_domain(const char* host);
+extern const char* mask_domain(const char* mask);
 
 
 #endif  /* INCLUDED_hash_h */
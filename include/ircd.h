@@ -33,6 +33,7 @@
 #endif
 
 struct Client;
+struct Timer;
 
 struct SetOptions
 {
@@ -127,6 +128,7 @@ extern int            cold_start;
 extern int            dline_in_progress;
 extern int            dorehash;
 extern int            doremotd;
+extern int            dolatency;
 extern int            rehashed;
 extern float          currlife;
 extern struct Client  me;
@@ -135,8 +137,7 @@ extern struct Client* local[];
 extern struct Counter Count;
 extern time_t         CurrentTime;
 extern time_t         LCF;
-extern time_t         nextconnect;
-extern time_t         nextping;
+extern struct Timer   connect_timer;
 
 /* char *isupport; removed ! */
 
@@ -22,8 +22,14 @@
  */
 #ifndef INCLUDED_ircd_signal_h
 #define INCLUDED_ircd_signal_h
+#ifndef INCLUDED_config_h
+#include "config.h"
+#endif
 
 extern void setup_signals(void);
+#ifdef HAVE_LIBPTHREAD
+extern int  ircd_thread_start(void* (*fn)(void*), void* arg);
+#endif
 
 #endif /* INCLUDED_ircd_signal_h */
 
@@ -81,18 +81,40 @@ Info MyInformation[] = {
   { "ANTI_SPAM_EXIT_MESSAGE_TIME", "NONE", 0, "Delay before Allowing Spam Bot Exit Messages" },
 #endif /* ANTI_SPAM_EXIT_MESSAGE_TIME */
 
+#ifdef AUTH_CACHE
+  { "AUTH_CACHE", "ON", 0, "Cache reverse DNS and ident results by IP" },
+  { "AUTH_CACHE_SIZE", "", AUTH_CACHE_SIZE, "Number of IPs kept in the auth cache" },
+#else
+  { "AUTH_CACHE", "OFF", 0, "Cache reverse DNS and ident results by IP" },
+#endif /* AUTH_CACHE */
+
 #ifdef B_LINES_OPER_ONLY
   { "B_LINES_OPER_ONLY", "ON", 0, "Allow only Operators to use STATS B" },
 #else
   { "B_LINES_OPER_ONLY", "OFF", 0, "Allow only Operators to use STATS B" },
 #endif /* B_LINES_OPER_ONLY */
 
+#ifdef BAN_DB
+  { "BAN_DB", "ON", 0, "Load K/D lines from a compiled image when there is one" },
+#else
+  { "BAN_DB", "OFF", 0, "Load K/D lines from a compiled image when there is one" },
+#endif /* BAN_DB */
+
 #ifdef BAN_INFO
   { "BAN_INFO", "ON", 0, "Displays who set a ban and when" },
 #else
   { "BAN_INFO", "OFF", 0, "Displays who set a ban and when" },
 #endif /* BAN_INFO */
 
+#ifdef BAN_JOURNAL
+  { "BAN_JOURNAL", "ON", 0, "Write K/D lines to a journal off the main loop" },
+  { "BAN_JOURNAL_COMPACT", "", BAN_JOURNAL_COMPACT, "Seconds between folding the ban journal in" },
+  { "BAN_JOURNAL_DELAY", "", BAN_JOURNAL_DELAY, "Milliseconds of bans the journal writes at once" },
+  { "BAN_JOURNAL_SYNC", "", BAN_JOURNAL_SYNC, "Sync the ban journal after each write" },
+#else
+  { "BAN_JOURNAL", "OFF", 0, "Write K/D lines to a journal off the main loop" },
+#endif /* BAN_JOURNAL */
+
   { "BUFFERPOOL", "", BUFFERPOOL, "Maximum size of all SendQs" },
 
 #ifdef BURST_AWAY
@@ -385,6 +407,12 @@ Info MyInformation[] = {
   { "KPATH", "NONE", 0, "Path to K-line File" },
 #endif /* KPATH */
 
+#ifdef LATENCY_STATS
+  { "LATENCY_STATS", "ON", 0, "Time the main loop and commands for STATS W" },
+#else
+  { "LATENCY_STATS", "OFF", 0, "Time the main loop and commands for STATS W" },
+#endif /* LATENCY_STATS */
+
 #ifdef LIMIT_UH
   { "LIMIT_UH", "ON", 0, "Make Y: lines limit username instead of hostname" },
 #else
@@ -397,6 +425,12 @@ Info MyInformation[] = {
   { "LITTLE_I_LINES", "OFF", 0, "\"i\" lines prevent matching clients from channel opping" },
 #endif /* LITTLE_I_LINES */
 
+#ifdef LOG_THREAD
+  { "LOG_THREAD", "ON", 0, "Write the log file on a helper thread" },
+#else
+  { "LOG_THREAD", "OFF", 0, "Write the log file on a helper thread" },
+#endif /* LOG_THREAD */
+
 #ifdef LPATH
   { "LPATH", LPATH, 0, "Path to Log File" },
 #else
@@ -575,6 +609,12 @@ Info MyInformation[] = {
   { "PROPAGATE_AWAY", "OFF", 0, "Propagate AWAY messages to other servers" },
 #endif
 
+#ifdef REHASH_THREAD
+  { "REHASH_THREAD", "ON", 0, "Load K-line and D-line files on a helper thread" },
+#else
+  { "REHASH_THREAD", "OFF", 0, "Load K-line and D-line files on a helper thread" },
+#endif /* REHASH_THREAD */
+
 #ifdef REJECT_HOLD
   { "REJECT_HELD_MAX", "", REJECT_HELD_MAX, "Maximum number of FD's used by REJECT_HOLD" },
 #endif
@@ -736,6 +776,12 @@ Info MyInformation[] = {
   { "U_LINES_OPER_ONLY", "OFF", 0, "Only allow Operators to use STATS U" },
 #endif /* U_LINES_OPER_ONLY */
 
+#ifdef USE_EPOLL
+  { "USE_EPOLL", "ON", 0, "Use epoll() for socket readiness" },
+#else
+  { "USE_EPOLL", "OFF", 0, "Use epoll() for socket readiness" },
+#endif /* USE_EPOLL */
+
 #ifdef USE_KNOCK
   { "USE_KNOCK", "ON", 0, "Enable the KNOCK command" },
 #else
@@ -780,6 +826,12 @@ Info MyInformation[] = {
   { "WINTRHAWK", "OFF", 0, "Enable Wintrhawk Styling" },
 #endif /* WINTRHAWK */
 
+#ifdef ZIP_ADAPTIVE
+  { "ZIP_ADAPTIVE", "ON", 0, "Zipped Link Compression Level follows the Load" },
+#else
+  { "ZIP_ADAPTIVE", "OFF", 0, "Zipped Link Compression Level follows the Load" },
+#endif /* ZIP_ADAPTIVE */
+
 #ifdef ZIP_LEVEL
   { "ZIP_LEVEL", "", ZIP_LEVEL, "Compression Value for Zipped Links" },
 #else
@@ -792,6 +844,12 @@ Info MyInformation[] = {
   { "ZIP_LINKS", "OFF", 0, "Compress Server to Server Links" },
 #endif /* ZIP_LINKS */
 
+#ifdef ZIP_THREADS
+  { "ZIP_THREADS", "", ZIP_THREADS, "Worker Threads for Zipped Links" },
+#else
+  { "ZIP_THREADS", "OFF", 0, "Worker Threads for Zipped Links" },
+#endif /* ZIP_THREADS */
+
   /*
    * since we don't want to include the world here, NULL probably
    * isn't defined by the time we read this, just use plain 0 instead
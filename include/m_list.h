@@ -0,0 +1,68 @@
+/************************************************************************
+ *   IRC - Internet Relay Chat, include/m_list.h
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 1, or (at your option)
+ *   any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ * $Id$
+ */
+#ifndef INCLUDED_m_list_h
+#define INCLUDED_m_list_h
+#ifndef INCLUDED_sys_types_h
+#include <sys/types.h>
+#define INCLUDED_sys_types_h
+#endif
+
+struct Client;
+struct Channel;
+
+/*
+ * Levels in the channel index, a skip list ordered by user count,
+ * biggest first, then by name. Good for some millions of channels.
+ */
+#define LIST_LEVELS     16
+
+/*
+ * Most channels a LIST sends per pass of the main loop, see list_run()
+ */
+#define LIST_SLICE      64
+
+/*
+ * Most masks in one LIST
+ */
+#define LIST_MAX_MASKS  8
+
+/*
+ * A LIST in progress. The channels it is to show are picked when it
+ * starts, and their names kept one after the other, each with its
+ * NUL; list_run() then sends them as the client's sendq drains.
+ */
+struct ListTask
+{
+  struct ListTask* next;
+  struct Client*   client;
+  char*            names;
+  size_t           len;         /* bytes used in names */
+  size_t           size;        /* bytes allocated */
+  size_t           pos;         /* the next name to send */
+};
+
+extern void list_add_channel(struct Channel* chptr);
+extern void list_del_channel(struct Channel* chptr);
+extern void list_set_users(struct Channel* chptr, int users);
+extern void list_cancel(struct Client* cptr);
+extern void list_run(void);
+extern int  list_waiting(void);
+
+#endif /* INCLUDED_m_list_h */
@@ -26,6 +26,7 @@
 #endif
 
 struct Client;
+struct LatencyHist;
 
 /* 
  * Message table structure 
@@ -49,18 +50,9 @@ struct  Message
   char    reset_idle;                   /* flag if this command causes
                                            idle time to be reset */
   unsigned long bytes;
+  struct LatencyHist* latency;          /* handler time, see s_latency.c */
 };
 
-struct MessageTree
-{
-  char*               final;
-  struct Message*     msg;
-  struct MessageTree* pointers[26];
-}; 
-
-typedef struct MessageTree MESSAGE_TREE;
-
-
 #define MSG_PRIVATE  "PRIVMSG"  /* PRIV */
 #define MSG_WHO      "WHO"      /* WHO  -> WHOC */
 #define MSG_WHOIS    "WHOIS"    /* WHOI */
@@ -276,11 +268,8 @@ struct Message msgtab[] = {
   { (char *) 0, (int (*)()) 0 , 0, 0,    0, 0, 0, 0L }
 };
 
-struct MessageTree* msg_tree_root;
-
 #else
 extern struct Message       msgtab[];
-extern struct MessageTree*  msg_tree_root;
 #endif
 
 #endif /* INCLUDED_msg_h */
@@ -9,9 +9,17 @@
 
 struct ConfItem;
 struct Client;
+struct DlineConf;
+struct MtrieConf;
 
 extern void   add_mtrie_conf_entry(struct ConfItem *,int);
 extern void   add_ip_Iline( struct ConfItem * );
+extern struct MtrieConf* new_mtrie_conf(struct DlineConf *);
+extern struct MtrieConf* use_mtrie_conf(struct MtrieConf *);
+extern struct ConfItem* free_mtrie_conf(struct MtrieConf *);
+extern void   quiet_mtrie_conf(struct MtrieConf *,int);
+extern void   add_mtrie_conf_entry_to(struct MtrieConf *,struct ConfItem *,int);
+extern void   add_ip_Iline_to(struct MtrieConf *,struct ConfItem *);
 extern struct ConfItem* find_matching_mtrie_conf(const char* host,
                                            const char* user, 
                                            unsigned long ip);
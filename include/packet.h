@@ -33,6 +33,7 @@ struct Client;
 
 extern int dopacket(struct Client* client, char* buf, size_t len);
 extern int client_dopacket(struct Client* client, char* buf, size_t len);
+extern int dopacket_unzipped(struct Client* client, char* buf, size_t len);
 
 #endif /* INCLUDED_packet_h */
 
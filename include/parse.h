@@ -30,6 +30,6 @@ struct Message;
 struct Client;
 
 extern  int            parse (struct Client *, char *, char *);
-extern  void           init_tree_parse (struct Message *);
-extern  struct Message *tree_parse(char *);
+extern  void           init_msg_hash (struct Message *);
+extern  struct Message *find_message(const char *);
 #endif /* INCLUDED_parse_h_h */
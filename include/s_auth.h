@@ -26,6 +26,9 @@
 #ifndef INCLUDED_config_h
 #include "config.h"
 #endif
+#ifndef INCLUDED_s_timer_h
+#include "s_timer.h"
+#endif
 
 struct Client;
 
@@ -36,7 +39,7 @@ struct AuthRequest {
   unsigned int        flags;     /* current state of request */
   int                 fd;        /* file descriptor for auth queries */
   int                 index;     /* select / poll index */
-  time_t              timeout;   /* time when query expires */
+  struct Timer        timer;     /* expires the queries */
 };
 
 /*
@@ -67,10 +70,12 @@ struct AuthRequest {
 extern struct AuthRequest* AuthPollList;  /* GLOBAL - auth queries pending io */
 
 extern void start_auth(struct Client *);
-extern void timeout_auth_queries(time_t now);
 extern void read_auth_reply(struct AuthRequest* req);
 extern void send_auth_query(struct AuthRequest* req);
 extern void free_auth_request(struct AuthRequest* request);
+#ifdef AUTH_CACHE
+extern void flush_auth_cache(void);
+#endif
 
 #endif /* INCLUDED_s_auth_h */
 
@@ -25,12 +25,27 @@
 #include <sys/types.h>
 #define INCLUDED_sys_types_h
 #endif
+#ifndef INCLUDED_config_h
+#include "config.h"
+#endif
 #define READBUF_SIZE    16384   /* used in s_bsd *AND* s_zip.c ! */
 
+/*
+ * descriptor types and interest flags for netio_add()
+ */
+#define NETIO_CLIENT    1
+#define NETIO_LISTENER  2
+#define NETIO_AUTH      3
+#define NETIO_ZIP       4       /* wakeup from the zip workers */
+
+#define NETIO_READ      0x01
+#define NETIO_WRITE     0x02
+
 #include "res.h"
 
 /* dummies */
 struct Client;
+struct iovec;
 struct ConfItem;
 struct hostent;
 struct DNSReply;
@@ -55,6 +70,20 @@ extern int   set_non_blocking(int);
 extern int   set_sock_buffers(int, int);
 extern int   send_queued(struct Client*);
 extern int   deliver_it(struct Client*, const char*, int);
+extern int   deliver_it_iov(struct Client*, const struct iovec*, int);
+
+#ifdef USE_EPOLL
+extern void  netio_add(int fd, int type, void* data, int flags);
+extern void  netio_set_flags(int fd, int flags);
+extern void  netio_del(int fd);
+#else
+/*
+ * select() and poll() rebuild their descriptor sets on every call
+ */
+#define netio_add(fd, type, data, flags)  ((void) 0)
+#define netio_set_flags(fd, flags)        ((void) 0)
+#define netio_del(fd)                     ((void) 0)
+#endif
 
 #endif /* INCLUDED_s_bsd_h */
 
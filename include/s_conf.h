@@ -42,6 +42,7 @@ struct Client;
 struct SLink;
 struct DNSReply;
 struct hostent;
+struct TempLineList;
 
 struct ConfItem
 {
@@ -61,6 +62,9 @@ struct ConfItem
   struct Class*    c_class;     /* Class of connection */
   int              dns_pending; /* 1 if dns query pending, 0 otherwise */
   struct DNSQuery* dns_query;
+#ifdef BAN_DB
+  int              in_image;    /* strings are in a mapped ban image */
+#endif
 };
 
 typedef struct QlineItem {
@@ -195,8 +199,7 @@ extern struct QlineItem *q_conf;
 
 extern struct ConfItem* ConfigItemList;        /* GLOBAL - conf list head */
 extern int              specific_virtual_host; /* GLOBAL - used in s_bsd.c */
-extern struct ConfItem *temporary_klines;
-extern struct ConfItem *temporary_ip_klines;
+extern struct TempLineList temporary_klines;
 extern ConfigFileEntryType ConfigFileEntry;    /* GLOBAL - defined in ircd.c */
 
 extern void clear_ip_hash_table(void);
@@ -281,9 +284,15 @@ extern int safe_write(struct Client *, const char *, int ,char *);
 extern void add_temp_kline(struct ConfItem *);
 extern  void    flush_temp_klines(void);
 extern  void    report_temp_klines(struct Client *);
-extern  void    show_temp_klines(struct Client *, struct ConfItem *);
+extern  void    show_temp_klines(struct Client *, struct TempLineList *);
+extern  void    expire_temp_klines(void);
 extern  int     is_address(char *,unsigned long *,unsigned long *); 
 extern  int     rehash (struct Client *, struct Client *, int);
+extern  void    conf_report(const char *, ...);
+#ifdef REHASH_THREAD
+extern  void    conf_collect(void);
+extern  void    conf_new_ban(struct ConfItem *);
+#endif
 
 
 #endif /* INCLUDED_s_conf_h */
@@ -0,0 +1,71 @@
+/************************************************************************
+ *   IRC - Internet Relay Chat, include/s_latency.h
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 1, or (at your option)
+ *   any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ * "s_latency.h". - main loop and command latency histograms
+ *
+ * $Id$
+ */
+#ifndef INCLUDED_s_latency_h
+#define INCLUDED_s_latency_h
+#ifndef INCLUDED_config_h
+#include "config.h"
+#endif
+
+struct Client;
+struct Message;
+
+/*
+ * A latency histogram in microseconds. Below 8 every value has a
+ * bucket of its own, above that each power of 2 is split in 8, so a
+ * bucket is never more than 1/8th of its values wide, up to 2^32us.
+ */
+#define LAT_SUB_BITS    3
+#define LAT_SUB         (1 << LAT_SUB_BITS)
+#define LAT_BUCKETS     ((32 - LAT_SUB_BITS + 1) * LAT_SUB)
+
+struct LatencyHist {
+  unsigned long count;
+  unsigned long max;
+  double        sum;
+  unsigned int  bucket[LAT_BUCKETS];
+};
+
+/* the parts of the main loop that are timed */
+enum LatencyPhase {
+  LAT_LOOP,                     /* a pass of io_loop() less the waits */
+  LAT_POLL,                     /* waiting in poll/epoll */
+  LAT_EVENTS,                   /* listeners, auth and the ready list */
+  LAT_CLIENTS,                  /* writing to and reading ready clients */
+  LAT_TIMERS,                   /* timers, ban checks, bursts, LIST */
+  LAT_PHASES
+};
+
+#ifdef LATENCY_STATS
+extern struct LatencyHist latency_phase[LAT_PHASES];
+
+extern unsigned long latency_usec(void);
+extern void latency_add(struct LatencyHist *, unsigned long);
+extern void latency_wait(unsigned long);
+extern void latency_pass(unsigned long);
+extern void latency_command(struct Message *, unsigned long);
+extern void report_latency(struct Client *, const char *);
+extern void dump_latency(void);
+
+#define latency_phase_add(p, t) latency_add(&latency_phase[(p)], (t))
+#endif
+
+#endif /* INCLUDED_s_latency_h */
@@ -22,6 +22,9 @@
 #ifndef INCLUDED_s_log_h
 #define INCLUDED_s_log_h
 
+#ifndef INCLUDED_config_h
+#include "config.h"
+#endif
 #include <stdarg.h> 
 
 #define L_CRIT    0
@@ -39,5 +42,8 @@ extern int  get_log_level(void);
 extern void ilog(int priority, const char* fmt, ...);
 extern void vlog(int priority, const char *fmt, va_list);
 extern const char *get_log_level_as_string(int level);
+#ifdef LOG_THREAD
+extern void log_flush(void);
+#endif
 
 #endif /* INCLUDED_s_log_h */
@@ -30,6 +30,7 @@
 #define INCLUDED_sys_types_h
 #endif
 
+struct Channel;
 struct Client;
 struct ConfItem;
 
@@ -50,6 +51,7 @@ struct Capability
 #define CAP_CLUSTER     0x00000100      /* Can do remote Cluster related cmds */
 #define CAP_ENCAP       0x00000200      /* Can do command encapsulation */
 #define CAP_IE          0x00000400      /* Can do channel +I exemptions */
+#define CAP_ZIPDICT     0x00000800      /* Can prime zip streams with zip_dict */
 
 #define DoesCAP(x)      ((x)->caps)
 
@@ -92,8 +94,21 @@ extern int MaxConnectionCount; /* GLOBAL - highest number of connections */
 #define HUNTED_ISME     0       /* if this server should execute the command */
 #define HUNTED_PASS     1       /* if message passed onwards successfully */
 
+/*
+ * Most clients or channels a connect burst sends per pass of the main
+ * loop, see burst_run()
+ */
+#define BURST_SLICE     256
+
 
+extern void        burst_del_channel(struct Channel* chptr);
+extern void        burst_del_client(struct Client* acptr);
+extern int         burst_drops(struct Client* link, const char* msg, int len);
+extern void        burst_run(void);
+extern int         burst_waiting(void);
 extern int         check_server(struct Client* server);
+extern void        count_downlinks(struct Client* server, int* link_s,
+                                   int* link_u);
 extern int         hunt_server(struct Client* cptr, struct Client* sptr,
                                char* command, int server, 
                                int parc, char** parv);
@@ -62,6 +62,12 @@ struct  ServerStatistics {
   unsigned int    is_abad; /* bad auth requests */
   unsigned int    is_udp; /* packets recv'd on udp port */
   unsigned int    is_loc; /* local connections made */
+#ifdef AUTH_CACHE
+  unsigned int    is_dch; /* hostnames found in the auth cache */
+  unsigned int    is_dcn; /* cached failed lookups */
+  unsigned int    is_dcm; /* lookups not in the auth cache */
+  unsigned int    is_ich; /* ident queries skipped, no identd */
+#endif /* AUTH_CACHE */
 #ifdef FLUD
   unsigned int    is_flud;        /* users/channels flood protected */
 #endif /* FLUD */
@@ -0,0 +1,49 @@
+/************************************************************************
+ *   IRC - Internet Relay Chat, include/s_timer.h
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 1, or (at your option)
+ *   any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ * "s_timer.h". - one second resolution timer wheel
+ *
+ * $Id$
+ */
+#ifndef INCLUDED_s_timer_h
+#define INCLUDED_s_timer_h
+#ifndef INCLUDED_sys_types_h
+#include <sys/types.h>         /* time_t */
+#define INCLUDED_sys_types_h
+#endif
+
+/*
+ * A Timer is embedded in whatever it times (a client, an auth
+ * request) or is a static for a periodic job. It costs nothing while
+ * it waits; timer_run() only looks at the timers that are due.
+ */
+struct Timer {
+  struct Timer*  next;
+  struct Timer** prev;         /* what points at us, NULL if not queued */
+  time_t         when;         /* second the handler is due */
+  void         (*handler)(void *);
+  void*          data;
+};
+
+#define TimerPending(t)     (0 != (t)->prev)
+
+extern void timer_init(struct Timer *, void (*)(void *), void *);
+extern void timer_add(struct Timer *, time_t);
+extern void timer_del(struct Timer *);
+extern void timer_run(time_t);
+
+#endif /* INCLUDED_s_timer_h */
@@ -38,6 +38,19 @@ struct Client;
 /* the maximum amount of data to be compressed (can actually be a bit more) */
 #define ZIP_MAXIMUM     8192    /* WARNING: *DON'T* CHANGE THIS!!!! */
 
+#ifdef ZIP_ADAPTIVE
+/* how often, and between what, zip_adapt() moves the levels */
+#define ZIP_ADAPT_FREQ  5       /* seconds */
+#define ZIP_LEVEL_MIN   1
+#define ZIP_LEVEL_MAX   9
+#define ZIP_LOAD_LOW    25      /* percent of a CPU, below is idle */
+#define ZIP_LOAD_HIGH   75      /* and above is busy */
+#endif
+
+#ifdef ZIP_THREADS
+struct ZipJob;
+#endif
+
 struct Zdata {
   z_stream*   in;            /* input zip stream data */
   z_stream*   out;           /* output zip stream data */
@@ -45,6 +58,34 @@ struct Zdata {
   char        outbuf[ZIP_MAXIMUM]; /* outgoing (unzipped) buffer */
   int         incount;        /* size of inbuf content */
   int         outcount;       /* size of outbuf content */
+  unsigned long total_in;     /* bytes deflated and queued so far */
+  unsigned long total_out;    /* what they came to */
+  /* with worker threads, the next four are added to under the zip lock */
+  unsigned long in_zipped;    /* bytes inflated so far */
+  unsigned long in_plain;     /* what they came to */
+  unsigned long out_usec;     /* CPU time spent deflating */
+  unsigned long in_usec;      /* and inflating */
+  int         dict;           /* streams primed with zip_dict */
+  int         level;          /* deflate level the stream is at */
+  int         want;           /* level the next deflate should use */
+#ifdef ZIP_THREADS
+  /*
+   * the rest belongs to the worker threads, under the zip lock
+   */
+  struct Client*  client;     /* link these jobs are for */
+  struct ZipJob*  todo;       /* jobs waiting for a worker, in order */
+  struct ZipJob*  todo_tail;
+  struct ZipJob*  done;       /* results waiting for the main loop */
+  struct ZipJob*  done_tail;
+  struct Zdata*   next_run;   /* on the run queue */
+  struct Zdata*   next_done;  /* on the done queue */
+  int             busy;       /* a worker has the streams */
+  int             queued;     /* on the run queue */
+  int             finished;   /* on the done queue */
+  int             failed;     /* a stream error, the rest is dropped */
+  int             closing;    /* zip in the main loop from here on */
+  size_t          pending;    /* bytes handed over, not collected */
+#endif
 };
 
 #endif /* ZIP_LINKS */
@@ -54,5 +95,18 @@ extern int     zip_init (struct Client *);
 extern void    zip_free (struct Client *);
 extern char*   unzip_packet (struct Client *, char *, int *);
 extern char*   zip_buffer (struct Client *, char *, int *, int);
+extern void    zip_report (struct Client *, const char *, struct Client *);
+
+#ifdef ZIP_ADAPTIVE
+extern void    zip_adapt (void);
+#endif
+
+#ifdef ZIP_THREADS
+extern void    zip_threads_init (void);
+extern void    zip_queue_in (struct Client *, const char *, int);
+extern void    zip_collect (void);
+extern void    zip_drain (struct Client *);
+extern size_t  zip_pending (struct Client *);
+#endif
 
 #endif /* INCLUDED_s_zip_h */
@@ -41,6 +41,8 @@ extern  void sendto_channel_type(struct Client *,
                                  const char *message);
 extern  void sendto_serv_butone(struct Client *, const char *, ...);
 extern  void sendto_common_channels(struct Client *, const char *, ...);
+extern  void sendto_split_channels(struct Client *, struct Client **,
+                                   const char *, ...);
 extern  void sendto_channel_butserv(struct Channel *, struct Client *, 
                                     const char *, ...);
 
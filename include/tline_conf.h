@@ -0,0 +1,38 @@
+/* tline_conf.h  -- temporary K-lines and G-lines
+ *
+ * $Id$
+ */
+
+#ifndef INCLUDED_tline_conf_h
+#define INCLUDED_tline_conf_h
+
+struct ConfItem;
+struct TempLine;
+struct TempLineNode;
+
+#define TLINE_HASH_SIZE 1024
+
+/*
+ * A list of lines that expire at conf->hold. The lines are indexed
+ * by host and by ip for lookups, and kept on a heap by hold so the
+ * main loop can expire them without looking at the rest.
+ */
+struct TempLineList {
+  struct TempLine**    heap;      /* soonest hold first */
+  int                  count;     /* lines on the heap */
+  int                  size;      /* heap slots allocated */
+  struct TempLineNode* hosts;     /* host masks by literal suffix */
+  struct TempLine*     ips[TLINE_HASH_SIZE]; /* ip masks by masked ip */
+  int                  ip_bits[33]; /* ip masks of each prefix length */
+  struct TempLine*     odd_ips;   /* ip masks that aren't a prefix */
+};
+
+extern void tline_add(struct TempLineList *, struct ConfItem *, const char *);
+extern void tline_del(struct TempLineList *, struct ConfItem *);
+extern struct ConfItem *tline_find(struct TempLineList *, const char *,
+                                   const char *, unsigned long);
+extern struct ConfItem *tline_expired(struct TempLineList *);
+extern struct ConfItem *tline_conf(struct TempLineList *, int);
+extern void tline_flush(struct TempLineList *);
+
+#endif /* INCLUDED_tline_conf_h */
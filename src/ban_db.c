@@ -0,0 +1,167 @@
+/************************************************************************
+ *   IRC - Internet Relay Chat, src/ban_db.c
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 1, or (at your option)
+ *   any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ * $Id$
+ */
+#include "ban_db.h"
+#include "config.h"
+#include "irc_string.h"
+#include "ircd_defs.h"
+
+#include <limits.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#ifdef BAN_DB
+/*
+ * text_hash - BAN_DB_HASH of the first size bytes of the file open on
+ * fd, -1 if there aren't that many
+ */
+static int text_hash(int fd, unsigned int size, unsigned int* hash)
+{
+  char*        text;
+  unsigned int h = BAN_DB_HASH_INIT;
+  unsigned int i;
+
+  if (size == 0)
+    {
+      *hash = h;
+      return 0;
+    }
+  text = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+  if (text == MAP_FAILED)
+    return -1;
+  for (i = 0; i < size; i++)
+    h = BAN_DB_HASH(h, text[i]);
+  munmap(text, size);
+  *hash = h;
+  return 0;
+}
+
+/*
+ * ban_db_check - is the image db sound, and made from what's in the
+ * text file open on fd?
+ */
+static const char* ban_db_check(struct BanDb* db, int fd)
+{
+  const struct BanDbHeader* head = db->head;
+  struct stat               sb;
+  unsigned int              hash;
+  unsigned int              i;
+  unsigned int              room;
+
+  if (db->size < sizeof(struct BanDbHeader) ||
+      head->magic != BAN_DB_MAGIC || head->version != BAN_DB_VERSION)
+    return "not a ban image";
+  if (head->size != db->size || head->strings > db->size ||
+      head->strings < sizeof(struct BanDbHeader) ||
+      (head->strings - sizeof(struct BanDbHeader)) /
+      sizeof(struct BanDbRecord) < head->count ||
+      db->base[db->size - 1] != '\0')
+    return "damaged";
+
+  db->strings = db->base + head->strings;
+  room = db->size - head->strings;
+  for (i = 0; i < head->count; i++)
+    if (db->rec[i].host >= room || db->rec[i].passwd >= room ||
+        db->rec[i].user >= room || db->rec[i].kind > BAN_DB_ELINE)
+      return "damaged";
+
+  if (fstat(fd, &sb) || sb.st_size < head->text_size ||
+      text_hash(fd, head->text_size, &hash) || hash != head->text_hash)
+    return "out of date";
+  return NULL;
+}
+
+/*
+ * ban_db_map
+ *
+ * inputs       - name of kline.conf or dline.conf
+ *              - where to say why there is no image
+ * output       - its image, mapped, or NULL with *why set (NULL if
+ *                there just isn't one)
+ * side effects - none, it can be called from the rehash thread
+ */
+struct BanDb* ban_db_map(const char* textname, const char** why)
+{
+  char          name[PATH_MAX + 1];
+  struct BanDb* db;
+  struct stat   sb;
+  int           fd;
+  int           tfd;
+  char*         base;
+
+  *why = NULL;
+  if (strlen(textname) + sizeof(BAN_DB_SUFFIX) > sizeof(name))
+    return NULL;
+  strcpy(name, textname);
+  strcat(name, BAN_DB_SUFFIX);
+
+  if ((fd = open(name, O_RDONLY)) < 0)
+    return NULL;
+  if (fstat(fd, &sb) || sb.st_size == 0)
+    {
+      close(fd);
+      *why = "empty";
+      return NULL;
+    }
+  base = mmap(NULL, sb.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (base == MAP_FAILED)
+    {
+      *why = "can't be mapped";
+      return NULL;
+    }
+
+  db = (struct BanDb*) MyMalloc(sizeof(struct BanDb));
+  db->next = NULL;
+  db->base = base;
+  db->size = sb.st_size;
+  db->head = (const struct BanDbHeader*) base;
+  db->rec = (const struct BanDbRecord*) (base + sizeof(struct BanDbHeader));
+  db->strings = NULL;
+
+  if ((tfd = open(textname, O_RDONLY)) < 0)
+    *why = "has no text file";
+  else
+    {
+      *why = ban_db_check(db, tfd);
+      close(tfd);
+    }
+  if (*why)
+    {
+      ban_db_unmap(db);
+      return NULL;
+    }
+  return db;
+}
+
+/*
+ * ban_db_unmap - done with db, no conf line can point into it now
+ */
+void ban_db_unmap(struct BanDb* db)
+{
+  munmap(db->base, db->size);
+  MyFree(db);
+}
+#endif /* BAN_DB */
@@ -0,0 +1,563 @@
+/************************************************************************
+ *   IRC - Internet Relay Chat, src/ban_journal.c
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 1, or (at your option)
+ *   any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ * $Id$
+ */
+#include "ban_journal.h"
+#include "common.h"
+#include "irc_string.h"
+#include "ircd_defs.h"
+#include "ircd_signal.h"
+#include "s_log.h"
+#include "send.h"
+
+#include <errno.h>
+#include <limits.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/types.h>
+#include <sys/time.h>
+#include <sys/stat.h>
+
+#ifdef BAN_JOURNAL
+#include <pthread.h>
+
+struct JournalFile {
+  const char* name;                     /* kline.conf */
+  char        journal[PATH_MAX + 1];    /* kline.conf.journal */
+  int         pending;                  /* the journal may have lines */
+};
+
+struct JournalLine {
+  struct JournalLine* next;
+  struct JournalFile* file;
+  int                 len;
+  char                text[1];
+};
+
+struct JournalNotice {
+  struct JournalNotice* next;
+  char                  text[1];
+};
+
+static struct JournalFile    journal_files[2];
+static int                   journal_nfiles = 0;
+static int                   journal_running = NO;
+
+/*
+ * journal_queue_lock guards the queue, the notices and the hold,
+ * journal_files_lock the files; whoever holds the latter can take the
+ * former, never the other way around
+ */
+static pthread_mutex_t       journal_queue_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t       journal_files_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t        journal_work = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t        journal_idle = PTHREAD_COND_INITIALIZER;
+
+static struct JournalLine*   journal_queue = NULL;
+static struct JournalLine**  journal_tail = &journal_queue;
+static struct timespec       journal_due;       /* write the queue by */
+static unsigned long         journal_queued = 0;
+static unsigned long         journal_written = 0;
+static int                   journal_flushing = 0;
+static int                   journal_held = 0;  /* the files are read */
+static int                   journal_busy = NO; /* at the files */
+
+static struct JournalNotice* journal_notices = NULL;
+static struct JournalNotice** journal_notices_tail = &journal_notices;
+
+/*
+ * journal_notice - keep a notice for the opers, for journal_collect()
+ * to send from the main loop
+ */
+static void journal_notice(const char* pattern, ...)
+{
+  char                  text[BUFSIZE];
+  struct JournalNotice* notice;
+  va_list               args;
+
+  va_start(args, pattern);
+  vsnprintf(text, sizeof(text), pattern, args);
+  va_end(args);
+
+  notice = (struct JournalNotice*) MyMalloc(sizeof(struct JournalNotice) +
+                                             strlen(text));
+  strcpy(notice->text, text);
+  notice->next = NULL;
+  pthread_mutex_lock(&journal_queue_lock);
+  *journal_notices_tail = notice;
+  journal_notices_tail = &notice->next;
+  pthread_mutex_unlock(&journal_queue_lock);
+}
+
+static struct JournalFile* journal_file(const char* filename)
+{
+  int i;
+
+  for (i = 0; i < journal_nfiles; i++)
+    if (0 == strcmp(journal_files[i].name, filename))
+      return &journal_files[i];
+  return NULL;
+}
+
+/*
+ * write_all - write all of buf to fd, -1 on error
+ */
+static int write_all(int fd, const char* buf, int len)
+{
+  int n;
+
+  while (len > 0)
+    {
+      if ((n = write(fd, buf, len)) < 0)
+        {
+          if (EINTR == errno)
+            continue;
+          return -1;
+        }
+      buf += n;
+      len -= n;
+    }
+  return 0;
+}
+
+/*
+ * journal_locked - is filename being edited? viconf leaves its pid in
+ * filename.lock, as LockedFile() in m_kline.c knows
+ */
+static int journal_locked(const char* filename)
+{
+  char  path[PATH_MAX + 1];
+  char  buf[32];
+  pid_t pid;
+  int   fd;
+  int   n;
+
+  snprintf(path, sizeof(path), "%s.lock", filename);
+  if ((fd = open(path, O_RDONLY)) < 0)
+    return NO;
+  n = read(fd, buf, sizeof(buf) - 1);
+  close(fd);
+  if (n <= 0)
+    return NO;
+  buf[n] = '\0';
+  if ((pid = atoi(buf)) <= 0)
+    return NO;
+  /* a stale lock, from a crashed editor, doesn't count */
+  return kill(pid, 0) == 0 || EPERM == errno;
+}
+
+/*
+ * journal_append - append the lines for jf in batch to its journal,
+ * with one write; the files are locked
+ */
+static void journal_append(struct JournalFile* jf, struct JournalLine* batch)
+{
+  struct JournalLine* line;
+  char*               buf;
+  int                 len = 0;
+  int                 fd;
+
+  for (line = batch; line; line = line->next)
+    if (line->file == jf)
+      len += line->len;
+  if (0 == len)
+    return;
+
+  buf = (char*) MyMalloc(len);
+  len = 0;
+  for (line = batch; line; line = line->next)
+    if (line->file == jf)
+      {
+        memcpy(buf + len, line->text, line->len);
+        len += line->len;
+      }
+
+  if ((fd = open(jf->journal, O_WRONLY|O_APPEND|O_CREAT, 0644)) < 0)
+    {
+      journal_notice("Error opening %s: %s", jf->journal, strerror(errno));
+      MyFree(buf);
+      return;
+    }
+  fchmod(fd, 0660);
+  jf->pending = YES;
+  if (write_all(fd, buf, len) || (BAN_JOURNAL_SYNC && fsync(fd)))
+    journal_notice("Write error to file %s: %s", jf->journal,
+                   strerror(errno));
+  close(fd);
+  MyFree(buf);
+}
+
+/*
+ * journal_fold_file - append the journal of jf to its file, and
+ * remove it; the files are locked. If it can't all go in, the file is
+ * cut back and the journal kept.
+ */
+static void journal_fold_file(struct JournalFile* jf)
+{
+  char        buf[8192];
+  struct stat sb;
+  int         in;
+  int         out;
+  int         n;
+
+  if ((in = open(jf->journal, O_RDONLY)) < 0)
+    {
+      if (ENOENT == errno)
+        jf->pending = NO;
+      else
+        journal_notice("Error opening %s: %s", jf->journal, strerror(errno));
+      return;
+    }
+  if ((out = open(jf->name, O_WRONLY|O_APPEND|O_CREAT, 0644)) < 0)
+    {
+      journal_notice("Error opening %s: %s", jf->name, strerror(errno));
+      close(in);
+      return;
+    }
+  fchmod(out, 0660);
+  if (fstat(out, &sb))
+    {
+      journal_notice("Error opening %s: %s", jf->name, strerror(errno));
+      close(out);
+      close(in);
+      return;
+    }
+
+  while ((n = read(in, buf, sizeof(buf))) != 0)
+    {
+      if (n < 0 && EINTR == errno)
+        continue;
+      if (n < 0 || write_all(out, buf, n))
+        {
+          n = -1;
+          break;
+        }
+    }
+  if (0 == n && BAN_JOURNAL_SYNC && fsync(out))
+    n = -1;
+
+  if (n < 0)
+    {
+      journal_notice("Write error to file %s: %s", jf->name, strerror(errno));
+      ftruncate(out, sb.st_size);
+    }
+  else
+    {
+      unlink(jf->journal);
+      jf->pending = NO;
+    }
+  close(out);
+  close(in);
+}
+
+/*
+ * journal_writer - write out the queue, a batch at a time, and fold
+ * the journals in every BAN_JOURNAL_COMPACT seconds
+ */
+static void* journal_writer(void* unused)
+{
+  struct JournalLine* batch;
+  struct JournalLine* line;
+  struct timespec     when;
+  unsigned long       taken;
+  time_t              fold_at;
+  int                 fold;
+  int                 i;
+
+  pthread_mutex_lock(&journal_queue_lock);
+  fold_at = time(NULL) + BAN_JOURNAL_COMPACT;
+  for (;;)
+    {
+      /* while a rehash reads the files, the queue waits for it */
+      while (journal_held || (!journal_queue && time(NULL) < fold_at))
+        {
+          if (journal_held)
+            {
+              pthread_cond_wait(&journal_work, &journal_queue_lock);
+              continue;
+            }
+          when.tv_sec = fold_at;
+          when.tv_nsec = 0;
+          pthread_cond_timedwait(&journal_work, &journal_queue_lock, &when);
+        }
+
+      /*
+       * the bans that follow close on the first go in the same write
+       * (and fsync), unless somebody is waiting for them
+       */
+      if (journal_queue)
+        while (!journal_flushing && !journal_held &&
+               pthread_cond_timedwait(&journal_work, &journal_queue_lock,
+                                      &journal_due) != ETIMEDOUT)
+          ;
+      if (journal_held)
+        continue;
+
+      batch = journal_queue;
+      journal_queue = NULL;
+      journal_tail = &journal_queue;
+      taken = journal_queued;
+      fold = time(NULL) >= fold_at;
+      journal_busy = YES;
+      pthread_mutex_unlock(&journal_queue_lock);
+
+      pthread_mutex_lock(&journal_files_lock);
+      for (i = 0; i < journal_nfiles; i++)
+        {
+          if (batch)
+            journal_append(&journal_files[i], batch);
+          if (fold && journal_files[i].pending &&
+              !journal_locked(journal_files[i].name))
+            journal_fold_file(&journal_files[i]);
+        }
+      pthread_mutex_unlock(&journal_files_lock);
+
+      while ((line = batch))
+        {
+          batch = line->next;
+          MyFree(line);
+        }
+
+      pthread_mutex_lock(&journal_queue_lock);
+      if (fold)
+        fold_at = time(NULL) + BAN_JOURNAL_COMPACT;
+      journal_busy = NO;
+      journal_written = taken;
+      pthread_cond_broadcast(&journal_idle);
+    }
+  return unused;
+}
+
+/*
+ * journal_init - start the writer, for the bans of kline.conf and
+ * dline.conf; without it journal_write() writes the journal itself
+ */
+void journal_init(const char* kfilename, const char* dfilename)
+{
+  const char* names[2];
+  int         i;
+  int         err;
+
+  names[0] = kfilename;
+  names[1] = dfilename;
+  for (i = 0; i < 2; i++)
+    {
+      if (!names[i] || journal_file(names[i]) ||
+          strlen(names[i]) + sizeof(BAN_JOURNAL_SUFFIX) >
+          sizeof(journal_files[0].journal))
+        continue;
+      journal_files[journal_nfiles].name = names[i];
+      strcpy(journal_files[journal_nfiles].journal, names[i]);
+      strcat(journal_files[journal_nfiles].journal, BAN_JOURNAL_SUFFIX);
+      /* there could be one left from before */
+      journal_files[journal_nfiles].pending = YES;
+      journal_nfiles++;
+    }
+
+  if ((err = ircd_thread_start(journal_writer, NULL)))
+    ilog(L_ERROR, "journal_init: pthread_create: %s", strerror(err));
+  else
+    journal_running = YES;
+}
+
+/*
+ * journal_name - the journal kept for filename, NULL if none is
+ */
+const char* journal_name(const char* filename)
+{
+  struct JournalFile* jf = journal_file(filename);
+
+  return jf ? jf->journal : NULL;
+}
+
+/*
+ * journal_write
+ *
+ * inputs       - kline.conf or dline.conf
+ *              - the lines of a ban, newline terminated
+ * output       - none
+ * side effects - the lines are queued for the writer
+ */
+void journal_write(const char* filename, const char* text)
+{
+  struct JournalFile* jf;
+  struct JournalLine* line;
+  struct timeval      now;
+  int                 len = strlen(text);
+
+  if (!(jf = journal_file(filename)))
+    {
+      ilog(L_ERROR, "journal_write: no journal for %s", filename);
+      return;
+    }
+
+  line = (struct JournalLine*) MyMalloc(sizeof(struct JournalLine) + len);
+  line->next = NULL;
+  line->file = jf;
+  line->len = len;
+  memcpy(line->text, text, len + 1);
+
+  pthread_mutex_lock(&journal_queue_lock);
+  if (!journal_running && !journal_held)
+    {
+      pthread_mutex_unlock(&journal_queue_lock);
+      pthread_mutex_lock(&journal_files_lock);
+      journal_append(jf, line);
+      pthread_mutex_unlock(&journal_files_lock);
+      MyFree(line);
+      return;
+    }
+
+  if (!journal_queue)
+    {
+      gettimeofday(&now, NULL);
+      now.tv_usec += (BAN_JOURNAL_DELAY % 1000) * 1000;
+      journal_due.tv_sec = now.tv_sec + BAN_JOURNAL_DELAY / 1000 +
+        now.tv_usec / 1000000;
+      journal_due.tv_nsec = (now.tv_usec % 1000000) * 1000;
+      pthread_cond_signal(&journal_work);
+    }
+  *journal_tail = line;
+  journal_tail = &line->next;
+  journal_queued++;
+  pthread_mutex_unlock(&journal_queue_lock);
+}
+
+/*
+ * journal_flush - wait for what is queued to be written
+ */
+void journal_flush(void)
+{
+  unsigned long target;
+
+  if (!journal_running)
+    return;
+  pthread_mutex_lock(&journal_queue_lock);
+  target = journal_queued;
+  journal_flushing++;
+  pthread_cond_signal(&journal_work);
+  while (journal_written != target)
+    pthread_cond_wait(&journal_idle, &journal_queue_lock);
+  journal_flushing--;
+  pthread_mutex_unlock(&journal_queue_lock);
+}
+
+/*
+ * journal_fold - put all that is journaled for filename in it now,
+ * edited or not, as it is about to be rewritten. Returns NO, without
+ * waiting, if a rehash is reading the files.
+ */
+int journal_fold(const char* filename)
+{
+  struct JournalFile* jf;
+  int                 held;
+
+  if (!(jf = journal_file(filename)))
+    return YES;
+  pthread_mutex_lock(&journal_queue_lock);
+  held = journal_held;
+  pthread_mutex_unlock(&journal_queue_lock);
+  if (held)
+    return NO;
+
+  journal_flush();
+  pthread_mutex_lock(&journal_files_lock);
+  if (jf->pending)
+    journal_fold_file(jf);
+  pthread_mutex_unlock(&journal_files_lock);
+  return YES;
+}
+
+/*
+ * journal_hold - keep the ban files and their journals as they are,
+ * from before they are opened for a rehash until they have been read,
+ * which may be on another thread; the bans queued meanwhile are
+ * written on journal_release()
+ */
+void journal_hold(void)
+{
+  pthread_mutex_lock(&journal_queue_lock);
+  journal_held++;
+  while (journal_busy)
+    pthread_cond_wait(&journal_idle, &journal_queue_lock);
+  pthread_mutex_unlock(&journal_queue_lock);
+}
+
+void journal_release(void)
+{
+  struct JournalLine* batch = NULL;
+  struct JournalLine* line;
+  int                 i;
+
+  pthread_mutex_lock(&journal_queue_lock);
+  if (0 == --journal_held)
+    {
+      if (journal_running)
+        pthread_cond_signal(&journal_work);
+      else
+        {
+          batch = journal_queue;
+          journal_queue = NULL;
+          journal_tail = &journal_queue;
+        }
+    }
+  pthread_mutex_unlock(&journal_queue_lock);
+
+  if (!batch)
+    return;
+  pthread_mutex_lock(&journal_files_lock);
+  for (i = 0; i < journal_nfiles; i++)
+    journal_append(&journal_files[i], batch);
+  pthread_mutex_unlock(&journal_files_lock);
+  while ((line = batch))
+    {
+      batch = line->next;
+      MyFree(line);
+    }
+}
+
+/*
+ * journal_collect - tell the opers what went wrong, from the main loop
+ */
+void journal_collect(void)
+{
+  struct JournalNotice* notice;
+
+  pthread_mutex_lock(&journal_queue_lock);
+  notice = journal_notices;
+  journal_notices = NULL;
+  journal_notices_tail = &journal_notices;
+  pthread_mutex_unlock(&journal_queue_lock);
+
+  while (notice)
+    {
+      struct JournalNotice* next = notice->next;
+
+      sendto_realops("%s", notice->text);
+      ilog(L_ERROR, "%s", notice->text);
+      MyFree(notice);
+      notice = next;
+    }
+}
+#endif /* BAN_JOURNAL */
@@ -14,6 +14,7 @@
 #include <string.h>
 #include <stdlib.h>
 #include <fcntl.h>
+#include <unistd.h>
 #include <assert.h>
 #ifdef HAVE_MMAP
 #include <sys/mman.h>
@@ -25,8 +26,26 @@ const char* BH_CurrentFile = 0;   /* GLOBAL used for BlockHeap debugging */
 int         BH_CurrentLine = 0;   /* GLOBAL used for BlockHeap debugging */
 #endif
 
+/*
+ * Every block is blockSize bytes, a power of two, and starts on a
+ * multiple of blockSize, with its Block header at the front. So the
+ * block an element belongs to is found by masking the element's
+ * address, and BlockHeapFree() never has to search for it.
+ *
+ * Free elements of a block are chained through their first word.
+ * Elements never handed out yet aren't on the chain, they are taken
+ * from b->unused onwards, so a new block isn't touched until it is used.
+ *
+ * Blocks with a free element are kept at the front of bh->base, full
+ * ones at the back, so BlockHeapAlloc() only ever looks at the first.
+ */
+#define BLOCK_HEADER_SIZE ((sizeof(Block) + 15) & ~((size_t) 15))
+
+#define BlockOf(bh, ptr) \
+  ((Block *) ((unsigned long) (ptr) & ~((unsigned long) (bh)->blockSize - 1)))
+
 static int newblock(BlockHeap *bh);
-static void *get_block(size_t size);
+static void *get_block(size_t size, void **mem);
 
 extern void outofmemory(void);      /* defined in list.c */
 
@@ -41,7 +60,7 @@ void initBlockHeap(void)
       outofmemory();
     }
 }
-static void *get_block(size_t size)
+static void *map_block(size_t size)
 {
     void *ptr;
     assert(zero_fd >= 0);
@@ -49,7 +68,7 @@ static void *get_block(size_t size)
     ptr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, zero_fd, 0);
     if(ptr == MAP_FAILED)
     	ptr = NULL;
-    return(ptr); 
+    return(ptr);
 }
 
 #else /* MAP_ANON */
@@ -58,9 +77,9 @@ void initBlockHeap(void)
 {
     return;
 }
-static void *get_block(size_t size)
+static void *map_block(size_t size)
 {
-    void *ptr; 
+    void *ptr;
     assert(size > 0);
     ptr = mmap(NULL, size, PROT_READ | PROT_WRITE,
               	MAP_PRIVATE | MAP_ANON, -1, 0);
@@ -70,9 +89,34 @@ static void *get_block(size_t size)
 }
 #endif /* MAP_ANON */
 
-static void free_block(void *ptr, size_t size)
+/*
+ * get_block - map twice size and unmap what lies either side of the
+ * size aligned part
+ */
+static void *get_block(size_t size, void **mem)
+{
+    char *raw;
+    char *ptr;
+
+    if ((raw = map_block(size * 2)) == NULL)
+      return NULL;
+    ptr = (char *) (((unsigned long) raw + size - 1) & ~((unsigned long) size - 1));
+    if (ptr > raw)
+      munmap(raw, ptr - raw);
+    if (raw + size > ptr)
+      munmap(ptr + size, raw + size - ptr);
+    *mem = ptr;
+    return ptr;
+}
+
+static void free_block(void *mem, size_t size)
 {
-    munmap(ptr, size);
+    munmap(mem, size);
+}
+
+static size_t block_min(void)
+{
+    return getpagesize();
 }
 
 #else /* HAVE_MMAP */
@@ -81,69 +125,88 @@ void initBlockHeap(void)
 {
     return;
 }
-static void *get_block(size_t size)
+static void *get_block(size_t size, void **mem)
+{
+    char *raw = MyMalloc(size * 2);
+
+    *mem = raw;
+    return (void *) (((unsigned long) raw + size - 1) & ~((unsigned long) size - 1));
+}
+static void free_block(void *mem, size_t size)
 {
-    return(MyMalloc(size));
+    MyFree(mem);
 }
-static void free_block(void *ptr, size_t size)
+static size_t block_min(void)
 {
-    MyFree(ptr);
+    return 4096;
 }
 #endif /* HAVE_MMAP */
 
+/*
+ * block_unlink/block_push/block_append - take b off bh->base, put it
+ * back at the front (it has free elements) or at the back (it's full)
+ */
+static void block_unlink(BlockHeap *bh, Block *b)
+{
+   if (b->prev)
+     b->prev->next = b->next;
+   else
+     bh->base = b->next;
+   if (b->next)
+     b->next->prev = b->prev;
+   else
+     bh->last = b->prev;
+}
+
+static void block_push(BlockHeap *bh, Block *b)
+{
+   b->prev = NULL;
+   if ((b->next = bh->base))
+     b->next->prev = b;
+   else
+     bh->last = b;
+   bh->base = b;
+}
+
+static void block_append(BlockHeap *bh, Block *b)
+{
+   b->next = NULL;
+   if ((b->prev = bh->last))
+     b->prev->next = b;
+   else
+     bh->base = b;
+   bh->last = b;
+}
+
 /* ************************************************************************ */
 /* FUNCTION DOCUMENTATION:                                                  */
 /*    newblock                                                              */
 /* Description:                                                             */
 /*    mallocs a new block for addition to a blockheap                       */
 /* Parameters:                                                              */
-/*    bh (IN): Pointer to parent blockheap.                                 */ 
+/*    bh (IN): Pointer to parent blockheap.                                 */
 /* Returns:                                                                 */
 /*    0 if successful, 1 if not                                             */
 /* ************************************************************************ */
 static int newblock(BlockHeap *bh)
 {
    Block *b;
-   int i;
+   void  *mem;
 
-   /* Setup the initial data structure. */
-   b = (Block *) MyMalloc (sizeof(Block));
-   if (b == NULL)
-      return 1;
+   if ((b = (Block *) get_block(bh->blockSize, &mem)) == NULL)
+     return 1;
 
+   b->mem = mem;
+   b->heap = bh;
+   b->freeList = NULL;
+   b->unused = (char *) b + BLOCK_HEADER_SIZE;
    b->freeElems = bh->elemsPerBlock;
-   b->next = bh->base;
-   b->allocMap = (unsigned long *) MyMalloc (sizeof(unsigned long) * (bh->numlongs +1));
-   memset((void *)b->allocMap, 0, (bh->numlongs + 1 ) * sizeof(unsigned long));
-
-   if (b->allocMap == NULL)
-     {
-       free(b);
-       return 1;
-     }
-   
-   /* Now allocate the memory for the elems themselves. */
-
-   b->elems = get_block((bh->elemsPerBlock + 1) * bh->elemSize);
-   if (b->elems == NULL)
-     {
-       free(b->allocMap);
-       free(b);
-       return 1;
-     }
-
-   b->endElem = (void *)((unsigned long) b->elems +
-       (unsigned long) ((bh->elemsPerBlock - 1) * bh->elemSize));
-
-   /* Mark all blocks as free */
-   for (i = 0; i < bh->numlongs; i++)
-      b->allocMap[i] = 0L;
 
    /* Finally, link it in to the heap. */
+   block_push(bh, b);
    ++bh->blocksAllocated;
    bh->freeElems += bh->elemsPerBlock;
-   bh->base = b;
-   
+
    return 0;
 }
 
@@ -159,7 +222,8 @@ static int newblock(BlockHeap *bh)
 /*   elemsize (IN):  Size of the basic element to be stored                 */
 /*   elemsperblock (IN):  Number of elements to be stored in a single block */
 /*         of memory.  When the blockheap runs out of free memory, it will  */
-/*         allocate elemsize * elemsperblock more.                          */
+/*         allocate elemsize * elemsperblock more.  This is rounded up to   */
+/*         fill a power of two sized block.                                 */
 /* Returns:                                                                 */
 /*   Pointer to new BlockHeap, or NULL if unsuccessful                      */
 /* ************************************************************************ */
@@ -167,6 +231,7 @@ BlockHeap * BlockHeapCreate (size_t elemsize,
                      int elemsperblock)
 {
    BlockHeap *bh;
+   size_t     need;
 
    /* Catch idiotic requests up front */
    if ((elemsize <= 0) || (elemsperblock <= 0))
@@ -176,20 +241,26 @@ BlockHeap * BlockHeapCreate (size_t elemsize,
 
    /* Allocate our new BlockHeap */
    bh = (BlockHeap *) MyMalloc( sizeof (BlockHeap));
-   if (bh == NULL) 
+   if (bh == NULL)
      {
        outofmemory(); /* die.. out of memory */
      }
 
-   elemsize = elemsize + (elemsize & (sizeof(void *) - 1));
+   /* room for the free list link, and keep pointers aligned */
+   if (elemsize < sizeof(void *))
+     elemsize = sizeof(void *);
+   elemsize = (elemsize + sizeof(void *) - 1) & ~(sizeof(void *) - 1);
+
+   need = BLOCK_HEADER_SIZE + elemsize * elemsperblock;
+   for (bh->blockSize = block_min(); bh->blockSize < need; )
+     bh->blockSize <<= 1;
+
    bh->elemSize = elemsize;
-   bh->elemsPerBlock = elemsperblock;
+   bh->elemsPerBlock = (bh->blockSize - BLOCK_HEADER_SIZE) / elemsize;
    bh->blocksAllocated = 0;
    bh->freeElems = 0;
-   bh->numlongs = (bh->elemsPerBlock / (sizeof(long) * 8)) + 1;
-   if ( (bh->elemsPerBlock % (sizeof(long) * 8)) == 0)
-     bh->numlongs--;
    bh->base = NULL;
+   bh->last = NULL;
 
    /* Be sure our malloc was successful */
    if (newblock(bh))
@@ -197,11 +268,6 @@ BlockHeap * BlockHeapCreate (size_t elemsize,
        free(bh);
        outofmemory(); /* die.. out of memory */
      }
-   /* DEBUG */
-   if(bh == NULL)
-     {
-       outofmemory(); /* die.. out of memory */
-     }
 
    return bh;
 }
@@ -220,83 +286,37 @@ BlockHeap * BlockHeapCreate (size_t elemsize,
 
 void *BlockHeapAlloc (BlockHeap *bh)
 {
-   Block *walker;
-   int unit;
-   unsigned long mask;
-   unsigned long ctr;
+   Block *b;
+   void  *elem;
 
    if (bh == NULL)
      return((void *)NULL);
 
-   if (bh->freeElems == 0)
-     {          /* Allocate new block and assign */
-
+   /* The first block has a free element if any block does. */
+   if ((b = bh->base) == NULL || b->freeElems == 0)
+     {
        /* newblock returns 1 if unsuccessful, 0 if not */
-
-       if(newblock(bh))
+       if (newblock(bh))
          return((void *)NULL);
-       else
-         {
-           walker = bh->base;
-           walker->allocMap[0] = 0x1L;
-           walker->freeElems--;  bh->freeElems--;
-           if(bh->base->elems == NULL)
-             return((void *)NULL);
-         }
+       b = bh->base;
+     }
 
-       return ((bh->base)->elems);      /* ...and take the first elem. */
+   if ((elem = b->freeList))
+     b->freeList = *(void **) elem;
+   else
+     {
+       elem = b->unused;
+       b->unused += bh->elemSize;
      }
 
-   for (walker = bh->base; walker != NULL; walker = walker->next)
+   bh->freeElems--;
+   if (--b->freeElems == 0 && b->next)
      {
-       if (walker->freeElems > 0)
-         {
-           mask = 0x1L; ctr = 0; unit = 0;
-           while (unit < bh->numlongs)
-             {
-               if ((mask == 0x1L) && (walker->allocMap[unit] == ~0))
-                 {
-                   /* Entire subunit is used, skip to next one. */
-                   unit++; 
-                   ctr = 0;
-                   continue;
-                 }
-               /* Check the current element, if free allocate block */
-               if (!(mask & walker->allocMap[unit]))
-                 {
-                   walker->allocMap[unit] |= mask; /* Mark block as used */
-                   walker->freeElems--;  bh->freeElems--;
-                                                   /* And return the pointer */
-
-                   /* Address arithemtic is always ca-ca 
-                    * have to make sure the the bit pattern for the
-                    * base address is converted into the same number of
-                    * bits in an integer type, that has at least
-                    * sizeof(unsigned long) at least == sizeof(void *)
-                    * -Dianora 
-                    */
-
-                   return ( (void *) (
-                            (unsigned long)walker->elems + 
-                            ( (unit * sizeof(unsigned long) * 8 + ctr)
-                              * (unsigned long )bh->elemSize))
-                            );
-
-                 }
-               /* Step up to the next unit */
-               mask <<= 1;
-               ctr++;
-               if (!mask)
-                 {
-                   mask = 0x1L;
-                   unit++;
-                   ctr = 0;
-                 }
-             }  /* while */
-         }     /* if */
-     }        /* for */
-
-    return((void *) NULL);   /* If you get here, something bad happened ! */
+       /* full, out of the way of the blocks that aren't */
+       block_unlink(bh, b);
+       block_append(bh, b);
+     }
+   return elem;
 }
 
 
@@ -313,9 +333,7 @@ void *BlockHeapAlloc (BlockHeap *bh)
 /* ************************************************************************ */
 int BlockHeapFree(BlockHeap *bh, void *ptr)
 {
-   Block *walker;
-   unsigned long ctr;
-   unsigned long bitmask;
+   Block *b;
 
    if (bh == NULL)
      {
@@ -325,42 +343,43 @@ int BlockHeapFree(BlockHeap *bh, void *ptr)
        return 1;
      }
 
-   for (walker = bh->base; walker != NULL; walker = walker->next)
-     {
-      if ((ptr >= walker->elems) && (ptr <= walker->endElem))
-        {
-          ctr = ((unsigned long) ptr - 
-                 (unsigned long) (walker->elems))
-            / (unsigned long )bh->elemSize;
-
-          bitmask = 1L << (ctr % (sizeof(long) * 8));
-          ctr = ctr / (sizeof(long) * 8);
-          /* Flip the right allocation bit */
-          /* Complain if the bit is already clear, something is wrong
-           * (typically, someone freed the same block twice)
-           */
-
-          if( (walker->allocMap[ctr] & bitmask) == 0 )
-            {
+   b = BlockOf(bh, ptr);
+   if (b->heap != bh || (char *) ptr < (char *) b + BLOCK_HEADER_SIZE ||
+       (char *) ptr >= b->unused)
+     return 1;
+
 #ifdef DEBUG_BLOCK_ALLOCATOR
-      ilog(L_WARN, "blalloc.c bit already clear in map caller %s %d",
-          BH_CurrentFile, BH_CurrentLine);
-      sendto_ops("blalloc.c bit already clear in map elemSize %d caller %s %d",
-                         bh->elemSize,
-                         BH_CurrentFile,
-                         BH_CurrentLine);
-              sendto_ops("Please report to the hybrid team! bugs@ircd-hybrid.org");
+   {
+     void *elem;
+
+     /* Complain if it is free already, something is wrong
+      * (typically, someone freed the same block twice)
+      */
+     for (elem = b->freeList; elem; elem = *(void **) elem)
+       if (elem == ptr)
+         {
+           ilog(L_WARN, "blalloc.c element already free caller %s %d",
+                BH_CurrentFile, BH_CurrentLine);
+           sendto_ops("blalloc.c element already free elemSize %d caller %s %d",
+                      bh->elemSize,
+                      BH_CurrentFile,
+                      BH_CurrentLine);
+           sendto_ops("Please report to the hybrid team! bugs@ircd-hybrid.org");
+           return 0;
+         }
+   }
 #endif /* DEBUG_BLOCK_ALLOCATOR */
-            }
-          else
-            {
-              walker->allocMap[ctr] = walker->allocMap[ctr] & ~bitmask;
-              walker->freeElems++;  bh->freeElems++;
-            }
-          return 0;
-        }
+
+   *(void **) ptr = b->freeList;
+   b->freeList = ptr;
+   bh->freeElems++;
+   if (b->freeElems++ == 0 && b != bh->base)
+     {
+       /* not full anymore, to the front */
+       block_unlink(bh, b);
+       block_push(bh, b);
      }
-   return 1;
+   return 0;
 }
 
 /* ************************************************************************ */
@@ -369,7 +388,7 @@ int BlockHeapFree(BlockHeap *bh, void *ptr)
 /* Description:                                                             */
 /*    Performs garbage colletion on the block heap.  Any blocks that are    */
 /*    completely unallocated are removed from the heap.  Garbage collection */
-/*    will never remove the root node of the heap.                          */
+/*    will never remove the last block of the heap.                         */
 /* Parameters:                                                              */
 /*    bh (IN):  Pointer to the BlockHeap to be cleaned up                   */
 /* Returns:                                                                 */
@@ -377,7 +396,7 @@ int BlockHeapFree(BlockHeap *bh, void *ptr)
 /* ************************************************************************ */
 int BlockHeapGarbageCollect(BlockHeap *bh)
 {
-   Block *walker, *last;
+   Block *walker, *next;
 
    if (bh == NULL)
       return 1;
@@ -388,44 +407,18 @@ int BlockHeapGarbageCollect(BlockHeap *bh)
        return 0;
      }
 
-   last = NULL;
-   walker = bh->base;
-
-   /* This section rewritten Dec 10 1998 - Dianora */
-   while(walker)
+   /* Full blocks are at the back, stop at the first. */
+   for (walker = bh->base; walker && walker->freeElems; walker = next)
      {
-       int i;
-       for (i = 0; i < bh->numlongs; i++)
+       next = walker->next;
+       if (walker->freeElems == bh->elemsPerBlock && bh->blocksAllocated > 1)
          {
-           if (walker->allocMap[i])
-             break;
+           /* This entire block is free.  Remove it. */
+           block_unlink(bh, walker);
+           free_block(walker->mem, bh->blockSize);
+           bh->blocksAllocated--;
+           bh->freeElems -= bh->elemsPerBlock;
          }
-      if (i == bh->numlongs)
-        {
-          /* This entire block is free.  Remove it. */
-          free_block(walker->elems, (bh->elemsPerBlock + 1) * bh->elemSize);
-          free(walker->allocMap);
-
-          if (last)
-            {
-              last->next = walker->next;
-              free(walker);
-              walker = last->next;
-            }
-          else
-            {
-              bh->base = walker->next;
-              free(walker);
-              walker = bh->base;
-            }
-          bh->blocksAllocated--;
-          bh->freeElems -= bh->elemsPerBlock;
-        }
-      else
-        {
-          last = walker;
-          walker = walker->next;
-        }
      }
    return 0;
 }
@@ -451,9 +444,7 @@ int BlockHeapDestroy(BlockHeap *bh)
    for (walker = bh->base; walker != NULL; walker = next)
      {
        next = walker->next;
-       free_block(walker->elems, (bh->elemsPerBlock + 1) * bh->elemSize);
-       free(walker->allocMap);
-       free(walker);
+       free_block(walker->mem, bh->blockSize);
      }
 
    free (bh);
@@ -470,31 +461,38 @@ int BlockHeapDestroy(BlockHeap *bh)
 /*    bh (IN):  Pointer to the BlockHeap to be counted.                     */
 /*    TotalUsed (IN): Pointer to int, total memory used by heap             */
 /*    TotalAllocated (IN): Pointer to int, total memory allocated           */
+/*    Fragmented (IN): Pointer to int, memory of elems freed in blocks that */
+/*         are still in use, so garbage collection can't give it back       */
 /* Returns:                                                                 */
 /*   TotalUsed                                                              */
 /*   TotalAllocated                                                         */
+/*   Fragmented                                                             */
 /* ************************************************************************ */
 
-void BlockHeapCountMemory(BlockHeap *bh,int *TotalUsed,int *TotalAllocated)
+void BlockHeapCountMemory(BlockHeap *bh,int *TotalUsed,int *TotalAllocated,
+                          int *Fragmented)
 {
   Block *walker;
 
   *TotalUsed = 0;
   *TotalAllocated = 0;
+  *Fragmented = 0;
 
   if (bh == NULL)
     return;
 
-  *TotalUsed = sizeof(BlockHeap);
-  *TotalAllocated = sizeof(BlockHeap);
+  *TotalUsed = sizeof(BlockHeap) + bh->blocksAllocated * bh->blockSize;
+  *TotalAllocated =
+    (bh->blocksAllocated * bh->elemsPerBlock - bh->freeElems) * bh->elemSize;
 
-  for (walker = bh->base; walker != NULL; walker = walker->next)
+  for (walker = bh->base; walker && walker->freeElems; walker = walker->next)
     {
-      *TotalUsed += sizeof(Block);
-      *TotalUsed += ((bh->elemSize * bh->elemsPerBlock) + bh->numlongs);
+      int used = (walker->unused - ((char *) walker + BLOCK_HEADER_SIZE)) /
+        bh->elemSize;
 
-      *TotalAllocated = sizeof(Block);      
-      *TotalAllocated = ((bh->elemsPerBlock - walker->freeElems)
-                         * bh->elemSize);
+      /* elems freed and not reused yet, in a block still in use */
+      if (walker->freeElems < bh->elemsPerBlock)
+        *Fragmented += (walker->freeElems - (bh->elemsPerBlock - used)) *
+          bh->elemSize;
     }
 }
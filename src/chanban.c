@@ -0,0 +1,370 @@
+/************************************************************************
+ *   IRC - Internet Relay Chat, src/chanban.c
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 1, or (at your option)
+ *   any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ * $Id$
+ */
+#include "chanban.h"
+#include "channel.h"
+#include "irc_string.h"
+#include "ircd_defs.h"
+#include "struct.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Masks are sorted into three kinds as they are added:
+ *
+ *  - masks without any '*' or '?' can only match a client whose
+ *    nick!user@host or nick!user@ip is the mask itself. They go in a
+ *    hash keyed on the lower cased mask.
+ *  - masks whose host part starts with literal characters (1.2.3.*,
+ *    foo*.bar.com, but not *.bar.com) hang off a prefix tree of those
+ *    characters, so a client is only tried against the masks whose
+ *    prefix its host or ip really starts with.
+ *  - everything else sits on the root of the tree and is tried against
+ *    every client, as the plain lists used to be.
+ *
+ * A nick!user part can't hold an '@', so the single '@' of a mask has
+ * to line up with the '@' in front of the client's host, which is what
+ * makes the prefix tree safe. match() still decides every candidate.
+ */
+#define BAN_HASH_SIZE 64
+
+struct BanEntry {
+  struct BanEntry* next;
+  struct SLink*    ban;
+};
+
+struct BanNode {
+  struct BanNode*  child;     /* first node one character deeper */
+  struct BanNode*  sibling;   /* next node at the same depth */
+  struct BanEntry* entries;   /* masks whose host prefix ends here */
+  unsigned char    c;         /* lower cased prefix character */
+};
+
+struct BanIndex {
+  struct BanEntry* exact[BAN_HASH_SIZE];
+  struct BanNode   root;
+  int              count;
+};
+
+/*
+ * ban_hash - case insensitive hash of a mask or nick!user@host
+ */
+static unsigned int ban_hash(const char* s)
+{
+  unsigned int h = 0;
+
+  while (*s)
+    h = (h * 31) + ToLower(*s++);
+  return h % BAN_HASH_SIZE;
+}
+
+/*
+ * ban_host_prefix - find the literal start of the host part of mask
+ * returns -1 if mask has no wildcards at all, otherwise the length of
+ * the literal prefix stored in *prefix (0 if there is none usable)
+ */
+static int ban_host_prefix(const char* mask, const char** prefix)
+{
+  const char* at;
+  const char* p;
+
+  if (!strchr(mask, '*') && !strchr(mask, '?'))
+    return -1;
+
+  *prefix = mask;
+  if (!(at = strchr(mask, '@')) || strchr(at + 1, '@'))
+    return 0;
+
+  *prefix = ++at;
+  for (p = at; *p && *p != '*' && *p != '?'; p++)
+    ;
+  return p - at;
+}
+
+/*
+ * ban_tree_node - find, or create, the node for prefix
+ */
+static struct BanNode* ban_tree_node(struct BanNode* node,
+                                     const char* prefix, int len)
+{
+  struct BanNode* child;
+  unsigned char   c;
+
+  for ( ; len > 0; len--, prefix++)
+    {
+      c = ToLower(*prefix);
+      for (child = node->child; child; child = child->sibling)
+        if (child->c == c)
+          break;
+      if (!child)
+        {
+          child = (struct BanNode*) MyMalloc(sizeof(struct BanNode));
+          memset(child, 0, sizeof(struct BanNode));
+          child->c = c;
+          child->sibling = node->child;
+          node->child = child;
+        }
+      node = child;
+    }
+  return node;
+}
+
+/*
+ * ban_tree_del - unhook ban from below node, freeing any node left
+ * without masks or children. returns 1 if ban was found
+ */
+static int ban_tree_del(struct BanNode* node, const char* prefix, int len,
+                        struct SLink* ban)
+{
+  struct BanNode**  cp;
+  struct BanNode*   child;
+  struct BanEntry** ep;
+  struct BanEntry*  e;
+
+  if (0 == len)
+    {
+      for (ep = &node->entries; (e = *ep); ep = &e->next)
+        if (e->ban == ban)
+          {
+            *ep = e->next;
+            MyFree(e);
+            return 1;
+          }
+      return 0;
+    }
+
+  for (cp = &node->child; (child = *cp); cp = &child->sibling)
+    if (child->c == ToLower(*prefix))
+      break;
+  if (!child || !ban_tree_del(child, prefix + 1, len - 1, ban))
+    return 0;
+
+  if (!child->entries && !child->child)
+    {
+      *cp = child->sibling;
+      MyFree(child);
+    }
+  return 1;
+}
+
+/*
+ * ban_tree_match - try name against the masks on the path host
+ * takes through the tree
+ */
+static struct SLink* ban_tree_match(struct BanNode* node, const char* host,
+                                    const char* name)
+{
+  struct BanEntry* e;
+
+  for (;;)
+    {
+      for (e = node->entries; e; e = e->next)
+        if (match(BANSTR(e->ban), name))
+          return e->ban;
+      if (!*host)
+        return NULL;
+      for (node = node->child; node; node = node->sibling)
+        if (node->c == ToLower(*host))
+          break;
+      if (!node)
+        return NULL;
+      host++;
+    }
+}
+
+static void ban_tree_free(struct BanNode* node, int self)
+{
+  struct BanNode*  child;
+  struct BanEntry* e;
+
+  while ((child = node->child))
+    {
+      node->child = child->sibling;
+      ban_tree_free(child, 1);
+    }
+  while ((e = node->entries))
+    {
+      node->entries = e->next;
+      MyFree(e);
+    }
+  if (self)
+    MyFree(node);
+}
+
+static unsigned long ban_tree_memory(struct BanNode* node)
+{
+  unsigned long    mem = 0;
+  struct BanNode*  child;
+  struct BanEntry* e;
+
+  for (e = node->entries; e; e = e->next)
+    mem += sizeof(struct BanEntry);
+  for (child = node->child; child; child = child->sibling)
+    mem += sizeof(struct BanNode) + ban_tree_memory(child);
+  return mem;
+}
+
+/*
+ * ban_index_add - compile ban into the index at *index, creating the
+ * index if this is the first mask on the list
+ */
+void ban_index_add(struct BanIndex** index, struct SLink* ban)
+{
+  struct BanEntry* e;
+  const char*      mask = BANSTR(ban);
+  const char*      prefix;
+  int              len;
+
+  if (!*index)
+    {
+      *index = (struct BanIndex*) MyMalloc(sizeof(struct BanIndex));
+      memset(*index, 0, sizeof(struct BanIndex));
+    }
+
+  e = (struct BanEntry*) MyMalloc(sizeof(struct BanEntry));
+  e->ban = ban;
+
+  if ((len = ban_host_prefix(mask, &prefix)) < 0)
+    {
+      unsigned int h = ban_hash(mask);
+
+      e->next = (*index)->exact[h];
+      (*index)->exact[h] = e;
+    }
+  else
+    {
+      struct BanNode* node = ban_tree_node(&(*index)->root, prefix, len);
+
+      e->next = node->entries;
+      node->entries = e;
+    }
+  (*index)->count++;
+}
+
+/*
+ * ban_index_del - drop ban from the index at *index, freeing the index
+ * once it is empty. ban must still hold the mask it was added with.
+ */
+void ban_index_del(struct BanIndex** index, struct SLink* ban)
+{
+  struct BanEntry** ep;
+  struct BanEntry*  e;
+  const char*       mask = BANSTR(ban);
+  const char*       prefix;
+  int               len;
+  int               found = 0;
+
+  if (!*index)
+    return;
+
+  if ((len = ban_host_prefix(mask, &prefix)) < 0)
+    {
+      for (ep = &(*index)->exact[ban_hash(mask)]; (e = *ep); ep = &e->next)
+        if (e->ban == ban)
+          {
+            *ep = e->next;
+            MyFree(e);
+            found = 1;
+            break;
+          }
+    }
+  else
+    found = ban_tree_del(&(*index)->root, prefix, len, ban);
+
+  assert(found);
+  if (found && 0 == --(*index)->count)
+    ban_index_free(index);
+}
+
+void ban_index_free(struct BanIndex** index)
+{
+  struct BanEntry* e;
+  int              i;
+
+  if (!*index)
+    return;
+
+  for (i = 0; i < BAN_HASH_SIZE; i++)
+    while ((e = (*index)->exact[i]))
+      {
+        (*index)->exact[i] = e->next;
+        MyFree(e);
+      }
+  ban_tree_free(&(*index)->root, 0);
+  MyFree(*index);
+  *index = NULL;
+}
+
+/*
+ * ban_name_match - return the first mask in index matching name
+ */
+static struct SLink* ban_name_match(struct BanIndex* index, const char* name)
+{
+  struct BanEntry* e;
+  struct SLink*    ban;
+  const char*      at;
+
+  for (e = index->exact[ban_hash(name)]; e; e = e->next)
+    if (match(BANSTR(e->ban), name))
+      return e->ban;
+
+  /*
+   * there should be exactly one '@', but walk from each of them
+   * rather than trust that
+   */
+  if (!(at = strchr(name, '@')))
+    return ban_tree_match(&index->root, "", name);
+  for ( ; at; at = strchr(at + 1, '@'))
+    if ((ban = ban_tree_match(&index->root, at + 1, name)))
+      return ban;
+  return NULL;
+}
+
+/*
+ * ban_index_match - return the first mask in index matching either
+ * nick!user@host in s or nick!user@ip in s2, or NULL
+ */
+struct SLink* ban_index_match(struct BanIndex* index, const char* s,
+                              const char* s2)
+{
+  struct SLink* ban;
+
+  if (!index)
+    return NULL;
+  if ((ban = ban_name_match(index, s)))
+    return ban;
+  return ban_name_match(index, s2);
+}
+
+unsigned long ban_index_memory(struct BanIndex* index)
+{
+  unsigned long    mem;
+  struct BanEntry* e;
+  int              i;
+
+  if (!index)
+    return 0;
+  mem = sizeof(struct BanIndex) + ban_tree_memory(&index->root);
+  for (i = 0; i < BAN_HASH_SIZE; i++)
+    for (e = index->exact[i]; e; e = e->next)
+      mem += sizeof(struct BanEntry);
+  return mem;
+}
@@ -25,6 +25,7 @@
  * $Id: channel.c,v 1.253 2005/09/30 15:58:12 ievil Exp $
  */
 #include "channel.h"
+#include "chanban.h"
 #include "m_commands.h"
 #include "client.h"
 #include "common.h"
@@ -33,6 +34,7 @@
 #include "irc_string.h"
 #include "ircd.h"
 #include "list.h"
+#include "m_list.h"
 #include "numeric.h"
 #include "s_serv.h"       /* captab */
 #include "s_user.h"
@@ -66,6 +68,7 @@ static  void    free_a_ban_list(Link *ban_ptr);
 static  int     is_banned (struct Client *, struct Channel *);
 static  int     is_invex (struct Client *, struct Channel *);
 static  void    sub1_from_channel (struct Channel *);
+static  void    sub_from_channel (struct Channel *, int);
 
 
 /* static functions used in set_mode */
@@ -90,6 +93,16 @@ static  char    buf[BUFSIZE];
 static  char    modebuf[MODEBUFLEN], modebuf2[MODEBUFLEN];
 static  char    parabuf[MODEBUFLEN], parabuf2[MODEBUFLEN];
 
+/*
+ * source of chptr->ban_serial. Global rather than per channel so a
+ * channel reusing a freed one's memory can't inherit its cached
+ * ban verdicts.
+ */
+static  unsigned long ban_generation = 0;
+
+/* source of chptr->serial, new channels count up, see burst_run() */
+static  unsigned long channel_serial = 0;
+
 
 /* 
  * return the length (>=0) of a chain of links.
@@ -160,6 +173,7 @@ static int add_id(struct Client *cptr, struct Channel *chptr, char *banid, int t
 {
   Link **list;
   Link *tmp;
+  struct BanIndex **index;
   
   if (!banid)
     return 0;
@@ -180,12 +194,15 @@ static int add_id(struct Client *cptr, struct Channel *chptr, char *banid, int t
     {
     case CHFL_BAN:
       list = &chptr->banlist; 
+      index = &chptr->banindex;
       break;
     case CHFL_EXCEPTION:
       list = &chptr->exceptlist;
+      index = &chptr->exceptindex;
       break;
     case CHFL_INVEX:
       list = &chptr->invexlist;
+      index = &chptr->invexindex;
       break;
     default:
       sendto_realops("add_id() called with unknown ban type %d! call the hybteam.", type);
@@ -256,6 +273,8 @@ static int add_id(struct Client *cptr, struct Channel *chptr, char *banid, int t
 #endif  /* #ifdef BAN_INFO */
 
   *list = tmp;
+  ban_index_add(index, tmp);
+  chptr->ban_serial = ++ban_generation;
   chptr->num_bed++;
   return 0;
   
@@ -266,6 +285,7 @@ static int del_id(struct Channel *chptr, char *banid, int type)
 {
   Link **list;
   Link *tmp;
+  struct BanIndex **index;
 
   if (!banid)
     return -1;
@@ -274,12 +294,15 @@ static int del_id(struct Channel *chptr, char *banid, int type)
       {
     case CHFL_BAN:
       list = &chptr->banlist;
+      index = &chptr->banindex;
         break;
     case CHFL_EXCEPTION:
       list = &chptr->exceptlist;
+      index = &chptr->exceptindex;
       break;
     case CHFL_INVEX:
       list = &chptr->invexlist;
+      index = &chptr->invexindex;
       break;
     default:
       sendto_realops("del_id() called with unknown ban type %d! call the hybteam.", type);  
@@ -295,6 +318,8 @@ static int del_id(struct Channel *chptr, char *banid, int type)
       {
         tmp = *list;
         *list = tmp->next;
+        ban_index_del(index, tmp);
+        chptr->ban_serial = ++ban_generation;
 #ifdef BAN_INFO
         MyFree(tmp->value.banptr->banstr);
         MyFree(tmp->value.banptr->who);
@@ -313,6 +338,26 @@ static int del_id(struct Channel *chptr, char *banid, int type)
   return 0;
 }
 
+/*
+ * find_ban_verdict - return the ban cache slot of local client cptr
+ * for chptr, emptied if it held another channel or the channel's
+ * lists have changed since
+ */
+static struct BanVerdict *find_ban_verdict(struct Client *cptr,
+                                           struct Channel *chptr)
+{
+  struct BanVerdict *bv;
+
+  bv = &cptr->ban_cache[((unsigned long) chptr >> 4) % BAN_CACHE_SIZE];
+  if (bv->chptr != chptr || bv->serial != chptr->ban_serial)
+    {
+      bv->chptr = chptr;
+      bv->serial = chptr->ban_serial;
+      bv->banned = bv->invex = -1;
+    }
+  return bv;
+}
+
 /*
  * is_banned -  returns an int 0 if not banned,
  *              CHFL_BAN if banned
@@ -326,38 +371,40 @@ static int del_id(struct Channel *chptr, char *banid, int type)
 
 static  int is_banned(struct Client *cptr,struct Channel *chptr)
 {
-  Link *tmp;
+  struct BanVerdict *bv = NULL;
   char  s[NICKLEN+USERLEN+HOSTLEN+6];
   char  *s2;
+  int   result = 0;
 
   if (!IsPerson(cptr))
     return (0);
 
-  strcpy(s, make_nick_user_host(cptr->name, cptr->username, cptr->host));
-  s2 = make_nick_user_host(cptr->name, cptr->username,
-                           inetntoa((char*) &cptr->ip));
-
-  for (tmp = chptr->banlist; tmp; tmp = tmp->next)
-    if (match(BANSTR(tmp), s) ||
-        match(BANSTR(tmp), s2))
-      break;
-
-#ifdef CHANMODE_E
-  if (tmp)
+  if (MyConnect(cptr))
     {
-      Link *t2;
-      for (t2 = chptr->exceptlist; t2; t2 = t2->next)
-        if (match(BANSTR(t2), s) ||
-            match(BANSTR(t2), s2))
-          {
-            return CHFL_EXCEPTION;
-          }
+      bv = find_ban_verdict(cptr, chptr);
+      if (bv->banned != -1)
+        return bv->banned;
     }
+
+  if (chptr->banindex)
+    {
+      strcpy(s, make_nick_user_host(cptr->name, cptr->username, cptr->host));
+      s2 = make_nick_user_host(cptr->name, cptr->username,
+                               inetntoa((char*) &cptr->ip));
+
+      /* CHFL_BAN for +b or +d match, we really dont need to be more
+         specific */
+      if (ban_index_match(chptr->banindex, s, s2))
+        result = CHFL_BAN;
+#ifdef CHANMODE_E
+      if (result && ban_index_match(chptr->exceptindex, s, s2))
+        result = CHFL_EXCEPTION;
 #endif
+    }
 
-  /* return CHFL_BAN for +b or +d match, we really dont need to be more
-     specific */
-  return ((tmp?CHFL_BAN:0));
+  if (bv)
+    bv->banned = result;
+  return result;
 }
 
 /*
@@ -374,30 +421,167 @@ static  int is_invex(struct Client *cptr,struct Channel *chptr)
 {
 /* if we dont have CHANMODE_I just abort */
 #ifdef CHANMODE_I
+  struct BanVerdict *bv = NULL;
   char  s[NICKLEN+USERLEN+HOSTLEN+6];
   char  *s2;
-  Link *t2;
+  int   result = 0;
 
   if (!IsPerson(cptr))
     return (0);
 
-  strcpy(s, make_nick_user_host(cptr->name, cptr->username, cptr->host));
-  s2 = make_nick_user_host(cptr->name, cptr->username,
-                           inetntoa((char*) &cptr->ip));
-  for (t2 = chptr->invexlist; t2; t2 = t2->next)
-    if (match(BANSTR(t2), s) || match(BANSTR(t2), s2))
-      {
-        return CHFL_INVEX;
-      }
-#endif
+  if (MyConnect(cptr))
+    {
+      bv = find_ban_verdict(cptr, chptr);
+      if (bv->invex != -1)
+        return bv->invex;
+    }
+
+  if (chptr->invexindex)
+    {
+      strcpy(s, make_nick_user_host(cptr->name, cptr->username, cptr->host));
+      s2 = make_nick_user_host(cptr->name, cptr->username,
+                               inetntoa((char*) &cptr->ip));
+      if (ban_index_match(chptr->invexindex, s, s2))
+        result = CHFL_INVEX;
+    }
+
+  if (bv)
+    bv->invex = result;
+  return result;
+#else
   /* return 0 if we get here.. bcoz then there is no INVEX */
   return (0);
+#endif
+}
+
+
+/*
+ * member_hash - hash a client pointer into a channel's member index
+ */
+static unsigned int member_hash(struct Channel *chptr, struct Client *who)
+{
+  unsigned long h = ((unsigned long) who >> 3) * 2654435761UL;
+
+  return (unsigned int) (h ^ (h >> 16)) & (chptr->memberh_size - 1);
 }
 
+/*
+ * rehash_members - rebuild the member hash of chptr over memberv
+ */
+static void rehash_members(struct Channel *chptr)
+{
+  int i;
+  unsigned int h;
+
+  memset(chptr->memberh, -1, chptr->memberh_size * sizeof(int));
+  for (i = 0; i < chptr->memberc; i++)
+    {
+      h = member_hash(chptr, chptr->memberv[i]->value.cptr);
+      while (chptr->memberh[h] != -1)
+        h = (h + 1) & (chptr->memberh_size - 1);
+      chptr->memberh[h] = i;
+    }
+}
+
+/*
+ * grow_member_index - double the member array of chptr and rebuild
+ * the hash over it
+ */
+static void grow_member_index(struct Channel *chptr)
+{
+  chptr->memberv_size = chptr->memberv_size ? chptr->memberv_size * 2 : 4;
+  chptr->memberv = (Link **) MyRealloc(chptr->memberv,
+                                       chptr->memberv_size * sizeof(Link *));
+
+  MyFree(chptr->memberh);
+  chptr->memberh_size = chptr->memberv_size * 2;
+  chptr->memberh = (int *) MyMalloc(chptr->memberh_size * sizeof(int));
+  rehash_members(chptr);
+}
+
+/*
+ * find_member_slot - return the memberh slot holding who, or the
+ * empty slot that ends its probe sequence
+ */
+static unsigned int find_member_slot(struct Channel *chptr, struct Client *who)
+{
+  unsigned int h = member_hash(chptr, who);
+
+  while (chptr->memberh[h] != -1 &&
+         chptr->memberv[chptr->memberh[h]]->value.cptr != who)
+    h = (h + 1) & (chptr->memberh_size - 1);
+  return h;
+}
+
+/*
+ * find_member_link - return the member link of who on chptr, or NULL
+ */
+Link *find_member_link(struct Channel *chptr, struct Client *who)
+{
+  int i;
+
+  if (!chptr->memberc)
+    return NULL;
+  i = chptr->memberh[find_member_slot(chptr, who)];
+  return (i == -1) ? NULL : chptr->memberv[i];
+}
+
+/*
+ * del_member_link - remove who from the member index of chptr and
+ * return its link, or NULL if who was not a member. The last member
+ * is moved into the hole so memberv stays compact.
+ */
+static Link *del_member_link(struct Channel *chptr, struct Client *who)
+{
+  unsigned int h, j, k;
+  unsigned int mask;
+  int i, last;
+  Link *lp;
+
+  if (!chptr->memberc)
+    return NULL;
+
+  mask = chptr->memberh_size - 1;
+  h = find_member_slot(chptr, who);
+  if ((i = chptr->memberh[h]) == -1)
+    return NULL;
+  lp = chptr->memberv[i];
+
+  /* backward shift the rest of the probe sequence over the slot */
+  chptr->memberh[h] = -1;
+  for (j = (h + 1) & mask; chptr->memberh[j] != -1; j = (j + 1) & mask)
+    {
+      k = member_hash(chptr, chptr->memberv[chptr->memberh[j]]->value.cptr);
+      if (((j - k) & mask) >= ((j - h) & mask))
+        {
+          chptr->memberh[h] = chptr->memberh[j];
+          chptr->memberh[j] = -1;
+          h = j;
+        }
+    }
+
+  last = --chptr->memberc;
+  if (i != last)
+    {
+      chptr->memberv[i] = chptr->memberv[last];
+      chptr->memberh[find_member_slot(chptr,
+                                      chptr->memberv[i]->value.cptr)] = i;
+    }
+
+  if (!chptr->memberc)
+    {
+      MyFree(chptr->memberv);
+      MyFree(chptr->memberh);
+      chptr->memberv = NULL;
+      chptr->memberh = NULL;
+      chptr->memberv_size = chptr->memberh_size = 0;
+    }
+  return lp;
+}
 
 /*
  * adds a user to a channel by adding another link to the channels member
- * chain.
+ * index.
  */
 static  void    add_user_to_channel(struct Channel *chptr, struct Client *who, int flags)
 {
@@ -408,10 +592,13 @@ static  void    add_user_to_channel(struct Channel *chptr, struct Client *who, i
       ptr = make_link();
       ptr->flags = flags;
       ptr->value.cptr = who;
-      ptr->next = chptr->members;
-      chptr->members = ptr;
 
-      chptr->users++;
+      if (chptr->memberc == chptr->memberv_size)
+        grow_member_index(chptr);
+      chptr->memberh[find_member_slot(chptr, who)] = chptr->memberc;
+      chptr->memberv[chptr->memberc++] = ptr;
+
+      list_set_users(chptr, chptr->users + 1);
 
       ptr = make_link();
       ptr->value.chptr = chptr;
@@ -426,13 +613,8 @@ void    remove_user_from_channel(struct Client *sptr,struct Channel *chptr,int w
   Link  **curr;
   Link  *tmp;
 
-  for (curr = &chptr->members; (tmp = *curr); curr = &tmp->next)
-    if (tmp->value.cptr == sptr)
-      {
-        *curr = tmp->next;
-        free_link(tmp);
-        break;
-      }
+  if ((tmp = del_member_link(chptr, sptr)))
+    free_link(tmp);
   for (curr = &sptr->user->channel; (tmp = *curr); curr = &tmp->next)
     if (tmp->value.chptr == chptr)
       {
@@ -446,11 +628,120 @@ void    remove_user_from_channel(struct Client *sptr,struct Channel *chptr,int w
 
 }
 
+/*
+ * drop_split_members - take every member marked FLAGS_SPLIT off chptr
+ * in one pass over its members, which may free it
+ */
+static void drop_split_members(struct Channel *chptr)
+{
+  Link *lp;
+  int   i, kept = 0;
+
+  for (i = 0; i < chptr->memberc; i++)
+    {
+      lp = chptr->memberv[i];
+      if (lp->value.cptr->flags & FLAGS_SPLIT)
+        {
+          free_link(lp);
+        }
+      else
+        chptr->memberv[kept++] = lp;
+    }
+  i = chptr->memberc - kept;
+  if ((chptr->memberc = kept))
+    rehash_members(chptr);
+  else
+    {
+      MyFree(chptr->memberv);
+      MyFree(chptr->memberh);
+      chptr->memberv = NULL;
+      chptr->memberh = NULL;
+      chptr->memberv_size = chptr->memberh_size = 0;
+    }
+  sub_from_channel(chptr, i);
+}
+
+/*
+ * remove_split_users - take the count users, all marked FLAGS_SPLIT,
+ * off their channels at once, and tell the local users who shared a
+ * channel with them that they quit with comment.
+ *
+ * Each channel the split touches is looked at once: its staying local
+ * members are gathered up front, so a QUIT only goes past them and
+ * never past the rest of a big channel, and the departing members come
+ * off in one pass rather than one by one.
+ */
+void remove_split_users(struct Client **users, int count, const char *comment)
+{
+  static struct Channel **chans = NULL;
+  static struct Client  **locals = NULL;
+  static int            chans_size = 0;
+  static int            locals_size = 0;
+  static unsigned long  split_serial = 0;
+  struct Channel *chptr;
+  struct Client  *acptr;
+  Link *lp;
+  int   nchans = 0, nlocals = 0;
+  int   i, j;
+
+  ++split_serial;
+  for (i = 0; i < count; i++)
+    for (lp = users[i]->user->channel; lp; lp = lp->next)
+      {
+        chptr = lp->value.chptr;
+        if (chptr->split_serial == split_serial)
+          continue;
+        chptr->split_serial = split_serial;
+        if (nchans == chans_size)
+          {
+            chans_size = chans_size ? chans_size * 2 : 64;
+            chans = (struct Channel **) MyRealloc(chans,
+                                chans_size * sizeof(struct Channel *));
+          }
+        chans[nchans++] = chptr;
+
+        chptr->split_local = nlocals;
+        for (j = 0; j < chptr->memberc; j++)
+          {
+            acptr = chptr->memberv[j]->value.cptr;
+            if (!MyConnect(acptr) || acptr->fd < 0 ||
+                (acptr->flags & FLAGS_SPLIT))
+              continue;
+            if (nlocals == locals_size)
+              {
+                locals_size = locals_size ? locals_size * 2 : 256;
+                locals = (struct Client **) MyRealloc(locals,
+                                locals_size * sizeof(struct Client *));
+              }
+            locals[nlocals++] = acptr;
+          }
+        chptr->split_nlocal = nlocals - chptr->split_local;
+      }
+
+  for (i = 0; i < count; i++)
+    if (users[i]->user->channel)
+      sendto_split_channels(users[i], locals, ":%s QUIT :%s",
+                            users[i]->name, comment);
+
+  for (i = 0; i < nchans; i++)
+    drop_split_members(chans[i]);
+
+  for (i = 0; i < count; i++)
+    {
+      while ((lp = users[i]->user->channel))
+        {
+          users[i]->user->channel = lp->next;
+          free_link(lp);
+        }
+      users[i]->user->joined = 0;
+    }
+}
+
 static  void    change_chan_flag(struct Channel *chptr,struct Client *cptr, int flag)
 {
   Link *tmp;
 
-  if ((tmp = find_user_link(chptr->members, cptr)))
+  if ((tmp = find_member_link(chptr, cptr)))
    {
     if (flag & MODE_ADD)
       {
@@ -469,7 +760,7 @@ static  void    set_deopped(struct Client *cptr, struct Channel *chptr,int flag)
 {
   Link  *tmp;
 
-  if ((tmp = find_user_link(chptr->members, cptr)))
+  if ((tmp = find_member_link(chptr, cptr)))
     if ((tmp->flags & flag) == 0)
       tmp->flags |= MODE_DEOPPED;
 }
@@ -479,7 +770,7 @@ int     is_chan_op(struct Client *cptr, struct Channel *chptr)
   Link  *lp;
 
   if (chptr)
-    if ((lp = find_user_link(chptr->members, cptr)))
+    if ((lp = find_member_link(chptr, cptr)))
       return (lp->flags & CHFL_CHANOP);
   
   return 0;
@@ -490,7 +781,7 @@ int     is_deopped(struct Client *cptr, struct Channel *chptr)
   Link  *lp;
 
   if (chptr)
-    if ((lp = find_user_link(chptr->members, cptr)))
+    if ((lp = find_member_link(chptr, cptr)))
       return (lp->flags & CHFL_DEOPPED);
   
   return 0;
@@ -501,7 +792,7 @@ int     has_voice(struct Client *cptr, struct Channel *chptr)
   Link  *lp;
 
   if (chptr)
-    if ((lp = find_user_link(chptr->members, cptr)))
+    if ((lp = find_member_link(chptr, cptr)))
       return (lp->flags & CHFL_VOICE);
 
   return 0;
@@ -522,7 +813,7 @@ int     can_send(struct Client *cptr, struct Channel *chptr)
     }
 #endif
 
-  lp = find_user_link(chptr->members, cptr);
+  lp = find_member_link(chptr, cptr);
 
   if (chptr->mode.mode & MODE_MODERATED &&
       (!lp || !(lp->flags & (CHFL_CHANOP|CHFL_VOICE))))
@@ -539,7 +830,7 @@ int     user_channel_mode(struct Client *cptr, struct Channel *chptr)
   Link  *lp;
 
   if (chptr)
-    if ((lp = find_user_link(chptr->members, cptr)))
+    if ((lp = find_member_link(chptr, cptr)))
       return (lp->flags);
   
   return 0;
@@ -655,7 +946,9 @@ static  void    send_mode_list(struct Client *cptr,
  */
 void send_channel_modes(struct Client *cptr, struct Channel *chptr)
 {
-  Link  *l, *anop = NULL, *skip = NULL;
+  Link  *l;
+  int   anop = -1;
+  int   i;
   int   n = 0;
   char  *t;
 
@@ -674,34 +967,20 @@ void send_channel_modes(struct Client *cptr, struct Channel *chptr)
   ircsprintf(buf, ":%s SJOIN %lu %s %s %s:", me.name,
           chptr->channelts, chptr->chname, modebuf, parabuf);
   t = buf + strlen(buf);
-  for (l = chptr->members; l && l->value.cptr; l = l->next)
-    if (l->flags & MODE_CHANOP)
+  for (i = 0; i < chptr->memberc; i++)
+    if (chptr->memberv[i]->flags & MODE_CHANOP)
       {
-        anop = l;
+        anop = i;
         break;
       }
   /* follow the channel, but doing anop first if it's defined
   **  -orabidoo
   */
-  l = NULL;
-  for (;;)
+  for (i = (anop == -1) ? 0 : -1; i < chptr->memberc; i++)
     {
-      if (anop)
-        {
-          l = skip = anop;
-          anop = NULL;
-        }
-      else 
-        {
-          if (l == NULL || l == skip)
-            l = chptr->members;
-          else
-            l = l->next;
-          if (l && l == skip)
-            l = l->next;
-          if (l == NULL)
-            break;
-        }
+      if (i == anop)
+        continue;
+      l = chptr->memberv[(i == -1) ? anop : i];
       if (l->flags & MODE_CHANOP)
         *t++ = '@';
       if (l->flags & MODE_VOICE)
@@ -2041,7 +2320,10 @@ static struct Channel* get_channel(struct Client *cptr, char *chname, int flag)
       chptr->nextch = channel;
       channel = chptr;
       chptr->channelts = CurrentTime;     /* doesn't hurt to set it here */
+      chptr->ban_serial = ++ban_generation;
+      chptr->serial = ++channel_serial;
       add_to_channel_hash_table(chname, chptr);
+      list_add_channel(chptr);
       Count.chan++;
     }
   return chptr;
@@ -2112,14 +2394,21 @@ void    del_invite(struct Client *cptr,struct Channel *chptr)
 **  block, if channel became empty).
 */
 static  void    sub1_from_channel(struct Channel *chptr)
+{
+  sub_from_channel(chptr, 1);
+}
+
+/* sub_from_channel - n members have left chptr, free it if it's empty */
+static  void    sub_from_channel(struct Channel *chptr, int n)
 {
   Link *tmp;
 
-  if (--chptr->users <= 0)
+  /* if chptr->users < 0, make sure it sticks at 0
+   * It should never happen but...
+   */
+  list_set_users(chptr, chptr->users > n ? chptr->users - n : 0);
+  if (chptr->users <= 0)
     {
-      chptr->users = 0; /* if chptr->users < 0, make sure it sticks at 0
-                         * It should never happen but...
-                         */
 #ifdef JUPE_CHANNEL
         if(chptr->juped)
           {
@@ -2142,6 +2431,7 @@ static  void    sub1_from_channel(struct Channel *chptr)
 	  /* free all bans/exceptions/denies */
 	  free_bans_exceptions_denies( chptr );
 
+          burst_del_channel(chptr);
           if (chptr->prevch)
             chptr->prevch->nextch = chptr->nextch;
           else
@@ -2153,6 +2443,7 @@ static  void    sub1_from_channel(struct Channel *chptr)
           free_fluders(NULL, chptr);
 #endif
           del_from_channel_hash_table(chptr->chname, chptr);
+          list_del_channel(chptr);
           MyFree((char*) chptr);
           Count.chan--;
         }
@@ -2171,9 +2462,14 @@ static void free_bans_exceptions_denies(struct Channel *chptr)
 {
   free_a_ban_list(chptr->banlist);
   free_a_ban_list(chptr->exceptlist);
+  free_a_ban_list(chptr->invexlist);
+  ban_index_free(&chptr->banindex);
+  ban_index_free(&chptr->exceptindex);
+  ban_index_free(&chptr->invexindex);
 
-  chptr->banlist = chptr->exceptlist = NULL;
+  chptr->banlist = chptr->exceptlist = chptr->invexlist = NULL;
   chptr->num_bed = 0;
+  chptr->ban_serial = ++ban_generation;
 }
 
 static void
@@ -3369,6 +3665,7 @@ int     m_names( struct Client *cptr,
   Link  *lp;
   struct Channel *ch2ptr = NULL;
   int   idx, flag = 0, len, mlen;
+  int   i;
   char  *s, *para = parc > 1 ? parv[1] : NULL;
   int comma_count=0;
   int char_count=0;
@@ -3446,8 +3743,9 @@ int     m_names( struct Client *cptr,
         *buf = '@';
       idx = len + 4;
       flag = 1;
-      for (lp = chptr->members; lp; lp = lp->next)
+      for (i = 0; i < chptr->memberc; i++)
         {
+          lp = chptr->memberv[i];
           c2ptr = lp->value.cptr;
           if (IsInvisible(c2ptr) && !IsMember(sptr,chptr))
             continue;
@@ -3634,6 +3932,7 @@ int     m_sjoin(struct Client *cptr,
   Link  *l;
   int   args = 0, haveops = 0, keep_our_modes = 1, keep_new_modes = 1;
   int   doesop = 0, what = 0, pargs = 0, fl, people = 0, isnew;
+  int   i;
   /* loop unrolled this is now redundant */
   /*  int ip; */
   char *s, *s0;
@@ -3725,8 +4024,8 @@ int     m_sjoin(struct Client *cptr,
 
   doesop = (parv[4+args][0] == '@' || parv[4+args][1] == '@');
 
-  for (l = chptr->members; l && l->value.cptr; l = l->next)
-    if (l->flags & MODE_CHANOP)
+  for (i = 0; i < chptr->memberc; i++)
+    if (chptr->memberv[i]->flags & MODE_CHANOP)
       {
         haveops++;
         break;
@@ -4011,8 +4310,9 @@ int     m_sjoin(struct Client *cptr,
   if (!keep_our_modes)
     {
       what = 0;
-      for (l = chptr->members; l && l->value.cptr; l = l->next)
+      for (i = 0; i < chptr->memberc; i++)
         {
+          l = chptr->memberv[i];
           if (l->flags & MODE_CHANOP)
             {
               if (what != -1)
@@ -4221,34 +4521,30 @@ void report_juped_channels(struct Client *sptr)
 {
   struct Channel * chptr;
   aQlineItem *qp;
-  int i, mj;
+  int mj;
 
   if (sptr->user == NULL)
     return;
 
-  for (i=0;i<CH_MAX;i++)
+  for (chptr = channel; chptr; chptr = chptr->nextch)
   {
-    for (chptr = (struct Channel *) (hash_get_channel_block(i).list);
-	 chptr != NULL; chptr = chptr->hnextch)
+    if (chptr->juped)
     {
-      if (chptr->juped)
+      mj = 0;
+      for (qp = q_conf; qp; qp = qp->next)
       {
-        mj = 0;
-        for (qp = q_conf; qp; qp = qp->next)
-        {
-          if (!qp->name || irccmp(qp->name, chptr->chname)) continue;
-          /* qp->name and aconf->name is set to the same variable. */
-          mj = 1;
-          break;
-        }
-	sendto_one(sptr, form_str(RPL_STATSQLINE),
-		   me.name,
-		   sptr->name,
-		   'q',
-		   chptr->chname,
-		   "","",
-		   mj ? "conf juped" : "oper juped");
+        if (!qp->name || irccmp(qp->name, chptr->chname)) continue;
+        /* qp->name and aconf->name is set to the same variable. */
+        mj = 1;
+        break;
       }
+      sendto_one(sptr, form_str(RPL_STATSQLINE),
+                 me.name,
+                 sptr->name,
+                 'q',
+                 chptr->chname,
+                 "","",
+                 mj ? "conf juped" : "oper juped");
     }
   }
 }
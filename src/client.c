@@ -34,6 +34,7 @@
 #include "irc_string.h"
 #include "ircd.h"
 #include "list.h"
+#include "m_list.h"
 #include "m_gline.h"
 #include "numeric.h"
 #include "res.h"
@@ -42,6 +43,7 @@
 #include "s_log.h"
 #include "s_misc.h"
 #include "s_serv.h"
+#include "s_timer.h"
 #include "send.h"
 #include "struct.h"
 #include "m_whowas.h"
@@ -77,6 +79,8 @@ static const char* const BH_FREE_ERROR_MESSAGE = \
 struct Client* dying_clients[MAXCONNECTIONS]; /* list of dying clients */
 char*          dying_clients_reason[MAXCONNECTIONS];
 
+static void client_timeout(void *);
+
 /*
  * init_client_heap - initialize client free memory
  */
@@ -127,6 +131,7 @@ struct Client* make_client(struct Client* from)
 
       cptr->from  = cptr; /* 'from' of local client is self! */
       cptr->since = cptr->lasttime = cptr->firsttime = CurrentTime;
+      timer_init(&cptr->timer, client_timeout, cptr);
 
 #ifdef NULL_POINTER_NOT_ZERO
 #ifdef FLUD
@@ -163,8 +168,7 @@ struct Client* make_client(struct Client* from)
    * zeroed up above =DUH= 
    * -Dianora 
    */
-  cptr->listprogress=0;
-  cptr->listprogress2=0;
+  cptr->listtask = NULL;
   cptr->next    = NULL;
   cptr->prev    = NULL;
   cptr->hnext   = NULL;
@@ -221,442 +225,551 @@ void _free_client(struct Client* cptr)
 }
 
 /*
- * I re-wrote check_pings a tad
- *
- * check_pings - go through the local client list and check activity
- * kill off stuff that should die
- *
- * inputs       - current time
- * output       - next time_t when check_pings() should be called again
- *
- * side effects - 
- *
- * Clients can be k-lined/d-lined/g-lined/r-lined and exit_client
- * called for each of these.
- *
- * A PING can be sent to clients as necessary.
- *
- * Client/Server ping outs are handled.
- *
- * -Dianora
+ * client_deadline - the next time client_timeout() will have something
+ * to do for cptr: a PING to send, a ping or registration timeout, an
+ * idle or reject hold limit running out
  */
+static time_t client_deadline(struct Client* cptr)
+{
+  time_t deadline;
+  int    ping;
 
-/* Note, that dying_clients and dying_clients_reason
- * really don't need to be any where near as long as MAXCONNECTIONS
- * but I made it this long for now. If its made shorter,
- * then a limit check is going to have to be added as well
- * -Dianora
+  if (cptr->flags & FLAGS_DEADSOCKET)
+    return CurrentTime;
+
+  ping = IsRegistered(cptr) ? get_client_ping(cptr) : CONNECTTIMEOUT;
+  if (cptr->flags & FLAGS_PINGSENT)
+    deadline = cptr->lasttime + 2 * ping;
+  else
+    deadline = cptr->lasttime + ping + 1;
+
+  if (IsUnknown(cptr) && cptr->firsttime &&
+      cptr->firsttime + UNKNOWN_TIME + 1 < deadline)
+    deadline = cptr->firsttime + UNKNOWN_TIME + 1;
+#ifdef REJECT_HOLD
+  if (IsRejectHeld(cptr) &&
+      cptr->firsttime + REJECT_HOLD_TIME + 1 < deadline)
+    deadline = cptr->firsttime + REJECT_HOLD_TIME + 1;
+#endif
+#ifdef IDLE_CHECK
+  if (IsPerson(cptr) && IDLETIME &&
+      cptr->user->last + IDLETIME + 1 < deadline)
+    deadline = cptr->user->last + IDLETIME + 1;
+#endif
+  return deadline;
+}
+
+/*
+ * set_client_timer - (re)schedule the timeout checks of a local client,
+ * called whenever something its deadline depends on has changed
  */
-time_t check_pings(time_t currenttime)
-{               
-  struct Client *cptr;          /* current local cptr being examined */
-  struct ConfItem     *aconf = (struct ConfItem *)NULL;
-  int           ping = 0;               /* ping time value from client */
-  int           i;                      /* used to index through fd/cptr's */
-  time_t        oldest = 0;             /* next ping time */
-  time_t        timeout;                /* found necessary ping time */
-  char          *reason;                /* pointer to reason string */
-  int           die_index=0;            /* index into list */
-  char          ping_time_out_buffer[64];   /* blech that should be a define */
-
-#if defined(IDLE_CHECK) && defined(SEND_FAKE_KILL_TO_CLIENT)
-  int           fakekill=0;
-#endif /* IDLE_CHECK && SEND_FAKE_KILL_TO_CLIENT */
-
-                                        /* of dying clients */
-  dying_clients[0] = (struct Client *)NULL;   /* mark first one empty */
+void set_client_timer(struct Client* cptr)
+{
+  assert(MyConnect(cptr));
+  timer_add(&cptr->timer, client_deadline(cptr));
+}
+
+/*
+ * client_timeout - timer handler of a local client
+ *
+ * A PING is sent to clients as necessary, client/server ping outs,
+ * registration timeouts, idle limits and dead sockets are handled.
+ * Only clients whose deadline has come up get here, the timer is set
+ * again for the next deadline if the client lives on.
+ */
+static void client_timeout(void* data)
+{
+  struct Client* cptr = (struct Client*) data;
+  time_t         deadline;
+  int            ping;
+  char           ping_time_out_buffer[64];
 
   /*
-   * I re-wrote the way klines are handled. Instead of rescanning
-   * the local[] array and calling exit_client() right away, I
-   * mark the client thats dying by placing a pointer to its struct Client
-   * into dying_clients[]. When I have examined all in local[],
-   * I then examine the dying_clients[] for struct Client's to exit.
-   * This saves the rescan on k-lines, also greatly simplifies the code,
-   *
-   * Jan 28, 1998
-   * -Dianora
-   */
+  ** Note: No need to notify opers here. It's
+  ** already done when "FLAGS_DEADSOCKET" is set.
+  */
+  if (cptr->flags & FLAGS_DEADSOCKET)
+    {
+      (void)exit_client(cptr, cptr, &me, (cptr->flags & FLAGS_SENDQEX) ?
+                        "SendQ exceeded" : "Dead socket");
+      return;
+    }
 
-   for (i = 0; i <= highest_fd; i++)
+#ifdef IDLE_CHECK
+  if (IsPerson(cptr))
+    {
+      if( !IsElined(cptr) &&
+          IDLETIME && 
+#ifdef OPER_IDLE
+          !IsAnOper(cptr) &&
+#endif /* OPER_IDLE */
+          !IsIdlelined(cptr) && 
+          ((CurrentTime - cptr->user->last) > IDLETIME))
+        {
+          struct ConfItem *tmpaconf;
+
+          tmpaconf = make_conf();
+          tmpaconf->status = CONF_KILL;
+          DupString(tmpaconf->host, cptr->host);
+          DupString(tmpaconf->passwd, "Idle time limit exceeded" );
+          DupString(tmpaconf->name, cptr->username);
+          tmpaconf->port = 0;
+          tmpaconf->hold = CurrentTime + 60;
+          add_temp_kline(tmpaconf);
+          sendto_realops("Idle time limit exceeded for %s - temp k-lining",
+                     get_client_name(cptr,FALSE));
+#ifdef SEND_FAKE_KILL_TO_CLIENT
+          sendto_prefix_one(cptr, cptr, ":%s KILL %s :(%s)", "AutoKILL",
+                            cptr->name, "Idle time limit exceeded");
+#endif
+          (void)exit_client(cptr, cptr, &me, "Idle time limit exceeded");
+          return;
+        }
+    }
+#endif
+
+#ifdef REJECT_HOLD
+  if (IsRejectHeld(cptr))
+    {
+      if( CurrentTime > (cptr->firsttime + REJECT_HOLD_TIME) )
+        {
+          if( reject_held_fds )
+            reject_held_fds--;
+
+          (void)exit_client(cptr, cptr, &me, "reject held client");
+          return;
+        }
+    }
+#endif
+
+  if (!IsRegistered(cptr))
+    ping = CONNECTTIMEOUT;
+  else
+    ping = get_client_ping(cptr);
+
+  if (ping < (CurrentTime - cptr->lasttime))
     {
-      if (!(cptr = local[i]) || IsMe(cptr))
-        continue;               /* and go examine next fd/cptr */
       /*
-      ** Note: No need to notify opers here. It's
-      ** already done when "FLAGS_DEADSOCKET" is set.
-      */
-      if (cptr->flags & FLAGS_DEADSOCKET)
+       * If the server hasnt talked to us in 2*ping seconds
+       * and it has a ping time, then close its connection.
+       */
+      if (((CurrentTime - cptr->lasttime) >= (2 * ping) &&
+           (cptr->flags & FLAGS_PINGSENT)))
+        {
+          if (IsServer(cptr) || IsConnecting(cptr) ||
+              IsHandshake(cptr))
+            {
+              sendto_ops("No response from %s, closing link",
+                         get_client_name(cptr, MASK_IP));
+            }
+          cptr->flags2 |= FLAGS2_PING_TIMEOUT;
+          (void)ircsprintf(ping_time_out_buffer,
+                           "Ping timeout: %d seconds",
+                           CurrentTime - cptr->lasttime);
+          (void)exit_client(cptr, cptr, &me, ping_time_out_buffer);
+          return;
+        }
+      else if ((cptr->flags & FLAGS_PINGSENT) == 0)
         {
-          /* N.B. EVERY single time dying_clients[] is set
-           * it must be followed by an immediate continue,
-           * to prevent this cptr from being marked again for exit.
-           * If you don't, you could cause exit_client() to be called twice
-           * for the same cptr. i.e. bad news
-           * -Dianora
+          /*
+           * if we havent PINGed the connection and we havent
+           * heard from it in a while, PING it to make sure
+           * it is still alive.
            */
+          cptr->flags |= FLAGS_PINGSENT;
+          /* not nice but does the job */
+          cptr->lasttime = CurrentTime - ping;
+          sendto_one(cptr, "PING :%s", me.name);
+        }
+    }
 
-          dying_clients[die_index] = cptr;
-          dying_clients_reason[die_index++] =
-            ((cptr->flags & FLAGS_SENDQEX) ?
-             "SendQ exceeded" : "Dead socket");
-          dying_clients[die_index] = (struct Client *)NULL;
-          continue;             /* and go examine next fd/cptr */
+  /*
+   * Check UNKNOWN connections - if they have been in this state
+   * for > UNKNOWN_TIME, close them.
+   */
+  if (IsUnknown(cptr))
+    {
+      if (cptr->firsttime ?
+          ((CurrentTime - cptr->firsttime) > UNKNOWN_TIME) : 0)
+        {
+          (void)exit_client(cptr, cptr, &me, "Connection Timed Out");
+          return;
         }
+    }
+
+  /*
+   * the sendto_one() above can have marked the socket dead, that is
+   * picked up on the next second
+   */
+  deadline = client_deadline(cptr);
+  if (deadline <= CurrentTime)
+    deadline = CurrentTime + 1;
+  timer_add(&cptr->timer, deadline);
+}
+
+/*
+ * A new K/D/G-line is tried on the local clients it could match, found
+ * through the /24 and domain tables in hash.c, from the main loop
+ * (check_klines()) so nobody is exited from under the command that
+ * added the line. A mask the tables can't narrow down, and a rehash,
+ * still mean looking at every local client, but that sweep is done
+ * KLINE_SWEEP_SLICE clients per pass of the main loop.
+ */
+struct NewBan {
+  struct NewBan* next;
+  unsigned long  ip;            /* host order, 0 for a host mask */
+  unsigned long  ip_mask;
+  int            dline;
+  char           host[HOSTLEN + 1];
+};
+
+static struct NewBan* new_bans;
+static int            new_ban_count;
+static int            sweep_fd = -1;   /* next fd to sweep, -1 if none */
+static int            sweep_klines;
+static int            sweep_dlines;
+static int            die_index;       /* entries in dying_clients[] */
+
+/* Note, that dying_clients and dying_clients_reason
+ * really don't need to be any where near as long as MAXCONNECTIONS
+ * but I made it this long for now. If its made shorter,
+ * then a limit check is going to have to be added as well
+ * -Dianora
+ */
+
+/*
+ * check_banned - mark cptr for exit if a D-line (dline) or a G/K-line
+ * now covers it
+ *
+ * inputs       - local client, which kind of line to look for
+ * output       - 1 if cptr was put on dying_clients[]
+ * side effects - opers are told, and so is cptr
+ *
+ * I re-wrote the way klines are handled. Instead of rescanning
+ * the local[] array and calling exit_client() right away, I
+ * mark the client thats dying by placing a pointer to its struct Client
+ * into dying_clients[]. When I have examined all in local[],
+ * I then examine the dying_clients[] for struct Client's to exit.
+ * This saves the rescan on k-lines, also greatly simplifies the code,
+ *
+ * Jan 28, 1998
+ * -Dianora
+ */
+static int check_banned(struct Client* cptr, int dline)
+{
+  struct ConfItem *aconf;
+  char            *reason;                /* pointer to reason string */
+
+  /* dead sockets are left to their timer */
+  if (cptr->flags & FLAGS_DEADSOCKET)
+    return 0;
+
+  if(dline)
+    {
+      if( (aconf = match_Dline(ntohl(cptr->ip.s_addr))) )
 
-      if (rehashed)
+          /* if there is a returned 
+           * struct ConfItem then kill it
+           */
         {
-          if(dline_in_progress)
+          if(IsConfElined(aconf))
             {
-              if( (aconf = match_Dline(ntohl(cptr->ip.s_addr))) )
-
-                  /* if there is a returned 
-                   * struct ConfItem then kill it
-                   */
-                {
-                  if(IsConfElined(aconf))
-                    {
-                      sendto_realops("D-line over-ruled for %s client is E-lined",
-                                 get_client_name(cptr,FALSE));
-                                 continue;
-                      continue;
-                    }
+              sendto_realops("D-line over-ruled for %s client is E-lined",
+                             get_client_name(cptr,FALSE));
+              return 0;
+            }
 
-                  sendto_realops("D-line active for %s",
-                                 get_client_name(cptr, FALSE));
+          sendto_realops("D-line active for %s",
+                         get_client_name(cptr, FALSE));
 
-                  dying_clients[die_index] = cptr;
+          dying_clients[die_index] = cptr;
 /* Wintrhawk */
 #if defined(KLINE_WITH_CONNECTION_CLOSED) && defined(KLINE_WITH_REASON)
-                  dying_clients_reason[die_index++] = "Connection closed";
-		  reason = aconf->passwd ? aconf->passwd :"D-lined";
+          dying_clients_reason[die_index++] = "Connection closed";
+          reason = aconf->passwd ? aconf->passwd :"D-lined";
 #else
 #ifdef KLINE_WITH_CONNECTION_CLOSED
-                  /*
-                   * Use a generic non-descript message here on 
-                   * purpose, so as to prevent other users seeing the
-                   * client disconnect, from harassing the IRCops.
-                   */
-                  reason = "Connection closed";
-		  dying_clients_reason[die_index++] = reason;
+          /*
+           * Use a generic non-descript message here on 
+           * purpose, so as to prevent other users seeing the
+           * client disconnect, from harassing the IRCops.
+           */
+          reason = "Connection closed";
+          dying_clients_reason[die_index++] = reason;
 #else
 #ifdef KLINE_WITH_REASON
-                  reason = aconf->passwd ? aconf->passwd : "D-lined";
-		  dying_clients_reason[die_index++] = reason;
+          reason = aconf->passwd ? aconf->passwd : "D-lined";
+          dying_clients_reason[die_index++] = reason;
 #else
-                  reason = "D-lined";
-		  dying_clients_reason[die_index++] = reason;
+          reason = "D-lined";
+          dying_clients_reason[die_index++] = reason;
 #endif /* KLINE_WITH_REASON */
 #endif /* KLINE_WITH_CONNECTION_CLOSED */
 #endif /* KLINE_WITH_CONNECTION_CLOSED && KLINE_WITH_REASON */
 
-                  dying_clients[die_index] = (struct Client *)NULL;
-                  if(IsPerson(cptr))
-                    {
-                      sendto_one(cptr, form_str(ERR_YOUREBANNEDCREEP),
-                                 me.name, cptr->name, reason);
-                    }
-#ifdef REPORT_DLINE_TO_USER
-                  else
-                    {
-                      sendto_one(cptr, "NOTICE DLINE :*** You have been D-lined");
-                    }
-#endif
-                  continue;         /* and go examine next fd/cptr */
-                }
+          dying_clients[die_index] = (struct Client *)NULL;
+          if(IsPerson(cptr))
+            {
+              sendto_one(cptr, form_str(ERR_YOUREBANNEDCREEP),
+                         me.name, cptr->name, reason);
             }
+#ifdef REPORT_DLINE_TO_USER
           else
             {
-              if(IsPerson(cptr))
-                {
+              sendto_one(cptr, "NOTICE DLINE :*** You have been D-lined");
+            }
+#endif
+          return 1;
+        }
+      return 0;
+    }
+
+  if(!IsPerson(cptr))
+    return 0;
+
 #ifdef GLINES
-                  if( (aconf = find_gkill(cptr,cptr->username)) )
-                    {
-                      sendto_realops("G-line active for %s",
-                                 get_client_name(cptr, FALSE));
+  if( (aconf = find_gkill(cptr,cptr->username)) )
+    {
+      sendto_realops("G-line active for %s",
+                     get_client_name(cptr, FALSE));
 
-                      dying_clients[die_index] = cptr;
+      dying_clients[die_index] = cptr;
 /* Wintrhawk */
 #if defined(KLINE_WITH_CONNECTION_CLOSED) && defined(KLINE_WITH_REASON)
-                     dying_clients_reason[die_index++] = "Connection closed";
-		     reason = "Connection closed";
+      dying_clients_reason[die_index++] = "Connection closed";
+      reason = "Connection closed";
 #else
 #ifdef KLINE_WITH_CONNECTION_CLOSED
-                      /*
-                       * We use a generic non-descript message here on 
-                       * purpose, so as to prevent other users seeing the
-                       * client, disconnect from harassing the IRCops.
-                       */
-                      reason = "Connection closed";
-		      dying_clients_reason[die_index++] = reason;
+      /*
+       * We use a generic non-descript message here on 
+       * purpose, so as to prevent other users seeing the
+       * client, disconnect from harassing the IRCops.
+       */
+      reason = "Connection closed";
+      dying_clients_reason[die_index++] = reason;
 #else
 #ifdef KLINE_WITH_REASON
-                      reason = aconf->passwd ? aconf->passwd : "G-lined";
-		      dying_clients_reason[die_index++] = reason;
+      reason = aconf->passwd ? aconf->passwd : "G-lined";
+      dying_clients_reason[die_index++] = reason;
 #else
-                      reason = "G-lined";
-		      dying_clients_reason[die_index++] = reason;
+      reason = "G-lined";
+      dying_clients_reason[die_index++] = reason;
 #endif /* KLINE_WITH_REASON */
 #endif /* KLINE_WITH_CONNECTION_CLOSED */
 #endif /* KLINE_WITH_CONNECTION_CLOSED && KLINE_WITH_REASON */
 
-                      dying_clients[die_index] = (struct Client *)NULL;
-                      sendto_one(cptr, form_str(ERR_YOUREBANNEDCREEP),
-                                 me.name, cptr->name, reason);
-
-                      continue;         /* and go examine next fd/cptr */
-                    }
-                  else
+      dying_clients[die_index] = (struct Client *)NULL;
+      sendto_one(cptr, form_str(ERR_YOUREBANNEDCREEP),
+                 me.name, cptr->name, reason);
+      return 1;
+    }
 #endif
-                  if((aconf = find_kill(cptr))) /* if there is a returned
-                                                   struct ConfItem.. then kill it */
-                    {
-                      if(aconf->status & CONF_ELINE)
-                        {
-                          sendto_realops("K-line over-ruled for %s client is E-lined",
-                                     get_client_name(cptr,FALSE));
-                                     continue;
-                        }
+  if((aconf = find_kill(cptr))) /* if there is a returned
+                                   struct ConfItem.. then kill it */
+    {
+      if(aconf->status & CONF_ELINE)
+        {
+          sendto_realops("K-line over-ruled for %s client is E-lined",
+                         get_client_name(cptr,FALSE));
+          return 0;
+        }
 
-                      sendto_realops("K-line active for %s",
-                                 get_client_name(cptr, FALSE));
-                      dying_clients[die_index] = cptr;
+      sendto_realops("K-line active for %s",
+                     get_client_name(cptr, FALSE));
+      dying_clients[die_index] = cptr;
 
 /* Wintrhawk */
 #if defined(KLINE_WITH_CONNECTION_CLOSED) && defined(KLINE_WITH_REASON)
-                      dying_clients_reason[die_index++] = "Connection closed";
-		      reason = aconf->passwd ? aconf->passwd :"D-lined";
+      dying_clients_reason[die_index++] = "Connection closed";
+      reason = aconf->passwd ? aconf->passwd :"D-lined";
 #else
 #ifdef KLINE_WITH_CONNECTION_CLOSED
-                      /*
-                       * We use a generic non-descript message here on 
-                       * purpose so as to prevent other users seeing the
-                       * client disconnect from harassing the IRCops
-                       */
-                      reason = "Connection closed";
-		      dying_clients_reason[die_index++] = reason;
+      /*
+       * We use a generic non-descript message here on 
+       * purpose so as to prevent other users seeing the
+       * client disconnect from harassing the IRCops
+       */
+      reason = "Connection closed";
+      dying_clients_reason[die_index++] = reason;
 #else
 #ifdef KLINE_WITH_REASON
-                      reason = aconf->passwd ? aconf->passwd : "K-lined";
-		      dying_clients_reason[die_index++] = reason;
+      reason = aconf->passwd ? aconf->passwd : "K-lined";
+      dying_clients_reason[die_index++] = reason;
 #else
-                      reason = "K-lined";
-		      dying_clients_reason[die_index++] = reason;
+      reason = "K-lined";
+      dying_clients_reason[die_index++] = reason;
 #endif /* KLINE_WITH_REASON */
 #endif /* KLINE_WITH_CONNECTION_CLOSED */
 #endif /* KLINE_WITH_CONNECTION_CLOSED && KLINE_WITH_REASON */
 
-                      dying_clients[die_index] = (struct Client *)NULL;
-                      sendto_one(cptr, form_str(ERR_YOUREBANNEDCREEP),
-                                 me.name, cptr->name, reason);
-                      continue;         /* and go examine next fd/cptr */
-                    }
-                }
-            }
-        }
+      dying_clients[die_index] = (struct Client *)NULL;
+      sendto_one(cptr, form_str(ERR_YOUREBANNEDCREEP),
+                 me.name, cptr->name, reason);
+      return 1;
+    }
+  return 0;
+}
 
-#ifdef IDLE_CHECK
-      if (IsPerson(cptr))
-        {
-          if( !IsElined(cptr) &&
-              IDLETIME && 
-#ifdef OPER_IDLE
-              !IsAnOper(cptr) &&
-#endif /* OPER_IDLE */
-              !IsIdlelined(cptr) && 
-              ((CurrentTime - cptr->user->last) > IDLETIME))
-            {
-              struct ConfItem *tmpaconf;
-
-              dying_clients[die_index] = cptr;
-              dying_clients_reason[die_index++] = "Idle time limit exceeded";
-#if defined(SEND_FAKE_KILL_TO_CLIENT) && defined(IDLE_CHECK)
-              fakekill = 1;
-#endif /* SEND_FAKE_KILL_TO_CLIENT && IDLE_CHECK */
-              dying_clients[die_index] = (struct Client *)NULL;
-
-              tmpaconf = make_conf();
-              tmpaconf->status = CONF_KILL;
-              DupString(tmpaconf->host, cptr->host);
-              DupString(tmpaconf->passwd, "Idle time limit exceeded" );
-              DupString(tmpaconf->name, cptr->username);
-              tmpaconf->port = 0;
-              tmpaconf->hold = CurrentTime + 60;
-              add_temp_kline(tmpaconf);
-              sendto_realops("Idle time limit exceeded for %s - temp k-lining",
-                         get_client_name(cptr,FALSE));
-              continue;         /* and go examine next fd/cptr */
-            }
-        }
-#endif
+/*
+ * exit_dying_clients - exit the clients check_banned() marked.
+ * it doesn't matter if local[] gets re-arranged now
+ */
+static void exit_dying_clients(void)
+{
+  struct Client* cptr;
+  int            i;
 
-#ifdef REJECT_HOLD
-      if (IsRejectHeld(cptr))
-        {
-          if( CurrentTime > (cptr->firsttime + REJECT_HOLD_TIME) )
-            {
-              if( reject_held_fds )
-                reject_held_fds--;
+  for(i = 0; (cptr = dying_clients[i]); i++)
+    (void)exit_client(cptr, cptr, &me, dying_clients_reason[i]);
+  die_index = 0;
+  dying_clients[0] = (struct Client *)NULL;
+}
 
-              dying_clients[die_index] = cptr;
-              dying_clients_reason[die_index++] = "reject held client";
-              dying_clients[die_index] = (struct Client *)NULL;
-              continue;         /* and go examine next fd/cptr */
-            }
-        }
-#endif
+static void start_sweep(int dline)
+{
+  if (dline)
+    sweep_dlines = YES;
+  else
+    sweep_klines = YES;
+  sweep_fd = 0;
+}
 
-      if (!IsRegistered(cptr))
-        ping = CONNECTTIMEOUT;
-      else
-        ping = get_client_ping(cptr);
+/*
+ * check_new_ban - a K/G-line (dline NO) or D-line (dline YES) was just
+ * added for host, or for ip/ip_mask (host order) if ip isn't 0. Have
+ * check_klines() try it on the clients it could match.
+ */
+void check_new_ban(const char* host, unsigned long ip,
+                   unsigned long ip_mask, int dline)
+{
+  struct NewBan* ban;
 
-      /*
-       * Ok, so goto's are ugly and can be avoided here but this code
-       * is already indented enough so I think its justified. -avalon
-       */
-       /*  if (!rflag &&
-               (ping >= currenttime - cptr->lasttime))
-              goto ping_timeout; */
+  if (ip ? ((ip_mask & 0xffff0000UL) != 0xffff0000UL) :
+      (dline || !mask_domain(host)))
+    {
+      start_sweep(dline);
+      return;
+    }
+  if (new_ban_count >= NEW_BAN_MAX)
+    {
+      /* a flood of lines, just look at everybody */
+      start_sweep(NO);
+      start_sweep(YES);
+      return;
+    }
 
-      /*
-       * *sigh* I think not -Dianora
-       */
+  ban = (struct NewBan*) MyMalloc(sizeof(struct NewBan));
+  ban->ip = ip & ip_mask;
+  ban->ip_mask = ip_mask;
+  ban->dline = dline;
+  strncpy_irc(ban->host, ip ? "" : host, HOSTLEN);
+  ban->next = new_bans;
+  new_bans = ban;
+  ++new_ban_count;
+}
+
+/*
+ * check_ip_ban - try ban on the clients in the /24s under its ip mask
+ */
+static void check_ip_ban(struct NewBan* ban)
+{
+  struct Client* cptr;
+  unsigned long  block;
+  unsigned long  addr;
+  int            i;
 
-      if (ping < (currenttime - cptr->lasttime))
+  for (i = 0; i < 256; ++i)
+    {
+      block = (ban->ip & 0xffff0000UL) | ((unsigned long) i << 8);
+      if ((block ^ ban->ip) & ban->ip_mask & 0xffffff00UL)
+        continue;
+      for (cptr = hash_find_ip_block(block); cptr; cptr = cptr->ipnext)
         {
+          addr = ntohl(cptr->ip.s_addr);
+          if ((addr & 0xffffff00UL) == block &&
+              (addr & ban->ip_mask) == ban->ip)
+            check_banned(cptr, ban->dline);
+        }
+    }
+}
 
-          /*
-           * If the server hasnt talked to us in 2*ping seconds
-           * and it has a ping time, then close its connection.
-           * If the client is a user and a KILL line was found
-           * to be active, close this connection too.
-           */
-          if (((currenttime - cptr->lasttime) >= (2 * ping) &&
-               (cptr->flags & FLAGS_PINGSENT)))
-            {
-              if (IsServer(cptr) || IsConnecting(cptr) ||
-                  IsHandshake(cptr))
-                {
-                  sendto_ops("No response from %s, closing link",
-                             get_client_name(cptr, MASK_IP));
-                }
-              /*
-               * this is used for KILL lines with time restrictions
-               * on them - send a messgae to the user being killed
-               * first.
-               * *** Moved up above  -taner ***
-               */
-              cptr->flags2 |= FLAGS2_PING_TIMEOUT;
-              dying_clients[die_index++] = cptr;
-              /* the reason is taken care of at exit time */
-      /*      dying_clients_reason[die_index++] = "Ping timeout"; */
-              dying_clients[die_index] = (struct Client *)NULL;
-              
-              /*
-               * need to start loop over because the close can
-               * affect the ordering of the local[] array.- avalon
-               *
-               ** Not if you do it right - Dianora
-               */
+/*
+ * check_host_ban - try ban on the clients in the domain of its mask
+ */
+static void check_host_ban(struct NewBan* ban)
+{
+  struct Client* cptr;
 
-              continue;
-            }
-          else if ((cptr->flags & FLAGS_PINGSENT) == 0)
-            {
-              /*
-               * if we havent PINGed the connection and we havent
-               * heard from it in a while, PING it to make sure
-               * it is still alive.
-               */
-              cptr->flags |= FLAGS_PINGSENT;
-              /* not nice but does the job */
-              cptr->lasttime = currenttime - ping;
-              sendto_one(cptr, "PING :%s", me.name);
-            }
-        }
-      /* ping_timeout: */
-      timeout = cptr->lasttime + ping;
-      while (timeout <= currenttime)
-        timeout += ping;
-      if (timeout < oldest || !oldest)
-        oldest = timeout;
+  for (cptr = hash_find_domain(mask_domain(ban->host)); cptr;
+       cptr = cptr->domnext)
+    if (match(ban->host, cptr->host))
+      check_banned(cptr, ban->dline);
+}
 
-      /*
-       * Check UNKNOWN connections - if they have been in this state
-       * for > UNKNOWN_TIME, close them.
-       */
+/*
+ * check_klines - kill off the local clients caught by K/D/G-lines
+ * added since the last call, then go on with a sweep of local[] for a
+ * rehash or for a line that check_new_ban() couldn't narrow down.
+ * Called once per pass of the main loop; a sweep looks at no more
+ * than KLINE_SWEEP_SLICE clients each time.
+ *
+ * inputs       - none
+ * output       - none
+ * side effects - Clients can be k-lined/d-lined/g-lined and exit_client
+ *                called for each of these.
+ *
+ * Pings, timeouts and dead sockets are no longer handled here, each
+ * local client has a timer for those (client_timeout()).
+ *
+ * -Dianora
+ */
+void check_klines(void)
+{               
+  struct Client *cptr;          /* current local cptr being examined */
+  struct NewBan *ban;
+  int           n;
 
-      if (IsUnknown(cptr))
-        {
-          if (cptr->firsttime ?
-	      ((CurrentTime - cptr->firsttime) > UNKNOWN_TIME) : 0)
-            {
-              dying_clients[die_index] = cptr;
-              dying_clients_reason[die_index++] = "Connection Timed Out";
-              dying_clients[die_index] = (struct Client *)NULL;
-              continue;
-            }
-        }
+  if (rehashed)
+    {
+      start_sweep(dline_in_progress);
+      rehashed = 0;
+      dline_in_progress = 0;
     }
 
-  /* Now exit clients marked for exit above.
-   * it doesn't matter if local[] gets re-arranged now
-   *
-   * -Dianora
-   */
-
-  for(die_index = 0; (cptr = dying_clients[die_index]); die_index++)
+  while ((ban = new_bans))
     {
-      if(cptr->flags2 & FLAGS2_PING_TIMEOUT)
-        {
-          (void)ircsprintf(ping_time_out_buffer,
-                            "Ping timeout: %d seconds",
-                            currenttime - cptr->lasttime);
-
-          /* ugh. this is horrible.
-           * but I can get away with this hack because of the
-           * block allocator, and right now,I want to find out
-           * just exactly why occasional already bit cleared errors
-           * are still happening
-           */
-          if(cptr->flags2 & FLAGS2_ALREADY_EXITED)
-            {
-              sendto_realops("Client already exited doing ping timeout %X",cptr);
-            }
-          else
-            (void)exit_client(cptr, cptr, &me, ping_time_out_buffer );
-          cptr->flags2 |= FLAGS2_ALREADY_EXITED;
-        }
+      new_bans = ban->next;
+      if (ban->host[0])
+        check_host_ban(ban);
       else
-#if defined(SEND_FAKE_KILL_TO_CLIENT) && defined(IDLE_CHECK)
-        {
-	  char *killer;
-	  char *p;
-
-	  killer = "AutoKILL";
-          if (fakekill)
-            sendto_prefix_one(cptr, cptr, ":%s KILL %s :(%s)", killer,
-            cptr->name, dying_clients_reason[die_index]);
-	  (void)exit_client(cptr, cptr, &me, dying_clients_reason[die_index]);
-        }
-#else 
-      {
-	(void)exit_client(cptr, cptr, &me, dying_clients_reason[die_index]);
-      }
+        check_ip_ban(ban);
+      MyFree(ban);
+      exit_dying_clients();     /* before the next line finds them again */
+    }
+  new_ban_count = 0;
 
-#endif /* SEND_FAKE_KILL_TO_CLIENT && IDLE_CHECK */
+  if (sweep_fd < 0)
+    return;
+
+  for (n = 0; n < KLINE_SWEEP_SLICE && sweep_fd <= highest_fd; ++sweep_fd)
+    {
+      if (!(cptr = local[sweep_fd]) || IsMe(cptr))
+        continue;               /* and go examine next fd/cptr */
+      ++n;
+      if (sweep_dlines && check_banned(cptr, YES))
+        continue;
+      if (sweep_klines)
+        check_banned(cptr, NO);
     }
 
-  rehashed = 0;
-  dline_in_progress = 0;
+  if (sweep_fd > highest_fd)
+    {
+      sweep_fd = -1;
+      sweep_klines = NO;
+      sweep_dlines = NO;
+    }
 
-  if (!oldest || oldest < currenttime)
-    oldest = currenttime + PINGFREQUENCY;
-  Debug((DEBUG_NOTICE, "Next check_ping() call at: %s, %d %d %d",
-         myctime(oldest), ping, oldest, currenttime));
-  
-  return (oldest);
+  exit_dying_clients();
 }
 
 
@@ -736,6 +849,8 @@ void remove_client_from_list(struct Client* cptr)
       return;
     }
 
+  burst_del_client(cptr);
+  list_cancel(cptr);
   if (cptr->prev)
     cptr->prev->next = cptr->next;
   else
@@ -763,10 +878,14 @@ void remove_client_from_list(struct Client* cptr)
  */
 void add_client_to_list(struct Client *cptr)
 {
+  static unsigned long serial;
+
   /*
    * since we always insert new clients to the top of the list,
    * this should mean the "me" is the bottom most item in the list.
+   * The serial keeps that order, see burst_run().
    */
+  cptr->serial = ++serial;
   cptr->next = GlobalClientList;
   GlobalClientList = cptr;
   if (cptr->next)
@@ -774,6 +893,24 @@ void add_client_to_list(struct Client *cptr)
   return;
 }
 
+/*
+ * relink_client - move a local client that has just registered to the
+ * top of the list, as if it had only now been added, so the list stays
+ * in the order clients were introduced to the other servers
+ */
+void relink_client(struct Client *cptr)
+{
+  assert(cptr != &me);
+  burst_del_client(cptr);
+  if (cptr->prev)
+    cptr->prev->next = cptr->next;
+  else
+    GlobalClientList = cptr->next;
+  cptr->next->prev = cptr->prev;
+  cptr->prev = NULL;
+  add_client_to_list(cptr);
+}
+
 /* Functions taken from +CSr31, paranoified to check that the client
 ** isn't on a llist already when adding, and is there when removing -orabidoo
 */
@@ -1176,6 +1313,7 @@ static void exit_one_client(struct Client *cptr, struct Client *sptr, struct Cli
     {
       del_client_from_llist(&(sptr->servptr->serv->users), sptr);
       sptr->servptr->serv->usercnt--;
+      del_from_user_domain_table(sptr);
     }
   /* there are clients w/o a servptr: unregistered ones */
 
@@ -1328,6 +1466,36 @@ static void recurse_remove_clients(struct Client* sptr, const char* comment)
     }
 }
 
+/*
+ * collect_split_users - gather the users behind server into split_users,
+ * marking them FLAGS_SPLIT
+ */
+static struct Client** split_users = NULL;
+static int             split_users_size = 0;
+
+static int collect_split_users(struct Client* server, int count)
+{
+  struct Client* acptr;
+
+  for (acptr = server->serv->users; acptr; acptr = acptr->lnext)
+    {
+      if (!acptr->user)
+        continue;
+      if (count == split_users_size)
+        {
+          split_users_size = split_users_size ? split_users_size * 2 : 1024;
+          split_users = (struct Client**) MyRealloc(split_users,
+                              split_users_size * sizeof(struct Client*));
+        }
+      acptr->flags |= FLAGS_SPLIT;
+      split_users[count++] = acptr;
+    }
+  for (acptr = server->serv->servers; acptr; acptr = acptr->lnext)
+    if (acptr->serv)
+      count = collect_split_users(acptr, count);
+  return count;
+}
+
 /*
 ** Remove *everything* that depends on sptr, from all lists, and sending
 ** all necessary QUITs and SQUITs.  sptr itself is still on the lists,
@@ -1373,6 +1541,12 @@ static void remove_dependents(struct Client* cptr,
       recurse_send_quits(cptr, sptr, to, comment1, myname);
     }
 
+  /*
+   * take the users off their channels all at once, so each of them
+   * only has its hashes and lists left to leave
+   */
+  if (sptr->serv)
+    remove_split_users(split_users, collect_split_users(sptr, 0), comment1);
   recurse_remove_clients(sptr, comment1);
 }
 
@@ -1673,21 +1847,25 @@ const char* comment        /* Reason for the exit */
  * Count up local client memory
  */
 void count_local_client_memory(int *local_client_memory_used,
-                               int *local_client_memory_allocated )
+                               int *local_client_memory_allocated,
+                               int *local_client_memory_fragmented)
 {
   BlockHeapCountMemory( localClientFreeList,
                         local_client_memory_used,
-                        local_client_memory_allocated);
+                        local_client_memory_allocated,
+                        local_client_memory_fragmented);
 }
 
 /*
  * Count up remote client memory
  */
 void count_remote_client_memory(int *remote_client_memory_used,
-                               int *remote_client_memory_allocated )
+                               int *remote_client_memory_allocated,
+                               int *remote_client_memory_fragmented)
 {
   BlockHeapCountMemory( remoteClientFreeList,
                         remote_client_memory_used,
-                        remote_client_memory_allocated);
+                        remote_client_memory_allocated,
+                        remote_client_memory_fragmented);
 }
 
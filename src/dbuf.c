@@ -29,6 +29,7 @@
 #include "ircd_defs.h"
 
 #include <assert.h>
+#include <stddef.h>
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
@@ -53,19 +54,55 @@ struct DBufBuffer {
   struct DBufBuffer* next;             /* Next data buffer, NULL if last */
   char*              start;            /* data starts here */
   char*              end;              /* data ends here */ 
+  struct DBufBlock*  block;            /* shared block, NULL if private */
   char               data[DBUF_SIZE];  /* Actual data stored here */
 };
 
+/*
+ * A shared block holds one message queued on many sendQs. The sendQs
+ * don't copy it, they each get a reference node pointing into it, and
+ * the block goes away when the last of them has sent it. Reference
+ * nodes are a struct DBufBuffer without the data array.
+ */
+struct DBufBlock {
+  int                refcount;         /* sendQs + creator holding it */
+  size_t             length;           /* message length */
+  char               data[1];          /* message, length bytes */
+};
+
+#define DBUF_REF_SIZE offsetof(struct DBufBuffer, data)
+
 int                       DBufUsedCount = 0;
 int                       DBufCount = 0;
 static struct DBufBuffer* dbufFreeList = NULL;
 
+static int                dbufRefCount = 0;
+static int                dbufRefUsedCount = 0;
+static struct DBufBuffer* dbufRefFreeList = NULL;
+static int                dbufBlockCount = 0;
+static size_t             dbufBlockMemory = 0;
+
 void count_dbuf_memory(size_t* allocated, size_t* used)
 {
   assert(allocated != NULL);
   assert(used != NULL);
-  *allocated = DBufCount     * sizeof(struct DBufBuffer);
-  *used      = DBufUsedCount * sizeof(struct DBufBuffer);
+  *allocated = DBufCount     * sizeof(struct DBufBuffer) +
+               dbufRefCount  * DBUF_REF_SIZE + dbufBlockMemory;
+  *used      = DBufUsedCount * sizeof(struct DBufBuffer) +
+               dbufRefUsedCount * DBUF_REF_SIZE + dbufBlockMemory;
+}
+
+/*
+ * count_dbuf_shared - shared blocks and references to them, these are
+ * already included in count_dbuf_memory()
+ */
+void count_dbuf_shared(int* blocks, size_t* block_memory,
+                       int* refs, size_t* ref_memory)
+{
+  *blocks       = dbufBlockCount;
+  *block_memory = dbufBlockMemory;
+  *refs         = dbufRefUsedCount;
+  *ref_memory   = dbufRefUsedCount * DBUF_REF_SIZE;
 }
 
 /* 
@@ -124,16 +161,51 @@ static struct DBufBuffer* dbuf_alloc(void)
   ++DBufUsedCount;
 
   db->next  = 0;
+  db->block = 0;
   db->start = db->end = db->data;
   return db;
 }
 
+/*
+ * dbuf_ref_alloc - allocate a reference node for a shared block
+ */
+static struct DBufBuffer* dbuf_ref_alloc(struct DBufBlock* block)
+{
+  struct DBufBuffer* db = dbufRefFreeList;
+
+  if (db)
+    dbufRefFreeList = dbufRefFreeList->next;
+  else
+  {
+    db = (struct DBufBuffer*) MyMalloc(DBUF_REF_SIZE);
+    assert(db != NULL);
+    ++dbufRefCount;
+  }
+  ++dbufRefUsedCount;
+  ++block->refcount;
+
+  db->next  = 0;
+  db->block = block;
+  db->start = block->data;
+  db->end   = block->data + block->length;
+  return db;
+}
+
 /*
  * dbuf_free - return a struct DBufBuffer structure to the dbufFreeList
  */
 static void dbuf_free(struct DBufBuffer* ptr)
 {
   assert(ptr != NULL);
+
+  if (ptr->block)
+  {
+    dbuf_block_release(ptr->block);
+    ptr->next = dbufRefFreeList;
+    dbufRefFreeList = ptr;
+    --dbufRefUsedCount;
+    return;
+  }
   assert(DBufUsedCount > 0);
 
   if (DBufUsedCount > DBUF_USUAL_MAX_COUNT)
@@ -203,7 +275,10 @@ int dbuf_put(struct DBuf* dyn, const char* buf, size_t length)
       dyn->tail = d;
       *h        = d;        /* prev->next = d */
     }
-    chunk = (d->data + DBUF_SIZE) - d->end;
+    /*
+     * shared blocks are never written to
+     */
+    chunk = d->block ? 0 : (d->data + DBUF_SIZE) - d->end;
     if (chunk != 0)
     {
       if (chunk > length)
@@ -220,6 +295,76 @@ int dbuf_put(struct DBuf* dyn, const char* buf, size_t length)
 }
 
 
+/*
+ * dbuf_block_make - copy a message into a new shared block, the caller
+ * holds the first reference and drops it with dbuf_block_release()
+ */
+struct DBufBlock* dbuf_block_make(const char* buf, size_t length)
+{
+  struct DBufBlock* block;
+  size_t            size = offsetof(struct DBufBlock, data) + length;
+
+  assert(buf != NULL);
+
+  block = (struct DBufBlock*) MyMalloc(size);
+  assert(block != NULL);
+
+  block->refcount = 1;
+  block->length   = length;
+  memcpy(block->data, buf, length);
+
+  ++dbufBlockCount;
+  dbufBlockMemory += size;
+  return block;
+}
+
+/*
+ * dbuf_block_release - drop a reference, free the block with the last one
+ */
+void dbuf_block_release(struct DBufBlock* block)
+{
+  assert(block != NULL);
+  assert(block->refcount > 0);
+
+  if (0 == --block->refcount)
+  {
+    --dbufBlockCount;
+    dbufBlockMemory -= offsetof(struct DBufBlock, data) + block->length;
+    MyFree(block);
+  }
+}
+
+/*
+ * dbuf_put_block - queue a shared block. A message shorter than a
+ * reference node that still fits in the last buffer is cheaper to copy.
+ */
+int dbuf_put_block(struct DBuf* dyn, struct DBufBlock* block)
+{
+  struct DBufBuffer* d;
+
+  assert(dyn != NULL);
+  assert(block != NULL);
+
+  if (0 == block->length)
+    return 1;
+
+  if (block->length <= DBUF_REF_SIZE && dyn->length && !dyn->tail->block &&
+      (size_t) ((dyn->tail->data + DBUF_SIZE) - dyn->tail->end) >= block->length)
+    return dbuf_put(dyn, block->data, block->length);
+
+  if (0 == (d = dbuf_ref_alloc(block)))
+    return dbuf_malloc_error(dyn);
+
+  if (0 == dyn->length)
+    dyn->head = d;
+  else
+    dyn->tail->next = d;
+  dyn->tail    = d;
+  dyn->length += block->length;
+  return 1;
+}
+
+
 const char* dbuf_map(const struct DBuf* dyn, size_t* length)
 {
   assert(dyn != NULL);
@@ -236,6 +381,32 @@ const char* dbuf_map(const struct DBuf* dyn, size_t* length)
 }
 
 
+int dbuf_map_iov(const struct DBuf* dyn, struct iovec* iov, int max,
+                 size_t* length)
+{
+  struct DBufBuffer* db;
+  int                count = 0;
+
+  assert(dyn != NULL);
+  assert(iov != NULL);
+
+  *length = 0;
+  if (0 == dyn->length)
+    return 0;
+
+  for (db = dyn->head; db && count < max; db = db->next)
+  {
+    if (db->start == db->end)
+      continue;
+    iov[count].iov_base = db->start;
+    iov[count].iov_len  = db->end - db->start;
+    *length += iov[count].iov_len;
+    ++count;
+  }
+  return count;
+}
+
+
 void dbuf_delete(struct DBuf* dyn, size_t length)
 {
   struct DBufBuffer* db;
@@ -30,18 +30,28 @@ typedef struct ip_subtree
   struct ip_subtree *right;
 } IP_SUBTREE;
 
-/* the D/d-line structure */
-struct ip_subtree *Dline[256];   
-/* the ip K-line structure, tracks E/I/K */
-struct ip_subtree *ip_Kline[256];   
+struct DlineConf
+{
+  /* the D/d-line structure */
+  struct ip_subtree *Dline[256];
+  /* the ip K-line structure, tracks E/I/K */
+  struct ip_subtree *ip_Kline[256];
+
+  /* the oracle thingy */
+  unsigned long oracle[256];
+  /* the oracle thingy */
+  unsigned long ike_oracle[256];
 
-/* the oracle thingy */
-unsigned long oracle[256];
-/* the oracle thingy */
-unsigned long ike_oracle[256];
+  /* leftover D/d-lines */
+  aConfItem *leftover;
+};
 
-/* leftover D/d-lines */
-aConfItem *leftover = NULL;
+/*
+ * the tables in use; a rehash builds a new set with new_dline_conf()
+ * and swaps it in with use_dline_conf()
+ */
+static struct DlineConf boot_dlines;
+static struct DlineConf *dlines = &boot_dlines;
 
 /* defined in mtrie_conf.c */
 extern char *show_iline_prefix(aClient *,aConfItem *,char *);
@@ -66,8 +76,8 @@ aConfItem *trim_Dlines(aConfItem *);
 aConfItem *trim_ip_Klines(aConfItem *, int);
 aConfItem *trim_ip_Elines(aConfItem *, int);
 struct ip_subtree *destroy_ip_subtree(struct ip_subtree *);
-aConfItem *find_exception(unsigned long);
-aConfItem *rescan_dlines(aConfItem *);
+aConfItem *find_exception(struct DlineConf *, unsigned long);
+aConfItem *rescan_dlines(struct DlineConf *, aConfItem *);
 
 
 
@@ -312,9 +322,9 @@ struct ip_subtree *destroy_ip_subtree(struct ip_subtree *head)
  * find_exception - match an IP against all unplaced d-line exceptions 
  * -good
  */
-aConfItem *find_exception(unsigned long ip)
+aConfItem *find_exception(struct DlineConf *dc, unsigned long ip)
 {
-  aConfItem *scan=leftover;
+  aConfItem *scan=dc->leftover;
   
   while (scan)
     {
@@ -327,12 +337,12 @@ aConfItem *find_exception(unsigned long ip)
 
 
 /*
- * add_dline - add's a d-line to the conf list of the parent D-line
+ * add_dline_to - add's a d-line to the conf list of the parent D-line
  * if no parent D-line can be found, the d-line is added to the list
- * of unplaced d-lines, and is rescanned later by add_Dline.
+ * of unplaced d-lines, and is rescanned later by add_Dline_to.
  * -good
  */
-void add_dline(aConfItem *conf_ptr)
+void add_dline_to(struct DlineConf *dc, aConfItem *conf_ptr)
 {
   unsigned long host_ip;
   unsigned long host_mask;
@@ -345,11 +355,11 @@ void add_dline(aConfItem *conf_ptr)
   conf_ptr->flags = CONF_FLAGS_E_LINED;
 
   /* find the parent D-line for this exception */
-  node=find_ip_subtree(Dline[host_ip>>24], host_ip);
+  node=find_ip_subtree(dc->Dline[host_ip>>24], host_ip);
   if (!node)
     {   /* no parent found, so add this to the leftovers list */
-      conf_ptr->next = leftover;
-      leftover=conf_ptr;
+      conf_ptr->next = dc->leftover;
+      dc->leftover=conf_ptr;
       return;
     }
   
@@ -367,16 +377,16 @@ void add_dline(aConfItem *conf_ptr)
  * rescan_dlines - attempts to add unplaced dlines to the tree 
  * -good
  */
-aConfItem *rescan_dlines(aConfItem *s)
+aConfItem *rescan_dlines(struct DlineConf *dc, aConfItem *s)
 {
   aConfItem *temp;
   if (!s) return NULL;
-  s->next=rescan_dlines(s->next);
-  if (find_ip_subtree(Dline[s->ip>>24],s->ip))
+  s->next=rescan_dlines(dc, s->next);
+  if (find_ip_subtree(dc->Dline[s->ip>>24],s->ip))
     { /* parent found! */
       temp=s->next;
       s->next=NULL;
-      add_dline(s);
+      add_dline_to(dc, s);
       return temp;
     }
   return s;
@@ -384,7 +394,7 @@ aConfItem *rescan_dlines(aConfItem *s)
 
 
 /*
- * add_Dline  - adds a D-line for ip & mask to the Dline[] table.
+ * add_Dline_to  - adds a D-line for ip & mask to the Dline[] table.
  * Will not add D-lines that are less broad than an existing D-line,
  * or that are covered by an unplaced d-line.
  * Less broad D-lines covered by the new D-line are removed from the
@@ -392,7 +402,7 @@ aConfItem *rescan_dlines(aConfItem *s)
  * add_Dline also updates the oracle[] value for the appropriate tree.
  * -good
  */
-void add_Dline(aConfItem *conf_ptr)
+void add_Dline_to(struct DlineConf *dc, aConfItem *conf_ptr)
 {
   unsigned long host_ip;
   unsigned long host_mask;
@@ -410,21 +420,21 @@ void add_Dline(aConfItem *conf_ptr)
 
   /* resolve ambiguities, duplicates, etc. */
 
-  node=find_ip_subtree(Dline[host_ip>>24], host_ip);
+  node=find_ip_subtree(dc->Dline[host_ip>>24], host_ip);
   if ((node) && (node->ip_mask <= host_mask)) /* found a broader Dline, dont add this one */
     return;
   /* check if this Dline is covered by an exception */
-  if(find_exception(host_ip))  /* it is!  throw it away! */
+  if(find_exception(dc, host_ip))  /* it is!  throw it away! */
      return;
 
   /* update the oracle's bitmask */
-  oracle[host_ip>>24] |= ((0xffffffff-host_mask)+host_ip);
+  dc->oracle[host_ip>>24] |= ((0xffffffff-host_mask)+host_ip);
 
   /* all good so far, now remove any ambiguities
    * and collect their conf lists
    */
-  Dline[host_ip>>24]=
-    delete_ip_subtree(Dline[host_ip>>24], host_ip, host_mask, &clist);
+  dc->Dline[host_ip>>24]=
+    delete_ip_subtree(dc->Dline[host_ip>>24], host_ip, host_mask, &clist);
   
   /* remove any D's in the list */
   clist=trim_Dlines(clist);
@@ -436,10 +446,20 @@ void add_Dline(aConfItem *conf_ptr)
 
   /* create a new node and insert it into the tree */
   node=new_ip_subtree(host_ip, host_mask, clist, NULL, NULL);
-  Dline[host_ip>>24]=insert_ip_subtree(Dline[host_ip>>24], node);
+  dc->Dline[host_ip>>24]=insert_ip_subtree(dc->Dline[host_ip>>24], node);
 
   /* last of all, rescan unplaced d-lines list in case any are now placeable */
-  leftover=rescan_dlines(leftover);
+  dc->leftover=rescan_dlines(dc, dc->leftover);
+}
+
+void add_dline(aConfItem *conf_ptr)
+{
+  add_dline_to(dlines, conf_ptr);
+}
+
+void add_Dline(aConfItem *conf_ptr)
+{
+  add_Dline_to(dlines, conf_ptr);
 }
 
 
@@ -454,14 +474,14 @@ aConfItem *match_Dline(unsigned long ip)
   aConfItem *scan;
   int head=ip>>24;
   
-  if ((oracle[head] & ip) != ip)    /* oracle query failed.. IP is definitely not in */
+  if ((dlines->oracle[head] & ip) != ip)    /* oracle query failed.. IP is definitely not in */
     return NULL;                    /*   this tree.  Don't even bother looking */
 
   /* check the top level */
   /* if (Dline[head]==NULL) return NULL; <--- oracle check should cover this */  /* no match */
   
   /* check the ip_subtree */
-  node=find_ip_subtree(Dline[head], ip);
+  node=find_ip_subtree(dlines->Dline[head], ip);
   if (!node) return NULL;   /* no match */
   
   /* scan for exceptions */
@@ -489,10 +509,10 @@ aConfItem *match_Dline(unsigned long ip)
 }
 
 /*
- * add_ip_Kline  - modified form of add_Dline
+ * add_ip_Kline_to  - modified form of add_Dline_to
  * -good
  */
-void add_ip_Kline(aConfItem *conf_ptr)
+void add_ip_Kline_to(struct DlineConf *dc, aConfItem *conf_ptr)
 {
   unsigned long host_ip;
   unsigned long host_mask;
@@ -512,17 +532,17 @@ void add_ip_Kline(aConfItem *conf_ptr)
   /* resolve ambiguities, duplicates, etc. */
 
   /* check for existing ip/mask */
-  node=find_ip_subtree(ip_Kline[host_ip>>24], host_ip);
+  node=find_ip_subtree(dc->ip_Kline[host_ip>>24], host_ip);
 
   if (!node)
     { /* none exist, gather up the lesser ones and add a new node */
       /* update oracle */
-      ike_oracle[host_ip>>24] |= ((0xffffffff-host_mask)+host_ip);
+      dc->ike_oracle[host_ip>>24] |= ((0xffffffff-host_mask)+host_ip);
 
       /* now collect nodes with more specific ip masks */
       /* #if 0 */
-      ip_Kline[host_ip>>24]=
-        delete_ip_subtree(ip_Kline[host_ip>>24], host_ip, host_mask, &clist);
+      dc->ip_Kline[host_ip>>24]=
+        delete_ip_subtree(dc->ip_Kline[host_ip>>24], host_ip, host_mask, &clist);
       /* #endif */
 
       /* if this is a *@ Kline, then we can toast all the other Klines in the clist */
@@ -534,7 +554,7 @@ void add_ip_Kline(aConfItem *conf_ptr)
  
       /* create a new node and insert it into the tree */
       node=new_ip_subtree(host_ip, host_mask, clist, NULL, NULL);
-      ip_Kline[host_ip>>24]=insert_ip_subtree(ip_Kline[host_ip>>24], node);
+      dc->ip_Kline[host_ip>>24]=insert_ip_subtree(dc->ip_Kline[host_ip>>24], node);
       return;  /* done */
     }
   
@@ -549,7 +569,7 @@ void add_ip_Kline(aConfItem *conf_ptr)
   if (scan) return; /* don't bother adding */
 
   /* update oracle */
-  ike_oracle[host_ip>>24] |= ((0xffffffff-host_mask)+host_ip);
+  dc->ike_oracle[host_ip>>24] |= ((0xffffffff-host_mask)+host_ip);
 
   if (strcmp(conf_ptr->user,"*")) 
     {  /* not adding a *@ Kline, just slap it in */
@@ -566,6 +586,10 @@ void add_ip_Kline(aConfItem *conf_ptr)
   return; /* done, whew */
 }
 
+void add_ip_Kline(aConfItem *conf_ptr)
+{
+  add_ip_Kline_to(dlines, conf_ptr);
+}
 
 
 /*
@@ -586,17 +610,17 @@ void add_ip_Eline(aConfItem *conf_ptr)
   /* resolve ambiguities, duplicates, etc. */
 
   /* check for existing ip/mask */
-  node=find_ip_subtree(ip_Kline[host_ip>>24], host_ip);
+  node=find_ip_subtree(dlines->ip_Kline[host_ip>>24], host_ip);
 
   if (!node)
     { /* none exist, gather up the lesser ones and add a new node */
       /* update oracle */
-      ike_oracle[host_ip>>24] |= ((0xffffffff-host_mask)+host_ip);
+      dlines->ike_oracle[host_ip>>24] |= ((0xffffffff-host_mask)+host_ip);
 
       /* now collect nodes with more specific ip masks */
 
-      ip_Kline[host_ip>>24]=
-        delete_ip_subtree(ip_Kline[host_ip>>24], host_ip, host_mask, &clist);
+      dlines->ip_Kline[host_ip>>24]=
+        delete_ip_subtree(dlines->ip_Kline[host_ip>>24], host_ip, host_mask, &clist);
 
       /* if this is a *@ Eline, then we can toast all the others in the clist */
       if (!(strcmp(conf_ptr->user,"*"))) 
@@ -607,7 +631,7 @@ void add_ip_Eline(aConfItem *conf_ptr)
  
       /* create a new node and insert it into the tree */
       node=new_ip_subtree(host_ip, host_mask, clist, NULL, NULL);
-      ip_Kline[host_ip>>24]=insert_ip_subtree(ip_Kline[host_ip>>24], node);
+      dlines->ip_Kline[host_ip>>24]=insert_ip_subtree(dlines->ip_Kline[host_ip>>24], node);
       return;  /* done */
     }
   
@@ -622,7 +646,7 @@ void add_ip_Eline(aConfItem *conf_ptr)
   if (scan) return; /* don't bother adding */
 
   /* update oracle */
-  ike_oracle[host_ip>>24] |= ((0xffffffff-host_mask)+host_ip);
+  dlines->ike_oracle[host_ip>>24] |= ((0xffffffff-host_mask)+host_ip);
 
   if (strcmp(conf_ptr->user,"*")) 
     {  /* not adding a *@ Eline, just slap it in */
@@ -706,7 +730,7 @@ aConfItem* match_ip_Kline(unsigned long ip, const char* name)
   int                head = ip >> 24;
   aConfItem*         winner;
   char               winnertype;
-  if ((ike_oracle[head] & ip) != ip) 
+  if ((dlines->ike_oracle[head] & ip) != ip) 
    /* 
     * oracle query failed.. IP is definitely not in
     *   this tree.  Don't even bother looking 
@@ -714,10 +738,10 @@ aConfItem* match_ip_Kline(unsigned long ip, const char* name)
     return NULL;
 
   /* check the top level */
-  if (ip_Kline[head]==NULL) return NULL;
+  if (dlines->ip_Kline[head]==NULL) return NULL;
   
   /* check the ip_subtree */
-  node=find_ip_subtree(ip_Kline[head], ip);
+  node=find_ip_subtree(dlines->ip_Kline[head], ip);
   if (!node) return NULL;   /* no match */
   
   if(!name)
@@ -762,35 +786,31 @@ aConfItem* match_ip_Kline(unsigned long ip, const char* name)
 /* clears the D/d-line table, as well as E/I/K table */
 void clear_Dline_table()
 {
-  memset((void *)oracle, 0, sizeof(oracle));
-  memset((void *)ike_oracle, 0, sizeof(oracle));
-  memset((void *)Dline, 0, sizeof(Dline));
-  memset((void *)ip_Kline, 0, sizeof(ip_Kline));
-  leftover=NULL;
+  memset((void *)dlines, 0, sizeof(struct DlineConf));
 }
 
 
 /*
- * zap_Dlines - clears out the entire Dline/ip_Kline structure.
+ * zap_dline_conf - clears out the entire Dline/ip_Kline structure.
  * (use this to init the tables too)us
  * -good
  */
-void zap_Dlines() 
+static void zap_dline_conf(struct DlineConf *dc)
 {
   int i;
   aConfItem *s, *ss;
   for (i=0; i<256; i++)
     {
-      oracle[i]=0;  /* clear the oracle field */
-      Dline[i] = destroy_ip_subtree(Dline[i]);   /* kill the tree */
+      dc->oracle[i]=0;  /* clear the oracle field */
+      dc->Dline[i] = destroy_ip_subtree(dc->Dline[i]);   /* kill the tree */
     }
 
   for (i=0; i<256; i++)
     {
-      ike_oracle[i]=0;  /* clear the oracle field */
-      ip_Kline[i] = destroy_ip_subtree(ip_Kline[i]);   /* kill the tree */
+      dc->ike_oracle[i]=0;  /* clear the oracle field */
+      dc->ip_Kline[i] = destroy_ip_subtree(dc->ip_Kline[i]);   /* kill the tree */
     }
-  s=leftover;
+  s=dc->leftover;
 
   while (s)
     {    /* toast the leftovers list */
@@ -798,7 +818,46 @@ void zap_Dlines()
       free_conf(s);
       s=ss;
     }
-  leftover=NULL;
+  dc->leftover=NULL;
+}
+
+void zap_Dlines() 
+{
+  zap_dline_conf(dlines);
+}
+
+/*
+ * new_dline_conf - an empty set of D-line and ip K-line tables
+ */
+struct DlineConf *new_dline_conf(void)
+{
+  struct DlineConf *dc;
+
+  dc = (struct DlineConf *)MyMalloc(sizeof(struct DlineConf));
+  memset((void *)dc, 0, sizeof(struct DlineConf));
+  return dc;
+}
+
+/*
+ * use_dline_conf - put dc in use, returns the tables it replaces
+ */
+struct DlineConf *use_dline_conf(struct DlineConf *dc)
+{
+  struct DlineConf *old = dlines;
+
+  dlines = dc;
+  return old;
+}
+
+/*
+ * free_dline_conf - free tables use_dline_conf() gave back. No client
+ * is ever attached to what's in them, so it needn't be the main thread.
+ */
+void free_dline_conf(struct DlineConf *dc)
+{
+  zap_dline_conf(dc);
+  if (dc != &boot_dlines)
+    MyFree(dc);
 }
 
 /*
@@ -842,7 +901,7 @@ walk_the_dlines(struct Client *sptr, struct ip_subtree *tree)
 void report_dlines(aClient *sptr)
 {
   int i;
-  for (i=0;i<256;i++) walk_the_dlines(sptr, Dline[i]);
+  for (i=0;i<256;i++) walk_the_dlines(sptr, dlines->Dline[i]);
 }
 
 void report_temp_dlines(aClient *sptr)
@@ -906,7 +965,7 @@ void
 report_ip_Klines(aClient *sptr)
 {
   int i;
-  for (i=0;i<256;i++) walk_the_ip_Klines(sptr, ip_Kline[i],'K', CONF_KILL);
+  for (i=0;i<256;i++) walk_the_ip_Klines(sptr, dlines->ip_Kline[i],'K', CONF_KILL);
 }
 
 
@@ -914,5 +973,5 @@ void
 report_ip_Ilines(aClient *sptr)
 {
   int i;
-  for (i=0;i<256;i++) walk_the_ip_Klines(sptr, ip_Kline[i],'I', CONF_CLIENT);
+  for (i=0;i<256;i++) walk_the_ip_Klines(sptr, dlines->ip_Kline[i],'I', CONF_CLIENT);
 }
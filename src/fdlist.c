@@ -16,12 +16,79 @@
 
 unsigned char GlobalFDList[MAXCONNECTIONS + 1];
 
+#ifdef USE_EPOLL
+/*
+ * ready lists for the epoll engine, one per priority class, so
+ * read_message() only has to look at descriptors the kernel told us
+ * about. A descriptor is queued on the list of the highest class it
+ * belongs to, and read_message() walks the lists in priority order.
+ */
+#define FDR_LISTS 4
+
+static const unsigned char ReadyClass[FDR_LISTS] = {
+  FDL_SERVER, FDL_BUSY, FDL_OPER, FDL_DEFAULT
+};
+
+unsigned char GlobalFDReady[MAXCONNECTIONS + 1];
+
+static int         readyHead[FDR_LISTS];
+static int         readyTail[FDR_LISTS];
+static int         readyNext[MAXCONNECTIONS + 1];
+static int         readyPrev[MAXCONNECTIONS + 1];
+static signed char readyList[MAXCONNECTIONS + 1];   /* -1 if not queued */
+
+static void ready_link(int fd)
+{
+  int list;
+
+  if (-1 < readyList[fd] || !GlobalFDList[fd])
+    return;
+
+  for (list = 0; list < FDR_LISTS - 1; ++list)
+    if (GlobalFDList[fd] & ReadyClass[list])
+      break;
+
+  readyList[fd] = list;
+  readyNext[fd] = -1;
+  readyPrev[fd] = readyTail[list];
+  if (-1 < readyTail[list])
+    readyNext[readyTail[list]] = fd;
+  else
+    readyHead[list] = fd;
+  readyTail[list] = fd;
+}
+
+static void ready_unlink(int fd)
+{
+  int list = readyList[fd];
+
+  if (list < 0)
+    return;
+
+  if (-1 < readyPrev[fd])
+    readyNext[readyPrev[fd]] = readyNext[fd];
+  else
+    readyHead[list] = readyNext[fd];
+  if (-1 < readyNext[fd])
+    readyPrev[readyNext[fd]] = readyPrev[fd];
+  else
+    readyTail[list] = readyPrev[fd];
+  readyList[fd] = -1;
+}
+#endif /* USE_EPOLL */
+
 void fdlist_init(void)
 {
   static int initialized = 0;
   assert(0 == initialized);
   if (!initialized) {
     memset(GlobalFDList, 0, sizeof(GlobalFDList));
+#ifdef USE_EPOLL
+    memset(GlobalFDReady, 0, sizeof(GlobalFDReady));
+    memset(readyList, -1, sizeof(readyList));
+    memset(readyHead, -1, sizeof(readyHead));
+    memset(readyTail, -1, sizeof(readyTail));
+#endif
     initialized = 1;
   }
 }
@@ -30,13 +97,89 @@ void fdlist_add(int fd, unsigned char mask)
 {
   assert(fd < MAXCONNECTIONS + 1);
   GlobalFDList[fd] |= mask;
+#ifdef USE_EPOLL
+  /*
+   * requeue, the descriptor may have been promoted to a better class
+   * or may have become ready before it had any class at all (auth)
+   */
+  if (GlobalFDReady[fd])
+    {
+      ready_unlink(fd);
+      ready_link(fd);
+    }
+#endif
 }
  
 void fdlist_delete(int fd, unsigned char mask)
 {
   assert(fd < MAXCONNECTIONS + 1);
   GlobalFDList[fd] &= ~mask;
+#ifdef USE_EPOLL
+  if (!GlobalFDList[fd])
+    {
+      ready_unlink(fd);
+      GlobalFDReady[fd] = 0;
+    }
+#endif
+}
+
+#ifdef USE_EPOLL
+/*
+ * fdlist_set_ready - note readiness on a descriptor and queue it on the
+ * ready list of its class. Descriptors without a class yet (clients
+ * still in the auth module) are queued by fdlist_add() later.
+ */
+void fdlist_set_ready(int fd, unsigned char flags)
+{
+  assert(fd < MAXCONNECTIONS + 1);
+  GlobalFDReady[fd] |= flags;
+  ready_link(fd);
+}
+
+/*
+ * fdlist_clear_ready - clear readiness, dequeue once nothing is left
+ */
+void fdlist_clear_ready(int fd, unsigned char flags)
+{
+  assert(fd < MAXCONNECTIONS + 1);
+  GlobalFDReady[fd] &= ~flags;
+  if (!GlobalFDReady[fd])
+    ready_unlink(fd);
+}
+
+/*
+ * fdlist_has_ready - true if a descriptor matching mask is queued
+ */
+int fdlist_has_ready(unsigned char mask)
+{
+  int list;
+  int fd;
+
+  for (list = 0; list < FDR_LISTS; ++list)
+    for (fd = readyHead[list]; -1 < fd; fd = readyNext[fd])
+      if (GlobalFDList[fd] & mask)
+        return 1;
+  return 0;
+}
+
+/*
+ * fdlist_get_ready - copy up to max queued descriptors matching mask
+ * into fds, highest priority class first. The descriptors stay queued,
+ * the caller clears their readiness as it services them.
+ */
+int fdlist_get_ready(int* fds, int max, unsigned char mask)
+{
+  int list;
+  int fd;
+  int count = 0;
+
+  for (list = 0; list < FDR_LISTS; ++list)
+    for (fd = readyHead[list]; -1 < fd && count < max; fd = readyNext[fd])
+      if (GlobalFDList[fd] & mask)
+        fds[count++] = fd;
+  return count;
 }
+#endif /* USE_EPOLL */
 
 #ifndef NO_PRIORITY
 #ifdef CLIENT_SERVER
@@ -46,7 +189,6 @@ void fdlist_delete(int fd, unsigned char mask)
 #define BUSY_CLIENT(x) \
     (((x)->priority < 40) || (!GlobalSetOptions.lifesux && ((x)->priority < 60)))
 #endif
-#define FDLISTCHKFREQ  2
 
 /*
  * This is a pretty expensive routine -- it loops through
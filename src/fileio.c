@@ -186,3 +186,10 @@ int fbstat(struct stat* sb, FBFILE* fb)
   return fstat(fb->fd, sb);
 }
 
+int fbseek(FBFILE* fb, long offset)
+{
+  assert(fb);
+  fb->ptr = fb->endp = fb->buf;
+  fb->flags = 0;
+  return lseek(fb->fd, offset, SEEK_SET) == -1 ? -1 : 0;
+}
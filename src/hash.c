@@ -33,6 +33,7 @@
 
 #include <assert.h>
 #include <fcntl.h>     /* O_RDWR ... */
+#include <stddef.h>    /* offsetof */
 #include <string.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -45,48 +46,12 @@
  * Contributed by James L. Davis
  */
 
-#ifdef  DEBUGMODE
-static struct HashEntry* clientTable = NULL;
-static struct HashEntry* channelTable = NULL;
-static int clhits;
-static int clmiss;
-static int chhits;
-static int chmiss;
-#else
-
-static struct HashEntry clientTable[U_MAX];
-static struct HashEntry channelTable[CH_MAX];
-
-#endif
-
-struct HashEntry hash_get_channel_block(int i)
-{
-  return channelTable[i];
-}
-
-size_t hash_get_channel_table_size(void)
-{
-  return sizeof(struct HashEntry) * CH_MAX;
-}
-
-size_t hash_get_client_table_size(void)
-{
-  return sizeof(struct HashEntry) * U_MAX;
-}
-
-/*
- *
- * look in whowas.c for the missing ...[WW_MAX]; entry
- *   - Dianora
- */
-
 /*
  * Hashing.
  *
  *   The server uses a chained hash table to provide quick and efficient
  * hash table mantainence (providing the hash function works evenly over
- * the input range).  The hash table is thus not susceptible to problems
- * of filling all the buckets or the need to rehash.
+ * the input range).
  *    It is expected that the hash table would look somehting like this
  * during use:
  *                   +-----+    +-----+    +-----+   +-----+
@@ -103,43 +68,268 @@ size_t hash_get_client_table_size(void)
  *
  * A - GOPbot, B - chang, C - hanuaway, D - *.mu.OZ.AU
  *
- * The order shown above is just one instant of the server.  Each time a
- * lookup is made on an entry in the hash table and it is found, the entry
- * is moved to the top of the chain.
- *
- *    ^^^^^^^^^^^^^^^^ **** Not anymore - Dianora
+ * The client and channel tables start at U_MAX and CH_MAX buckets and
+ * double when they hold more names than they have buckets, halving
+ * again, not below the start, when under a quarter full. A resize
+ * doesn't move everything at once: the old table is kept, and every
+ * add and delete moves HASH_REHASH_STEP of its buckets across, so the
+ * old one is empty well before the next resize is due. Until then a
+ * name is looked for in the old table if its bucket there hasn't been
+ * moved yet, and in the new one if it has.
  *
+ * The hash is HalfSipHash-2-4 of the name folded with ToLower(), under
+ * a key read from /dev/urandom at startup, so nobody can pick nicks or
+ * channel names that all land in one bucket.
  */
+struct HashTable {
+  struct HashEntry* table;
+  unsigned int      size;       /* buckets in table, a power of two */
+  struct HashEntry* old;        /* table being moved out of, or NULL */
+  unsigned int      old_size;
+  unsigned int      moved;      /* buckets of old moved so far */
+  unsigned int      count;      /* names in both */
+  unsigned int      min_size;
+  unsigned int      key[2];
+  size_t            next;       /* offset of the chain pointer */
+  size_t            name;       /* offset of the name */
+};
+
+#define HashNext(t, e)  (*(void**) ((char*) (e) + (t)->next))
+#define HashName(t, e)  ((const char*) (e) + (t)->name)
+
+static struct HashTable clientTable;
+static struct HashTable channelTable;
 
-unsigned int hash_nick_name(const char* name)
+#ifdef  DEBUGMODE
+static int clhits;
+static int clmiss;
+static int chhits;
+static int chmiss;
+#endif
+
+#define ROTL(x, b)      (((x) << (b)) | ((x) >> (32 - (b))))
+#define SIPROUND \
+  do { \
+    v0 += v1; v1 = ROTL(v1, 5); v1 ^= v0; v0 = ROTL(v0, 16); \
+    v2 += v3; v3 = ROTL(v3, 8); v3 ^= v2; \
+    v0 += v3; v3 = ROTL(v3, 7); v3 ^= v0; \
+    v2 += v1; v1 = ROTL(v1, 13); v1 ^= v2; v2 = ROTL(v2, 16); \
+  } while (0)
+
+/*
+ * hash_name - HalfSipHash-2-4 of name, case folded, under key
+ */
+static unsigned int hash_name(const unsigned int* key, const char* name)
 {
-  unsigned int h = 0;
+  unsigned int v0 = key[0];
+  unsigned int v1 = key[1];
+  unsigned int v2 = key[0] ^ 0x6c796765U;
+  unsigned int v3 = key[1] ^ 0x74656462U;
+  unsigned int m = 0;
+  unsigned int len = 0;
+  int          shift = 0;
 
   while (*name)
     {
-      h = (h << 4) - (h + (unsigned char)ToLower(*name++));
+      m |= (unsigned int) ToLower(*name++) << shift;
+      ++len;
+      if ((shift += 8) == 32)
+        {
+          v3 ^= m;
+          SIPROUND;
+          SIPROUND;
+          v0 ^= m;
+          m = 0;
+          shift = 0;
+        }
+    }
+  m |= len << 24;
+  v3 ^= m;
+  SIPROUND;
+  SIPROUND;
+  v0 ^= m;
+  v2 ^= 0xff;
+  SIPROUND;
+  SIPROUND;
+  SIPROUND;
+  SIPROUND;
+  return v1 ^ v3;
+}
+
+/*
+ * hash_new_key - a key for a table, from /dev/urandom if it can be had
+ */
+static void hash_new_key(unsigned int* key)
+{
+  int fd;
+
+  if ((fd = open("/dev/urandom", O_RDONLY)) != -1)
+    {
+      int n = read(fd, key, 2 * sizeof(unsigned int));
+
+      close(fd);
+      if (n == 2 * sizeof(unsigned int))
+        return;
     }
+  key[0] = (unsigned int) time(NULL) ^ ((unsigned int) getpid() << 16);
+  key[1] = (unsigned int) clock() * 2654435761U ^ key[0];
+}
 
-  return(h & (U_MAX - 1));
+unsigned int hash_nick_name(const char* name)
+{
+  return hash_name(clientTable.key, name);
 }
 
 /*
  * hash_channel_name
- *
- * Having just the first 30 chars may make something bad happend.
  */
 unsigned int hash_channel_name(const char* name)
 {
-  unsigned int h = 0;
+  return hash_name(channelTable.key, name);
+}
+
+/*
+ * hash_bucket - the bucket of t that a name hashing to hashv is in
+ */
+static struct HashEntry* hash_bucket(struct HashTable* t, unsigned int hashv)
+{
+  if (t->old && (hashv & (t->old_size - 1)) >= t->moved)
+    return &t->old[hashv & (t->old_size - 1)];
+  return &t->table[hashv & (t->size - 1)];
+}
+
+/*
+ * hash_rehash_step - move up to count buckets of t's old table across,
+ * freeing it once it is empty
+ */
+static void hash_rehash_step(struct HashTable* t, unsigned int count)
+{
+  struct HashEntry* bucket;
+  void*             entry;
+  void*             next;
 
-  while (*name != '\0')
+  for ( ; t->old && count; count--)
     {
-      h = (h << 4) - (h + (unsigned char)ToLower(*name++));
+      for (entry = t->old[t->moved].list; entry; entry = next)
+        {
+          next = HashNext(t, entry);
+          bucket = &t->table[hash_name(t->key, HashName(t, entry)) &
+                             (t->size - 1)];
+          HashNext(t, entry) = bucket->list;
+          bucket->list = entry;
+          ++bucket->links;
+        }
+      if (++t->moved == t->old_size)
+        {
+          MyFree(t->old);
+          t->old = NULL;
+          t->old_size = t->moved = 0;
+        }
     }
+}
+
+/*
+ * hash_resize - start moving t into a table of size buckets
+ */
+static void hash_resize(struct HashTable* t, unsigned int size)
+{
+  hash_rehash_step(t, t->old_size);     /* never more than one at once */
+  t->old = t->table;
+  t->old_size = t->size;
+  t->moved = 0;
+  t->table = (struct HashEntry*) MyMalloc(size * sizeof(struct HashEntry));
+  memset(t->table, 0, size * sizeof(struct HashEntry));
+  t->size = size;
+}
+
+/*
+ * hash_clear - empty t, back to its starting size, keeping its key
+ */
+static void hash_clear(struct HashTable* t)
+{
+  MyFree(t->old);
+  MyFree(t->table);
+  t->old = NULL;
+  t->old_size = t->moved = 0;
+  t->count = 0;
+  t->size = t->min_size;
+  t->table = (struct HashEntry*) MyMalloc(t->size * sizeof(struct HashEntry));
+  memset(t->table, 0, t->size * sizeof(struct HashEntry));
+}
+
+static void hash_init_table(struct HashTable* t, unsigned int size,
+                            size_t next, size_t name)
+{
+  t->table = t->old = NULL;
+  t->min_size = size;
+  t->next = next;
+  t->name = name;
+  hash_new_key(t->key);
+  hash_clear(t);
+}
+
+static void hash_add(struct HashTable* t, const char* name, void* entry)
+{
+  struct HashEntry* bucket;
+
+  hash_rehash_step(t, HASH_REHASH_STEP);
+  bucket = hash_bucket(t, hash_name(t->key, name));
+  HashNext(t, entry) = bucket->list;
+  bucket->list = entry;
+  ++bucket->links;
+  ++bucket->hits;
+  if (++t->count > t->size && !t->old)
+    hash_resize(t, t->size << 1);
+}
+
+/*
+ * hash_del - take entry out of t, returning 0 if it wasn't there
+ */
+static int hash_del(struct HashTable* t, const char* name, void* entry)
+{
+  struct HashEntry* bucket;
+  void**            p;
+
+  hash_rehash_step(t, HASH_REHASH_STEP);
+  bucket = hash_bucket(t, hash_name(t->key, name));
+  for (p = &bucket->list; *p; p = &HashNext(t, *p))
+    {
+      if (*p == entry)
+        {
+          *p = HashNext(t, entry);
+          HashNext(t, entry) = NULL;
+          assert(bucket->links > 0);
+          if (bucket->links > 0)
+            --bucket->links;
+          if (--t->count < t->size / 4 && t->size > t->min_size && !t->old)
+            hash_resize(t, t->size >> 1);
+          return 1;
+        }
+    }
+  return 0;
+}
+
+static size_t hash_table_size(struct HashTable* t)
+{
+  return sizeof(struct HashEntry) * (t->size + t->old_size);
+}
+
+size_t hash_get_channel_table_size(void)
+{
+  return hash_table_size(&channelTable);
+}
 
-  return (h & (CH_MAX - 1));
+size_t hash_get_client_table_size(void)
+{
+  return hash_table_size(&clientTable);
 }
 
+/*
+ *
+ * look in whowas.c for the missing ...[WW_MAX]; entry
+ *   - Dianora
+ */
+
 /*
  * clear_client_hash_table
  *
@@ -150,11 +340,8 @@ static void clear_client_hash_table(void)
 #ifdef        DEBUGMODE
   clhits = 0;
   clmiss = 0;
-  if(!clientTable)
-    clientTable = (struct HashEntry*) MyMalloc(U_MAX * 
-                                               sizeof(struct HashEntry));
 #endif
-  memset(clientTable, 0, sizeof(struct HashEntry) * U_MAX);
+  hash_clear(&clientTable);
 }
 
 static void clear_channel_hash_table(void)
@@ -162,17 +349,16 @@ static void clear_channel_hash_table(void)
 #ifdef        DEBUGMODE
   chmiss = 0;
   chhits = 0;
-  if (!channelTable)
-    channelTable = (struct HashEntry*) MyMalloc(CH_MAX *
-                                                sizeof(struct HashEntry));
 #endif
-  memset(channelTable, 0, sizeof(struct HashEntry) * CH_MAX);
+  hash_clear(&channelTable);
 }
 
 void init_hash(void)
 {
-  clear_client_hash_table();
-  clear_channel_hash_table();
+  hash_init_table(&clientTable, U_MAX, offsetof(struct Client, hnext),
+                  offsetof(struct Client, name));
+  hash_init_table(&channelTable, CH_MAX, offsetof(struct Channel, hnextch),
+                  offsetof(struct Channel, chname));
 }
 
 /*
@@ -180,15 +366,10 @@ void init_hash(void)
  */
 void add_to_client_hash_table(const char* name, struct Client* cptr)
 {
-  unsigned int hashv;
   assert(0 != name);
   assert(0 != cptr);
 
-  hashv = hash_nick_name(name);
-  cptr->hnext = (struct Client*) clientTable[hashv].list;
-  clientTable[hashv].list = (void*) cptr;
-  ++clientTable[hashv].links;
-  ++clientTable[hashv].hits;
+  hash_add(&clientTable, name, cptr);
 }
 
 /*
@@ -196,15 +377,10 @@ void add_to_client_hash_table(const char* name, struct Client* cptr)
  */
 void add_to_channel_hash_table(const char* name, struct Channel* chptr)
 {
-  unsigned int hashv;
   assert(0 != name);
   assert(0 != chptr);
 
-  hashv = hash_channel_name(name);
-  chptr->hnextch = (struct Channel*) channelTable[hashv].list;
-  channelTable[hashv].list = (void*) chptr;
-  ++channelTable[hashv].links;
-  ++channelTable[hashv].hits;
+  hash_add(&channelTable, name, chptr);
 }
 
 /*
@@ -213,32 +389,11 @@ void add_to_channel_hash_table(const char* name, struct Channel* chptr)
  */
 void del_from_client_hash_table(const char* name, struct Client* cptr)
 {
-  struct Client* tmp;
-  struct Client* prev = NULL;
-  unsigned int   hashv;
   assert(0 != name);
   assert(0 != cptr);
 
-  hashv = hash_nick_name(name);
-  tmp = (struct Client*) clientTable[hashv].list;
-
-  for ( ; tmp; tmp = tmp->hnext)
-    {
-      if (tmp == cptr)
-        {
-          if (prev)
-            prev->hnext = tmp->hnext;
-          else
-            clientTable[hashv].list = (void*) tmp->hnext;
-          tmp->hnext = NULL;
-
-          assert(clientTable[hashv].links > 0);
-          if (clientTable[hashv].links > 0)
-            --clientTable[hashv].links;
-          return;
-        }
-      prev = tmp;
-    }
+  if (hash_del(&clientTable, name, cptr))
+    return;
   Debug((DEBUG_ERROR, "%#x !in tab %s[%s] %#x %#x %#x %d %d %#x",
          cptr, cptr->name, cptr->from ? cptr->from->host : "??host",
          cptr->from, cptr->next, cptr->prev, cptr->fd, 
@@ -250,32 +405,10 @@ void del_from_client_hash_table(const char* name, struct Client* cptr)
  */
 void del_from_channel_hash_table(const char* name, struct Channel* chptr)
 {
-  struct Channel* tmp;
-  struct Channel* prev = NULL;
-  unsigned int    hashv;
   assert(0 != name);
   assert(0 != chptr);
 
-  hashv = hash_channel_name(name);
-  tmp = (struct Channel*) channelTable[hashv].list;
-
-  for ( ; tmp; tmp = tmp->hnextch)
-    {
-      if (tmp == chptr)
-        {
-          if (prev)
-            prev->hnextch = tmp->hnextch;
-          else
-            channelTable[hashv].list = (void*) tmp->hnextch;
-          tmp->hnextch = NULL;
-
-          assert(channelTable[hashv].links > 0);
-          if (channelTable[hashv].links > 0)
-            --channelTable[hashv].links;
-          return;
-        }
-      prev = tmp;
-    }
+  hash_del(&channelTable, name, chptr);
 }
 
 
@@ -285,11 +418,10 @@ void del_from_channel_hash_table(const char* name, struct Channel* chptr)
 struct Client* hash_find_client(const char* name, struct Client* cptr)
 {
   struct Client* tmp;
-  unsigned int   hashv;
   assert(0 != name);
 
-  hashv = hash_nick_name(name);
-  tmp = (struct Client*) clientTable[hashv].list;
+  tmp = (struct Client*) hash_bucket(&clientTable,
+                                     hash_nick_name(name))->list;
   /*
    * Got the bucket, now search the chain.
    */
@@ -366,11 +498,10 @@ static struct Client* hash_find_masked_server(const char* name)
 struct Client* hash_find_server(const char* name)
 {
   struct Client* tmp;
-  unsigned int   hashv;
 
   assert(0 != name);
-  hashv = hash_nick_name(name);
-  tmp = (struct Client*) clientTable[hashv].list;
+  tmp = (struct Client*) hash_bucket(&clientTable,
+                                     hash_nick_name(name))->list;
 
   for ( ; tmp; tmp = tmp->hnext)
     {
@@ -401,11 +532,10 @@ struct Client* hash_find_server(const char* name)
 struct Channel* hash_find_channel(const char* name, struct Channel* chptr)
 {
   struct Channel*    tmp;
-  unsigned int hashv;
   
   assert(0 != name);
-  hashv = hash_channel_name(name);
-  tmp = (struct Channel*) channelTable[hashv].list;
+  tmp = (struct Channel*) hash_bucket(&channelTable,
+                                      hash_channel_name(name))->list;
 
   for ( ; tmp; tmp = tmp->hnextch)
     if (irccmp(name, tmp->chname) == 0)
@@ -421,6 +551,173 @@ struct Channel* hash_find_channel(const char* name, struct Channel* chptr)
   return chptr;
 }
 
+static struct Client* ipBlockTable[IP_BLOCK_MAX];
+static struct Client* domainTable[DOMAIN_MAX];
+static struct Client* userDomainTable[USER_DOMAIN_MAX];
+
+static unsigned int hash_ip_block(unsigned long ip)
+{
+  return (unsigned int) (((ip >> 8) & 0xffffffUL) * 2654435761UL)
+    % IP_BLOCK_MAX;
+}
+
+/*
+ * host_domain - return the last two labels of host, or all of it if
+ * it hasn't that many
+ */
+const char* host_domain(const char* host)
+{
+  const char* p = host + strlen(host);
+  int         dots = 0;
+
+  while (p > host)
+    {
+      if (*--p == '.' && ++dots == 2)
+        return p + 1;
+    }
+  return host;
+}
+
+/*
+ * mask_domain - the host whose domain every host matching mask has,
+ * or NULL if there isn't one. That takes the mask's literal tail after
+ * the last wildcard to hold the last two labels whole.
+ */
+const char* mask_domain(const char* mask)
+{
+  const char* p = mask + strlen(mask);
+  int         dots = 0;
+
+  while (p > mask && p[-1] != '*' && p[-1] != '?')
+    if (*--p == '.')
+      ++dots;
+
+  if (p == mask || dots >= 2)
+    return p;
+  return NULL;
+}
+
+static unsigned int hash_domain(const char* host)
+{
+  return hash_nick_name(host_domain(host)) % DOMAIN_MAX;
+}
+
+/*
+ * add_to_ip_block_table - index a local client by the /24 it connects
+ * from
+ */
+void add_to_ip_block_table(struct Client* cptr)
+{
+  struct Client** bucket;
+
+  assert(0 != cptr);
+  assert(MyConnect(cptr));
+  if (cptr->ipprev)
+    return;
+  bucket = &ipBlockTable[hash_ip_block(ntohl(cptr->ip.s_addr))];
+  if ((cptr->ipnext = *bucket))
+    cptr->ipnext->ipprev = &cptr->ipnext;
+  cptr->ipprev = bucket;
+  *bucket = cptr;
+}
+
+void del_from_ip_block_table(struct Client* cptr)
+{
+  if (!cptr->ipprev)
+    return;
+  if ((*cptr->ipprev = cptr->ipnext))
+    cptr->ipnext->ipprev = cptr->ipprev;
+  cptr->ipnext = NULL;
+  cptr->ipprev = NULL;
+}
+
+/*
+ * add_to_domain_table - index a local client by the domain of its host,
+ * once the host is final (after any I-line spoof)
+ */
+void add_to_domain_table(struct Client* cptr)
+{
+  struct Client** bucket;
+
+  assert(0 != cptr);
+  assert(MyConnect(cptr));
+  del_from_domain_table(cptr);
+  bucket = &domainTable[hash_domain(cptr->host)];
+  if ((cptr->domnext = *bucket))
+    cptr->domnext->domprev = &cptr->domnext;
+  cptr->domprev = bucket;
+  *bucket = cptr;
+}
+
+void del_from_domain_table(struct Client* cptr)
+{
+  if (!cptr->domprev)
+    return;
+  if ((*cptr->domprev = cptr->domnext))
+    cptr->domnext->domprev = cptr->domprev;
+  cptr->domnext = NULL;
+  cptr->domprev = NULL;
+}
+
+/*
+ * add_to_user_domain_table - index a user, local or remote, by the
+ * domain of its host, once registered
+ */
+void add_to_user_domain_table(struct Client* cptr)
+{
+  struct Client** bucket;
+
+  assert(0 != cptr);
+  del_from_user_domain_table(cptr);
+  bucket = &userDomainTable[hash_nick_name(host_domain(cptr->host)) %
+                            USER_DOMAIN_MAX];
+  if ((cptr->udomnext = *bucket))
+    cptr->udomnext->udomprev = &cptr->udomnext;
+  cptr->udomprev = bucket;
+  *bucket = cptr;
+}
+
+void del_from_user_domain_table(struct Client* cptr)
+{
+  if (!cptr->udomprev)
+    return;
+  if ((*cptr->udomprev = cptr->udomnext))
+    cptr->udomnext->udomprev = cptr->udomprev;
+  cptr->udomnext = NULL;
+  cptr->udomprev = NULL;
+}
+
+/*
+ * hash_find_ip_block - return the first local client in the bucket of
+ * the /24 holding ip (host order). Follow ->ipnext for the rest; other
+ * /24s share buckets, so the caller checks the address.
+ */
+struct Client* hash_find_ip_block(unsigned long ip)
+{
+  return ipBlockTable[hash_ip_block(ip)];
+}
+
+/*
+ * hash_find_domain - return the first local client in the bucket of
+ * the domain of host. Follow ->domnext for the rest; the caller still
+ * matches the host.
+ */
+struct Client* hash_find_domain(const char* host)
+{
+  return domainTable[hash_domain(host)];
+}
+
+/*
+ * hash_find_user_domain - return the first user in the bucket of the
+ * domain of host. Follow ->udomnext for the rest; the caller still
+ * matches the host.
+ */
+struct Client* hash_find_user_domain(const char* host)
+{
+  return userDomainTable[hash_nick_name(host_domain(host)) %
+                         USER_DOMAIN_MAX];
+}
+
 /*
  * NOTE: this command is not supposed to be an offical part of the ircd
  *       protocol.  It is simply here to help debug and to monitor the
@@ -438,7 +735,7 @@ int m_hash(struct Client *cptr, struct Client *sptr,int parc,char *parv[])
   int l;
   int i;
   struct HashEntry* tab;
-  struct HashEntry* table;
+  struct HashTable* table;
   struct tm*        tmptr;
   int        deepest = 0;
   int   deeplink = 0;
@@ -449,7 +746,7 @@ int m_hash(struct Client *cptr, struct Client *sptr,int parc,char *parv[])
   int   used = 0;
   int   used_now = 0;
   int   totlink = 0;
-  int   size = U_MAX;
+  int   size;
   char        ch;
   int   out = 0;
   int        link_pop[10];
@@ -489,15 +786,9 @@ int m_hash(struct Client *cptr, struct Client *sptr,int parc,char *parv[])
 
       ch = *parv[1];
       if (IsLower(ch))
-        {
-          table = clientTable;
-          
-        }
+        table = &clientTable;
       else
-        {
-          table = channelTable;
-          size = CH_MAX;
-        }
+        table = &channelTable;
       if (ch == 'L' || ch == 'l')
         {
           tmptr = localtime(&CurrentTime);
@@ -516,15 +807,22 @@ int m_hash(struct Client *cptr, struct Client *sptr,int parc,char *parv[])
   else
     {
       ch = '\0';
-      table = clientTable;
+      table = &clientTable;
     }
+  size = table->size;
 
   for (i = 0; i < 10; i++)
     link_pop[i] = 0;
 
-  for (i = 0; i < size; i++)
+  /* the buckets of an old table still being moved come after the rest */
+  for (i = 0; i < size + (int) table->old_size; i++)
     {
-      tab = &table[i];
+      if (i < size)
+        tab = &table->table[i];
+      else if (i - size >= (int) table->moved)
+        tab = &table->old[i - size];
+      else
+        continue;
       l = tab->links;
       if (showlist)
         {
@@ -592,9 +890,16 @@ int m_hash(struct Client *cptr, struct Client *sptr,int parc,char *parv[])
                    parv[0], listlength, bad);
       }
     case 'P' : case 'p' :
+      sendto_one(sptr,"NOTICE %s :%s hash: %u entries in %d buckets, "
+                 "%u old buckets left to move",
+                 parv[0], (table == &clientTable) ? "Client" : "Channel",
+                 table->count, size,
+                 table->old ? table->old_size - table->moved : 0);
       for (i = 0; i < 10; i++)
-        sendto_one(sptr,"NOTICE %s :Entires with %d links : %d",
-                   parv[0], i, link_pop[i]);
+        sendto_one(sptr,"NOTICE %s :Entires with %d%s links : %d",
+                   parv[0], i, (i == 9) ? " or more" : "", link_pop[i]);
+      sendto_one(sptr,"NOTICE %s :Deepest Link: %d Links: %d",
+                 parv[0], deeplink, deepest);
       return (0);
     case 'r' :
       {
@@ -620,13 +925,13 @@ int m_hash(struct Client *cptr, struct Client *sptr,int parc,char *parv[])
       if (parc > 2)
         sendto_one(sptr,"NOTICE %s :%s hash to entry %d",
                    parv[0], parv[2],
-                   hash_channel_name(parv[2]));
+                   hash_channel_name(parv[2]) & (size - 1));
       return (0);
     case 'h' :
       if (parc > 2)
         sendto_one(sptr,"NOTICE %s :%s hash to entry %d",
                    parv[0], parv[2],
-                   hash_nick_name(parv[2]));
+                   hash_nick_name(parv[2]) & (size - 1));
       return (0);
     case 'n' :
       {
@@ -635,13 +940,13 @@ int m_hash(struct Client *cptr, struct Client *sptr,int parc,char *parv[])
         
         if (parc <= 2)
           return (0);
-        l = atoi(parv[2]) % U_MAX;
+        l = atoi(parv[2]) & (size - 1);
         if (parc > 3)
-          max = atoi(parv[3]) % U_MAX;
+          max = atoi(parv[3]) & (size - 1);
         else
           max = l;
         for (;l <= max; l++)
-          for (i = 0, tmp = (struct Client *)clientTable[l].list; tmp;
+          for (i = 0, tmp = (struct Client *)clientTable.table[l].list; tmp;
                i++, tmp = tmp->hnext)
             {
               if (parv[1][2] == '1' && tmp != tmp->from)
@@ -658,13 +963,13 @@ int m_hash(struct Client *cptr, struct Client *sptr,int parc,char *parv[])
 
         if (parc <= 2)
           return (0);
-        l = atoi(parv[2]) % CH_MAX;
+        l = atoi(parv[2]) & (size - 1);
         if (parc > 3)
-          max = atoi(parv[3]) % CH_MAX;
+          max = atoi(parv[3]) & (size - 1);
         else
           max = l;
         for (;l <= max; l++)
-          for (i = 0, tmp = (struct Channel*) channelTable[l].list; tmp;
+          for (i = 0, tmp = (struct Channel*) channelTable.table[l].list; tmp;
                i++, tmp = tmp->hnextch)
             sendto_one(sptr,"NOTICE %s :Node: %d #%d %s",
                        parv[0], l, i, tmp->chname);
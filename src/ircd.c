@@ -20,6 +20,7 @@
  * $Id: ircd.c,v 1.172 2005/09/30 15:58:12 ievil Exp $
  */
 #include "ircd.h"
+#include "ban_journal.h"
 #include "channel.h"
 #include "class.h"
 #include "client.h"
@@ -30,6 +31,7 @@
 #include "irc_string.h"
 #include "ircd_signal.h"
 #include "list.h"
+#include "m_list.h"
 #include "m_gline.h"
 #include "motd.h"
 #include "msg.h"         /* msgtab */
@@ -42,10 +44,12 @@
 #include "s_bsd.h"
 #include "s_conf.h"
 #include "s_debug.h"
+#include "s_latency.h"
 #include "s_log.h"
 #include "s_misc.h"
 #include "s_serv.h"      /* try_connections */
 #include "s_stats.h"
+#include "s_timer.h"
 #include "s_zip.h"
 #include "scache.h"
 #include "send.h"
@@ -151,14 +155,14 @@ static int         bootDaemon  = 1;
 char**  myargv;
 int     dorehash   = 0;
 int     doremotd   = 0;
+int     dolatency  = 0;
 int     debuglevel = -1;        /* Server debug level */
 char*   debugmode  = "";        /*  -"-    -"-   -"-  */
 
 
 int     rehashed = YES;
 int     dline_in_progress = NO; /* killing off matching D lines ? */
-time_t  nextconnect = 1;        /* time for next try_connections call */
-time_t  nextping = 1;           /* same as above for check_pings() */
+struct Timer connect_timer;     /* next try_connections call */
 
 /* code added by mika nystrom (mnystrom@mit.edu) */
 /* this flag is used to signal globally that the server is heavily loaded,
@@ -229,7 +233,7 @@ static void init_sys(int boot_daemon)
           exit(-1);
         }
 
-#ifndef USE_POLL
+#if !defined(USE_POLL) && !defined(USE_EPOLL)
       if( MAXCONNECTIONS > FD_SETSIZE )
         {
           fprintf(stderr, "FD_SETSIZE = %d MAXCONNECTIONS = %d\n",
@@ -240,7 +244,7 @@ static void init_sys(int boot_daemon)
           exit(-1);
         }
       printf("Value of FD_SETSIZE is %d\n", FD_SETSIZE);
-#endif /* USE_POLL */
+#endif /* !USE_POLL && !USE_EPOLL */
     }
 #endif        /* RLIMIT_FD_MAX */
 
@@ -354,7 +358,79 @@ static void parse_command_line(int argc, char* argv[])
     }
   }
 }
-static time_t next_gc = 0;
+static struct Timer expire_timer;
+static struct Timer gc_timer;
+#ifndef NO_PRIORITY
+static struct Timer fdlist_timer;
+#endif
+#ifdef ZIP_ADAPTIVE
+static struct Timer zip_timer;
+#endif
+
+/*
+ * periodic jobs, run off the timer wheel along with the client
+ * and auth timeouts
+ */
+static void connect_timeout(void* unused)
+{
+  time_t next;
+
+  /*
+  ** Note, if there are no active C lines, try_connections
+  ** returns 0 and is not called again until a rehash.
+  */
+  if ((next = try_connections(CurrentTime)))
+    timer_add(&connect_timer, next);
+}
+
+static void expire_timeout(void* unused)
+{
+  expire_temp_klines();
+#ifdef GLINES
+  expire_glines();
+#endif
+  timer_add(&expire_timer, CurrentTime + 1);
+}
+
+static void gc_timeout(void* unused)
+{
+  block_garbage_collect();
+  timer_add(&gc_timer, CurrentTime + 600);
+}
+
+#ifndef NO_PRIORITY
+static void fdlist_timeout(void* unused)
+{
+  fdlist_check(CurrentTime);
+  timer_add(&fdlist_timer, CurrentTime + FDLISTCHKFREQ);
+}
+#endif
+
+#ifdef ZIP_ADAPTIVE
+static void zip_timeout(void* unused)
+{
+  zip_adapt();
+  timer_add(&zip_timer, CurrentTime + ZIP_ADAPT_FREQ);
+}
+#endif
+
+static void init_timers(void)
+{
+  timer_init(&connect_timer, connect_timeout, NULL);
+  timer_init(&expire_timer, expire_timeout, NULL);
+  timer_init(&gc_timer, gc_timeout, NULL);
+  timer_add(&expire_timer, CurrentTime + 1);
+  timer_add(&gc_timer, CurrentTime + 600);
+#ifndef NO_PRIORITY
+  timer_init(&fdlist_timer, fdlist_timeout, NULL);
+  timer_add(&fdlist_timer, CurrentTime + FDLISTCHKFREQ);
+#endif
+#ifdef ZIP_ADAPTIVE
+  timer_init(&zip_timer, zip_timeout, NULL);
+  timer_add(&zip_timer, CurrentTime + ZIP_ADAPT_FREQ);
+#endif
+}
+
 static time_t io_loop(time_t delay)
 {
   static char   to_send[200];
@@ -362,6 +438,10 @@ static time_t io_loop(time_t delay)
   static long   lastrecvK = 0;
   static int    lrv       = 0;
   time_t        lasttimeofday;
+#ifdef LATENCY_STATS
+  unsigned long pass_start = latency_usec();
+  unsigned long start;
+#endif
   lasttimeofday = CurrentTime;
 
   if (CurrentTime < lasttimeofday)
@@ -370,11 +450,6 @@ static time_t io_loop(time_t delay)
                  CurrentTime, lasttimeofday);
       report_error(to_send, me.name, 0);
     }
-  if(!next_gc)
-    {
-  	next_gc = CurrentTime + 600;
-    }
-
   /*
    * This chunk of code determines whether or not
    * "life sucks", that is to say if the traffic
@@ -432,36 +507,6 @@ static time_t io_loop(time_t delay)
       lastrecvK = (long)me.receiveK;
     }
 
-  /*
-  ** We only want to connect if a connection is due,
-  ** not every time through.  Note, if there are no
-  ** active C lines, this call to Tryconnections is
-  ** made once only; it will return 0. - avalon
-  */
-  if (nextconnect && CurrentTime >= nextconnect)
-    nextconnect = try_connections(CurrentTime);
-
-  /*
-  ** take the smaller of the two 'timed' event times as
-  ** the time of next event (stops us being late :) - avalon
-  ** WARNING - nextconnect can return 0!
-  */
-  if (nextconnect)
-    delay = IRCD_MIN(nextping, nextconnect);
-  delay -= CurrentTime;
-  /*
-  ** Adjust delay to something reasonable [ad hoc values]
-  ** (one might think something more clever here... --msa)
-  ** We don't really need to check that often and as long
-  ** as we don't delay too long, everything should be ok.
-  ** waiting too long can cause things to timeout...
-  ** i.e. PINGS -> a disconnection :(
-  ** - avalon
-  */
-  if (delay < 1)
-    delay = 1;
-  else
-    delay = IRCD_MIN(delay, TIMESEC);
   /*
    * We want to read servers on every io_loop, as well
    * as "busy" clients (which again, includes servers.
@@ -512,19 +557,57 @@ static time_t io_loop(time_t delay)
   flush_server_connections();
 #endif
 
+#ifdef LATENCY_STATS
+  start = latency_usec();
+#endif
+
   /*
-  ** ...perhaps should not do these loops every time,
-  ** but only if there is some chance of something
-  ** happening (but, note that conf->hold times may
-  ** be changed elsewhere--so precomputed next event
-  ** time might be too far away... (similarly with
-  ** ping times) --msa
+  ** Only the timers that are due are looked at: client pings
+  ** and timeouts, auth queries, connects, tkline expiry and
+  ** the periodic jobs above.
   */
+  timer_run(CurrentTime);
 
-  if (CurrentTime >= nextping) {
-    nextping = check_pings(CurrentTime);
-    timeout_auth_queries(CurrentTime);
-  }
+#ifdef REHASH_THREAD
+  /*
+  ** a rehash loaded on its thread goes in use here
+  */
+  conf_collect();
+#endif
+
+#ifdef BAN_JOURNAL
+  /*
+  ** anything that went wrong writing the ban journal
+  */
+  journal_collect();
+#endif
+
+  /*
+  ** new K/D/G-lines or a rehash, see who has to go
+  */
+  check_klines();
+
+#ifdef ZIP_THREADS
+  /*
+  ** zipped link data back from the workers, the epoll engine
+  ** also picks it up as soon as it is woken
+  */
+  zip_collect();
+#endif
+
+  /*
+  ** the next slice of any connect burst
+  */
+  burst_run();
+
+  /*
+  ** and of any LIST
+  */
+  list_run();
+
+#ifdef LATENCY_STATS
+  latency_phase_add(LAT_TIMERS, latency_usec() - start);
+#endif
 
   if (dorehash && !LIFESUX)
     {
@@ -537,6 +620,14 @@ static time_t io_loop(time_t delay)
       sendto_realops("Got signal SIGUSR1, reloading ircd motd file");
       doremotd = 0;
     }
+#ifdef LATENCY_STATS
+  if (dolatency)
+    {
+      dump_latency();
+      sendto_realops("Got signal SIGUSR2, latency written to the log");
+      dolatency = 0;
+    }
+#endif
   /*
   ** Flush output buffers on all connections now if they
   ** have data in them (or at least try to flush)
@@ -544,16 +635,9 @@ static time_t io_loop(time_t delay)
   */
   flush_connections(0);
 
-#ifndef NO_PRIORITY
-  fdlist_check(CurrentTime);
+#ifdef LATENCY_STATS
+  latency_pass(pass_start);
 #endif
-  
-  if(CurrentTime >= next_gc)
-  {
-     block_garbage_collect();
-     next_gc = CurrentTime + 600;
-  }
-
   return delay;
 
 }
@@ -825,10 +909,17 @@ int main(int argc, char *argv[])
   initclass();
   initwhowas();
   init_stats();
-  init_tree_parse(msgtab);      /* tree parse code (orabidoo) */
+  init_msg_hash(msgtab);        /* command lookup table */
 
   fdlist_init();
   init_netio();
+  init_timers();
+#ifdef ZIP_THREADS
+  zip_threads_init();
+#endif
+#ifdef BAN_JOURNAL
+  journal_init(get_conf_name(KLINE_TYPE), get_conf_name(DLINE_TYPE));
+#endif
 
   read_conf_files(YES);         /* cold start init conf files */
 
@@ -27,6 +27,9 @@
 
 #include <stdlib.h>
 #include <signal.h>
+#ifdef HAVE_LIBPTHREAD
+#include <pthread.h>
+#endif
 
 /*
  * dummy_handler - don't know if this is really needed but if alarm is still
@@ -63,6 +66,16 @@ static void sigusr1_handler(int sig)
   doremotd = 1;
 }
 
+#ifdef LATENCY_STATS
+/*
+ * sigusr2_handler - write the latency histograms to the log
+ */
+static void sigusr2_handler(int sig)
+{
+  dolatency = 1;
+}
+#endif
+
 /*
  * sigint_handler - restart the server
  */
@@ -117,6 +130,35 @@ void setup_signals(void)
   act.sa_handler = sigusr1_handler;
   sigaddset(&act.sa_mask, SIGUSR1);
   sigaction(SIGUSR1, &act, 0);
+
+#ifdef LATENCY_STATS
+  act.sa_handler = sigusr2_handler;
+  sigaddset(&act.sa_mask, SIGUSR2);
+  sigaction(SIGUSR2, &act, 0);
+#endif
 }
 
 
+
+#ifdef HAVE_LIBPTHREAD
+/*
+ * ircd_thread_start - run fn(arg) on a detached thread of its own,
+ * with every signal blocked so they are all taken by the main loop.
+ * Returns 0, or the error from pthread_create().
+ */
+int ircd_thread_start(void* (*fn)(void*), void* arg)
+{
+  pthread_t thread;
+  sigset_t  all;
+  sigset_t  old;
+  int       err;
+
+  sigfillset(&all);
+  pthread_sigmask(SIG_BLOCK, &all, &old);
+  err = pthread_create(&thread, NULL, fn, arg);
+  pthread_sigmask(SIG_SETMASK, &old, NULL);
+  if (0 == err)
+    pthread_detach(thread);
+  return err;
+}
+#endif
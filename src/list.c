@@ -287,32 +287,38 @@ void block_garbage_collect()
 /*
  */
 void count_user_memory(int *user_memory_used,
-                       int *user_memory_allocated )
+                       int *user_memory_allocated,
+                       int *user_memory_fragmented)
 {
   BlockHeapCountMemory( free_anUsers,
                         user_memory_used,
-                        user_memory_allocated);
+                        user_memory_allocated,
+                        user_memory_fragmented);
 }
 
 /*
  */
 void count_links_memory(int *links_memory_used,
-                       int *links_memory_allocated )
+                       int *links_memory_allocated,
+                       int *links_memory_fragmented)
 {
   BlockHeapCountMemory( free_Links,
                         links_memory_used,
-                        links_memory_allocated);
+                        links_memory_allocated,
+                        links_memory_fragmented);
 }
 
 #ifdef FLUD
 /*
  */
 void count_flud_memory(int *flud_memory_used,
-                       int *flud_memory_allocated )
+                       int *flud_memory_allocated,
+                       int *flud_memory_fragmented)
 {
   BlockHeapCountMemory( free_fludbots,
                         flud_memory_used,
-                        flud_memory_allocated);
+                        flud_memory_allocated,
+                        flud_memory_fragmented);
 }
 #endif
 
@@ -194,6 +194,7 @@ static int inetport(struct Listener* listener)
     report_error(NONB_ERROR_MSG, get_listener_name(listener), errno);
 
   listener->fd = fd;
+  netio_add(fd, NETIO_LISTENER, listener, NETIO_READ);
 
   return 1;
 }
@@ -278,7 +279,10 @@ void close_listener(struct Listener* listener)
     }
   }
   if (-1 < listener->fd)
-    close(listener->fd);
+    {
+      netio_del(listener->fd);
+      close(listener->fd);
+    }
   free_listener(listener);
 }
  
@@ -371,7 +375,6 @@ void accept_connection(struct Listener* listener)
     return;
   }
   ServerStats->is_ac++;
-  nextping = CurrentTime;
 
   add_connection(listener, fd);
 }
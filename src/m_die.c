@@ -23,6 +23,7 @@
  *   $Id: m_die.c,v 1.6 2003/06/24 03:57:16 ievil Exp $
  */
 #include "m_commands.h"
+#include "ban_journal.h"
 #include "client.h"
 #include "ircd.h"
 #include "irc_string.h"
@@ -148,6 +149,9 @@ int m_die(struct Client *cptr, struct Client *sptr, int parc, char *parv[])
     }
   flush_connections(0);
   ilog(L_NOTICE, "Server terminated by %s", get_client_name(sptr, HIDE_IP));
+#ifdef BAN_JOURNAL
+  journal_flush();
+#endif
   /* 
    * this is a normal exit, tell the os it's ok 
    */
@@ -92,7 +92,7 @@ int ms_encap(struct Client *cptr, struct Client *sptr, int parc, char *parv[])
   if (!match(parv[1], me.name))
     return 0;
 
-  mptr = tree_parse(parv[2]);
+  mptr = find_message(parv[2]);
   if ((mptr == NULL) || (mptr->cmd == NULL))
     return 0;
   mptr->bytes += strlen(buffer);
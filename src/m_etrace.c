@@ -31,16 +31,96 @@
 #include "ircd.h"
 #include "numeric.h"
 #include "s_bsd.h"
+#include "s_conf.h"
 #include "s_serv.h"
 #include "send.h"
 
 #include <string.h>
 #include <time.h>
+#include <netinet/in.h>
+
+/*
+ * etrace_one - report acptr, a local connection, if it is a client
+ */
+static void etrace_one(struct Client* sptr, struct Client* acptr)
+{
+  const char* ip;
+
+  if (acptr->status != STAT_CLIENT)
+    return;
+
+#ifdef HIDE_SPOOF_IPS
+  if (IsIPSpoof(acptr))
+    ip = "255.255.255.255";
+  else
+#endif  
+  ip = inetntoa((const char*) &acptr->ip);
+
+  sendto_one(sptr, form_str(RPL_ETRACE), me.name, sptr->name,
+             IsAnOper(acptr) ? "Oper" : "User",
+             get_client_class(acptr), acptr->name,
+             acptr->username, acptr->host, ip, acptr->info);
+}
+
+/*
+ * etrace_match - report the local clients whose host or address
+ * matches mask. An address with a netmask of /16 or longer only looks
+ * in the /24s under it, a host mask ending in a literal domain only at
+ * the clients in that domain; a spoofed address isn't matched.
+ */
+static void etrace_match(struct Client* sptr, char* mask)
+{
+  struct Client* acptr;
+  const char*    domain;
+  unsigned long  ip = 0;
+  unsigned long  ip_mask = 0;
+  unsigned long  block;
+  int            i;
+
+  if (!is_address(mask, &ip, &ip_mask))
+    ip = ip_mask = 0;
+  ip &= ip_mask;
+
+  if ((ip_mask & 0xffff0000UL) == 0xffff0000UL)
+    {
+      for (i = 0; i < 256; ++i)
+        {
+          block = (ip & 0xffff0000UL) | ((unsigned long) i << 8);
+          if ((block ^ ip) & ip_mask & 0xffffff00UL)
+            continue;
+          for (acptr = hash_find_ip_block(block); acptr;
+               acptr = acptr->ipnext)
+            if ((ntohl(acptr->ip.s_addr) & 0xffffff00UL) == block &&
+                (ntohl(acptr->ip.s_addr) & ip_mask) == ip &&
+                !IsIPSpoof(acptr))
+              etrace_one(sptr, acptr);
+        }
+      return;
+    }
+
+  /* an address never ends in a letter */
+  if ((domain = mask_domain(mask)) && *domain &&
+      !IsDigit(domain[strlen(domain) - 1]))
+    {
+      for (acptr = hash_find_domain(domain); acptr; acptr = acptr->domnext)
+        if (match(mask, acptr->host))
+          etrace_one(sptr, acptr);
+      return;
+    }
+
+  for (i = 0; i <= highest_fd; i++)
+    if ((acptr = local[i]) &&
+        (match(mask, acptr->host) ||
+         (!IsIPSpoof(acptr) &&
+          (ip_mask ? (ntohl(acptr->ip.s_addr) & ip_mask) == ip :
+           match(mask, inetntoa((const char*) &acptr->ip))))))
+      etrace_one(sptr, acptr);
+}
 
 /*
 ** m_etrace - Extended trace - see docs/ETRACE.txt - ideas based on W. Campbell
 **      parv[0] = sender prefix
-**      parv[1] = servername
+**      parv[1] = host or address mask, optional
 */
 
 int m_etrace(struct Client *cptr, struct Client *sptr, int parc, char *parv[])
@@ -62,35 +142,19 @@ int m_etrace(struct Client *cptr, struct Client *sptr, int parc, char *parv[])
   sendto_realops_flags(FLAGS_SPY, "etrace requested by %s (%s@%s)",
                        sptr->name, sptr->username, sptr->host);
 
-  /* report all direct connections */
-  for (i = 0; i <= highest_fd; i++)
+  if (parc > 1 && !EmptyString(parv[1]))
     {
-      const char* ip;
-      
-      if (!(acptr = local[i])) /* Local Connection? */
-        continue;
-
-#ifdef HIDE_SPOOF_IPS
-      if (IsIPSpoof(acptr))
-        ip = "255.255.255.255";
-      else
-#endif  
-      ip = inetntoa((const char*) &acptr->ip);
-
-      switch(acptr->status)
-        {
-        case STAT_CLIENT:
-          sendto_one(sptr, form_str(RPL_ETRACE), me.name, parv[0],
-                     IsAnOper(acptr) ? "Oper" : "User",
-                     get_client_class(acptr), acptr->name,
-                     acptr->username, acptr->host, ip, acptr->info);
-          break;
-        default: /* We will ignore all of the rest */
-          break;
-        }
+      collapse(parv[1]);
+      etrace_match(sptr, parv[1]);
+    }
+  else
+    {
+      /* report all direct connections */
+      for (i = 0; i <= highest_fd; i++)
+        if ((acptr = local[i])) /* Local Connection? */
+          etrace_one(sptr, acptr);
     }
 
   sendto_one(sptr, form_str(RPL_ENDOFTRACE),me.name, parv[0], me.name);
   return 0;
 }
-
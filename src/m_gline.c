@@ -39,6 +39,7 @@
 #include "scache.h"
 #include "send.h"
 #include "struct.h"
+#include "tline_conf.h"
 
 #include <assert.h>
 #include <string.h>
@@ -54,7 +55,7 @@
 extern ConfigFileEntryType ConfigFileEntry; /* defined in ircd.c */
 
 /* internal variables */
-static  aConfItem *glines = (aConfItem *)NULL;
+static struct TempLineList glines;
 static GLINE_PENDING *pending_glines;
 
 /* internal functions */
@@ -337,9 +338,7 @@ int     m_gline(aClient *cptr,
 #endif
                      );
       
-      rehashed = YES;
-      dline_in_progress = NO;
-      nextping = CurrentTime;
+      check_new_ban(host, 0, 0, NO);
 
       return 0;
     }
@@ -590,19 +589,24 @@ static void log_gline(aClient *sptr,
  * placed k-lines
  */
 void flush_glines()
+{
+  tline_flush(&glines);
+}
+
+/*
+ * expire_glines
+ *
+ * inputs       - NONE
+ * output       - NONE
+ * side effects - placed G lines whose time is up are dropped,
+ *                called once a pass from the main loop
+ */
+void expire_glines()
 {
   aConfItem *kill_list_ptr;
 
-  if((kill_list_ptr = glines))
-    {
-      while(kill_list_ptr)
-        {
-          glines = kill_list_ptr->next;
-          free_conf(kill_list_ptr);
-          kill_list_ptr = glines;
-        }
-    }
-  glines = (aConfItem *)NULL;
+  while((kill_list_ptr = tline_expired(&glines)))
+    free_conf(kill_list_ptr);
 }
 
 /* find_gkill
@@ -634,55 +638,7 @@ aConfItem *find_gkill(aClient* cptr, char* username)
 
 struct ConfItem* find_is_glined(const char* host, const char* name)
 {
-  aConfItem *kill_list_ptr;     /* used for the link list only */
-  aConfItem *last_list_ptr;
-  aConfItem *tmp_list_ptr;
-
-  /* gline handling... exactly like temporary klines 
-   * I expect this list to be very tiny. (crosses fingers) so CPU
-   * time in this, should be minimum.
-   * -Dianora
-  */
-
-  if(glines)
-    {
-      kill_list_ptr = last_list_ptr = glines;
-
-      while(kill_list_ptr)
-        {
-          if(kill_list_ptr->hold <= CurrentTime)  /* a gline has expired */
-            {
-              if(glines == kill_list_ptr)
-                {
-                  /* Its pointing to first one in link list*/
-                  /* so, bypass this one, remember bad things can happen
-                     if you try to use an already freed pointer.. */
-
-                  glines = last_list_ptr = tmp_list_ptr =
-                    kill_list_ptr->next;
-                }
-              else
-                {
-                  /* its in the middle of the list, so link around it */
-                  tmp_list_ptr = last_list_ptr->next = kill_list_ptr->next;
-                }
-
-              free_conf(kill_list_ptr);
-              kill_list_ptr = tmp_list_ptr;
-            }
-          else
-            {
-              if( (kill_list_ptr->name && (!name || match(kill_list_ptr->name,
-                 name))) && (kill_list_ptr->host &&
-                   (!host || match(kill_list_ptr->host,host))))
-                return(kill_list_ptr);
-              last_list_ptr = kill_list_ptr;
-              kill_list_ptr = kill_list_ptr->next;
-            }
-        }
-    }
-
-  return((aConfItem *)NULL);
+  return tline_find(&glines, host, name, 0);
 }
 
 /* report_glines
@@ -699,8 +655,7 @@ void report_glines(aClient *sptr)
 {
   GLINE_PENDING *gline_pending_ptr;
   aConfItem *kill_list_ptr;
-  aConfItem *last_list_ptr;
-  aConfItem *tmp_list_ptr;
+  int i;
   char timebuffer[MAX_DATE_STRING];
   struct tm *tmptr;
   char *host;
@@ -752,52 +707,28 @@ void report_glines(aClient *sptr)
                  sptr->name);
     }
 
-  if(glines)
+  for(i = 0; (kill_list_ptr = tline_conf(&glines, i)); i++)
     {
-      kill_list_ptr = last_list_ptr = glines;
+      if(kill_list_ptr->hold <= CurrentTime)   /* gline has expired */
+        continue;
 
-      while(kill_list_ptr)
-        {
-          if(kill_list_ptr->hold <= CurrentTime)   /* gline has expired */
-            {
-              if(glines == kill_list_ptr)
-                {
-                  glines = last_list_ptr = tmp_list_ptr =
-                    kill_list_ptr->next;
-                }
-              else
-                {
-                  /* its in the middle of the list, so link around it */
-                  tmp_list_ptr = last_list_ptr->next = kill_list_ptr->next;
-                }
+      if(kill_list_ptr->host)
+        host = kill_list_ptr->host;
+      else
+        host = "*";
 
-              free_conf(kill_list_ptr);
-              kill_list_ptr = tmp_list_ptr;
-            }
-          else
-            {
-              if(kill_list_ptr->host)
-                host = kill_list_ptr->host;
-              else
-                host = "*";
-
-              if(kill_list_ptr->name)
-                name = kill_list_ptr->name;
-              else
-                name = "*";
-
-              if(kill_list_ptr->passwd)
-                reason = kill_list_ptr->passwd;
-              else
-                reason = "No Reason";
-
-              sendto_one(sptr,form_str(RPL_STATSKLINE), me.name,
-                         sptr->name, 'G' , host, name, reason);
-
-              last_list_ptr = kill_list_ptr;
-              kill_list_ptr = kill_list_ptr->next;
-            }
-        }
+      if(kill_list_ptr->name)
+        name = kill_list_ptr->name;
+      else
+        name = "*";
+
+      if(kill_list_ptr->passwd)
+        reason = kill_list_ptr->passwd;
+      else
+        reason = "No Reason";
+
+      sendto_one(sptr,form_str(RPL_STATSKLINE), me.name,
+                 sptr->name, 'G' , host, name, reason);
     }
 }
 
@@ -810,47 +741,20 @@ void report_glines(aClient *sptr)
  */
 int remove_gline_match(const char* user, const char* host)
 {
-  aConfItem *kill_list_ptr;     /* used for the link list only */
-  aConfItem *last_list_ptr;
-  aConfItem *tmp_list_ptr;
+  aConfItem *kill_list_ptr;
+  int i;
 
-  if(glines)
+  for(i = 0; (kill_list_ptr = tline_conf(&glines, i)); i++)
     {
-      kill_list_ptr = last_list_ptr = glines;
-
-      while(kill_list_ptr)
+      if(!irccmp(kill_list_ptr->host,host) &&
+         !irccmp(kill_list_ptr->name,user))  /* this gline matches */
         {
-          if(!irccmp(kill_list_ptr->host,host) &&
-             !irccmp(kill_list_ptr->name,user))  /* this gline matches */
-            {
-              if(glines == kill_list_ptr)
-                {
-                  /* Its pointing to first one in link list*/
-                  /* so, bypass this one, remember bad things can happen
-                     if you try to use an already freed pointer.. */
-
-                  glines = last_list_ptr = tmp_list_ptr =
-                    kill_list_ptr->next;
-                }
-              else
-                {
-                  /* its in the middle of the list, so link around it */
-                  tmp_list_ptr = last_list_ptr->next = kill_list_ptr->next;
-                }
-              free_conf(kill_list_ptr);
-              kill_list_ptr = tmp_list_ptr;
-              return 1;
-            }
-          else
-            {
-              last_list_ptr = kill_list_ptr;
-              kill_list_ptr = kill_list_ptr->next;
-            }
+          tline_del(&glines, kill_list_ptr);
+          free_conf(kill_list_ptr);
+          return 1;
         }
-      return 0;
     }
-  else
-    return 0;
+  return 0;
 }
 
 /*
@@ -1069,8 +973,7 @@ static int majority_gline(aClient *sptr,
 
 static void add_gline(aConfItem *aconf)
 {
-  aconf->next = glines;
-  glines = aconf;
+  tline_add(&glines, aconf, aconf->name);
 }
 
 #endif /* GLINES */
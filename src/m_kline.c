@@ -24,6 +24,7 @@
  */
 #include "m_commands.h"
 #include "m_kline.h"
+#include "ban_journal.h"
 #include "channel.h"
 #include "class.h"
 #include "client.h"
@@ -54,6 +55,7 @@ extern ConfigFileEntryType ConfigFileEntry; /* defined in ircd.c */
 static int isnumber(char *);    /* return 0 if not, else return number */
 static char *cluster(char *);
 
+#ifndef BAN_JOURNAL
 /*
  * Linked list of pending klines that need to be written to
  * the conf
@@ -67,6 +69,8 @@ static aPendingLine *AddPending(void);
 static void DelPending(aPendingLine *);
 static int LockedFile(const char *);
 static void WritePendingLines(const char *);
+#endif
+static void WriteBan(const char *, struct Client *, char *);
 static void WriteKline(const char *, struct Client *, struct Client *,
                        const char *, const char *, const char *, 
                        const char *, const char *);
@@ -74,6 +78,7 @@ static void WriteDline(const char *, struct Client *,
                        const char *, const char *,
 		       const char *, const char *);
 
+#ifndef BAN_JOURNAL
 /*
 AddPending()
  Add a pending K/D line to our linked list
@@ -232,25 +237,23 @@ WritePendingLines(const char *filename)
   rehash(&me, &me, 0);
 
 } /* WritePendingLines() */
+#endif /* BAN_JOURNAL */
 
 /*
- * WriteKline()
- *  Write out a kline to the kline configuration file
+ * WriteBan()
+ *  Append the lines of a K/D line to the configuration file, or
+ *  with BAN_JOURNAL, queue them for its journal
  */
 
 static void
-WriteKline(const char *filename, struct Client *sptr, struct Client *rcptr,
-           const char *user, const char *host,
-	   const char *reason, const char *oper_reason,
-           const char *when)
+WriteBan(const char *filename, struct Client *sptr, char *buffer)
 
 {
-  char buffer[1024];
+#ifdef BAN_JOURNAL
+  journal_write(filename, buffer);
+#else
   int out;
 
-  if (filename == NULL)
-    return;
-
   if ((out = open(filename, O_RDWR|O_APPEND|O_CREAT, 0644)) == (-1))
   {
     sendto_realops("Error opening %s: %s",
@@ -261,39 +264,43 @@ WriteKline(const char *filename, struct Client *sptr, struct Client *rcptr,
 
   fchmod(out, 0660);
 
-  {
-    if (oper_reason != NULL)
-      {
-	ircsprintf(buffer,
-		   "#%s!%s@%s K'd: %s@%s:%s|%s\n",
-		   sptr->name,
-		   sptr->username,
-		   sptr->host,
-		   user,
-		   host,
-		   reason,
-		   oper_reason);
-      }
-    else
-      {
-	ircsprintf(buffer,
-		   "#%s!%s@%s K'd: %s@%s:%s\n",
-		   sptr->name,
-		   sptr->username,
-		   sptr->host,
-		   user,
-		   host,
-		   reason);
-      }
+  if (safe_write(sptr, filename, out, buffer) == (-1))
+    return;
 
-  }
+  (void) close(out);
+#endif
+} /* WriteBan() */
 
-  if (safe_write(sptr, filename, out, buffer) == (-1))
+/*
+ * WriteKline()
+ *  Write out a kline to the kline configuration file
+ */
+
+static void
+WriteKline(const char *filename, struct Client *sptr, struct Client *rcptr,
+           const char *user, const char *host,
+	   const char *reason, const char *oper_reason,
+           const char *when)
+
+{
+  char buffer[2048];
+  int len;
+
+  if (filename == NULL)
     return;
 
   if (oper_reason != NULL)
     {
-      ircsprintf(buffer, "K:%s:%s (%s) |%s:%s\n",
+      len = ircsprintf(buffer,
+		       "#%s!%s@%s K'd: %s@%s:%s|%s\n",
+		       sptr->name,
+		       sptr->username,
+		       sptr->host,
+		       user,
+		       host,
+		       reason,
+		       oper_reason);
+      ircsprintf(buffer + len, "K:%s:%s (%s) |%s:%s\n",
 		 host,
 		 reason,
 		 when,
@@ -302,17 +309,22 @@ WriteKline(const char *filename, struct Client *sptr, struct Client *rcptr,
     }
   else
     {
-      ircsprintf(buffer, "K:%s:%s (%s):%s\n",
+      len = ircsprintf(buffer,
+		       "#%s!%s@%s K'd: %s@%s:%s\n",
+		       sptr->name,
+		       sptr->username,
+		       sptr->host,
+		       user,
+		       host,
+		       reason);
+      ircsprintf(buffer + len, "K:%s:%s (%s):%s\n",
 		 host,
 		 reason,
 		 when,
 		 user);
     }
 
-  if (safe_write(sptr, filename, out, buffer) == (-1))
-    return;
-
-  (void) close(out);
+  WriteBan(filename, sptr, buffer);
 } /* WriteKline() */
 
 /*
@@ -326,55 +338,38 @@ WriteDline(const char *filename, struct Client *sptr,
 	   const char *when)
 
 {
-  char buffer[1024];
-  int out;
+  char buffer[2048];
+  int len;
 
   if (!filename)
     return;
 
-  if ((out = open(filename, O_RDWR|O_APPEND|O_CREAT, 0644)) == (-1))
-  {
-    sendto_realops("Error opening %s: %s",
-      filename,
-      strerror(errno));
-    return;
-  }
-
-  fchmod(out, 0660);
-
   if(oper_reason != NULL)
-    ircsprintf(buffer,
-	       "#%s!%s@%s D'd: %s:%s|%s (%s)\n",
-	       sptr->name,
-	       sptr->username,
-	       sptr->host,
-	       host,
-	       reason,
-	       oper_reason,
-	       when);
+    len = ircsprintf(buffer,
+		     "#%s!%s@%s D'd: %s:%s|%s (%s)\n",
+		     sptr->name,
+		     sptr->username,
+		     sptr->host,
+		     host,
+		     reason,
+		     oper_reason,
+		     when);
   else
-    ircsprintf(buffer,
-	       "#%s!%s@%s D'd: %s:%s (%s)\n",
-	       sptr->name,
-	       sptr->username,
-	       sptr->host,
-	       host,
-	       reason,
-	       when);
-
-
-  if (safe_write(sptr, filename, out, buffer) == (-1))
-    return;
+    len = ircsprintf(buffer,
+		     "#%s!%s@%s D'd: %s:%s (%s)\n",
+		     sptr->name,
+		     sptr->username,
+		     sptr->host,
+		     host,
+		     reason,
+		     when);
 
-  ircsprintf(buffer, "D:%s:%s (%s)\n",
+  ircsprintf(buffer + len, "D:%s:%s (%s)\n",
     host,
     reason,
     when);
 
-  if (safe_write(sptr, filename, out, buffer) == (-1))
-    return;
-
-  (void) close(out);
+  WriteBan(filename, sptr, buffer);
 } /* WriteDline() */
 
 /*
@@ -716,15 +711,13 @@ m_kline(struct Client *cptr,
           aconf->ip_mask = ip_mask;
         }
       add_temp_kline(aconf);
-      rehashed = YES;
-      dline_in_progress = NO;
-      nextping = CurrentTime;
       sendto_realops("%s added temporary %d min. K-Line for [%s@%s] [%s]",
 		     parv[0],
 		     temporary_kline_time,
 		     user,
 		     host,
 		     reason);
+      check_new_ban(host, ip_kline ? ip : 0, ip_mask, NO);
       return 0;
     }
   else
@@ -738,8 +731,12 @@ m_kline(struct Client *cptr,
     {
       aconf->ip = ip;
       aconf->ip_mask = ip_mask;
-      add_ip_Kline(aconf);
     }
+#ifdef REHASH_THREAD
+  conf_new_ban(aconf);
+#endif
+  if(ip_kline)
+    add_ip_Kline(aconf);
   else
     add_mtrie_conf_entry(aconf,CONF_KILL);
 
@@ -752,9 +749,11 @@ m_kline(struct Client *cptr,
 
   ilog(L_TRACE, "%s added K-Line for [%s@%s] [%s|%s]",
       sptr->name, user, host, reason, oper_reason ? oper_reason : "");
+  check_new_ban(host, ip_kline ? ip : 0, ip_mask, NO);
 
   kconf = get_conf_name(KLINE_TYPE);
 
+#ifndef BAN_JOURNAL
   /*
    * Check if the conf file is locked - if so, add the kline
    * to our pending kline list, to be written later, if not,
@@ -794,6 +793,7 @@ m_kline(struct Client *cptr,
   }
   else if (PendingLines)
     WritePendingLines(kconf);
+#endif
 
   sendto_one(sptr,
     ":%s NOTICE %s :Added K-Line [%s@%s] to %s",
@@ -815,9 +815,6 @@ m_kline(struct Client *cptr,
 	     oper_reason,
 	     current_date);
 
-  rehashed = YES;
-  dline_in_progress = NO;
-  nextping = CurrentTime;
   return 0;
 } /* m_kline() */
 
@@ -1177,6 +1174,9 @@ m_dline(struct Client *cptr, struct Client *sptr, int parc, char *parv[])
   aconf->ip = ip_host;
   aconf->ip_mask = ip_mask;
 
+#ifdef REHASH_THREAD
+  conf_new_ban(aconf);
+#endif
   add_Dline(aconf);
 
   sendto_realops("%s added D-Line for [%s] [%s]",
@@ -1188,8 +1188,17 @@ m_dline(struct Client *cptr, struct Client *sptr, int parc, char *parv[])
       sptr->name, host, reason,
       oper_reason ? oper_reason : "" );
 
+  /*
+  ** we still want the server to
+  ** hunt for 'targetted' clients even if
+  ** there are problems adding the D-line
+  ** to the appropriate file. -ThemBones
+  */
+  check_new_ban(host, ip_host, ip_mask, YES);
+
   dconf = get_conf_name(DLINE_TYPE);
 
+#ifndef BAN_JOURNAL
   /*
    * Check if the conf file is locked - if so, add the dline
    * to our pending dline list, to be written later, if not,
@@ -1227,6 +1236,7 @@ m_dline(struct Client *cptr, struct Client *sptr, int parc, char *parv[])
     }
   else if (PendingLines)
     WritePendingLines(dconf);
+#endif
   
   sendto_one(sptr,
 	     ":%s NOTICE %s :Added D-Line [%s] to %s",
@@ -1245,15 +1255,5 @@ m_dline(struct Client *cptr, struct Client *sptr, int parc, char *parv[])
 	     oper_reason,
 	     current_date);
 
-  /*
-  ** I moved the following 2 lines up here
-  ** because we still want the server to
-  ** hunt for 'targetted' clients even if
-  ** there are problems adding the D-line
-  ** to the appropriate file. -ThemBones
-  */
-  rehashed = YES;
-  dline_in_progress = YES;
-  nextping = CurrentTime;
   return 0;
 } /* m_dline() */
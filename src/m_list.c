@@ -20,7 +20,9 @@
  *   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
  */
 #include "m_commands.h"
+#include "m_list.h"
 #include "channel.h"
+#include "class.h"
 #include "client.h"
 #include "hash.h"
 #include "irc_string.h"
@@ -29,21 +31,384 @@
 #include "send.h"
 
 #include <assert.h>
+#include <limits.h>
 #include <string.h>
 #include <stdlib.h>
 
+/*
+ * The channel index. Every channel is on it from get_channel() until
+ * it is freed, ordered by user count, biggest first, then by name, so
+ * a LIST asking for channels over or under some size only looks at
+ * those. It is a skip list; chptr->listnext[i] is the next channel on
+ * level i and list_head[i] the first. A channel's place is kept right
+ * by list_set_users(), which every change to chptr->users goes through.
+ */
+static struct Channel* list_head[LIST_LEVELS];
+
+/* LISTs still being sent, see list_run() */
+static struct ListTask* list_tasks;
+
+/*
+ * list_before - true if chptr sorts before a channel of users users
+ * called name
+ */
+static int list_before(struct Channel* chptr, int users, const char* name)
+{
+  if (chptr->users != users)
+    return chptr->users > users;
+  return irccmp(chptr->chname, name) < 0;
+}
+
+/*
+ * list_find - fill in update with the last channel on each level that
+ * sorts before users/name, NULL where that is the head
+ */
+static void list_find(struct Channel** update, int users, const char* name)
+{
+  struct Channel* chptr = NULL;
+  struct Channel* next;
+  int             i;
+
+  for (i = LIST_LEVELS - 1; i >= 0; i--)
+    {
+      while ((next = chptr ? chptr->listnext[i] : list_head[i]) &&
+             list_before(next, users, name))
+        chptr = next;
+      update[i] = chptr;
+    }
+}
+
+static void list_link(struct Channel* chptr)
+{
+  struct Channel*  update[LIST_LEVELS];
+  struct Channel** prev;
+  int              i;
+
+  list_find(update, chptr->users, chptr->chname);
+  for (i = 0; i < chptr->listlevel; i++)
+    {
+      prev = update[i] ? &update[i]->listnext[i] : &list_head[i];
+      chptr->listnext[i] = *prev;
+      *prev = chptr;
+    }
+}
+
+static void list_unlink(struct Channel* chptr)
+{
+  struct Channel*  update[LIST_LEVELS];
+  struct Channel** prev;
+  int              i;
+
+  list_find(update, chptr->users, chptr->chname);
+  for (i = 0; i < chptr->listlevel; i++)
+    {
+      prev = update[i] ? &update[i]->listnext[i] : &list_head[i];
+      assert(*prev == chptr);
+      *prev = chptr->listnext[i];
+    }
+}
+
+/*
+ * list_add_channel - put a new channel on the index
+ */
+void list_add_channel(struct Channel* chptr)
+{
+  int level = 1;
+
+  while (level < LIST_LEVELS && (rand() & 3) == 0)
+    level++;
+  chptr->listlevel = level;
+  chptr->listnext = (struct Channel**) MyMalloc(level *
+                                                sizeof(struct Channel*));
+  list_link(chptr);
+}
+
+/*
+ * list_del_channel - take a channel about to be freed off the index
+ */
+void list_del_channel(struct Channel* chptr)
+{
+  list_unlink(chptr);
+  MyFree(chptr->listnext);
+  chptr->listnext = NULL;
+}
+
+/*
+ * list_set_users - change chptr->users, moving chptr to its new place
+ */
+void list_set_users(struct Channel* chptr, int users)
+{
+  if (chptr->users == users)
+    return;
+  list_unlink(chptr);
+  chptr->users = users;
+  list_link(chptr);
+}
+
+/*
+ * What a LIST asked for. A channel is shown if it has more than
+ * min_users and fewer than max_users, was created and had its topic
+ * set within the times given, and matches one of the masks, if any.
+ */
+struct ListFilter
+{
+  int         min_users;
+  int         max_users;
+  time_t      created_min;
+  time_t      created_max;
+#ifdef TOPIC_INFO
+  time_t      topic_min;
+  time_t      topic_max;
+#endif
+  int         masks;
+  int         wild;             /* some mask has wildcards */
+  const char* mask[LIST_MAX_MASKS];
+};
+
+/*
+ * list_minutes - the time N minutes before now, for a C or T filter
+ */
+static time_t list_minutes(const char* p)
+{
+  return CurrentTime - atoi(p) * 60;
+}
+
+/*
+ * list_parse - fill in f from the comma separated LIST parameter.
+ *
+ *   >N, <N     more than, fewer than N users
+ *   C>N, C<N   created more than, less than N minutes ago
+ *   T>N, T<N   topic set more than, less than N minutes ago
+ *
+ * anything else is a channel name or mask; past LIST_MAX_MASKS of
+ * them the rest are let go.
+ */
+static void list_parse(struct ListFilter* f, char* param)
+{
+  char* p = NULL;
+  char* name;
+
+  memset(f, 0, sizeof(struct ListFilter));
+  f->min_users = -1;
+  f->max_users = INT_MAX;
+  if (!param)
+    return;
+
+  for (name = strtoken(&p, param, ","); name;
+       name = strtoken(&p, NULL, ","))
+    {
+      if (*name == '>')
+        f->min_users = atoi(name + 1);
+      else if (*name == '<')
+        f->max_users = atoi(name + 1);
+      else if (ToUpper(*name) == 'C' && name[1] == '>')
+        f->created_max = list_minutes(name + 2);
+      else if (ToUpper(*name) == 'C' && name[1] == '<')
+        f->created_min = list_minutes(name + 2);
+#ifdef TOPIC_INFO
+      else if (ToUpper(*name) == 'T' && name[1] == '>')
+        f->topic_max = list_minutes(name + 2);
+      else if (ToUpper(*name) == 'T' && name[1] == '<')
+        f->topic_min = list_minutes(name + 2);
+#endif
+      else if (f->masks < LIST_MAX_MASKS)
+        {
+          if (strchr(name, '*') || strchr(name, '?'))
+            f->wild = 1;
+          f->mask[f->masks++] = name;
+        }
+    }
+}
+
+/*
+ * list_matches - true if chptr passes the filters in f
+ */
+static int list_matches(struct ListFilter* f, struct Channel* chptr)
+{
+  int i;
+
+  if (f->created_min && chptr->channelts < f->created_min)
+    return 0;
+  if (f->created_max && chptr->channelts > f->created_max)
+    return 0;
+#ifdef TOPIC_INFO
+  if ((f->topic_min || f->topic_max) && !*chptr->topic)
+    return 0;
+  if (f->topic_min && chptr->topic_time < f->topic_min)
+    return 0;
+  if (f->topic_max && chptr->topic_time > f->topic_max)
+    return 0;
+#endif
+  if (!f->masks)
+    return 1;
+  for (i = 0; i < f->masks; i++)
+    if (match(f->mask[i], chptr->chname))
+      return 1;
+  return 0;
+}
+
+/*
+ * list_keep - add a channel name to what task is to send
+ */
+static void list_keep(struct ListTask* task, const char* name)
+{
+  size_t len = strlen(name) + 1;
+
+  if (task->len + len > task->size)
+    {
+      task->size = task->size ? task->size * 2 : 4096;
+      task->names = (char*) MyRealloc(task->names, task->size);
+    }
+  memcpy(task->names + task->len, name, len);
+  task->len += len;
+}
+
+/*
+ * list_snapshot - make the task for a LIST, keeping the names of the
+ * channels sptr may see that pass f. The walk starts at the first
+ * channel under max_users and stops at min_users.
+ */
+static struct ListTask* list_snapshot(struct Client* sptr,
+                                      struct ListFilter* f)
+{
+  struct ListTask* task;
+  struct Channel*  chptr = NULL;
+  struct Channel*  next;
+  int              i;
+
+  task = (struct ListTask*) MyMalloc(sizeof(struct ListTask));
+  memset(task, 0, sizeof(struct ListTask));
+  task->client = sptr;
+
+  for (i = LIST_LEVELS - 1; i >= 0; i--)
+    while ((next = chptr ? chptr->listnext[i] : list_head[i]) &&
+           next->users >= f->max_users)
+      chptr = next;
+
+  for (chptr = chptr ? chptr->listnext[0] : list_head[0];
+       chptr && chptr->users > f->min_users; chptr = chptr->listnext[0])
+    {
+      if (SecretChannel(chptr) && !IsMember(sptr, chptr))
+        continue;
+      if (list_matches(f, chptr))
+        list_keep(task, chptr->chname);
+    }
+  return task;
+}
+
+static void list_free(struct ListTask* task)
+{
+  task->client->listtask = NULL;
+  MyFree(task->names);
+  MyFree(task);
+}
+
+/*
+ * list_held - true while cptr has enough queued to be getting on with
+ */
+static int list_held(struct Client* cptr)
+{
+  return IsDead(cptr) || DBufLength(&cptr->sendQ) > get_sendq(cptr) / 2;
+}
+
+/*
+ * list_step - send the next slice of task, return 1 once it is all
+ * sent. A channel gone or turned secret since the LIST started is
+ * left out, the rest go with their users and topic as they are now.
+ */
+static int list_step(struct ListTask* task)
+{
+  struct Client*  cptr = task->client;
+  struct Channel* chptr;
+  const char*     name;
+  int             n;
+
+  for (n = 0; n < LIST_SLICE && task->pos < task->len; )
+    {
+      if (list_held(cptr))
+        return 0;
+      name = task->names + task->pos;
+      task->pos += strlen(name) + 1;
+      if (!(chptr = hash_find_channel(name, NullChn)) ||
+          (SecretChannel(chptr) && !IsMember(cptr, chptr)))
+        continue;
+      sendto_one(cptr, form_str(RPL_LIST), me.name, cptr->name,
+                 ShowChannel(cptr, chptr) ? chptr->chname : "*",
+                 chptr->users,
+                 ShowChannel(cptr, chptr) ? chptr->topic : "");
+      n++;
+    }
+  if (task->pos < task->len)
+    return 0;
+  sendto_one(cptr, form_str(RPL_LISTEND), me.name, cptr->name);
+  return 1;
+}
+
+/*
+ * list_run - send the next slice of each LIST in progress
+ */
+void list_run(void)
+{
+  struct ListTask** link = &list_tasks;
+  struct ListTask*  task;
+
+  while ((task = *link))
+    {
+      if (list_step(task))
+        {
+          *link = task->next;
+          list_free(task);
+        }
+      else
+        link = &task->next;
+    }
+}
+
+/*
+ * list_waiting - true if a LIST could go on right away
+ */
+int list_waiting(void)
+{
+  struct ListTask* task;
+
+  for (task = list_tasks; task; task = task->next)
+    if (!list_held(task->client))
+      return 1;
+  return 0;
+}
+
+/*
+ * list_cancel - drop the LIST cptr has in progress, if any
+ */
+void list_cancel(struct Client* cptr)
+{
+  struct ListTask** link;
+
+  if (!cptr->listtask)
+    return;
+  for (link = &list_tasks; *link; link = &(*link)->next)
+    if (*link == cptr->listtask)
+      {
+        *link = cptr->listtask->next;
+        break;
+      }
+  list_free(cptr->listtask);
+}
+
 /*
 ** m_list
 **      parv[0] = sender prefix
-**      parv[1] = channel
+**      parv[1] = channels, masks and filters, comma separated
 */
 int     m_list(struct Client *cptr,
                struct Client *sptr,
                int parc,
                char *parv[])
 {
-  struct Channel *chptr;
-  char  *name, *p = NULL;
+  struct ListFilter filter;
+  struct ListTask*  task;
+  struct Channel*   chptr;
+  int               i;
   /* anti flooding code,
    * I did have this in parse.c with a table lookup
    * but I think this will be less inefficient doing it in each
@@ -52,15 +417,14 @@ int     m_list(struct Client *cptr,
    * -Dianora
    */
   static time_t last_used=0L;
-  int i,j;
 
   /* throw away non local list requests that do get here -Dianora */
-  if(!MyConnect(sptr))
+  if(!MyConnect(sptr) || !sptr->user)
     return 0;
 
   if(!IsAnOper(sptr))
     {
-      if(((last_used + PACE_WAIT) > CurrentTime) && (!IsDoingList(sptr)))
+      if((last_used + PACE_WAIT) > CurrentTime)
         {
           sendto_one(sptr,form_str(RPL_LOAD2HI),me.name,parv[0]);
           return 0;
@@ -69,96 +433,45 @@ int     m_list(struct Client *cptr,
         last_used = CurrentTime;
     }
 
-  /* right.. if we are already involved in a "blocked" /list, we will simply
-     continue where we left off */
-  if (IsDoingList(sptr)) {
-    if (sptr->listprogress != -1) {
-      for (i=sptr->listprogress; i<CH_MAX; i++) {
-        int progress2 = sptr->listprogress2;
-        for (j=0, chptr=(struct Channel*)(hash_get_channel_block(i).list);
-             (chptr) && (j<hash_get_channel_block(i).links); chptr=chptr->hnextch, j++) {
-          if (j<progress2) continue;  /* wind up to listprogress2 */
-          if (!sptr->user ||
-              (SecretChannel(chptr) && !IsMember(sptr, chptr)))
-            continue;
-          sendto_one(sptr, form_str(RPL_LIST), me.name, parv[0],
-                     ShowChannel(sptr, chptr)?chptr->chname:"*",
-                     chptr->users,
-                     ShowChannel(sptr, chptr)?chptr->topic:"");
-          if (IsSendqPopped(sptr)) {
-            /* we popped again! : P */
-            sptr->listprogress=i;
-            sptr->listprogress2=j;
-            return 0;
-          }
-        }
-        sptr->listprogress2 = 0;
-      }
-    }
-    sendto_one(sptr, form_str(RPL_LISTEND), me.name, parv[0]);
-    if (IsSendqPopped(sptr)) { /* popped with the RPL_LISTEND code. d0h */
-      sptr->listprogress = -1;
-      return 0;
+  /* a new LIST ends the one still being sent */
+  if (sptr->listtask)
+    {
+      list_cancel(sptr);
+      sendto_one(sptr, form_str(RPL_LISTEND), me.name, parv[0]);
     }
-    ClearDoingList(sptr);   /* yupo, its over */
-    return 0;
-    
-  }
-  
+
+  list_parse(&filter, (parc < 2 || BadPtr(parv[1])) ? NULL : parv[1]);
   sendto_one(sptr, form_str(RPL_LISTSTART), me.name, parv[0]);
 
-  if (parc < 2 || BadPtr(parv[1]))
+  /* just names, look them up */
+  if (filter.masks && !filter.wild && filter.min_users < 0 &&
+      filter.max_users == INT_MAX && !filter.created_min &&
+      !filter.created_max
+#ifdef TOPIC_INFO
+      && !filter.topic_min && !filter.topic_max
+#endif
+      )
     {
-      SetDoingList(sptr);     /* only set if its a full list */
-      ClearSendqPop(sptr);    /* just to make sure */
-      /* we'll do this by looking through each hash table bucket */
-      for (i=0; i<CH_MAX; i++) {
-        for (j=0, chptr = (struct Channel*)(hash_get_channel_block(i).list);
-             (chptr) && (j<hash_get_channel_block(i).links); chptr = chptr->hnextch, j++) {
-          if (!sptr->user ||
-              (SecretChannel(chptr) && !IsMember(sptr, chptr)))
-            continue;
-          /* EVIL!  sendto_one doesnt return status of any kind!  Forcing us
-             to make up yet another stupid client flag (we could just
-             negate the DOING_LIST flag, but that might confuse people) -good*/
-          sendto_one(sptr, form_str(RPL_LIST), me.name, parv[0],
-                     ShowChannel(sptr, chptr)?chptr->chname:"*",
-                     chptr->users,
-                     ShowChannel(sptr, chptr)?chptr->topic:"");
-          if (IsSendqPopped(sptr)) {
-            /* GAAH!  We popped our sendq.  Mark our location in the /list */
-            sptr->listprogress=i;
-            sptr->listprogress2=j;
-            return 0;
-          }
+      for (i = 0; i < filter.masks; i++)
+        {
+          chptr = hash_find_channel(filter.mask[i], NullChn);
+          if (chptr && ShowChannel(sptr, chptr))
+            sendto_one(sptr, form_str(RPL_LIST), me.name, parv[0],
+                       chptr->chname, chptr->users, chptr->topic);
         }
-      
-      }
-
       sendto_one(sptr, form_str(RPL_LISTEND), me.name, parv[0]);
-      if (IsSendqPopped(sptr)) {
-        sptr->listprogress=-1;
-        return 0;
-      }
-      ClearDoingList(sptr);   /* yupo, its over */
       return 0;
-    }   
-
-  p = strchr(parv[1],',');
-  if(p)
-    *p = '\0';
-  name = parv[1]; /* strtoken(&p, parv[1], ","); */
+    }
 
-  /* while(name) */
-  if(name)
+  task = list_snapshot(sptr, &filter);
+  if (list_step(task))
     {
-      chptr = hash_find_channel(name, NullChn);
-      if (chptr && ShowChannel(sptr, chptr) && sptr->user)
-        sendto_one(sptr, form_str(RPL_LIST), me.name, parv[0],
-                   ShowChannel(sptr,chptr) ? name : "*",
-                   chptr->users, chptr->topic);
-      /*      name = strtoken(&p, (char *)NULL, ","); */
+      MyFree(task->names);
+      MyFree(task);
+      return 0;
     }
-  sendto_one(sptr, form_str(RPL_LISTEND), me.name, parv[0]);
+  sptr->listtask = task;
+  task->next = list_tasks;
+  list_tasks = task;
   return 0;
 }
@@ -218,12 +218,8 @@ int     m_ltrace(struct Client *cptr,
   /*
    * Count up all the servers and clients in a downlink.
    */
-  if (doall) {
-    for (acptr = GlobalClientList; acptr; acptr = acptr->next) {
-      if (IsServer(acptr)) 
-        ++link_s[acptr->from->fd];
-    }
-  }
+  if (doall)
+    count_downlinks(&me, link_s, NULL);
 
   /* report all direct connections */
   now = time(NULL);
@@ -31,6 +31,7 @@
 #include "m_gline.h"
 #include "numeric.h"
 #include "res.h"
+#include "s_auth.h"
 #include "s_conf.h"
 #include "s_log.h"
 #include "send.h"
@@ -125,6 +126,9 @@ int m_rehash(struct Client *cptr, struct Client *sptr, int parc, char *parv[])
                  parv[0]);
           restart_resolver();   /* re-read /etc/resolv.conf AGAIN?
                                    and close/re-open res socket */
+#ifdef AUTH_CACHE
+          flush_auth_cache();
+#endif
           found = YES;
         }
       else if(irccmp(parv[1],"TKLINES") == 0)
@@ -37,6 +37,7 @@
 #include "channel.h"  /* for server_was_split */
 #include "m_sinfo.h"
 #include "irc_string.h"
+#include "tline_conf.h"
 
 int m_sinfo (struct Client *cptr, struct Client *sptr, int parc, char *parv[])
 {
@@ -91,15 +92,8 @@ int m_sinfo (struct Client *cptr, struct Client *sptr, int parc, char *parv[])
         break;
       case TOKEN_TKLINES:
         {
-          struct ConfItem *cur_p;
-          int tknum = 0;
-          
-          for (cur_p = temporary_klines; cur_p; cur_p = cur_p->next)
-          { 
-            tknum++;
-          }
           sendto_one(sptr, ":%s NOTICE %s :There are currently %d temporary kline(s)", 
-                     me.name, parv[0], tknum);  
+                     me.name, parv[0], temporary_klines.count);  
           return 0;
           break;
         }
@@ -41,6 +41,7 @@
 #include "struct.h"
 #include "s_conf.h"      /* ConfItem, report_configured_links */
 #include "s_debug.h"     /* send_usage */
+#include "s_latency.h"   /* report_latency */
 #include "s_misc.h"      /* serv_info */
 #include "s_serv.h"      /* hunt_server, show_servers */
 #include "s_stats.h"     /* tstats */
@@ -521,6 +522,19 @@ int m_stats(struct Client *cptr, struct Client *sptr, int parc, char *parv[])
       valid_stats++;
       break;
 
+#ifdef LATENCY_STATS
+    case 'W' : case 'w' :
+      if (!IsAnOper(sptr))
+        {
+          ignore_request++;
+          valid_stats++;
+          break;
+        }
+      report_latency(sptr, parv[0]);
+      valid_stats++;
+      break;
+#endif
+
     case 'x' : case 'X' :
       if(IsAnOper(sptr))
         {
@@ -615,12 +629,12 @@ static int report_channel_stats(struct Client *sptr)
 
   for(chptr = channel; chptr; chptr = chptr->nextch)
   {
-    struct SLink *m;
+    int i;
     opped = 0;
     
-    for (m = chptr->members; m; m = m->next)
+    for (i = 0; i < chptr->memberc; i++)
     {
-      if(m->flags & CHFL_CHANOP)
+      if(chptr->memberv[i]->flags & CHFL_CHANOP)
       {
         opped++;
 	break;
@@ -264,28 +264,21 @@ int m_trace(struct Client *cptr, struct Client *sptr, int parc, char *parv[])
    */
   if (doall)
    {
-    for (acptr = GlobalClientList; acptr; acptr = acptr->next)
-     {
-#ifdef  SHOW_INVISIBLE_LUSERS
-      if (IsPerson(acptr))
-        {
-          link_u[acptr->from->fd]++;
-        }
-#else
-      if (IsPerson(acptr) &&
-        (!IsInvisible(acptr) || IsAnOper(sptr)))
-        {
-          link_u[acptr->from->fd]++;
-        }
-#endif
-      else
-        {
-          if (IsServer(acptr))
-            {
+#ifndef SHOW_INVISIBLE_LUSERS
+    if (!IsAnOper(sptr))
+      {
+        /* the invisible aren't counted for them, look at everybody */
+        for (acptr = GlobalClientList; acptr; acptr = acptr->next)
+          {
+            if (IsPerson(acptr) && !IsInvisible(acptr))
+              link_u[acptr->from->fd]++;
+            else if (IsServer(acptr))
               link_s[acptr->from->fd]++;
-            }
-        }
-     }
+          }
+      }
+    else
+#endif
+      count_downlinks(&me, link_s, link_u);
    }
   /* report all direct connections */
   for (i = 0; i <= highest_fd; i++)
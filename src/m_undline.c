@@ -24,6 +24,7 @@
  *   $Id: m_undline.c,v 1.2 2003/06/24 03:57:16 ievil Exp $
  */
 #include "m_commands.h"
+#include "ban_journal.h"
 #include "channel.h"
 #include "client.h"
 #include "common.h"
@@ -148,6 +149,15 @@ m_undline (aClient *cptr,aClient *sptr,int parc,char *parv[])
     }
 
   filename = get_conf_name(DLINE_TYPE);
+#ifdef BAN_JOURNAL
+  /* the file is rewritten below, what is journaled goes in first */
+  if (!journal_fold(filename))
+    {
+      sendto_one(sptr, ":%s NOTICE %s :%s is being read by a rehash, try again",
+                 me.name, parv[0], filename);
+      return 0;
+    }
+#endif
 
   if ((in = fbopen(filename, "r")) == 0)
     {
@@ -24,6 +24,7 @@
  *   $Id: m_unkline.c,v 1.54 2003/06/24 03:57:16 ievil Exp $
  */
 #include "m_commands.h"
+#include "ban_journal.h"
 #include "channel.h"
 #include "client.h"
 #include "common.h"
@@ -39,6 +40,7 @@
 #include "s_serv.h"
 #include "send.h"
 #include "struct.h"
+#include "tline_conf.h"
 
 #include <stdio.h>
 #include <time.h>
@@ -164,6 +166,15 @@ int m_unkline (aClient *cptr,aClient *sptr,int parc,char *parv[])
     }
 
   filename = get_conf_name(KLINE_TYPE);
+#ifdef BAN_JOURNAL
+  /* the file is rewritten below, what is journaled goes in first */
+  if (!journal_fold(filename))
+    {
+      sendto_one(sptr, ":%s NOTICE %s :%s is being read by a rehash, try again",
+                 me.name, parv[0], filename);
+      return 0;
+    }
+#endif
 
   if ((in = fbopen(filename, "r")) == 0)
     {
@@ -379,58 +390,23 @@ flush_write(aClient *sptr, FBFILE *in, FBFILE *out, char *buf, char *temppath)
 static int remove_tkline_match(char *host,char *user, unsigned long ip)
 {
   aConfItem *kill_list_ptr;
-  aConfItem *last_kill_ptr=(aConfItem *)NULL;
-
-  if(!temporary_klines && !temporary_ip_klines)
-    return NO;
+  int i;
 
-  if(ip != 0)
+  for(i = 0; (kill_list_ptr = tline_conf(&temporary_klines, i)); i++)
   {
-    kill_list_ptr = temporary_ip_klines;
-
-    while(kill_list_ptr)
+    if(ip != 0)
     {
-      if((ip & kill_list_ptr->ip_mask) == kill_list_ptr->ip)
-      {
-        if(last_kill_ptr)
-	  last_kill_ptr->next = kill_list_ptr->next;
-	else
-	  temporary_ip_klines = kill_list_ptr->next;
-	free_conf(kill_list_ptr);
-	return YES;
-      }
-      else
-      {
-        last_kill_ptr = kill_list_ptr;
-
-        kill_list_ptr = kill_list_ptr->next;
-      }
-    }
-
-    return NO;
-  }
-  else
-  {
-    kill_list_ptr = temporary_klines;
-
-    while(kill_list_ptr)
-    {
-      if( !irccmp(kill_list_ptr->host,host)
-          && !irccmp(kill_list_ptr->user,user)) /* match */
-        {
-          if(last_kill_ptr)
-            last_kill_ptr->next = kill_list_ptr->next;
-          else
-            temporary_klines = kill_list_ptr->next;
-          free_conf(kill_list_ptr);
-          return YES;
-        }
-      else
-        {
-          last_kill_ptr = kill_list_ptr;
-          kill_list_ptr = kill_list_ptr->next;
-        }
+      if(!kill_list_ptr->ip || (ip & kill_list_ptr->ip_mask) != kill_list_ptr->ip)
+        continue;
     }
-    return NO;
+    else if(kill_list_ptr->ip
+            || irccmp(kill_list_ptr->host,host)
+            || irccmp(kill_list_ptr->user,user))
+      continue;
+
+    tline_del(&temporary_klines, kill_list_ptr);
+    free_conf(kill_list_ptr);
+    return YES;
   }
+  return NO;
 }
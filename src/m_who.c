@@ -35,6 +35,10 @@
 #include "send.h"
 #include "list.h"
 #include "irc_string.h"
+#include "s_conf.h"
+
+#include <string.h>
+#include <netinet/in.h>
 
 /*
  * m_functions execute protocol messages on this server:
@@ -109,7 +113,7 @@ static  void    do_who(struct Client *sptr,
   if (IsAnOper(acptr))
     *p++ = '*';
   if ((repchan != NULL) && (lp == NULL))
-    lp = find_user_link(repchan->members, acptr);
+    lp = find_member_link(repchan, acptr);
   if (lp != NULL)
     {
 #ifdef HIDE_OPS
@@ -139,11 +143,240 @@ static  void    do_who(struct Client *sptr,
 }
 
 
+/*
+ * Fields a WHO mask is matched against. By default it is tried on all
+ * but the address; letters after the mask pick fields, see who_flags().
+ * A search on nothing but host, address and server goes through the
+ * indexes of users by domain, local users by /24 and users by server
+ * instead of looking at every client. So does a default search whose
+ * mask ends in a domain, see who_domain().
+ */
+#define WHO_NICK        0x01
+#define WHO_USER        0x02
+#define WHO_HOST        0x04
+#define WHO_IP          0x08
+#define WHO_SERVER      0x10
+#define WHO_INFO        0x20
+#define WHO_DEFAULT     (WHO_NICK | WHO_USER | WHO_HOST | WHO_SERVER | WHO_INFO)
+#define WHO_INDEXED     (WHO_HOST | WHO_IP | WHO_SERVER)
+
+struct WhoQuery
+{
+  struct Client* sptr;
+  const char*    mask;
+  int            fields;
+  int            oper;          /* opers only */
+  int            spy;           /* an OPERSPY WHO, everybody shows */
+  int            left;          /* replies still to go */
+  unsigned long  ip;            /* mask as an address and netmask, */
+  unsigned long  ip_mask;       /* if it is one, host order */
+  const char*    done;          /* domain an earlier pass has covered */
+};
+
+/*
+ * who_flags - the fields picked by the letters in flags, 0 if none
+ * are. 'o' still means opers only; 'i' is for opers.
+ */
+static int who_flags(struct WhoQuery* q, const char* flags)
+{
+  int fields = 0;
+
+  for ( ; *flags; flags++)
+    switch (*flags)
+      {
+      case 'o': q->oper = 1; break;
+      case 'n': fields |= WHO_NICK; break;
+      case 'u': fields |= WHO_USER; break;
+      case 'h': fields |= WHO_HOST; break;
+      case 's': fields |= WHO_SERVER; break;
+      case 'r': fields |= WHO_INFO; break;
+      case 'i':
+        if (IsAnOper(q->sptr))
+          fields |= WHO_IP;
+        break;
+      default:
+        break;
+      }
+  return fields;
+}
+
+/*
+ * who_matches - true if the mask matches acptr on one of fields.
+ * Only local users have an address, and not a spoofed one.
+ */
+static int who_matches(struct WhoQuery* q, struct Client* acptr, int fields)
+{
+  unsigned long addr;
+
+  if ((fields & WHO_NICK) && match(q->mask, acptr->name))
+    return 1;
+  if ((fields & WHO_USER) && match(q->mask, acptr->username))
+    return 1;
+  if ((fields & WHO_HOST) && match(q->mask, acptr->host))
+    return 1;
+  if ((fields & WHO_SERVER) && match(q->mask, acptr->user->server))
+    return 1;
+  if ((fields & WHO_INFO) && match(q->mask, acptr->info))
+    return 1;
+  if ((fields & WHO_IP) && MyConnect(acptr) && !IsIPSpoof(acptr))
+    {
+      addr = ntohl(acptr->ip.s_addr);
+      if (q->ip_mask ? (addr & q->ip_mask) == q->ip :
+          match(q->mask, inetntoa((const char*) &acptr->ip)))
+        return 1;
+    }
+  return 0;
+}
+
+/*
+ * who_one - send acptr if the mask matches it on fields but not on
+ * skip, what an earlier pass has covered, and sptr may see it
+ */
+static void who_one(struct WhoQuery* q, struct Client* acptr,
+                    int fields, int skip)
+{
+  struct Channel* chptr;
+  struct Channel* ch2ptr = NULL;
+  Link*           lp;
+  int             showperson = 0;
+  int             isinvis;
+  int             member;
+
+  if (!q->left || !IsPerson(acptr))
+    return;
+  if (q->oper && !IsAnOper(acptr))
+    return;
+  if (!who_matches(q, acptr, fields) ||
+      (skip && who_matches(q, acptr, skip)))
+    return;
+  if (q->done && !irccmp(host_domain(acptr->host), q->done))
+    return;
+
+  /*
+   * Show user if they are on the same channel, or not
+   * invisible and on a non secret channel (if any).
+   */
+  isinvis = IsInvisible(acptr);
+  for (lp = acptr->user->channel; lp; lp = lp->next)
+    {
+      chptr = lp->value.chptr;
+      member = IsMember(q->sptr, chptr);
+      if (isinvis && !member)
+        continue;
+      if (member || (!isinvis && PubChannel(chptr)))
+        {
+          ch2ptr = chptr;
+          showperson = 1;
+          break;
+        }
+      if (HiddenChannel(chptr) && !SecretChannel(chptr) &&
+          !isinvis)
+        showperson = 1;
+    }
+  if (!acptr->user->channel && !isinvis)
+    showperson = 1;
+
+  if (showperson || q->spy)
+    {
+      do_who(q->sptr, acptr, ch2ptr, NULL);
+      --q->left;
+    }
+}
+
+/*
+ * who_hosts - users whose host matches, from the users of the mask's
+ * domain if it has one
+ */
+static void who_hosts(struct WhoQuery* q, int skip)
+{
+  struct Client* acptr;
+  const char*    domain;
+
+  if (!(domain = mask_domain(q->mask)))
+    {
+      for (acptr = GlobalClientList; acptr && q->left; acptr = acptr->next)
+        who_one(q, acptr, WHO_HOST, skip);
+      return;
+    }
+  for (acptr = hash_find_user_domain(domain); acptr && q->left;
+       acptr = acptr->udomnext)
+    who_one(q, acptr, WHO_HOST, skip);
+}
+
+/*
+ * who_ips - local users whose address matches, from the /24s under
+ * the mask if it is an address with a netmask of /16 or longer
+ */
+static void who_ips(struct WhoQuery* q, int skip)
+{
+  struct Client* acptr;
+  unsigned long  block;
+  int            i;
+
+  if ((q->ip_mask & 0xffff0000UL) != 0xffff0000UL)
+    {
+      for (acptr = local_cptr_list; acptr && q->left;
+           acptr = acptr->next_local_client)
+        who_one(q, acptr, WHO_IP, skip);
+      return;
+    }
+  for (i = 0; i < 256 && q->left; ++i)
+    {
+      block = (q->ip & 0xffff0000UL) | ((unsigned long) i << 8);
+      if ((block ^ q->ip) & q->ip_mask & 0xffffff00UL)
+        continue;
+      for (acptr = hash_find_ip_block(block); acptr && q->left;
+           acptr = acptr->ipnext)
+        if ((ntohl(acptr->ip.s_addr) & 0xffffff00UL) == block)
+          who_one(q, acptr, WHO_IP, skip);
+    }
+}
+
+/*
+ * who_servers - users of the servers from server down whose names
+ * match
+ */
+static void who_servers(struct WhoQuery* q, struct Client* server, int skip)
+{
+  struct Client* acptr;
+
+  if (match(q->mask, server->name))
+    for (acptr = server->serv->users; acptr && q->left;
+         acptr = acptr->lnext)
+      who_one(q, acptr, WHO_SERVER, skip);
+  for (acptr = server->serv->servers; acptr && q->left;
+       acptr = acptr->lnext)
+    who_servers(q, acptr, skip);
+}
+
+/*
+ * who_domain - a default search for a mask that ends in a domain: the
+ * users of that domain, matched on every field, then the users of the
+ * servers the mask matches. Users elsewhere whose user name or real
+ * name alone matches are not looked for; nicks can't hold the dots.
+ */
+static void who_domain(struct WhoQuery* q, const char* domain)
+{
+  struct Client* acptr;
+
+  domain = host_domain(domain);
+  for (acptr = hash_find_user_domain(domain); acptr && q->left;
+       acptr = acptr->udomnext)
+    if (!irccmp(host_domain(acptr->host), domain))
+      who_one(q, acptr, q->fields, 0);
+
+  q->done = domain;
+  who_servers(q, &me, 0);
+}
+
+
 /*
 ** m_who
 **      parv[0] = sender prefix
 **      parv[1] = nickname mask list
-**      parv[2] = additional selection flag, only 'o' for now.
+**      parv[2] = selection flags: 'o' for opers only, and the fields
+**                to match, any of 'n'ick, 'u'ser, 'h'ost, 'i'p,
+**                's'erver and 'r'ealname
 */
 int     m_who(struct Client *cptr,
               struct Client *sptr,
@@ -156,9 +389,11 @@ int     m_who(struct Client *cptr,
   struct Channel *chptr;
   struct Channel *mychannel = NULL;
   char  *channame = NULL;
-  int   oper = parc > 2 ? (*parv[2] == 'o' ): 0; /* Show OPERS only */
+  struct WhoQuery q;
+  const char* domain;
+  int   oper;
   int   member;
-  int   maxmatches = 500;
+  int   i;
 #ifdef OPERSPY
   int OperSpyWho = 0;
 
@@ -168,6 +403,12 @@ int     m_who(struct Client *cptr,
   }
 #endif
 
+  memset(&q, 0, sizeof(q));
+  q.sptr = sptr;
+  q.left = 500;
+  q.fields = parc > 2 ? who_flags(&q, parv[2]) : 0;
+  oper = q.oper;    /* Show OPERS only */
+
   mychannel = NullChn;
   if (sptr->user)
     if ((lp = sptr->user->channel))
@@ -214,8 +455,9 @@ int     m_who(struct Client *cptr,
 #endif
                    ;
           if (member || !SecretChannel(chptr))
-            for (lp = chptr->members; lp; lp = lp->next)
+            for (i = 0; i < chptr->memberc; i++)
               {
+                lp = chptr->memberv[i];
                 if (oper && !IsAnOper(lp->value.cptr))
                   continue;
                 if (IsInvisible(lp->value.cptr) && !member)
@@ -224,7 +466,7 @@ int     m_who(struct Client *cptr,
               }
         }
     }
-  else if (mask && 
+  else if (mask && (!q.fields || (q.fields & WHO_NICK)) &&
            ((acptr = find_client(mask, NULL)) != NULL) &&
            IsPerson(acptr) && (!oper || IsAnOper(acptr)))
     {
@@ -249,68 +491,32 @@ int     m_who(struct Client *cptr,
         }
       do_who(sptr, acptr, ch2ptr, NULL);
     }
-  else for (acptr = GlobalClientList; acptr; acptr = acptr->next)
+  else
     {
-      struct Channel *ch2ptr = NULL;
-      int       showperson, isinvis;
-
-      if (!IsPerson(acptr))
-        continue;
-      if (oper && !IsAnOper(acptr))
-        continue;
-      
-      showperson = 0;
-      /*
-       * Show user if they are on the same channel, or not
-       * invisible and on a non secret channel (if any).
-       * Do this before brute force match on all relevant fields
-       * since these are less cpu intensive (I hope :-) and should
-       * provide better/more shortcuts - avalon
-       */
-      isinvis = IsInvisible(acptr);
-      for (lp = acptr->user->channel; lp; lp = lp->next)
-        {
-          chptr = lp->value.chptr;
-          member = IsMember(sptr, chptr);
-          if (isinvis && !member)
-            continue;
-          if (member || (!isinvis && PubChannel(chptr)))
-            {
-              ch2ptr = chptr;
-              showperson = 1;
-              break;
-            }
-          if (HiddenChannel(chptr) && !SecretChannel(chptr) &&
-              !isinvis)
-            showperson = 1;
-        }
-      if (!acptr->user->channel && !isinvis)
-        showperson = 1;
-
+      q.mask = mask;
 #ifdef OPERSPY
-      if (OperSpyWho)
-       showperson=1;
+      q.spy = OperSpyWho;
 #endif
+      if (!q.fields)
+        q.fields = WHO_DEFAULT;
+      if ((q.fields & WHO_IP) && !is_address(mask, &q.ip, &q.ip_mask))
+        q.ip = q.ip_mask = 0;
+      q.ip &= q.ip_mask;
 
-      if (showperson &&
-          (!mask ||
-           match(mask, acptr->name) ||
-           match(mask, acptr->username) ||
-           match(mask, acptr->host) ||
-           match(mask, acptr->user->server) ||
-           match(mask, acptr->info)))
+      if (WHO_DEFAULT == q.fields && (domain = mask_domain(mask)))
+        who_domain(&q, domain);
+      else if (q.fields & ~WHO_INDEXED)
+        for (acptr = GlobalClientList; acptr && q.left; acptr = acptr->next)
+          who_one(&q, acptr, q.fields, 0);
+      else
         {
-          do_who(sptr, acptr, ch2ptr, NULL);
-          if (!--maxmatches)
-            {
-              sendto_one(sptr, form_str(RPL_ENDOFWHO), me.name, parv[0],
-                         EmptyString(mask) ?  "*" : mask);
-#ifdef OPERSPY
-              if (OperSpyWho)
-                  operspy_log(cptr, "WHO", mask);
-#endif		 
-              return 0;
-            }
+          /* each pass leaves out who an earlier one has done */
+          if (q.fields & WHO_HOST)
+            who_hosts(&q, 0);
+          if (q.fields & WHO_IP)
+            who_ips(&q, q.fields & WHO_HOST);
+          if (q.fields & WHO_SERVER)
+            who_servers(&q, &me, q.fields & (WHO_HOST | WHO_IP));
         }
     }
 #ifdef OPERSPY
@@ -47,15 +47,13 @@ static aWhowas *WHOWASHASH[WW_MAX];
 
 static int whowas_next = 0;
 
+/*
+ * hash_whowas_name - the table is a fixed size, as it can never hold
+ * more than NICKNAMEHISTORYLENGTH, but takes the keyed nick hash
+ */
 static unsigned int hash_whowas_name(const char* name)
 {
-  unsigned int h = 0;
-
-  while (*name)
-    {
-      h = (h << 4) - (h + (unsigned char)ToLower(*name++));
-    }
-  return(h & (WW_MAX - 1));
+  return(hash_nick_name(name) & (WW_MAX - 1));
 }
 
 void add_history(aClient* cptr, int online)
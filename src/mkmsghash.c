@@ -0,0 +1,195 @@
+/************************************************************************
+ *   IRC - Internet Relay Chat, src/mkmsghash.c
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 1, or (at your option)
+ *   any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ * mkmsghash - build msg_hash.h from the MSG_ names in msg.h
+ *
+ *   mkmsghash < ../include/msg.h > msg_hash.h
+ *
+ * Every "#define MSG_xxx "NAME"" line is taken, whatever #ifdef it is
+ * under, so the table covers msgtab in any configuration. The hash is
+ * the first four bytes of the name, case folded, and its length run
+ * through a multiply; a multiplier is searched for that sends each name
+ * to a slot of its own, doubling the table until one turns up. The hash
+ * function is written into the header from the same text compiled in
+ * here, so the two can't differ.
+ *
+ * $Id$
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MAX_NAMES   256
+#define NAME_LEN    32
+#define MULT_TRIES  1000000
+
+static unsigned int MSG_HASH_BITS;
+static unsigned int MSG_HASH_MULT;
+
+#define MSG_HASH_FUNC \
+"static unsigned int msg_hash(const char* name, unsigned int len)\n" \
+"{\n" \
+"  unsigned int w = 0;\n" \
+"\n" \
+"  memcpy(&w, name, 4);\n" \
+"  w &= 0xdfdfdfdfU;\n" \
+"  return (((w ^ len << 27) * MSG_HASH_MULT) & 0xffffffffU) >>\n" \
+"         (32 - MSG_HASH_BITS);\n" \
+"}\n"
+
+/* name must be at least 3 characters, so 4 bytes with the NUL */
+static unsigned int msg_hash(const char* name, unsigned int len)
+{
+  unsigned int w = 0;
+
+  memcpy(&w, name, 4);
+  w &= 0xdfdfdfdfU;
+  return (((w ^ len << 27) * MSG_HASH_MULT) & 0xffffffffU) >>
+         (32 - MSG_HASH_BITS);
+}
+
+static char names[MAX_NAMES][NAME_LEN];
+static int  count;
+
+/*
+ * read_names - collect the quoted names of the MSG_ defines on stdin
+ */
+static void read_names(void)
+{
+  char  line[512];
+  char* p;
+  char* q;
+  int   i;
+
+  while (fgets(line, sizeof(line), stdin))
+    {
+      if (strncmp(line, "#define MSG_", 12))
+        continue;
+      if (!(p = strchr(line, '"')) || !(q = strchr(++p, '"')))
+        continue;
+      *q = '\0';
+      if (q - p < 3 || q - p >= NAME_LEN)
+        {
+          fprintf(stderr, "mkmsghash: %s must be 3 to %d characters\n",
+                  p, NAME_LEN - 1);
+          exit(1);
+        }
+      for (i = 0; i < count; i++)
+        if (!strcmp(names[i], p))
+          break;
+      if (i < count)
+        continue;
+      if (count == MAX_NAMES)
+        {
+          fprintf(stderr, "mkmsghash: too many names\n");
+          exit(1);
+        }
+      strcpy(names[count++], p);
+    }
+}
+
+/*
+ * try_mult - return 1 if every name gets a slot of its own
+ */
+static int try_mult(unsigned char* used)
+{
+  unsigned int h;
+  int          i;
+
+  memset(used, 0, 1 << MSG_HASH_BITS);
+  for (i = 0; i < count; i++)
+    {
+      h = msg_hash(names[i], strlen(names[i]));
+      if (used[h])
+        return 0;
+      used[h] = 1;
+    }
+  return 1;
+}
+
+int main(void)
+{
+  unsigned char* used;
+  const char*    slot[4096];
+  unsigned long  rand = 1;
+  unsigned int   size;
+  unsigned int   i;
+  int            shortest = NAME_LEN;
+  int            longest = 0;
+  int            n;
+
+  read_names();
+  if (!count)
+    {
+      fprintf(stderr, "mkmsghash: no MSG_ names found\n");
+      return 1;
+    }
+
+  for (MSG_HASH_BITS = 6; (1 << MSG_HASH_BITS) < count * 2; )
+    MSG_HASH_BITS++;
+  for (;;)
+    {
+      size = 1 << MSG_HASH_BITS;
+      if (size > sizeof(slot) / sizeof(slot[0]))
+        {
+          fprintf(stderr, "mkmsghash: no multiplier found\n");
+          return 1;
+        }
+      /* a fixed sequence, so the same msg.h gives the same header */
+      used = malloc(size);
+      for (i = 0; i < MULT_TRIES; i++)
+        {
+          rand = (rand * 1103515245UL + 12345UL) & 0xffffffffUL;
+          MSG_HASH_MULT = (rand ^ (rand >> 16) << 8) | 1;
+          if (try_mult(used))
+            break;
+        }
+      free(used);
+      if (i < MULT_TRIES)
+        break;
+      MSG_HASH_BITS++;
+    }
+
+  memset(slot, 0, sizeof(slot));
+  for (n = 0; n < count; n++)
+    {
+      slot[msg_hash(names[n], strlen(names[n]))] = names[n];
+      if ((int) strlen(names[n]) < shortest)
+        shortest = strlen(names[n]);
+      if ((int) strlen(names[n]) > longest)
+        longest = strlen(names[n]);
+    }
+
+  printf("/*\n * msg_hash.h - generated by mkmsghash from msg.h, do not edit\n */\n");
+  printf("#ifndef INCLUDED_msg_hash_h\n#define INCLUDED_msg_hash_h\n");
+  printf("#include <string.h>\n\n");
+  printf("#define MSG_HASH_BITS %u\n", MSG_HASH_BITS);
+  printf("#define MSG_HASH_SIZE (1 << MSG_HASH_BITS)\n");
+  printf("#define MSG_HASH_MULT 0x%08xU\n", MSG_HASH_MULT);
+  printf("#define MSG_NAME_MIN  %d\n", shortest);
+  printf("#define MSG_NAME_MAX  %d\n\n", longest);
+  printf("static const char* const msg_hash_names[MSG_HASH_SIZE] = {\n");
+  for (i = 0; i < size; i++)
+    {
+      if (slot[i])
+        printf("  \"%s\",\n", slot[i]);
+      else
+        printf("  0,\n");
+    }
+  printf("};\n\n%s\n#endif /* INCLUDED_msg_hash_h */\n", MSG_HASH_FUNC);
+  return 0;
+}
@@ -0,0 +1,102 @@
+/************************************************************************
+ *   IRC - Internet Relay Chat, src/msg_hash.c
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 1, or (at your option)
+ *   any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ * $Id$
+ */
+#include "parse.h"
+#include "msg.h"
+#include "s_log.h"
+#include "msg_hash.h"           /* generated by mkmsghash */
+
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+/*
+ * Command lookup. msg_hash.h is made at build time from the MSG_ names
+ * in msg.h, with a multiplier that gives every name a slot of its own,
+ * so a lookup is a strlen, a hash of the first four bytes and the
+ * length, and one compare; PRIVMSG costs the same as anything else.
+ * The ircd never calls setlocale(), so strcasecmp() only folds ASCII
+ * and a match means the command was letters only, as before.
+ */
+static struct Message* msg_table[MSG_HASH_SIZE];
+
+/* for qsort'ing the msgtab in place -orabidoo */
+static int mcmp(const void* m1, const void* m2)
+{
+  return strcmp(((const struct Message*) m1)->cmd,
+                ((const struct Message*) m2)->cmd);
+}
+
+/*
+ * init_msg_hash
+ *
+ * inputs       - pointer to msg_table defined in msg.h
+ * output       - NONE
+ * side effects - MUST be called at startup ONCE before find_message().
+ *                msgtab is sorted in place, as /stats m and /help
+ *                list it in that order.
+ */
+void init_msg_hash(struct Message* mptr)
+{
+  struct Message* mpt;
+  unsigned int    h = 0;
+  size_t          len;
+  int             i;
+
+  for (i = 0, mpt = mptr; mpt->cmd; mpt++)
+    i++;
+  qsort((void *)mptr, i, sizeof(struct Message), mcmp);
+
+  for (mpt = mptr; mpt->cmd; mpt++)
+    {
+      /*
+       * a name that isn't in msg.h as an MSG_ define didn't make it
+       * into the generated table
+       */
+      len = strlen(mpt->cmd);
+      if (len < MSG_NAME_MIN || len > MSG_NAME_MAX ||
+          !msg_hash_names[h = msg_hash(mpt->cmd, len)] ||
+          strcmp(msg_hash_names[h], mpt->cmd) || msg_table[h])
+        {
+          ilog(L_CRIT, "bad msgtab entry: ``%s''\n", mpt->cmd);
+          exit(1);
+        }
+      msg_table[h] = mpt;
+    }
+}
+
+/*
+ * find_message
+ *
+ * inputs       - pointer to command, in any case
+ * output       - NULL pointer if not found
+ *                struct Message pointer to command entry if found
+ * side effects - NONE
+ */
+struct Message* find_message(const char* cmd)
+{
+  struct Message* mptr;
+  size_t          len = strlen(cmd);
+
+  if (len < MSG_NAME_MIN || len > MSG_NAME_MAX)
+    return NULL;
+  if ((mptr = msg_table[msg_hash(cmd, len)]) && !strcasecmp(mptr->cmd, cmd))
+    return mptr;
+  return NULL;
+}
@@ -65,58 +65,77 @@
 
 /* internally defined functions */
 
-static void report_dup(char,struct ConfItem *);
-static int sortable(char *,char *);
-static void tokenize_and_stack(char* tokenized_out, const char* host);
-static void create_sub_mtrie(DOMAIN_LEVEL *,struct ConfItem *,int,char *);
-static struct ConfItem *find_sub_mtrie(DOMAIN_LEVEL *, const char* host,
-                                 const char* user, int);
+static void report_dup(struct MtrieConf *,char,struct ConfItem *);
+static int sortable(struct MtrieConf *,char *,char *);
+static void tokenize_and_stack(struct MtrieConf *,char* tokenized_out,
+                               const char* host);
+static void create_sub_mtrie(struct MtrieConf *,DOMAIN_LEVEL *,
+                             struct ConfItem *,int,char *);
+static struct ConfItem *find_sub_mtrie(struct MtrieConf *,DOMAIN_LEVEL *,
+                                 const char* host, const char* user, int);
 char *show_iline_prefix(struct Client *,struct ConfItem *,char *);
 static DOMAIN_PIECE *find_or_add_host_piece(DOMAIN_LEVEL *,int,char *);
 static DOMAIN_PIECE *find_host_piece(DOMAIN_LEVEL *,int,char *,
                                      const char* host);
 static struct ConfItem *find_wild_host_piece(DOMAIN_LEVEL *,int,char *, 
                                        const char* user);
-static void find_or_add_user_piece(DOMAIN_PIECE *,struct ConfItem *,int,char *);
+static void find_or_add_user_piece(struct MtrieConf *,DOMAIN_PIECE *,
+                                   struct ConfItem *,int,char *);
 static struct ConfItem *find_user_piece(DOMAIN_PIECE *,int,char *, const char* user);
 
-static struct ConfItem* look_for_dup_in_unsortable_ilines(const char* host,
+static struct ConfItem* look_for_dup_in_unsortable_ilines(struct MtrieConf *,
+const char* host, const char* user);
+static struct ConfItem* look_in_unsortable_ilines(struct MtrieConf *,
+const char* host, const char* user);
+static struct ConfItem* look_for_dup_in_unsortable_klines(struct MtrieConf *,
+const char* host, const char* user);
+static struct ConfItem* look_in_unsortable_klines(struct MtrieConf *,
+const char* host, const char* user);
+static struct ConfItem* find_wild_card_iline(struct MtrieConf *,
 const char* user);
-static struct ConfItem* look_in_unsortable_ilines(const char* host, const char* user);
-static struct ConfItem* look_for_dup_in_unsortable_klines(const char* host,
-const char* user);
-static struct ConfItem* look_in_unsortable_klines(const char* host, const char* user);
-static struct ConfItem* find_wild_card_iline(const char* user);
 
 static void report_sub_mtrie(struct Client *sptr,int,DOMAIN_LEVEL *);
 static void report_unsortable_klines(struct Client *,char *);
-static void clear_sub_mtrie(DOMAIN_LEVEL *);
-static struct ConfItem *find_matching_ip_i_line(char *user, unsigned long);
-
-static int stack_pointer;              /* dns piece stack */
-static char *dns_stack[MAX_TLD_STACK];
-
-static DOMAIN_LEVEL *trie_list = NULL;
-static DOMAIN_LEVEL *first_kline_trie_list = NULL;
-static int saved_stack_pointer;
+static void clear_sub_mtrie(DOMAIN_LEVEL *,struct ConfItem **);
+static struct ConfItem *find_matching_ip_i_line(struct MtrieConf *,
+                                                char *user, unsigned long);
 
-static struct ConfItem *last_found_iline_aconf = NULL;
+struct MtrieConf
+{
+  DOMAIN_LEVEL *trie_list;
+  struct ConfItem *unsortable_list_ilines;
+  struct ConfItem *unsortable_list_klines;
+  struct ConfItem *wild_card_ilines;
+  struct ConfItem *ip_i_lines;
+  struct DlineConf *dlines;     /* where ip K-lines go, NULL for the live ones */
+  int quiet;                    /* don't report dups */
+
+  /* scratch for adding and searching */
+  int stack_pointer;            /* dns piece stack */
+  char *dns_stack[MAX_TLD_STACK];
+  DOMAIN_LEVEL *first_kline_trie_list;
+  int saved_stack_pointer;
+  struct ConfItem *last_found_iline_aconf;
+};
 
-static struct ConfItem *unsortable_list_ilines = NULL;
-static struct ConfItem *unsortable_list_klines = NULL;
-static struct ConfItem *wild_card_ilines = NULL;
-static struct ConfItem *ip_i_lines = NULL;
+/*
+ * the mtrie in use; a rehash builds a new one with new_mtrie_conf()
+ * and swaps it in with use_mtrie_conf()
+ */
+static struct MtrieConf boot_mtrie;
+static struct MtrieConf *mtrie = &boot_mtrie;
 
-/* add_mtrie_conf_entry
+/* add_mtrie_conf_entry_to
  *
- * inputs       - pointer to ConfItem
+ * inputs       - pointer to mtrie
+ *              - pointer to ConfItem
  *		- type of kline/iline
  * output       - NONE
  * side effects -
  */
 
 void 
-add_mtrie_conf_entry(struct ConfItem *aconf,int flags)
+add_mtrie_conf_entry_to(struct MtrieConf *mt,struct ConfItem *aconf,int flags)
 {
   char tokenized_host[HOSTLEN+1];
   unsigned long ip_host;
@@ -130,7 +149,7 @@ add_mtrie_conf_entry(struct ConfItem *aconf,int flags)
       return;
     }
 
-  stack_pointer = 0;
+  mt->stack_pointer = 0;
 
   /* check to see if its a kline on user@ip.ip.ip.ip/mask
    * or user@ip.ip.ip.* or user@ip.ip.ip.ip
@@ -140,51 +159,61 @@ add_mtrie_conf_entry(struct ConfItem *aconf,int flags)
     {
       aconf->ip = ip_host & ip_mask;
       aconf->ip_mask = ip_mask;
-      add_ip_Kline(aconf);
+      if(mt->dlines)
+        add_ip_Kline_to(mt->dlines,aconf);
+      else
+        add_ip_Kline(aconf);
       return;
     }
 
-  switch(sortable(tokenized_host,aconf->host))
+  switch(sortable(mt,tokenized_host,aconf->host))
     {
     case 0:
     case 1:
 
       if(aconf->status & CONF_CLIENT)
         {
-          aconf2 = look_for_dup_in_unsortable_ilines(aconf->host, aconf->user);
+          aconf2 = look_for_dup_in_unsortable_ilines(mt, aconf->host, aconf->user);
           if (aconf2 != NULL)
             {
-              report_dup('I', aconf2);
+              report_dup(mt, 'I', aconf2);
               free(aconf);
               return;
             }
-          if(unsortable_list_ilines)
+          if(mt->unsortable_list_ilines)
             {
-              aconf->next = unsortable_list_ilines;
-              unsortable_list_ilines = aconf;
+              aconf->next = mt->unsortable_list_ilines;
+              mt->unsortable_list_ilines = aconf;
             }
           else
-            unsortable_list_ilines = aconf;
+            mt->unsortable_list_ilines = aconf;
         }
       else
         {
           /* This is a CPU hit, but it prevents a mess of duplicate unsortable
            * klines. -Hwy
+           * mkbandb already threw out the duplicates in a ban image
            */
-          aconf2 = look_for_dup_in_unsortable_klines(aconf->host, aconf->user);
+#ifdef BAN_DB
+          if (aconf->in_image)
+            aconf2 = NULL;
+          else
+#endif
+            aconf2 = look_for_dup_in_unsortable_klines(mt, aconf->host,
+                                                       aconf->user);
           if (aconf2 != NULL)
             {
-              report_dup('K', aconf2);
+              report_dup(mt, 'K', aconf2);
               free(aconf);
               return;
             }
-          if(unsortable_list_klines)
+          if(mt->unsortable_list_klines)
             {
-              aconf->next = unsortable_list_klines;
-              unsortable_list_klines = aconf;
+              aconf->next = mt->unsortable_list_klines;
+              mt->unsortable_list_klines = aconf;
             }
           else
-            unsortable_list_klines = aconf;
+            mt->unsortable_list_klines = aconf;
         }
       return;
       break;
@@ -192,43 +221,50 @@ add_mtrie_conf_entry(struct ConfItem *aconf,int flags)
     case -2:
       if(aconf->status & CONF_CLIENT)
         {
-          aconf2 = find_wild_card_iline(aconf->user);
+          aconf2 = find_wild_card_iline(mt, aconf->user);
           if (aconf2 != NULL)
             {
               if (!irccmp(aconf->user, aconf2->user))
                 {
-                  report_dup('I', aconf2);
+                  report_dup(mt, 'I', aconf2);
                   free(aconf);
                   return;
                 }
             }
-          if(wild_card_ilines)
+          if(mt->wild_card_ilines)
             {
-              aconf->next = wild_card_ilines;
-              wild_card_ilines = aconf;
+              aconf->next = mt->wild_card_ilines;
+              mt->wild_card_ilines = aconf;
             }
           else
-            wild_card_ilines = aconf;
+            mt->wild_card_ilines = aconf;
         }
       else
         {
           /* This is a CPU hit, but it prevents a mess of duplicate unsortable
            * klines. -Hwy
+           * mkbandb already threw out the duplicates in a ban image
            */
-          aconf2 = look_for_dup_in_unsortable_klines(aconf->host, aconf->user);
+#ifdef BAN_DB
+          if (aconf->in_image)
+            aconf2 = NULL;
+          else
+#endif
+            aconf2 = look_for_dup_in_unsortable_klines(mt, aconf->host,
+                                                       aconf->user);
           if (aconf2 != NULL)
             {
-              report_dup('K', aconf2);
+              report_dup(mt, 'K', aconf2);
               free(aconf);
               return;
             }
-          if(unsortable_list_klines)
+          if(mt->unsortable_list_klines)
             {
-              aconf->next = unsortable_list_klines;
-              unsortable_list_klines = aconf;
+              aconf->next = mt->unsortable_list_klines;
+              mt->unsortable_list_klines = aconf;
             }
           else
-            unsortable_list_klines = aconf;
+            mt->unsortable_list_klines = aconf;
         }
       return;
       break;
@@ -237,15 +273,21 @@ add_mtrie_conf_entry(struct ConfItem *aconf,int flags)
       break;
     }
 
-  if(trie_list == NULL)
+  if(mt->trie_list == NULL)
     {
-      trie_list = (DOMAIN_LEVEL *)MyMalloc(sizeof(DOMAIN_LEVEL));
-      memset((void *)trie_list,0,sizeof(DOMAIN_LEVEL));
+      mt->trie_list = (DOMAIN_LEVEL *)MyMalloc(sizeof(DOMAIN_LEVEL));
+      memset((void *)mt->trie_list,0,sizeof(DOMAIN_LEVEL));
     }
 
   /* now, start generating the sub mtrie tree */
 
-  create_sub_mtrie(trie_list,aconf,flags,aconf->host);
+  create_sub_mtrie(mt,mt->trie_list,aconf,flags,aconf->host);
+}
+
+void 
+add_mtrie_conf_entry(struct ConfItem *aconf,int flags)
+{
+  add_mtrie_conf_entry_to(mtrie,aconf,flags);
 }
 
 /*
@@ -257,11 +299,17 @@ add_mtrie_conf_entry(struct ConfItem *aconf,int flags)
  * output       - NONE
  * side effects -
  */
+void 
+add_ip_Iline_to( struct MtrieConf *mt, struct ConfItem *aconf )
+{
+  aconf->next = mt->ip_i_lines;
+  mt->ip_i_lines = aconf;
+}
+
 void 
 add_ip_Iline( struct ConfItem *aconf )
 {
-  aconf->next = ip_i_lines;
-  ip_i_lines = aconf;
+  add_ip_Iline_to(mtrie, aconf);
 }
 
 
@@ -278,7 +326,8 @@ add_ip_Iline( struct ConfItem *aconf )
  */
 
 static void 
-create_sub_mtrie(DOMAIN_LEVEL *cur_level,
+create_sub_mtrie(struct MtrieConf *mt,
+                             DOMAIN_LEVEL *cur_level,
                              struct ConfItem *aconf,
                              int flags,
                              char *host)
@@ -287,12 +336,12 @@ create_sub_mtrie(DOMAIN_LEVEL *cur_level,
   DOMAIN_PIECE *last_piece;
   DOMAIN_PIECE *cur_piece;
 
-  cur_dns_piece = dns_stack[--stack_pointer];
+  cur_dns_piece = mt->dns_stack[--mt->stack_pointer];
   cur_piece = find_or_add_host_piece(cur_level,flags,cur_dns_piece);
 
-  if(stack_pointer == 0)
+  if(mt->stack_pointer == 0)
     {
-      (void)find_or_add_user_piece(cur_piece, aconf, flags, cur_dns_piece);
+      (void)find_or_add_user_piece(mt, cur_piece, aconf, flags, cur_dns_piece);
       return;
     }
 
@@ -306,7 +355,7 @@ create_sub_mtrie(DOMAIN_LEVEL *cur_level,
       memset((void *)cur_level,0,sizeof(DOMAIN_LEVEL));
       last_piece->next_level = cur_level;
     }
-  create_sub_mtrie(cur_level,aconf,flags,host);
+  create_sub_mtrie(mt,cur_level,aconf,flags,host);
 }
 
 
@@ -386,7 +435,8 @@ find_or_add_host_piece(DOMAIN_LEVEL *level_ptr,
  */
 
 static void 
-find_or_add_user_piece(DOMAIN_PIECE *piece_ptr,
+find_or_add_user_piece(struct MtrieConf *mt,
+                                   DOMAIN_PIECE *piece_ptr,
                                    struct ConfItem *aconf,
                                    int flags,
                                    char *host_piece)
@@ -428,7 +478,7 @@ find_or_add_user_piece(DOMAIN_PIECE *piece_ptr,
                * reading the conf file.
                */
 
-              report_dup('K',aconf);
+              report_dup(mt,'K',aconf);
               free_conf(aconf); /* toss it in the garbage */
 
               found_aconf->status |= flags;
@@ -439,7 +489,7 @@ find_or_add_user_piece(DOMAIN_PIECE *piece_ptr,
             }
           else if(flags & CONF_KILL)
             {
-              report_dup('K',found_aconf);
+              report_dup(mt,'K',found_aconf);
               if(found_aconf->clients)
                 found_aconf->status |= CONF_ILLEGAL;
               else
@@ -453,7 +503,7 @@ find_or_add_user_piece(DOMAIN_PIECE *piece_ptr,
               /* another I line/CONF_CLIENT exactly matching this
                * toss the new one into the garbage
                */
-              report_dup('I',aconf);
+              report_dup(mt,'I',aconf);
               free_conf(aconf); 
               found_aconf->status |= flags;
               piece_ptr->flags |= flags;
@@ -499,13 +549,13 @@ find_or_add_user_piece(DOMAIN_PIECE *piece_ptr,
             {
               if(flags & CONF_CLIENT)
                 {
-                  report_dup('I',aconf);
+                  report_dup(mt,'I',aconf);
                   free_conf(aconf);     /* toss new I line into the garbage */
                 }
               else
                 {
                   /* Its a K line */
-                  report_dup('K',aconf);
+                  report_dup(mt,'K',aconf);
 
                   if(found_aconf->clients)
                     found_aconf->status |= CONF_ILLEGAL;
@@ -757,30 +807,31 @@ find_matching_mtrie_conf(const char* host, const char* user,
   struct ConfItem *iline_aconf_unsortable = NULL;
   struct ConfItem *iline_aconf = NULL;
   struct ConfItem *kline_aconf = NULL;
+  struct MtrieConf *mt = mtrie;
   char tokenized_host[HOSTLEN + 1];
   int top_of_stack = 0;
 
-  last_found_iline_aconf = NULL;
+  mt->last_found_iline_aconf = NULL;
 
   /* Look in the unsortable i line list first, to find
    * special cases like *@*ppp* first.
    */
 
-  iline_aconf_unsortable = look_in_unsortable_ilines(host,user);
+  iline_aconf_unsortable = look_in_unsortable_ilines(mt,host,user);
 
   if(iline_aconf_unsortable &&
      (iline_aconf_unsortable->flags & CONF_FLAGS_E_LINED))
     return(iline_aconf_unsortable);
 
-  if(trie_list)
+  if(mt->trie_list)
     {
-      stack_pointer = 0;
-      tokenize_and_stack(tokenized_host, host);
-      top_of_stack = stack_pointer;
-      saved_stack_pointer = -1;
-      first_kline_trie_list = NULL;
+      mt->stack_pointer = 0;
+      tokenize_and_stack(mt, tokenized_host, host);
+      top_of_stack = mt->stack_pointer;
+      mt->saved_stack_pointer = -1;
+      mt->first_kline_trie_list = NULL;
 
-      iline_aconf = find_sub_mtrie(trie_list, host, user, CONF_CLIENT);
+      iline_aconf = find_sub_mtrie(mt, mt->trie_list, host, user, CONF_CLIENT);
     }
 
   if(iline_aconf)
@@ -792,7 +843,7 @@ find_matching_mtrie_conf(const char* host, const char* user,
     {
       if(ip)
 	{
-	  iline_aconf= find_matching_ip_i_line((char *)user, ip);
+	  iline_aconf= find_matching_ip_i_line(mt, (char *)user, ip);
 	  
 	  if(iline_aconf)
 	    {
@@ -808,7 +859,7 @@ find_matching_mtrie_conf(const char* host, const char* user,
     iline_aconf = iline_aconf_unsortable;
 
   if(!iline_aconf)
-    iline_aconf = find_wild_card_iline(user);
+    iline_aconf = find_wild_card_iline(mt, user);
 
   /* If there is no I line, there is no point checking for a K line now
    * is there? -Dianora
@@ -824,8 +875,8 @@ find_matching_mtrie_conf(const char* host, const char* user,
 
   /* I have an I line, now I have to see if it gets
    * over-ruled by a K line somewhere else in the tree.
-   * Note, that if first_kline_trie_list is non NULL
-   * then trie_list had to have been non NULL as well.
+   * Note, that if mt->first_kline_trie_list is non NULL
+   * then mt->trie_list had to have been non NULL as well.
    * call me paranoid.
    * Remember again, if any of the I lines
    * found also had an E line, I've already returned it
@@ -834,7 +885,7 @@ find_matching_mtrie_conf(const char* host, const char* user,
 
   /* ok, if there is a trie to use...
    * and if a possible branch was found the first time
-   * I'll have a first_kline_trie_list saved.
+   * I'll have a mt->first_kline_trie_list saved.
    * its possible there won't be a branch of possible klines
    * in which case, I will have to start from the top of the tree again.
    * - Dianora
@@ -842,25 +893,25 @@ find_matching_mtrie_conf(const char* host, const char* user,
 
   kline_aconf = (struct ConfItem *)NULL;
 
-  if(trie_list)
+  if(mt->trie_list)
     {
-      if(first_kline_trie_list)
+      if(mt->first_kline_trie_list)
         {
-          stack_pointer = saved_stack_pointer;
-          kline_aconf = find_sub_mtrie(first_kline_trie_list,host,user,
+          mt->stack_pointer = mt->saved_stack_pointer;
+          kline_aconf = find_sub_mtrie(mt,mt->first_kline_trie_list,host,user,
                                        CONF_KILL);
         }
       else
         {
-          stack_pointer = top_of_stack;
-          kline_aconf = find_sub_mtrie(trie_list,host,user,CONF_KILL);
+          mt->stack_pointer = top_of_stack;
+          kline_aconf = find_sub_mtrie(mt,mt->trie_list,host,user,CONF_KILL);
         }
     }
 
   /* I didn't find a kline in the mtrie, I'll try the unsortable list */
 
   if(!kline_aconf)
-    kline_aconf = look_in_unsortable_klines(host,user);
+    kline_aconf = look_in_unsortable_klines(mt,host,user);
 
   /* Try an IP hostname ban */
 
@@ -886,7 +937,7 @@ find_matching_mtrie_conf(const char* host, const char* user,
  */
 
 static struct ConfItem*
-find_sub_mtrie(DOMAIN_LEVEL *cur_level,
+find_sub_mtrie(struct MtrieConf *mt, DOMAIN_LEVEL *cur_level,
 	       const char* host, const char* user,int flags)
 {
   DOMAIN_PIECE *cur_piece;
@@ -894,7 +945,7 @@ find_sub_mtrie(DOMAIN_LEVEL *cur_level,
   struct ConfItem *aconf = NULL;
   struct ConfItem *aconf_user = NULL;
 
-  cur_dns_piece = dns_stack[--stack_pointer];
+  cur_dns_piece = mt->dns_stack[--mt->stack_pointer];
 
   if(!cur_dns_piece)
     return(NULL);
@@ -918,33 +969,33 @@ find_sub_mtrie(DOMAIN_LEVEL *cur_level,
     {
       aconf = find_wild_host_piece(cur_level,flags,cur_dns_piece,user);
       if(aconf)
-        last_found_iline_aconf = aconf;
+        mt->last_found_iline_aconf = aconf;
 
       /* looking for CONF_CLIENT, so descend deeper */
       cur_piece = find_host_piece(cur_level,flags,cur_dns_piece,user);
 
       if(!cur_piece)
 	{
-	  return(last_found_iline_aconf);
+	  return(mt->last_found_iline_aconf);
 	}
     }
 
-  if((cur_piece->flags & CONF_KILL) && (!first_kline_trie_list))
+  if((cur_piece->flags & CONF_KILL) && (!mt->first_kline_trie_list))
     {
-      first_kline_trie_list = cur_level;
-      saved_stack_pointer = stack_pointer+1;
+      mt->first_kline_trie_list = cur_level;
+      mt->saved_stack_pointer = mt->stack_pointer+1;
     }
 
-  if(stack_pointer == 0)
+  if(mt->stack_pointer == 0)
     {
       aconf_user=find_user_piece(cur_piece,flags,cur_dns_piece,user);
-      return(aconf_user ? aconf_user : last_found_iline_aconf);
+      return(aconf_user ? aconf_user : mt->last_found_iline_aconf);
     }
 
   if(cur_piece->next_level)
     {
       cur_level = cur_piece->next_level;
-      return(find_sub_mtrie(cur_level,host,user,flags));
+      return(find_sub_mtrie(mt,cur_level,host,user,flags));
     }
   else
     {
@@ -955,7 +1006,7 @@ find_sub_mtrie(DOMAIN_LEVEL *cur_level,
       }
       if((aconf = find_wild_host_piece(cur_level,flags,cur_dns_piece,user)))
         return(aconf);
-      return(last_found_iline_aconf);
+      return(mt->last_found_iline_aconf);
     }
 
   /* NOT REACHED */
@@ -976,7 +1027,7 @@ find_sub_mtrie(DOMAIN_LEVEL *cur_level,
 
 
 static int 
-sortable(char *tokenized,char *p)
+sortable(struct MtrieConf *mt,char *tokenized,char *p)
 {
   int  state=0;
   char *d;              /* destination */
@@ -1022,7 +1073,7 @@ sortable(char *tokenized,char *p)
           if(*p == '\0')        
             {
               *d = '\0';
-              dns_stack[stack_pointer++] = tokenized;
+              mt->dns_stack[mt->stack_pointer++] = tokenized;
               return(-1);       /* followed by null terminator is sortable */
             }
           else if(*p == '*')    /* '*' followed by another '*' is unsortable */
@@ -1030,7 +1081,7 @@ sortable(char *tokenized,char *p)
           else if(*p == '.')    /* this is a "*.foo" type kline */
             {
               *d = '\0';
-              dns_stack[stack_pointer++] = tokenized;
+              mt->dns_stack[mt->stack_pointer++] = tokenized;
               tokenized = d+1;
             }
           else
@@ -1041,7 +1092,7 @@ sortable(char *tokenized,char *p)
           if(*p == '\0')        
             {
               *d = '\0';        /* if null terminator seen, its sortable */
-              dns_stack[stack_pointer++] = tokenized;
+              mt->dns_stack[mt->stack_pointer++] = tokenized;
               return(-1);       
             }
           else if(*p == '*')    /* its "blah*blah" or "blah*"
@@ -1053,7 +1104,7 @@ sortable(char *tokenized,char *p)
           else if(*p == '.')    /* push another piece on stack */
             {
               *d = '\0';
-              dns_stack[stack_pointer++] = tokenized;
+              mt->dns_stack[mt->stack_pointer++] = tokenized;
               tokenized = d+1;
             }
           else
@@ -1081,7 +1132,7 @@ sortable(char *tokenized,char *p)
  */
 
 static void 
-tokenize_and_stack(char* tokenized, const char* p)
+tokenize_and_stack(struct MtrieConf *mt, char* tokenized, const char* p)
 {
   char* d = tokenized;
   assert(0 != d);
@@ -1096,7 +1147,7 @@ tokenize_and_stack(char* tokenized, const char* p)
       if(*p == '.')
         {
           *d = '\0';
-          dns_stack[stack_pointer++] = tokenized;
+          mt->dns_stack[mt->stack_pointer++] = tokenized;
           tokenized = d+1;
         }
       else
@@ -1106,7 +1157,7 @@ tokenize_and_stack(char* tokenized, const char* p)
       p++;
     }
   *d = '\0';
-  dns_stack[stack_pointer++] = tokenized;
+  mt->dns_stack[mt->stack_pointer++] = tokenized;
 }
 
 /*
@@ -1121,11 +1172,11 @@ tokenize_and_stack(char* tokenized, const char* p)
  */
 
 static struct ConfItem *
-look_in_unsortable_ilines(const char* host, const char* user)
+look_in_unsortable_ilines(struct MtrieConf *mt, const char* host, const char* user)
 {
   struct ConfItem *found_conf;
 
-  for(found_conf=unsortable_list_ilines;found_conf;found_conf=found_conf->next)
+  for(found_conf=mt->unsortable_list_ilines;found_conf;found_conf=found_conf->next)
     {
       if(match(found_conf->host,host) &&
          match(found_conf->user,user))
@@ -1148,11 +1199,11 @@ look_in_unsortable_ilines(const char* host, const char* user)
  */
             
 static struct ConfItem *
-look_for_dup_in_unsortable_ilines(const char* host, const char* user)
+look_for_dup_in_unsortable_ilines(struct MtrieConf *mt, const char* host, const char* user)
 {
   struct ConfItem *found_conf;
 
-  for(found_conf=unsortable_list_ilines;found_conf;found_conf=found_conf->next)
+  for(found_conf=mt->unsortable_list_ilines;found_conf;found_conf=found_conf->next)
     {
       if((irccmp(found_conf->host,host) == 0) &&
          (irccmp(found_conf->user,user) == 0))
@@ -1175,11 +1226,11 @@ look_for_dup_in_unsortable_ilines(const char* host, const char* user)
  */
 
 static struct ConfItem *
-look_in_unsortable_klines(const char* host, const char* user)
+look_in_unsortable_klines(struct MtrieConf *mt, const char* host, const char* user)
 {
   struct ConfItem *found_conf;
 
-  for(found_conf=unsortable_list_klines;found_conf;found_conf=found_conf->next)
+  for(found_conf=mt->unsortable_list_klines;found_conf;found_conf=found_conf->next)
     {
       if(match(found_conf->host,host) &&
          match(found_conf->user,user))
@@ -1200,11 +1251,11 @@ look_in_unsortable_klines(const char* host, const char* user)
  */
   
 static struct ConfItem *
-look_for_dup_in_unsortable_klines(const char* host, const char* user)
+look_for_dup_in_unsortable_klines(struct MtrieConf *mt, const char* host, const char* user)
 {
   struct ConfItem *found_conf;
 
-  for(found_conf=unsortable_list_klines;found_conf;found_conf=found_conf->next)
+  for(found_conf=mt->unsortable_list_klines;found_conf;found_conf=found_conf->next)
     {
       if((irccmp(found_conf->host,host) == 0) &&
          (irccmp(found_conf->user,user) == 0))
@@ -1224,11 +1275,11 @@ look_for_dup_in_unsortable_klines(const char* host, const char* user)
  */
 
 static struct ConfItem *
-find_wild_card_iline(const char* user)
+find_wild_card_iline(struct MtrieConf *mt, const char* user)
 {
   struct ConfItem *found_conf;
 
-  for(found_conf=wild_card_ilines;found_conf;found_conf=found_conf->next)
+  for(found_conf=mt->wild_card_ilines;found_conf;found_conf=found_conf->next)
     {
       if(match(found_conf->user,user))
         return(found_conf);
@@ -1260,6 +1311,7 @@ report_matching_host_klines(struct Client *sptr,char *host)
   char *cur_dns_piece;
   char *p;
   int two_letter_tld = 0;
+  struct MtrieConf *mt = mtrie;
   char tokenized_host[HOSTLEN+1];
 
   if (strlen(host) > (size_t) HOSTLEN)
@@ -1270,8 +1322,8 @@ report_matching_host_klines(struct Client *sptr,char *host)
       return;
     }
 
-  stack_pointer = 0;
-  tokenize_and_stack(tokenized_host,host);
+  mt->stack_pointer = 0;
+  tokenize_and_stack(mt,tokenized_host,host);
 
   p = host;
 
@@ -1281,11 +1333,11 @@ report_matching_host_klines(struct Client *sptr,char *host)
   if(p[3] == '\0')
     two_letter_tld = YES;
 
-  cur_dns_piece = dns_stack[--stack_pointer];
+  cur_dns_piece = mt->dns_stack[--mt->stack_pointer];
   if(!cur_dns_piece)
     return;
 
-  cur_piece = find_host_piece(trie_list,CONF_KILL,cur_dns_piece,"*");
+  cur_piece = find_host_piece(mt->trie_list,CONF_KILL,cur_dns_piece,"*");
 
   if(cur_piece == NULL)
     return;
@@ -1298,7 +1350,7 @@ report_matching_host_klines(struct Client *sptr,char *host)
   else
     return;
 
-  cur_dns_piece = dns_stack[--stack_pointer];
+  cur_dns_piece = mt->dns_stack[--mt->stack_pointer];
   if(!cur_dns_piece)
     return;
 
@@ -1337,7 +1389,7 @@ report_unsortable_klines(struct Client *sptr,char *need_host)
   char *host, *pass, *user, *name;
   int port;
 
-  for(found_conf = unsortable_list_klines;
+  for(found_conf = mtrie->unsortable_list_klines;
       found_conf;found_conf=found_conf->next)
     {
       get_printable_conf(found_conf, &name, &host, &pass, &user, &port);
@@ -1368,13 +1420,13 @@ void report_mtrie_conf_links(struct Client *sptr, int flags)
   int  port;
   char c;               /* conf char used for CONF_CLIENT only */
 
-  if(trie_list)
-    report_sub_mtrie(sptr,flags,trie_list);
+  if(mtrie->trie_list)
+    report_sub_mtrie(sptr,flags,mtrie->trie_list);
 
   /* If requesting I lines do this */
   if(flags & CONF_CLIENT)
     {
-      for(found_conf = unsortable_list_ilines;
+      for(found_conf = mtrie->unsortable_list_ilines;
           found_conf;found_conf=found_conf->next)
         {
           /* Non local opers do not need to know about
@@ -1405,7 +1457,7 @@ void report_mtrie_conf_links(struct Client *sptr, int flags)
                      get_conf_class(found_conf));
         }
 
-      for(found_conf = wild_card_ilines;
+      for(found_conf = mtrie->wild_card_ilines;
           found_conf;found_conf=found_conf->next)
         {
           get_printable_conf(found_conf, &name, &host, &pass, &user, &port);
@@ -1425,7 +1477,7 @@ void report_mtrie_conf_links(struct Client *sptr, int flags)
                      get_conf_class(found_conf));
         }
 
-      for(found_conf = ip_i_lines;
+      for(found_conf = mtrie->ip_i_lines;
           found_conf;found_conf=found_conf->next)
         {
           get_printable_conf(found_conf, &name, &host, &pass, &user, &port );
@@ -1452,7 +1504,7 @@ void report_mtrie_conf_links(struct Client *sptr, int flags)
     {
       report_ip_Klines(sptr);
 
-      for(found_conf = unsortable_list_klines;
+      for(found_conf = mtrie->unsortable_list_klines;
           found_conf;found_conf=found_conf->next)
         {
           get_printable_conf(found_conf, &name, &host, &pass,
@@ -1668,59 +1720,73 @@ report_sub_mtrie(struct Client *sptr, int flags, DOMAIN_LEVEL *dl_ptr)
 }
 
 /*
- * clear_mtrie_conf_links()
+ * clear_mtrie_conf()
  *
- * inputs       - NONE
+ * inputs       - pointer to mtrie
+ *              - where to put its I lines, or NULL
  * output       - NONE
  * side effects -
- * Clear out the mtrie list and the unsortable list (recursively)
+ * Clear out the mtrie list and the unsortable list (recursively).
+ * If ilines is NULL, I lines still in use are marked illegal and the
+ * rest are freed, otherwise they are all put on *ilines for the caller
+ * to do that.
  */
 
-void clear_mtrie_conf_links()
+static void clear_mtrie_conf(struct MtrieConf *mt, struct ConfItem **ilines)
 {
   struct ConfItem *found_conf;
   struct ConfItem *found_conf_next;
 
-  if(trie_list)
+  if(mt->trie_list)
     {
-      clear_sub_mtrie(trie_list);
-      trie_list = NULL;
+      clear_sub_mtrie(mt->trie_list, ilines);
+      mt->trie_list = NULL;
     }
 
-  for(found_conf=unsortable_list_ilines;
+  for(found_conf=mt->unsortable_list_ilines;
       found_conf;found_conf=found_conf_next)
     {
       found_conf_next = found_conf->next;
 
       /* this is an I line list */
 
-      if(found_conf->clients)
+      if(ilines)
+        {
+          found_conf->next = *ilines;
+          *ilines = found_conf;
+        }
+      else if(found_conf->clients)
         found_conf->status |= CONF_ILLEGAL;
       else
         free_conf(found_conf);
     }
-  unsortable_list_ilines = NULL;
+  mt->unsortable_list_ilines = NULL;
 
-  for(found_conf=unsortable_list_klines;
+  for(found_conf=mt->unsortable_list_klines;
       found_conf;found_conf=found_conf_next)
     {
       found_conf_next = found_conf->next;
       free_conf(found_conf);
     }
-  unsortable_list_klines = NULL;
+  mt->unsortable_list_klines = NULL;
 
-  for(found_conf=wild_card_ilines;
+  for(found_conf=mt->wild_card_ilines;
       found_conf;found_conf=found_conf_next)
     {
       found_conf_next = found_conf->next;
-      if (found_conf->clients)
+      if(ilines)
+        {
+          found_conf->next = *ilines;
+          *ilines = found_conf;
+        }
+      else if (found_conf->clients)
         found_conf->status |= CONF_ILLEGAL;
       else
         free_conf(found_conf);
     }
-  wild_card_ilines = NULL;
+  mt->wild_card_ilines = NULL;
 
-  for(found_conf = ip_i_lines; found_conf;
+  for(found_conf = mt->ip_i_lines; found_conf;
       found_conf = found_conf_next)
     {
       found_conf_next = found_conf->next;
@@ -1728,23 +1794,103 @@ void clear_mtrie_conf_links()
       /* The aconf's pointed to by each ip entry here,
        * have already been cleared out of the mtrie tree above.
        */
-      if(found_conf->clients)
+      if(ilines)
+        {
+          found_conf->next = *ilines;
+          *ilines = found_conf;
+        }
+      else if(found_conf->clients)
         found_conf->status |= CONF_ILLEGAL;
       else
         free_conf(found_conf);
     }
-  ip_i_lines = NULL;
+  mt->ip_i_lines = NULL;
+}
+
+void clear_mtrie_conf_links()
+{
+  clear_mtrie_conf(mtrie, NULL);
+}
+
+/*
+ * new_mtrie_conf()
+ *
+ * inputs       - the D-line tables ip K-lines are to go in
+ * output       - an empty mtrie
+ * side effects -
+ */
+
+struct MtrieConf *new_mtrie_conf(struct DlineConf *dlines)
+{
+  struct MtrieConf *mt;
+
+  mt = (struct MtrieConf *)MyMalloc(sizeof(struct MtrieConf));
+  memset((void *)mt, 0, sizeof(struct MtrieConf));
+  mt->dlines = dlines;
+  return(mt);
+}
+
+/*
+ * use_mtrie_conf()
+ *
+ * inputs       - pointer to mtrie
+ * output       - the mtrie it replaces
+ * side effects - mt is searched and added to from now on
+ */
+
+struct MtrieConf *use_mtrie_conf(struct MtrieConf *mt)
+{
+  struct MtrieConf *old = mtrie;
+
+  mtrie = mt;
+  return(old);
+}
+
+/*
+ * free_mtrie_conf()
+ *
+ * inputs       - an mtrie use_mtrie_conf() gave back
+ * output       - its I lines, linked through next
+ * side effects -
+ * Clients can still be attached to the I lines, so they are left for
+ * the main thread to mark illegal or free; the K lines and the mtrie
+ * itself can go from any thread.
+ */
+
+struct ConfItem *free_mtrie_conf(struct MtrieConf *mt)
+{
+  struct ConfItem *ilines = NULL;
+
+  clear_mtrie_conf(mt, &ilines);
+  if(mt != &boot_mtrie)
+    MyFree(mt);
+  return(ilines);
+}
+
+/*
+ * quiet_mtrie_conf()
+ *
+ * inputs       - pointer to mtrie
+ *              - YES to stop reporting dups, NO to start again
+ * output       - NONE
+ * side effects -
+ */
+
+void quiet_mtrie_conf(struct MtrieConf *mt, int quiet)
+{
+  mt->quiet = quiet;
 }
 
 /*
  * clear_sub_mtrie
  *
  * inputs       - DOMAIN_LEVEL pointer
+ *              - where to put I lines, or NULL
  * output       - none
  * side effects - this portion of the mtrie is cleared
  */
 
-static void clear_sub_mtrie(DOMAIN_LEVEL *dl_ptr)
+static void clear_sub_mtrie(DOMAIN_LEVEL *dl_ptr, struct ConfItem **ilines)
 {
   DOMAIN_PIECE *dp_ptr;
   DOMAIN_PIECE *next_dp_ptr;
@@ -1761,12 +1907,17 @@ static void clear_sub_mtrie(DOMAIN_LEVEL *dl_ptr)
 
       for(;dp_ptr; dp_ptr = next_dp_ptr)
         {
-          clear_sub_mtrie(dp_ptr->next_level);
+          clear_sub_mtrie(dp_ptr->next_level, ilines);
 
           if(dp_ptr->wild_conf_ptr)
             {
               conf_ptr = dp_ptr->wild_conf_ptr;
-              if( (conf_ptr->status & CONF_CLIENT) && conf_ptr->clients)
+              if(ilines && (conf_ptr->status & CONF_CLIENT))
+                {
+                  conf_ptr->next = *ilines;
+                  *ilines = conf_ptr;
+                }
+              else if( (conf_ptr->status & CONF_CLIENT) && conf_ptr->clients)
                 conf_ptr->status |= CONF_ILLEGAL;
               else
                 free_conf(conf_ptr);
@@ -1775,7 +1926,12 @@ static void clear_sub_mtrie(DOMAIN_LEVEL *dl_ptr)
           if(dp_ptr->conf_ptr)
             {
               conf_ptr = dp_ptr->conf_ptr;
-              if( (conf_ptr->status & CONF_CLIENT) && conf_ptr->clients)
+              if(ilines && (conf_ptr->status & CONF_CLIENT))
+                {
+                  conf_ptr->next = *ilines;
+                  *ilines = conf_ptr;
+                }
+              else if( (conf_ptr->status & CONF_CLIENT) && conf_ptr->clients)
                 conf_ptr->status |= CONF_ILLEGAL;
               else
                 free_conf(conf_ptr);
@@ -1801,11 +1957,11 @@ static void clear_sub_mtrie(DOMAIN_LEVEL *dl_ptr)
  */
 
 static struct ConfItem *
-find_matching_ip_i_line(char *user, unsigned long host_ip)
+find_matching_ip_i_line(struct MtrieConf *mt, char *user, unsigned long host_ip)
 {
   struct ConfItem *aconf;
 
-  for(aconf = ip_i_lines; aconf; aconf = aconf->next)
+  for(aconf = mt->ip_i_lines; aconf; aconf = aconf->next)
     {
       if (((host_ip & aconf->ip_mask) == aconf->ip) &&
 	  match(aconf->user,user))
@@ -1817,7 +1973,8 @@ find_matching_ip_i_line(char *user, unsigned long host_ip)
 /*
  * report_dup()
  *
- * input        - char type
+ * input        - pointer to mtrie
+ *              - char type
  *              - pointer to struct ConfItem
  * output       - NONE
  * side effects -
@@ -1825,13 +1982,16 @@ find_matching_ip_i_line(char *user, unsigned long host_ip)
  *
  */
 
-static void report_dup(char type, struct ConfItem *aconf)
+static void report_dup(struct MtrieConf *mt, char type, struct ConfItem *aconf)
 {
   char *name, *host, *pass, *user;
   int port;
 
+  if(mt->quiet)
+    return;
+
   get_printable_conf(aconf, &name, &host, &pass, &user, &port);
 
-  sendto_realops("DUP: %c: (%s@%s) pass %s name %s port %d",
-                 type,user,host,pass,name,port);
+  conf_report("DUP: %c: (%s@%s) pass %s name %s port %d",
+              type,user,host,pass,name,port);
 }
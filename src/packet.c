@@ -33,6 +33,100 @@
 #include <assert.h>
 #include <string.h>
 
+/*
+ * line_end - return the first CR or LF in [p, end), or NULL
+ *
+ * Yuck.  Stuck.  To make sure we stay backward compatible,
+ * we must assume that either CR or LF terminates the message
+ * and not CR-LF.  By allowing CR or LF (alone) into the body
+ * of messages, backward compatibility is lost and major
+ * problems will arise. - Avalon
+ */
+static char* line_end(char* p, char* end)
+{
+  char* nl = memchr(p, '\n', end - p);
+  char* cr = memchr(p, '\r', (nl ? nl : end) - p);
+
+  return cr ? cr : nl;
+}
+
+/*
+ * buffer_line - add length bytes of a line that straddles reads to
+ * cptr->buffer, dropping what doesn't fit
+ */
+static void buffer_line(aClient *cptr, const char *p, size_t length)
+{
+  size_t room = sizeof(cptr->buffer) - 1 - cptr->count;
+
+  if (length > room)
+    length = room;
+  memcpy(cptr->buffer + cptr->count, p, length);
+  cptr->count += length;
+}
+
+/*
+ * doline - parse the line starting at *chp, or keep the start of it
+ * in cptr->buffer if its CR/LF hasn't come yet
+ *
+ * returns CLIENT_EXITED if cptr is gone, 0 if the rest of the data was
+ * kept, otherwise 1 with *chp moved past the line
+ */
+static int doline(aClient *cptr, char **chp, char *end)
+{
+  char  *ch2 = *chp;
+  char  *eol;
+  char  *line;
+  char  *eom;
+
+  if (!(eol = line_end(ch2, end)))
+    {
+      /* no CR/LF yet, keep what we have for the next read */
+      buffer_line(cptr, ch2, end - ch2);
+      return 0;
+    }
+
+  if (cptr->count)
+    {
+      buffer_line(cptr, ch2, eol - ch2);
+      line = cptr->buffer;
+      eom = cptr->buffer + cptr->count;
+    }
+  else
+    {
+      line = ch2;
+      eom = eol;
+      if ((size_t) (eom - line) > sizeof(cptr->buffer) - 1)
+        eom = line + sizeof(cptr->buffer) - 1;
+    }
+  *chp = eol + 1;
+
+  if (eom == line)
+    return 1; /* Skip extra LF/CR's */
+  *eom = '\0';
+  me.receiveM += 1; /* Update messages received */
+  cptr->receiveM += 1;
+  cptr->count = 0; /* ...just in case parse returns with
+                   ** CLIENT_EXITED without removing the
+                   ** structure pointed by cptr... --msa
+                   */
+  if (parse(cptr, line, eom) == CLIENT_EXITED)
+    /*
+    ** CLIENT_EXITED means actually that cptr
+    ** structure *does* not exist anymore!!! --msa
+    */
+    return CLIENT_EXITED;
+  /*
+  ** Socket is dead so exit (which always returns with
+  ** CLIENT_EXITED here).  - avalon
+  */
+  if (cptr->flags & FLAGS_DEADSOCKET)
+    return exit_client(cptr, cptr, &me, (cptr->flags & FLAGS_SENDQEX) ?
+                       ((cptr->listtask) ?
+                        "Local kill by /list (so many channels!)" :
+                       "SendQ exceeded") : "Dead socket");
+  return 1;
+}
+
 /*
 ** dopacket
 **      cptr - pointer to client structure for which the buffer data
@@ -46,6 +140,11 @@
 **      the connection fails on the other server before switching
 **      to compressed mode.
 **
+**      A line that is whole in the buffer is terminated where it
+**      lies and handed to parse() from there; only the start of a
+**      line still waiting for its CR/LF is copied, to cptr->buffer.
+**      So buffer (readBuf, or unzip_packet()'s output) is written to.
+**
 ** Note:
 **      It is implicitly assumed that dopacket is called only
 **      with cptr of "local" variation, which contains all the
@@ -53,15 +152,14 @@
 */
 int dopacket(aClient *cptr, char *buffer, size_t length)
 {
-  char  *ch1;
   char  *ch2;
-  char *cptrbuf;
+  char  *end;
+  int   done;
 #ifdef ZIP_LINKS
   int  zipped = NO;
   int  done_unzip = NO;
 #endif
 
-  cptrbuf = cptr->buffer;
   me.receiveB += length; /* Update bytes received */
   cptr->receiveB += length;
 
@@ -76,7 +174,6 @@ int dopacket(aClient *cptr, char *buffer, size_t length)
       me.receiveK += (me.receiveB >> 10);
       me.receiveB &= 0x03ff;
     }
-  ch1 = cptrbuf + cptr->count;
   ch2 = buffer;
 
 #ifdef ZIP_LINKS
@@ -92,6 +189,14 @@ int dopacket(aClient *cptr, char *buffer, size_t length)
   else
     done_unzip = YES;
 
+#ifdef ZIP_THREADS
+  if (cptr->flags2 & FLAGS2_ZIP)
+    {
+      /* a worker inflates it, zip_collect() hands it to dopacket_unzipped() */
+      zip_queue_in(cptr, ch2, length);
+      return 1;
+    }
+#endif
   if (cptr->flags2 & FLAGS2_ZIP)
     {
       /* uncompressed buffer first */
@@ -118,86 +223,49 @@ int dopacket(aClient *cptr, char *buffer, size_t length)
       /* While there is "stuff" in uncompressed input to deal with
        * loop around parsing it. -Dianora
        */
-      while (length-- > 0)
+      end = ch2 + length;
+      while (ch2 < end)
         {
-          char g;
-          g = (*ch1 = *ch2++);
-          /*
-           * Yuck.  Stuck.  To make sure we stay backward compatible,
-           * we must assume that either CR or LF terminates the message
-           * and not CR-LF.  By allowing CR or LF (alone) into the body
-           * of messages, backward compatibility is lost and major
-           * problems will arise. - Avalon
-           */
-
-          /* The previous code is just silly, you do at least one test
-           * to see if g is less than 16, then at least one more, total of two
-           * its gotta be a '\r' or a '\n' before anything happens, so why
-           * not just check for either '\n' or '\r' ?
-           * -Dianora
-           */
-          /*      if ( g < '\16' && (g== '\n' || g == '\r')) */
-
-          if ( g == '\n' || g == '\r' )
+          if ((done = doline(cptr, &ch2, end)) == CLIENT_EXITED)
+            return CLIENT_EXITED;
+          if (!done)
+            break;
+          length = end - ch2;
+
+#ifdef ZIP_LINKS
+          if ((cptr->flags2 & FLAGS2_ZIP) && (zipped == 0) &&
+              (length > 0))
             {
-              if (ch1 == cptrbuf)
-                continue; /* Skip extra LF/CR's */
-              *ch1 = '\0';
-              me.receiveM += 1; /* Update messages received */
-              cptr->receiveM += 1;
-              cptr->count = 0; /* ...just in case parse returns with
-                               ** CLIENT_EXITED without removing the
-                               ** structure pointed by cptr... --msa
-                               */
-              if (parse(cptr, cptr->buffer, ch1) == CLIENT_EXITED)
-                /*
-                ** CLIENT_EXITED means actually that cptr
-                ** structure *does* not exist anymore!!! --msa
-                */
-                return CLIENT_EXITED;
               /*
-              ** Socket is dead so exit (which always returns with
-              ** CLIENT_EXITED here).  - avalon
+              ** beginning of server connection, the buffer
+              ** contained PASS/CAPAB/SERVER and is now 
+              ** zipped!
+              ** Ignore the '\n' that should be here.
+              */
+              /* Checked RFC1950: \r or \n can't start a
+              ** zlib stream  -orabidoo
               */
-              if (cptr->flags & FLAGS_DEADSOCKET)
-                return exit_client(cptr, cptr, &me, (cptr->flags & FLAGS_SENDQEX) ?
-                                   ((IsDoingList(cptr)) ?
-                                    "Local kill by /list (so many channels!)" :
-                                   "SendQ exceeded") : "Dead socket");
 
-#ifdef ZIP_LINKS
-              if ((cptr->flags2 & FLAGS2_ZIP) && (zipped == 0) &&
-                  (length > 0))
+              zipped = length;
+              if (zipped > 0 && (*ch2 == '\n' || *ch2 == '\r'))
                 {
-                  /*
-                  ** beginning of server connection, the buffer
-                  ** contained PASS/CAPAB/SERVER and is now 
-                  ** zipped!
-                  ** Ignore the '\n' that should be here.
-                  */
-                  /* Checked RFC1950: \r or \n can't start a
-                  ** zlib stream  -orabidoo
-                  */
-
-                  zipped = length;
-                  if (zipped > 0 && (*ch2 == '\n' || *ch2 == '\r'))
-                    {
-                      ch2++;
-                      zipped--;
-                    }
-                  cptr->flags2 &= ~FLAGS2_ZIPFIRST;
-                  ch2 = unzip_packet(cptr, ch2, &zipped);
-                  length = zipped;
-                  zipped = 1;
-                  if (length == -1)
-                    return exit_client(cptr, cptr, &me,
-                                       "fatal error in unzip_packet(2)");
+                  ch2++;
+                  zipped--;
                 }
-#endif /* ZIP_LINKS */
-              ch1 = cptrbuf;
+              cptr->flags2 &= ~FLAGS2_ZIPFIRST;
+#ifdef ZIP_THREADS
+              zip_queue_in(cptr, ch2, zipped);
+              return 1;
+#endif
+              ch2 = unzip_packet(cptr, ch2, &zipped);
+              length = zipped;
+              zipped = 1;
+              if (length == -1)
+                return exit_client(cptr, cptr, &me,
+                                   "fatal error in unzip_packet(2)");
+              end = ch2 + length;
             }
-          else if (ch1 < cptrbuf + (sizeof(cptr->buffer)-1))
-            ch1++; /* There is always room for the null */
+#endif /* ZIP_LINKS */
         }
 #ifdef ZIP_LINKS
       /* Now see if anything is left uncompressed in the input
@@ -215,7 +283,6 @@ int dopacket(aClient *cptr, char *buffer, size_t length)
               if (length == -1)
                 return exit_client(cptr, cptr, &me,
                                    "fatal error in unzip_packet(1)");
-              ch1 = ch2 + length;
               done_unzip = NO;
             }
           else
@@ -225,11 +292,30 @@ int dopacket(aClient *cptr, char *buffer, size_t length)
 #ifdef ZIP_LINKS
     }while(!done_unzip);
 #endif
-  cptr->count = ch1 - cptrbuf;
   return 1;
 }
 
 
+#ifdef ZIP_THREADS
+/*
+ * dopacket_unzipped - parse data a zip worker has inflated for cptr
+ */
+int dopacket_unzipped(struct Client *cptr, char *buffer, size_t length)
+{
+  char  *end = buffer + length;
+  int   done;
+
+  while (buffer < end)
+    {
+      if ((done = doline(cptr, &buffer, end)) == CLIENT_EXITED)
+        return CLIENT_EXITED;
+      if (!done)
+        break;
+    }
+  return 1;
+}
+#endif /* ZIP_THREADS */
+
 /*
  * client_dopacket - copy packet to client buf and parse it
  *      cptr - pointer to client structure for which the buffer data
@@ -27,6 +27,7 @@
 #include "irc_string.h"
 #include "ircd.h"
 #include "numeric.h"
+#include "s_latency.h"
 #include "s_log.h"
 #include "s_stats.h"
 #include "send.h"
@@ -58,9 +59,6 @@ static  void    remove_unknown (aClient *, char *, char *);
 static int do_numeric (char [], struct Client *,
                          struct Client *, int, char **);
 
-static struct Message *do_msg_tree(MESSAGE_TREE *, char *, struct Message *);
-struct Message *tree_parse(char *);
-
 static char buffer[1024];  /* ZZZ must this be so big? must it be here? */
 
 /*
@@ -190,7 +188,7 @@ int parse(aClient *cptr, char *pbuffer, char *bufend)
       if (s)
         *s++ = '\0';
 
-      mptr = tree_parse(ch);
+      mptr = find_message(ch);
 
       if (!mptr || !mptr->cmd)
         {
@@ -342,157 +340,17 @@ int parse(aClient *cptr, char *pbuffer, char *bufend)
   if (IsRegisteredUser(cptr) && !mptr->reset_idle && !(cptr->umodes & FLAGS_UNIDLE))
     from->user->last = CurrentTime;
 #endif
-  
-  /* don't allow other commands while a list is blocked. since we treat
-     them specially with respect to sendq. */
-  if ((IsDoingList(cptr)) && (*mptr->func != m_list))
-      return -1;
+#ifdef LATENCY_STATS
+  {
+    unsigned long start = latency_usec();
+    int           ret = (*mptr->func)(cptr, from, i, para);
+
+    latency_command(mptr, latency_usec() - start);
+    return ret;
+  }
+#else
   return (*mptr->func)(cptr, from, i, para);
-}
-
-/* for qsort'ing the msgtab in place -orabidoo */
-static int mcmp(struct Message *m1, struct Message *m2)
-{
-  return strcmp(m1->cmd, m2->cmd);
-}
-
-/*
- * init_tree_parse()
- *
- * inputs               - pointer to msg_table defined in msg.h 
- * output       - NONE
- * side effects - MUST MUST be called at startup ONCE before
- *                any other keyword hash routine is used.
- *
- *      -Dianora, orabidoo
- */
-/* Initialize the msgtab parsing tree -orabidoo
- */
-void init_tree_parse(struct Message *mptr)
-{
-  int i;
-  struct Message *mpt = mptr;
-
-  for (i=0; mpt->cmd; mpt++)
-    i++;
-  qsort((void *)mptr, i, sizeof(struct Message), 
-                (int (*)(const void *, const void *)) mcmp);
-  msg_tree_root = (MESSAGE_TREE *)MyMalloc(sizeof(MESSAGE_TREE));
-  mpt = do_msg_tree(msg_tree_root, "", mptr);
-
-  /*
-   * this happens if one of the msgtab entries included characters
-   * other than capital letters  -orabidoo
-   */
-  if (mpt->cmd)
-    {
-      ilog(L_CRIT, "bad msgtab entry: ``%s''\n", mpt->cmd);
-      exit(1);
-    }
-}
-
-/*  Recursively make a prefix tree out of the msgtab -orabidoo
- */
-static struct Message *do_msg_tree(MESSAGE_TREE *mtree, char *prefix,
-                                struct Message *mptr)
-{
-  char newpref[64];  /* must be longer than any command */
-  int c, c2, lp;
-  MESSAGE_TREE *mtree1;
-
-  lp = strlen(prefix);
-  if (!lp || !strncmp(mptr->cmd, prefix, lp))
-    {
-      if (!mptr[1].cmd || (lp && strncmp(mptr[1].cmd, prefix, lp)))
-        {
-          /* non ambiguous -> make a final case */
-          mtree->final = mptr->cmd + lp;
-          mtree->msg = mptr;
-          for (c=0; c<=25; c++)
-            mtree->pointers[c] = NULL;
-          return mptr+1;
-        }
-      else
-        {
-          /* ambigous -> make new entries for each of the letters that match */
-          if (!irccmp(mptr->cmd, prefix))
-            {
-              /* fucking OPERWALL blows me */
-              mtree->final = (void *)1;
-              mtree->msg = mptr;
-              mptr++;
-            }
-          else
-            mtree->final = NULL;
-
-      for (c='A'; c<='Z'; c++)
-        {
-          if (mptr->cmd[lp] == c)
-            {
-              mtree1 = (MESSAGE_TREE *)MyMalloc(sizeof(MESSAGE_TREE));
-              mtree1->final = NULL;
-              mtree->pointers[c-'A'] = mtree1;
-              strcpy(newpref, prefix);
-              newpref[lp] = c;
-              newpref[lp+1] = '\0';
-              mptr = do_msg_tree(mtree1, newpref, mptr);
-              if (!mptr->cmd || strncmp(mptr->cmd, prefix, lp))
-                {
-                  for (c2=c+1-'A'; c2<=25; c2++)
-                    mtree->pointers[c2] = NULL;
-                  return mptr;
-                }
-            } 
-          else
-            {
-              mtree->pointers[c-'A'] = NULL;
-            }
-        }
-      return mptr;
-        }
-    } 
-  else
-    {
-      assert(0);
-      exit(1);
-    }
-  return (0); 
-}
-
-/*
- * tree_parse()
- * 
- * inputs       - pointer to command in upper case
- * output       - NULL pointer if not found
- *                struct Message pointer to command entry if found
- * side effects - NONE
- *
- *      -Dianora, orabidoo
- */
-
-struct Message *tree_parse(char *cmd)
-{
-  char r;
-  MESSAGE_TREE *mtree = msg_tree_root;
-
-  while ((r = *cmd++))
-    {
-      r &= 0xdf;  /* some touppers have trouble w/ lowercase, says Dianora */
-      if (r < 'A' || r > 'Z')
-        return NULL;
-      mtree = mtree->pointers[r - 'A'];
-      if (!mtree)
-        return NULL;
-      if (mtree->final == (void *)1)
-        {
-          if (!*cmd)
-            return mtree->msg;
-        }
-      else
-        if (mtree->final && !irccmp(mtree->final, cmd))
-          return mtree->msg;
-    }
-  return ((struct Message *)NULL);
+#endif
 }
 
 static  int     cancel_clients(aClient *cptr,
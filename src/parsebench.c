@@ -0,0 +1,141 @@
+/************************************************************************
+ *   IRC - Internet Relay Chat, src/parsebench.c
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 1, or (at your option)
+ *   any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ * parsebench - time find_message() over captured traffic
+ *
+ *   make parsebench
+ *   ./parsebench capture [rounds]
+ *
+ * capture is raw protocol, one message a line, as a client or server
+ * link would send it (a netburst saved off a link, a client session
+ * logged by a proxy). The command word of each line is picked out the
+ * way parse() does, then every line is looked up rounds times and the
+ * average time per line printed. The table is built from the generated
+ * names, so no handlers are needed and only msg_hash.o is linked.
+ *
+ * $Id$
+ */
+#include "parse.h"
+#include "msg.h"
+#include "s_log.h"
+#include "msg_hash.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+#define MAX_LINES 1000000
+
+static struct Message table[MSG_HASH_SIZE + 1];   /* ends in a 0 cmd */
+
+void ilog(int priority, const char* fmt, ...)
+{
+  fprintf(stderr, "%s\n", fmt);
+}
+
+/*
+ * command - point at the command word of line, as parse() finds it,
+ * or NULL for a numeric or an empty line
+ */
+static char* command(char* line)
+{
+  char* p = line;
+  char* s;
+
+  if ((s = strpbrk(p, "\r\n")))
+    *s = '\0';
+  while (*p == ' ')
+    p++;
+  if (*p == ':')
+    {
+      if (!(p = strchr(p, ' ')))
+        return NULL;
+      while (*p == ' ')
+        p++;
+    }
+  if (!*p || (p[0] >= '0' && p[0] <= '9'))
+    return NULL;
+  if ((s = strchr(p, ' ')))
+    *s = '\0';
+  return p;
+}
+
+int main(int argc, char* argv[])
+{
+  char           line[1024];
+  char**         cmds;
+  FILE*          file;
+  struct timeval start;
+  struct timeval end;
+  double         ns;
+  int            rounds = 100;
+  int            count = 0;
+  long           unknown = 0;
+  int            i;
+  int            r;
+  char*          p;
+
+  if (argc < 2)
+    {
+      fprintf(stderr, "usage: %s capture [rounds]\n", argv[0]);
+      return 1;
+    }
+  if (argc > 2 && (rounds = atoi(argv[2])) < 1)
+    rounds = 1;
+  if (!(file = fopen(argv[1], "r")))
+    {
+      perror(argv[1]);
+      return 1;
+    }
+
+  for (i = r = 0; i < MSG_HASH_SIZE; i++)
+    if (msg_hash_names[i])
+      {
+        if (msg_hash(msg_hash_names[i], strlen(msg_hash_names[i])) != i)
+          {
+            fprintf(stderr, "msg_hash.h is out of step with itself\n");
+            return 1;
+          }
+        table[r++].cmd = (char *) msg_hash_names[i];
+      }
+  init_msg_hash(table);
+
+  cmds = (char **) malloc(MAX_LINES * sizeof(char *));
+  while (count < MAX_LINES && fgets(line, sizeof(line), file))
+    if ((p = command(line)))
+      cmds[count++] = strdup(p);
+  fclose(file);
+  if (!count)
+    {
+      fprintf(stderr, "%s: no commands found\n", argv[1]);
+      return 1;
+    }
+
+  gettimeofday(&start, NULL);
+  for (r = 0; r < rounds; r++)
+    for (i = 0; i < count; i++)
+      if (!find_message(cmds[i]))
+        unknown++;
+  gettimeofday(&end, NULL);
+
+  ns = ((end.tv_sec - start.tv_sec) * 1e9 +
+        (end.tv_usec - start.tv_usec) * 1e3) / ((double) count * rounds);
+  printf("%d lines (%ld unknown), %d rounds: %.1f ns/line\n",
+         count, unknown / rounds, rounds, ns);
+  return 0;
+}
@@ -4,6 +4,7 @@
  * $Id: restart.c,v 1.12 2003/06/24 03:57:16 ievil Exp $
  */
 #include "restart.h"
+#include "ban_journal.h"
 #include "common.h"
 #include "ircd.h"
 #include "send.h"
@@ -39,6 +40,12 @@ void server_reboot(void)
 
   ilog(L_NOTICE, "Restarting server...");
   flush_connections(0);
+#ifdef BAN_JOURNAL
+  journal_flush();
+#endif
+#ifdef LOG_THREAD
+  log_flush();
+#endif
 
   for (i = 0; i < MAXCONNECTIONS; ++i)
     close(i);
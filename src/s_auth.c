@@ -32,6 +32,7 @@
 #include "client.h"
 #include "common.h"
 #include "fdlist.h"              /* fdlist_add */
+#include "hash.h"
 #include "irc_string.h"
 #include "ircd.h"
 #include "numeric.h"
@@ -93,6 +94,8 @@ struct AuthRequest* AuthPollList = 0; /* GLOBAL - auth queries pending io */
 
 static struct AuthRequest* AuthIncompleteList = 0;
 
+static void auth_timeout(void *);
+
 /*
  * make_auth_request - allocate a new auth request
  */
@@ -107,7 +110,8 @@ static struct AuthRequest* make_auth_request(struct Client* client)
   memset(request, 0, sizeof(struct AuthRequest));
   request->fd      = -1;
   request->client  = client;
-  request->timeout = CurrentTime + AUTH_CONNECTTIMEOUT;
+  timer_init(&request->timer, auth_timeout, request);
+  timer_add(&request->timer, CurrentTime + AUTH_CONNECTTIMEOUT + 1);
   return request;
 }
 
@@ -119,6 +123,7 @@ void free_auth_request(struct AuthRequest* request)
   /*
    * XXX - use blfree here?
    */
+  timer_del(&request->timer);
   MyFree(request);
 }
 
@@ -149,6 +154,201 @@ static void link_auth_request(struct AuthRequest* request,
   *list = request;
 }
 
+#ifdef AUTH_CACHE
+/*
+ * The auth cache, what the last lookups for an IP found. A fixed
+ * pool of AUTH_CACHE_SIZE entries hashed by IP, with the least
+ * recently used at the tail of the lru list being reused once the
+ * pool is full. An entry's answers lapse on their own; it goes when
+ * it's reused or the cache is flushed.
+ */
+#define AUTH_CACHE_HASH 0x1000
+
+struct AuthCache {
+  struct AuthCache* hnext;         /* hash chain */
+  struct AuthCache* prev;          /* lru list, most recent first */
+  struct AuthCache* next;
+  struct in_addr    ip;
+  time_t            dns_expires;   /* host good till, 0 if none */
+  time_t            ident_expires; /* no identd till */
+  char              host[HOSTLEN + 1]; /* empty if the lookup failed */
+};
+
+static struct AuthCache  auth_cache[AUTH_CACHE_SIZE];
+static struct AuthCache* auth_cache_hash[AUTH_CACHE_HASH];
+static struct AuthCache* auth_cache_head = 0;
+static struct AuthCache* auth_cache_tail = 0;
+static int               auth_cache_count = 0;
+
+static unsigned int hash_auth_cache(const struct in_addr* ip)
+{
+  unsigned long addr = ntohl(ip->s_addr);
+
+  return ((addr >> 12) + addr) & (AUTH_CACHE_HASH - 1);
+}
+
+static void unlink_auth_cache(struct AuthCache* entry)
+{
+  if (entry->next)
+    entry->next->prev = entry->prev;
+  else
+    auth_cache_tail = entry->prev;
+  if (entry->prev)
+    entry->prev->next = entry->next;
+  else
+    auth_cache_head = entry->next;
+}
+
+static void link_auth_cache(struct AuthCache* entry)
+{
+  entry->prev = 0;
+  entry->next = auth_cache_head;
+  if (auth_cache_head)
+    auth_cache_head->prev = entry;
+  else
+    auth_cache_tail = entry;
+  auth_cache_head = entry;
+}
+
+/*
+ * find_auth_cache - the cache entry for ip, made if create is set and
+ * there isn't one; the entry becomes the most recently used
+ */
+static struct AuthCache* find_auth_cache(const struct in_addr* ip, int create)
+{
+  unsigned int       hashv = hash_auth_cache(ip);
+  struct AuthCache*  entry;
+  struct AuthCache** link;
+
+  for (entry = auth_cache_hash[hashv]; entry; entry = entry->hnext)
+    if (entry->ip.s_addr == ip->s_addr)
+      {
+        unlink_auth_cache(entry);
+        link_auth_cache(entry);
+        return entry;
+      }
+  if (!create)
+    return 0;
+
+  if (auth_cache_count < AUTH_CACHE_SIZE)
+    entry = &auth_cache[auth_cache_count++];
+  else
+    {
+      entry = auth_cache_tail;
+      unlink_auth_cache(entry);
+      for (link = &auth_cache_hash[hash_auth_cache(&entry->ip)];
+           *link != entry; link = &(*link)->hnext)
+        ;
+      *link = entry->hnext;
+    }
+  memset(entry, 0, sizeof(struct AuthCache));
+  entry->ip.s_addr = ip->s_addr;
+  entry->hnext = auth_cache_hash[hashv];
+  auth_cache_hash[hashv] = entry;
+  link_auth_cache(entry);
+  return entry;
+}
+
+/*
+ * cache_dns_reply - remember what the PTR lookup for client found.
+ * adns only answers adns_s_ok once the name's A records include the
+ * IP, so a cached hostname is always forward confirmed. Failures the
+ * next lookup could get past (timeouts, server failures) aren't kept.
+ */
+static void cache_dns_reply(struct Client* client, adns_answer* reply)
+{
+  struct AuthCache* entry;
+  time_t            expires;
+
+  if (!reply)
+    return;
+  if (reply->status == adns_s_ok)
+    {
+      if (strlen(*reply->rrs.str) >= HOSTLEN)
+        return;
+      expires = reply->expires;
+      if (expires > CurrentTime + DNS_CACHE_MAXTTL)
+        expires = CurrentTime + DNS_CACHE_MAXTTL;
+    }
+  else if (reply->status > adns_s_max_tempfail)
+    {
+      expires = CurrentTime + DNS_CACHE_NEGTTL;
+      if ((reply->status == adns_s_nxdomain ||
+           reply->status == adns_s_nodata) && reply->expires < expires)
+        expires = reply->expires;
+    }
+  else
+    return;
+  if (expires <= CurrentTime)
+    return;
+
+  entry = find_auth_cache(&client->ip, 1);
+  entry->dns_expires = expires;
+  if (reply->status == adns_s_ok)
+    strcpy(entry->host, *reply->rrs.str);
+  else
+    entry->host[0] = '\0';
+}
+
+/*
+ * cached_dns - give client the host the cache has for it, if any
+ * output	- 1 if it did, 0 if a lookup is needed
+ */
+static int cached_dns(struct Client* client)
+{
+  struct AuthCache* entry = find_auth_cache(&client->ip, 0);
+
+  if (!entry || entry->dns_expires <= CurrentTime)
+    {
+      ++ServerStats->is_dcm;
+      return 0;
+    }
+  if (entry->host[0])
+    {
+      strcpy(client->host, entry->host);
+      sendheader(client, REPORT_FIN_DNSC);
+      ++ServerStats->is_dch;
+    }
+  else
+    {
+      strcpy(client->host, client->sockhost);
+      sendheader(client, REPORT_FAIL_DNS);
+      ++ServerStats->is_dcn;
+    }
+  return 1;
+}
+
+/*
+ * ident_failed - client's host has no working identd, don't ask it
+ * again for a while. A reply we couldn't use isn't one of these, the
+ * next user from there may well get an answer.
+ */
+static void ident_failed(struct Client* client)
+{
+  find_auth_cache(&client->ip, 1)->ident_expires = CurrentTime + IDENT_CACHE_TTL;
+}
+
+/*
+ * no_identd - whether client's host failed an ident query recently
+ */
+static int no_identd(struct Client* client)
+{
+  struct AuthCache* entry = find_auth_cache(&client->ip, 0);
+
+  return entry && entry->ident_expires > CurrentTime;
+}
+
+/*
+ * flush_auth_cache - forget everything, from /REHASH DNS
+ */
+void flush_auth_cache(void)
+{
+  memset(auth_cache_hash, 0, sizeof(auth_cache_hash));
+  auth_cache_head = auth_cache_tail = 0;
+  auth_cache_count = 0;
+}
+#endif /* AUTH_CACHE */
+
 /*
  * release_auth_client - release auth client from auth system
  * this adds the client into the local client lists so it can be read by
@@ -162,8 +362,10 @@ static void release_auth_client(struct Client* client)
 
   fdlist_add(client->fd, FDL_DEFAULT);
   add_client_to_list(client);
+  add_to_ip_block_table(client);
   
   SetAccess(client);
+  set_client_timer(client);
 }
  
 /*
@@ -178,6 +380,9 @@ static void auth_dns_callback(void* vptr, adns_answer* reply)
   struct AuthRequest* auth = (struct AuthRequest*) vptr;
 
   ClearDNSPending(auth);
+#ifdef AUTH_CACHE
+  cache_dns_reply(auth->client, reply);
+#endif
   if (reply && (reply->status == adns_s_ok))
   {
       if(strlen(*reply->rrs.str) < HOSTLEN)
@@ -211,11 +416,15 @@ static void auth_error(struct AuthRequest* auth)
 {
   ++ServerStats->is_abad;
 
+  netio_del(auth->fd);
   close(auth->fd);
   auth->fd = -1;
 
   ClearAuth(auth);
   sendheader(auth->client, REPORT_FAIL_ID);
+#ifdef AUTH_CACHE
+  ident_failed(auth->client);
+#endif
 
   unlink_auth_request(auth, &AuthPollList);
 
@@ -243,6 +452,15 @@ static int start_auth_query(struct AuthRequest* auth)
   int                locallen = sizeof(struct sockaddr_in);
   int                fd;
 
+#ifdef AUTH_CACHE
+  if (no_identd(auth->client))
+    {
+      sendheader(auth->client, REPORT_DO_ID);
+      sendheader(auth->client, REPORT_FAIL_ID);
+      ++ServerStats->is_ich;
+      return 0;
+    }
+#endif
   if ((fd = socket(AF_INET, SOCK_STREAM, 0)) == -1)
     {
       /* er .. on the off chance we're having ident errors, we may leak a
@@ -310,6 +528,9 @@ static int start_auth_query(struct AuthRequest* auth)
 	   */
 	  close(fd);
 	  sendheader(auth->client, REPORT_FAIL_ID);
+#ifdef AUTH_CACHE
+	  ident_failed(auth->client);
+#endif
 	  return 0;
 	}
     }
@@ -317,6 +538,7 @@ static int start_auth_query(struct AuthRequest* auth)
   auth->fd = fd;
 
   SetAuthConnect(auth);
+  netio_add(fd, NETIO_AUTH, auth, NETIO_WRITE);
   return 1;
 }
 
@@ -392,14 +614,19 @@ void start_auth(struct Client* client)
 
   auth = make_auth_request(client);
 
-  client->dns_query = MyMalloc(sizeof(struct DNSQuery));
-  client->dns_query->ptr     = auth;
-  client->dns_query->callback = auth_dns_callback;
-
   sendheader(client, REPORT_DO_DNS);
 
-  if(!adns_getaddr(&client->ip, client->dns_query))
-    SetDNSPending(auth);
+#ifdef AUTH_CACHE
+  if (!cached_dns(client))
+#endif
+    {
+      client->dns_query = MyMalloc(sizeof(struct DNSQuery));
+      client->dns_query->ptr     = auth;
+      client->dns_query->callback = auth_dns_callback;
+
+      if(!adns_getaddr(&client->ip, client->dns_query))
+        SetDNSPending(auth);
+    }
 
   if (start_auth_query(auth))
     link_auth_request(auth, &AuthPollList);
@@ -413,53 +640,51 @@ void start_auth(struct Client* client)
 }
 
 /*
- * timeout_auth_queries - timeout resolver and identd requests
+ * auth_timeout - timeout resolver and identd requests
  * allow clients through if requests failed
  */
-void timeout_auth_queries(time_t now)
+static void auth_timeout(void* data)
 {
-  struct AuthRequest* auth;
-  struct AuthRequest* auth_next = 0;
+  struct AuthRequest* auth = (struct AuthRequest*) data;
 
-  for (auth = AuthPollList; auth; auth = auth_next)
+  /* identd still going means it is on the poll list */
+  if (IsDoingAuth(auth))
     {
-      auth_next = auth->next;
-      if (auth->timeout < CurrentTime)
-	{
-	  if (-1 < auth->fd)
-	    close(auth->fd);
-
-	  sendheader(auth->client, REPORT_FAIL_ID);
-	  if (IsDNSPending(auth))
-	    {
-	      delete_adns_queries(auth->client->dns_query);
-	      auth->client->dns_query->query = NULL;
-	      sendheader(auth->client, REPORT_FAIL_DNS);
-	    }
-	  ilog(L_INFO, "DNS/AUTH timeout %s",
-	      get_client_name(auth->client, SHOW_IP));
-
-	  auth->client->since = now;
-	  release_auth_client(auth->client);
-	  unlink_auth_request(auth, &AuthPollList);
-	  free_auth_request(auth);
-	}
+      if (-1 < auth->fd)
+        {
+          netio_del(auth->fd);
+          close(auth->fd);
+        }
+
+      sendheader(auth->client, REPORT_FAIL_ID);
+#ifdef AUTH_CACHE
+      ident_failed(auth->client);
+#endif
+      if (IsDNSPending(auth))
+        {
+          delete_adns_queries(auth->client->dns_query);
+          auth->client->dns_query->query = NULL;
+          sendheader(auth->client, REPORT_FAIL_DNS);
+        }
+      ilog(L_INFO, "DNS/AUTH timeout %s",
+          get_client_name(auth->client, SHOW_IP));
+
+      auth->client->since = CurrentTime;
+      release_auth_client(auth->client);
+      unlink_auth_request(auth, &AuthPollList);
+      free_auth_request(auth);
     }
-  for (auth = AuthIncompleteList; auth; auth = auth_next)
+  else
     {
-      auth_next = auth->next;
-      if (auth->timeout < CurrentTime)
-	{
-	  delete_adns_queries(auth->client->dns_query);
-	  auth->client->dns_query->query = NULL;
-	  sendheader(auth->client, REPORT_FAIL_DNS);
-	  ilog(L_INFO, "DNS timeout %s", get_client_name(auth->client, SHOW_IP));
-
-	  auth->client->since = now;
-	  release_auth_client(auth->client);
-	  unlink_auth_request(auth, &AuthIncompleteList);
-	  free_auth_request(auth);
-	}
+      delete_adns_queries(auth->client->dns_query);
+      auth->client->dns_query->query = NULL;
+      sendheader(auth->client, REPORT_FAIL_DNS);
+      ilog(L_INFO, "DNS timeout %s", get_client_name(auth->client, SHOW_IP));
+
+      auth->client->since = CurrentTime;
+      release_auth_client(auth->client);
+      unlink_auth_request(auth, &AuthIncompleteList);
+      free_auth_request(auth);
     }
 }
 
@@ -500,6 +725,7 @@ void send_auth_query(struct AuthRequest* auth)
     }
   ClearAuthConnect(auth);
   SetAuthPending(auth);
+  netio_set_flags(auth->fd, NETIO_READ);
 }
 
 
@@ -547,6 +773,7 @@ void read_auth_reply(struct AuthRequest* auth)
   if ((len < 0) && (EAGAIN == errno))
     return;
 
+  netio_del(auth->fd);
   close(auth->fd);
   auth->fd = -1;
   ClearAuth(auth);
@@ -555,6 +782,10 @@ void read_auth_reply(struct AuthRequest* auth)
     {
       ++ServerStats->is_abad;
       strcpy(auth->client->username, "unknown");
+#ifdef AUTH_CACHE
+      if (len <= 0)
+        ident_failed(auth->client);
+#endif
     }
   else
     {
@@ -25,19 +25,23 @@
 #include "common.h"
 #include "config.h"
 #include "fdlist.h"
+#include "hash.h"
 #include "irc_string.h"
 #include "ircd.h"
 #include "list.h"
 #include "listener.h"
+#include "m_list.h"
 #include "numeric.h"
 #include "packet.h"
 #include "res.h"
 #include "restart.h"
 #include "s_auth.h"
 #include "s_conf.h"
+#include "s_latency.h"
 #include "s_log.h"
 #include "s_serv.h"
 #include "s_stats.h"
+#include "s_timer.h"
 #include "s_zip.h"
 #include "send.h"
 #include "struct.h"
@@ -59,6 +63,7 @@
 #include <sys/socket.h>
 #include <sys/file.h>
 #include <sys/ioctl.h>
+#include <sys/uio.h>
 #include <sys/resource.h>
 #include <sys/param.h>    /* NOFILE */
 #include <arpa/inet.h>
@@ -71,6 +76,10 @@
 #define CONNECTFAST
 #endif
 
+#ifdef USE_EPOLL
+#include <sys/epoll.h>
+#endif
+
 #ifndef IN_LOOPBACKNET
 #define IN_LOOPBACKNET        0x7f
 #endif
@@ -91,7 +100,25 @@ int            highest_fd = 0;
 
 static struct sockaddr_in mysk;
 static char readBuf[READBUF_SIZE];
-#ifndef USE_POLL
+#if defined(USE_EPOLL)
+/*
+ * Stuff for epoll()
+ *
+ * Every descriptor is registered once when it is opened. netioFds
+ * remembers what each one is so an event can be dispatched without
+ * searching the auth and listener lists.
+ */
+#define EPOLL_MAXEVENTS 256
+
+struct NetioFd {
+  void*         data;       /* listener or auth request, NULL for clients */
+  unsigned char type;       /* NETIO_xxx, 0 if not registered */
+};
+
+static struct NetioFd netioFds[MAXCONNECTIONS];
+static int            epollFd = -1;
+
+#elif !defined(USE_POLL)
 /*
  * Stuff for select()
  */
@@ -115,12 +142,88 @@ void close_all_connections(void)
 
 void init_netio(void)
 {
-#ifndef USE_POLL
+#if defined(USE_EPOLL)
+  if ((epollFd = epoll_create(MAXCONNECTIONS)) == -1)
+    {
+      ilog(L_CRIT, "epoll_create failed: %s", strerror(errno));
+      exit(-1);
+    }
+#elif !defined(USE_POLL)
   read_set  = &readSet;
   write_set = &writeSet;
 #endif
   init_resolver();
 }
+
+#ifdef USE_EPOLL
+/*
+ * netio_add - register a descriptor with the event engine
+ *
+ * Listeners and auth queries are level triggered, they are always
+ * serviced as soon as they are reported. Client connections are edge
+ * triggered for both reading and writing, their readiness is kept on
+ * the fdlist ready lists until it has been consumed, so their
+ * registration never has to change.
+ */
+void netio_add(int fd, int type, void* data, int flags)
+{
+  struct epoll_event ev;
+
+  assert(-1 < fd && fd < MAXCONNECTIONS);
+
+  memset(&ev, 0, sizeof(ev));
+  ev.data.fd = fd;
+  if (NETIO_CLIENT == type)
+    ev.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+  else
+    {
+      if (flags & NETIO_READ)
+        ev.events |= EPOLLIN;
+      if (flags & NETIO_WRITE)
+        ev.events |= EPOLLOUT;
+    }
+
+  netioFds[fd].type = type;
+  netioFds[fd].data = data;
+  fdlist_clear_ready(fd, FDR_READ | FDR_WRITE | FDR_PARSE | FDR_HUP);
+
+  if (epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &ev) == -1 &&
+      (errno != EEXIST || epoll_ctl(epollFd, EPOLL_CTL_MOD, fd, &ev) == -1))
+    report_error("epoll_ctl add %s:%s", me.name, errno);
+}
+
+/*
+ * netio_set_flags - change the interest of a level triggered descriptor
+ */
+void netio_set_flags(int fd, int flags)
+{
+  struct epoll_event ev;
+
+  assert(-1 < fd && fd < MAXCONNECTIONS);
+  assert(NETIO_CLIENT != netioFds[fd].type);
+
+  memset(&ev, 0, sizeof(ev));
+  ev.data.fd = fd;
+  if (flags & NETIO_READ)
+    ev.events |= EPOLLIN;
+  if (flags & NETIO_WRITE)
+    ev.events |= EPOLLOUT;
+
+  if (epoll_ctl(epollFd, EPOLL_CTL_MOD, fd, &ev) == -1)
+    report_error("epoll_ctl mod %s:%s", me.name, errno);
+}
+
+/*
+ * netio_del - forget a descriptor that is about to be closed,
+ * close() itself drops the kernel registration
+ */
+void netio_del(int fd)
+{
+  assert(-1 < fd && fd < MAXCONNECTIONS);
+  netioFds[fd].type = 0;
+  netioFds[fd].data = NULL;
+}
+#endif /* USE_EPOLL */
  
 /*
  * get_sockerr - get the error value from the socket or the current errno
@@ -257,29 +360,11 @@ int set_non_blocking(int fd)
 }
 
 /*
- * deliver_it
- *      Attempt to send a sequence of bytes to the connection.
- *      Returns
- *
- *      < 0     Some fatal error occurred, (but not EWOULDBLOCK).
- *              This return is a request to close the socket and
- *              clean up the link.
- *      
- *      >= 0    No real error occurred, returns the number of
- *              bytes actually transferred. EWOULDBLOCK and other
- *              possibly similar conditions should be mapped to
- *              zero return. Upper level routine will have to
- *              decide what to do with those unwritten bytes...
- *
- *      *NOTE*  alarm calls have been preserved, so this should
- *              work equally well whether blocking or non-blocking
- *              mode is used...
+ * deliver_result - common tail of deliver_it and deliver_it_iov,
+ * maps EWOULDBLOCK to 0 and counts what was sent
  */
-int deliver_it(aClient* cptr, const char* str, int len)
+static int deliver_result(aClient* cptr, int retval)
 {
-  int   retval;
-
-  retval = send(cptr->fd, str, len, 0);
   /*
   ** Convert WOULDBLOCK to a return of "0 bytes moved". This
   ** should occur only if socket was non-blocking. Note, that
@@ -317,6 +402,40 @@ int deliver_it(aClient* cptr, const char* str, int len)
   return(retval);
 }
 
+/*
+ * deliver_it
+ *      Attempt to send a sequence of bytes to the connection.
+ *      Returns
+ *
+ *      < 0     Some fatal error occurred, (but not EWOULDBLOCK).
+ *              This return is a request to close the socket and
+ *              clean up the link.
+ *      
+ *      >= 0    No real error occurred, returns the number of
+ *              bytes actually transferred. EWOULDBLOCK and other
+ *              possibly similar conditions should be mapped to
+ *              zero return. Upper level routine will have to
+ *              decide what to do with those unwritten bytes...
+ *
+ *      *NOTE*  alarm calls have been preserved, so this should
+ *              work equally well whether blocking or non-blocking
+ *              mode is used...
+ */
+int deliver_it(aClient* cptr, const char* str, int len)
+{
+  return deliver_result(cptr, send(cptr->fd, str, len, 0));
+}
+
+/*
+ * deliver_it_iov
+ *      Same as deliver_it, but writes 'count' sections with a single
+ *      writev(), as mapped by dbuf_map_iov.
+ */
+int deliver_it_iov(aClient* cptr, const struct iovec* iov, int count)
+{
+  return deliver_result(cptr, writev(cptr->fd, iov, count));
+}
+
 
 /*
  * completed_connection - Complete non-blocking connect-sequence. 
@@ -622,8 +741,10 @@ int connect_server(struct ConfItem* aconf,
   SetConnecting(cptr);
 
   add_client_to_list(cptr);
+  add_to_ip_block_table(cptr);
+  netio_add(cptr->fd, NETIO_CLIENT, NULL, NETIO_READ | NETIO_WRITE);
   fdlist_add(cptr->fd, FDL_DEFAULT);
-  nextping = CurrentTime;
+  set_client_timer(cptr);
 
   return 1;
 }
@@ -672,8 +793,8 @@ void close_connection(struct Client *cptr)
           aconf->hold = time(NULL);
           aconf->hold += (aconf->hold - cptr->since > HANGONGOODLINK) ?
             HANGONRETRYDELAY : ConfConFreq(aconf);
-          if (nextconnect > aconf->hold)
-            nextconnect = aconf->hold;
+          if (TimerPending(&connect_timer) && connect_timer.when > aconf->hold)
+            timer_add(&connect_timer, aconf->hold);
         }
 
     }
@@ -700,9 +821,18 @@ void close_connection(struct Client *cptr)
     ServerStats->is_ni++;
   
   if (-1 < cptr->fd) {
+#ifdef ZIP_THREADS
+    /* get the last of its output back from the zip workers */
+    if (cptr->zip)
+      zip_drain(cptr);
+#endif
     flush_connections(cptr);
+    timer_del(&cptr->timer);
+    del_from_ip_block_table(cptr);
+    del_from_domain_table(cptr);
     local[cptr->fd] = NULL;
     fdlist_delete(cptr->fd, FDL_ALL);
+    netio_del(cptr->fd);
     close(cptr->fd);
     cptr->fd = -1;
   }
@@ -790,6 +920,7 @@ void add_connection(struct Listener* listener, int fd)
   if (!disable_sock_options(new_client->fd))
     report_error(OPT_ERROR_MSG, get_client_name(new_client, TRUE), errno);
 #endif    
+  netio_add(new_client->fd, NETIO_CLIENT, NULL, NETIO_READ | NETIO_WRITE);
   start_auth(new_client);
 }
 
@@ -855,6 +986,15 @@ static int read_packet(struct Client *cptr)
   if (!(IsPerson(cptr) && DBufLength(&cptr->recvQ) > SBSD_MAX_CLIENT)) {
     errno = 0;
     length = recv(cptr->fd, readBuf, READBUF_SIZE, 0);
+#ifdef USE_EPOLL
+    /*
+     * a short read emptied the socket, the next edge tells us
+     * when there is more to read. A FIN that came in with the
+     * data has no edge of its own, keep reading until the EOF.
+     */
+    if (length < READBUF_SIZE && !(GlobalFDReady[cptr->fd] & FDR_HUP))
+      fdlist_clear_ready(cptr->fd, FDR_READ);
+#endif
     /*
      * If not ready, fake it so it isnt closed
      */
@@ -883,7 +1023,13 @@ static int read_packet(struct Client *cptr)
   cptr->lasttime = CurrentTime;
   if (cptr->lasttime > cptr->since)
     cptr->since = cptr->lasttime;
-  cptr->flags &= ~(FLAGS_PINGSENT | FLAGS_NONL);
+  cptr->flags &= ~FLAGS_NONL;
+  if (cptr->flags & FLAGS_PINGSENT)
+    {
+      /* it answered, move its timer back out to the next PING */
+      cptr->flags &= ~FLAGS_PINGSENT;
+      set_client_timer(cptr);
+    }
 
   /*
    * For server connections, we process as many as we can without
@@ -972,7 +1118,212 @@ static void error_exit_client(struct Client* cptr, int error)
  * processed. Also check for connections with data queued and whether we can
  * write it out.
  */
-#ifndef USE_POLL
+#if defined(USE_EPOLL)
+int read_message(time_t delay, unsigned char mask)
+{
+  static struct epoll_event events[EPOLL_MAXEVENTS];
+  static int                ready[MAXCONNECTIONS];
+  struct Client*            cptr;
+  struct AuthRequest*       auth;
+  int                       nfds;
+  int                       nready;
+  int                       res = 0;
+  int                       length;
+  int                       fd;
+  int                       i;
+  unsigned char             flags;
+  size_t                    queued;
+  static int                stalled = 0;
+  int                       progress = 0;
+#ifdef ZIP_THREADS
+  int                       collect = 0;
+#endif
+#ifdef LATENCY_STATS
+  unsigned long             start;
+  unsigned long             waited;
+#endif
+
+  for ( ; ; ) {
+    /*
+     * don't sleep while an earlier call left work queued, unless the
+     * last full pass got nowhere (clients held back by flood control
+     * stay queued until CurrentTime catches up with them), or while a
+     * connect burst or a LIST has room to go on
+     */
+#ifdef LATENCY_STATS
+    start = latency_usec();
+#endif
+    nfds = epoll_wait(epollFd, events, EPOLL_MAXEVENTS,
+                      ((!stalled && fdlist_has_ready(FDL_ALL)) ||
+                       burst_waiting() || list_waiting()) ? 0 : 250);
+#ifdef LATENCY_STATS
+    waited = latency_usec() - start;
+    latency_wait(waited);
+    start += waited;
+#endif
+    if ((CurrentTime = time(0)) == -1)
+      {
+        ilog(L_CRIT, "Clock Failure");
+        restart("Clock failed");
+      }
+    if (nfds == -1 && ((errno == EINTR) || (errno == EAGAIN)))
+      return -1;
+    else if (nfds >= 0)
+      break;
+    report_error("epoll %s:%s", me.name, errno);
+    res++;
+    if (res > 5)
+      restart("too many epoll errors");
+    sleep(10);
+  }
+  /*
+   * something new came in, a stall from the last pass is over
+   */
+  if (nfds > 0)
+    stalled = 0;
+
+  /*
+   * auth queries and listeners are handled right away, client
+   * readiness is queued on the ready list of the client's class
+   */
+  for (i = 0; i < nfds; i++) {
+    fd = events[i].data.fd;
+
+    switch (netioFds[fd].type) {
+    case NETIO_LISTENER:
+      accept_connection((struct Listener*) netioFds[fd].data);
+      break;
+    case NETIO_AUTH:
+      auth = (struct AuthRequest*) netioFds[fd].data;
+      if (IsAuthConnect(auth))
+        send_auth_query(auth);
+      else
+        read_auth_reply(auth);
+      break;
+#ifdef ZIP_THREADS
+    case NETIO_ZIP:
+      collect = 1;
+      break;
+#endif
+    case NETIO_CLIENT:
+      flags = 0;
+      if (events[i].events & (EPOLLIN | EPOLLERR | EPOLLHUP))
+        flags |= FDR_READ;
+      if (events[i].events & (EPOLLRDHUP | EPOLLERR | EPOLLHUP))
+        flags |= FDR_READ | FDR_HUP;
+      if (events[i].events & (EPOLLOUT | EPOLLERR | EPOLLHUP))
+        flags |= FDR_WRITE;
+      fdlist_set_ready(fd, flags);
+      break;
+    default:
+      break;
+    }
+  }
+
+#ifdef ZIP_THREADS
+  /*
+   * zipped link data the workers have finished with
+   */
+  if (collect)
+    zip_collect();
+#endif
+
+#ifdef LATENCY_STATS
+  latency_phase_add(LAT_EVENTS, latency_usec() - start);
+  start = latency_usec();
+#endif
+
+  /*
+   * take a copy of the ready lists, servicing one client can close
+   * others (kills, ghosts), so everything is rechecked below
+   */
+  nready = fdlist_get_ready(ready, MAXCONNECTIONS, mask);
+
+  for (i = 0; i < nready; i++) {
+    fd = ready[i];
+    if (!(cptr = local[fd]) || !(flags = GlobalFDReady[fd]))
+      continue;
+
+    /*
+     * anything that IsMe should NEVER be in the local client array
+     */
+    assert(!IsMe(cptr));
+
+    if (flags & FDR_WRITE) {
+      fdlist_clear_ready(fd, FDR_WRITE);
+      cptr->flags &= ~FLAGS_BLOCKED;
+      progress = 1;
+
+      if (IsConnecting(cptr)) {
+        if (!completed_connection(cptr)) {
+          exit_client(cptr, cptr, &me, "Lost C/N Line");
+          continue;
+        }
+        send_queued(cptr);
+        if (!IsDead(cptr))
+          continue;
+        exit_client(cptr, cptr, &me, 
+                   (cptr->flags & FLAGS_SENDQEX) ? 
+                   "SendQ Exceeded" : strerror(get_sockerr(cptr->fd)));
+        continue;
+      }
+      if (DBufLength(&cptr->sendQ)
+#ifdef ZIP_LINKS
+          || ((cptr->flags2 & FLAGS2_ZIP) && (cptr->zip->outcount > 0))
+#endif
+          ) {
+        /*
+         * ...room for writing, empty some queue then...
+         */
+        send_queued(cptr);
+        if (!IsDead(cptr))
+          continue;
+        exit_client(cptr, cptr, &me, 
+                   (cptr->flags & FLAGS_SENDQEX) ? 
+                   "SendQ Exceeded" : strerror(get_sockerr(cptr->fd)));
+        continue;
+      }
+    }
+    length = 1;     /* for fall through case */
+    queued = DBufLength(&cptr->recvQ);
+
+    if ((flags & FDR_READ) && DBufLength(&cptr->recvQ) < 4088)
+      length = read_packet(cptr);
+    else if (PARSE_AS_CLIENT(cptr) && !NoNewLine(cptr))
+      length = parse_client_queued(cptr);
+
+    if (length == CLIENT_EXITED)
+      continue;
+    if (length > 0) {
+      /*
+       * keep it queued while it still has lines to parse
+       */
+      if (PARSE_AS_CLIENT(cptr) && DBufLength(&cptr->recvQ) &&
+          !NoNewLine(cptr))
+        fdlist_set_ready(fd, FDR_PARSE);
+      else
+        fdlist_clear_ready(fd, FDR_PARSE);
+      if (GlobalFDReady[fd] != flags || DBufLength(&cptr->recvQ) != queued)
+        progress = 1;
+      continue;
+    }
+    if (IsDead(cptr)) {
+       exit_client(cptr, cptr, &me,
+                    strerror(get_sockerr(cptr->fd)));
+       continue;
+    }
+    error_exit_client(cptr, length);
+    errno = 0;
+  }
+  if (FDL_ALL == mask)
+    stalled = (nfds == 0 && !progress);
+#ifdef LATENCY_STATS
+  latency_phase_add(LAT_CLIENTS, latency_usec() - start);
+#endif
+  return 0;
+}
+
+#elif !defined(USE_POLL)
 int read_message(time_t delay, unsigned char mask)        /* mika */
 
      /* Don't ever use ZERO here, unless you mean to poll
@@ -992,6 +1343,9 @@ int read_message(time_t delay, unsigned char mask)        /* mika */
   struct AuthRequest* auth_next = 0;
   struct Listener*    listener = 0;
   int                 i;
+#ifdef LATENCY_STATS
+  unsigned long       start;
+#endif
 
   now = CurrentTime;
 
@@ -1048,7 +1402,13 @@ int read_message(time_t delay, unsigned char mask)        /* mika */
       wait.tv_sec = 0;
       wait.tv_usec = 250000;
 
+#ifdef LATENCY_STATS
+      start = latency_usec();
+#endif
       nfds = select(MAXCONNECTIONS, read_set, write_set, 0, &wait);
+#ifdef LATENCY_STATS
+      latency_wait(latency_usec() - start);
+#endif
 
       if ((CurrentTime = time(NULL)) == -1)
         {
@@ -1233,6 +1593,9 @@ int read_message(time_t delay, unsigned char mask)
   int                  rr;
   int                  rw;
   int                  i;
+#ifdef LATENCY_STATS
+  unsigned long        start;
+#endif
 
   for ( ; ; ) {
     nbr_pfds = 0;
@@ -1303,7 +1666,13 @@ int read_message(time_t delay, unsigned char mask)
 
     wait.tv_sec = IRCD_MIN(delay2, delay);
     wait.tv_usec = usec;
+#ifdef LATENCY_STATS
+    start = latency_usec();
+#endif
     nfds = poll(poll_fdarray, nbr_pfds, 250);
+#ifdef LATENCY_STATS
+    latency_wait(latency_usec() - start);
+#endif
     if ((CurrentTime = time(0)) == -1)
       {
         ilog(L_CRIT, "Clock Failure");
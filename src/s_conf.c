@@ -23,6 +23,8 @@
  */
 #include "m_commands.h"
 #include "s_conf.h"
+#include "ban_db.h"
+#include "ban_journal.h"
 #include "channel.h"
 #include "class.h"
 #include "client.h"
@@ -31,8 +33,10 @@
 #include "hash.h"
 #include "irc_string.h"
 #include "ircd.h"
+#include "ircd_signal.h"
 #include "list.h"
 #include "listener.h"
+#include "m_list.h"
 #include "mtrie_conf.h"
 #include "numeric.h"
 #include "res.h"    /* gethost_byname, gethost_byaddr */
@@ -41,6 +45,8 @@
 #include "send.h"
 #include "struct.h"
 #include "s_debug.h"
+#include "s_timer.h"
+#include "tline_conf.h"
 
 #include <stdio.h>
 #include <string.h>
@@ -52,6 +58,11 @@
 #include <netdb.h>
 #include <fcntl.h>
 #include <assert.h>
+#include <stdarg.h>
+
+#ifdef REHASH_THREAD
+#include <pthread.h>
+#endif
 
 
 extern ConfigFileEntryType ConfigFileEntry; /* defined in ircd.c */
@@ -69,6 +80,9 @@ static void lookup_confhost(struct ConfItem* aconf);
 static void do_include_conf(void);
 static int  SplitUserHost( struct ConfItem * );
 static char *getfield(char *newline);
+static char *split_field(char **line);
+static void unquote_conf_line(char *line);
+static void add_conf_index(struct ConfItem *, int);
 
 static FBFILE*  openconf(const char* filename);
 static void     initconf(FBFILE*, int);
@@ -84,10 +98,8 @@ static void add_q_line(struct ConfItem *);
 static void clear_q_lines(void);
 static void clear_special_conf(struct ConfItem **);
 static struct ConfItem* find_tkline(const char*, const char*, unsigned long);
-static void expire_temp_klines(struct ConfItem **tklines);
 
-struct ConfItem *temporary_klines = NULL;
-struct ConfItem *temporary_ip_klines = NULL;
+struct TempLineList temporary_klines;
 
 static  char *set_conf_flags(struct ConfItem *,char *);
 static  int  oper_privs_from_string(int,char *);
@@ -127,6 +139,98 @@ static IP_ENTRY *find_or_add_ip(aClient *,const char *);
 static int count_users_on_this_ip(IP_ENTRY *,aClient *,const char *);
 #endif
 
+/* the indexes add_conf_index() can put a conf line in */
+#define INDEX_MTRIE_I   0       /* I line in the mtrie */
+#define INDEX_IP_I      1       /* IP I line */
+#define INDEX_IP_K      2       /* IP K line */
+#define INDEX_MTRIE_K   3       /* K line in the mtrie */
+#define INDEX_DLINE_E   4       /* d line, D line exception */
+#define INDEX_DLINE     5       /* D line */
+
+#ifdef BAN_DB
+struct ConfGen;
+static void read_ban_image(struct ConfGen* gen, const char* filename,
+                           FBFILE* file);
+#ifndef REHASH_THREAD
+static struct BanDb* ban_images = NULL; /* mapped for the bans in use */
+#endif
+#endif
+
+#ifdef REHASH_THREAD
+/*
+ * A rehash builds a new mtrie and new D line tables on a helper
+ * thread while the old ones stay in use, from the ban lines of
+ * ircd.conf (seeds, parsed here as before) and from kline.conf and
+ * dline.conf (parsed on the thread). conf_collect() swaps them in
+ * when they are done, and hands the old ones to another thread to be
+ * freed. Each generation keeps a sorted key for each of its bans, so
+ * the two can be compared and only the bans that are new have to be
+ * looked for among the clients.
+ */
+struct ConfNotice {
+  struct ConfNotice* next;
+  int                level;     /* ilog() level, -1 for the opers */
+  char               text[1];
+};
+
+struct ConfSeed {
+  struct ConfSeed*   next;
+  struct ConfItem*   aconf;
+  int                how;       /* INDEX_ */
+};
+
+#define KEY_BLOCK_SIZE  65536
+
+#define GEN_FILES       4       /* kline.conf, dline.conf, journals */
+
+struct KeyBlock {
+  struct KeyBlock*   next;
+  int                used;
+  char               text[KEY_BLOCK_SIZE];
+};
+
+struct ConfGen {
+  struct MtrieConf*  mtrie;
+  struct DlineConf*  dlines;
+  struct ConfSeed*   seeds;     /* from ircd.conf, in order */
+  struct ConfSeed**  seeds_tail;
+  struct ConfSeed*   replay;    /* KLINE/DLINE while it was loading */
+  struct ConfSeed**  replay_tail;
+  FBFILE*            files[GEN_FILES];  /* of bans, to read */
+  const char*        names[GEN_FILES];
+  int                nfiles;
+#ifdef BAN_DB
+  struct BanDb*      images;    /* the bans point into */
+#endif
+  int                dline;     /* REHASH DLINES */
+  aClass*            class0;
+  char**             keys;      /* sorted up to nsorted */
+  int                nkeys;
+  int                nsorted;
+  int                keys_size;
+  struct KeyBlock*   blocks;
+  char*              bans[NEW_BAN_MAX];
+  int                nbans;
+  int                sweep;     /* too much changed, look at everybody */
+  struct ConfNotice* notices;
+  struct ConfNotice** notices_tail;
+  struct ConfItem*   ilines;    /* old I lines, once freed */
+};
+
+static struct ConfGen* live_gen = NULL;     /* in use */
+static struct ConfGen* conf_loading = NULL; /* being built */
+static struct ConfGen* conf_freeing = NULL; /* being freed */
+
+static pthread_mutex_t conf_lock = PTHREAD_MUTEX_INITIALIZER;
+static int             conf_done = NO;      /* the thread is through */
+static pthread_t       main_thread;
+
+static int rehash_again = NO;
+static int rehash_again_dlines = NO;
+
+static void conf_start(int cold);
+#endif /* REHASH_THREAD */
+
 /* general conf items link list root */
 struct ConfItem* ConfigItemList = NULL;
 
@@ -225,6 +329,15 @@ free_conf(struct ConfItem* aconf)
 
   if (aconf->dns_pending)
     delete_adns_queries(aconf->dns_query);
+#ifdef BAN_DB
+  /* the image is unmapped once all of its lines are gone */
+  if (aconf->in_image)
+    {
+      MyFree(aconf->name);
+      MyFree((char*) aconf);
+      return;
+    }
+#endif
   MyFree(aconf->host);
   if (aconf->passwd)
     memset(aconf->passwd, 0, strlen(aconf->passwd));
@@ -978,7 +1091,12 @@ int detach_conf(struct Client* cptr,struct ConfItem* aconf)
                   if (ConfLinks(aconf) > 0)
                     --ConfLinks(aconf);
                 }
-              if (ConfMaxLinks(aconf) == -1 && ConfLinks(aconf) == 0)
+              if (ConfMaxLinks(aconf) == -1 && ConfLinks(aconf) == 0
+#ifdef REHASH_THREAD
+                  /* old I lines still in use could point at it */
+                  && !conf_loading && !conf_freeing
+#endif
+                  )
                 {
                   free_class(ClassPtr(aconf));
                   ClassPtr(aconf) = NULL;
@@ -1799,13 +1917,28 @@ int rehash_dump(aClient *sptr)
  */
 int rehash(aClient *cptr,aClient *sptr, int sig)
 {
+#ifdef REHASH_THREAD
+  if (conf_loading || conf_freeing)
+    {
+      /* do it again when the one in progress is through */
+      rehash_again = YES;
+      if (dline_in_progress)
+        rehash_again_dlines = YES;
+      dline_in_progress = 0;
+      sendto_realops("Rehash already in progress, will rehash again after it");
+      return 0;
+    }
+#endif
   if (sig)
     sendto_realops("Got signal SIGHUP, reloading ircd conf. file");
 
   read_conf_files(NO);
   close_listeners();
   flush_deleted_I_P();
+  /* with REHASH_THREAD, conf_collect() sees to the clients */
+#ifndef REHASH_THREAD
   rehashed = 1;
+#endif
   return 0;
 }
 
@@ -1878,20 +2011,14 @@ static char *set_conf_flags(struct ConfItem *aconf,char *tmp)
 }
 
 /*
-** initconf() 
-**    Read configuration file.
-**
-*
-* Inputs        - file descriptor pointing to config file to use
-*               - int (included file = 1, original (ircd.conf) = 0)
-*
-**    returns -1, if file cannot be opened
-**             0, if file opened
-*/
-
-#define MAXCONFLINKS 150
+ * unquote_conf_line
+ *
+ * inputs       - a line of a conf file
+ * output       - none
+ * side effects - \ quoting is done and the line is cut at any #
+ */
 
-static void initconf(FBFILE* file, int use_include)
+static void unquote_conf_line(char *line)
 {
   static char  quotes[] = {
     0,    /*  */
@@ -1924,8 +2051,42 @@ static void initconf(FBFILE* file, int use_include)
     0,0,0,0,0,0 
     };
 
+  char *tmp;
+  char *s;
+
+  for (tmp = line; *tmp; tmp++)
+    {
+      if (*tmp == '\\')
+        {
+          if ( *(tmp+1) == '\\' )
+            *tmp = '\\';
+          else
+            *tmp = quotes[ (unsigned int) (*(tmp+1) & 0x1F) ];
+          for (s = tmp; (*s = *(s+1)); s++)
+            ;
+        }
+      else if (*tmp == '#')
+        *tmp = '\0';
+    }
+}
+
+/*
+** initconf() 
+**    Read configuration file.
+**
+*
+* Inputs        - file descriptor pointing to config file to use
+*               - int (included file = 1, original (ircd.conf) = 0)
+*
+**    returns -1, if file cannot be opened
+**             0, if file opened
+*/
+
+#define MAXCONFLINKS 150
+
+static void initconf(FBFILE* file, int use_include)
+{
   char*            tmp;
-  char*            s;
   int              dontadd;
   char             line[BUFSIZE];
   int              ccount = 0;
@@ -1944,23 +2105,7 @@ static void initconf(FBFILE* file, int use_include)
       if ((tmp = strchr(line, '\n')))
         *tmp = '\0';
 
-      /*
-       * Do quoting of characters and # detection.
-       */
-      for (tmp = line; *tmp; tmp++)
-        {
-          if (*tmp == '\\')
-	    {
-	      if ( *(tmp+1) == '\\' )
-                *tmp = '\\';
-	      else
-                *tmp = quotes[ (unsigned int) (*(tmp+1) & 0x1F) ];
-	      for (s = tmp; (*s = *(s+1)); s++)
-		;
-            }
-          else if (*tmp == '#')
-            *tmp = '\0';
-        }
+      unquote_conf_line(line);
       if (!*line || line[0] == '#' || line[0] == '\n' ||
           line[0] == ' ' || line[0] == '\t')
         continue;
@@ -2462,7 +2607,7 @@ static void initconf(FBFILE* file, int use_include)
 	     {
                aconf->ip = ip_host & ip_lmask;
                aconf->ip_mask = ip_lmask;
-               add_ip_Iline(aconf);
+               add_conf_index(aconf, INDEX_IP_I);
              }
            else
 	     {
@@ -2484,7 +2629,7 @@ static void initconf(FBFILE* file, int use_include)
 		   aconf->host = aconf->user;
 		   DupString(aconf->user,"*");
 		 }
-	       add_mtrie_conf_entry(aconf,CONF_CLIENT);
+	       add_conf_index(aconf, INDEX_MTRIE_I);
 	     }
         }
       else if (aconf->host && (aconf->status & CONF_KILL))
@@ -2495,13 +2640,13 @@ static void initconf(FBFILE* file, int use_include)
               ip &= ip_mask;
               aconf->ip = ip;
               aconf->ip_mask = ip_mask;
-              add_ip_Kline(aconf);
+              add_conf_index(aconf, INDEX_IP_K);
             }
           else
             {
               (void)collapse(aconf->host);
               (void)collapse(aconf->user);
-              add_mtrie_conf_entry(aconf,CONF_KILL);
+              add_conf_index(aconf, INDEX_MTRIE_K);
             }
         }
       else if (aconf->host && (aconf->status & CONF_DLINE))
@@ -2514,9 +2659,9 @@ static void initconf(FBFILE* file, int use_include)
           aconf->ip_mask = ip_mask;
 
           if(aconf->flags & CONF_FLAGS_E_LINED)
-            add_dline(aconf);
+            add_conf_index(aconf, INDEX_DLINE_E);
           else
-            add_Dline(aconf);
+            add_conf_index(aconf, INDEX_DLINE);
         }
       else if (aconf->status & CONF_XLINE)
         {
@@ -2574,6 +2719,7 @@ static void initconf(FBFILE* file, int use_include)
                   /* JIC */
                   chptr->channelts = CurrentTime;
                   (void)add_to_channel_hash_table(aconf->name, chptr);
+                  list_add_channel(chptr);
                   Count.chan++;
                 }
 
@@ -2609,8 +2755,12 @@ static void initconf(FBFILE* file, int use_include)
   aconf = NULL;
 
   fbclose(file);
+#ifdef REHASH_THREAD
+  /* old I lines are in use until the new ones are swapped in */
+  if (!conf_loading)
+#endif
   check_class();
-  nextping = nextconnect = time(NULL);
+  timer_add(&connect_timer, time(NULL));
 
   if(me.name[0] == '\0')
     {
@@ -2619,6 +2769,55 @@ static void initconf(FBFILE* file, int use_include)
     }
 }
 
+/*
+ * add_conf_index
+ *
+ * inputs       - pointer to an I, K, D or d line
+ *              - which index it goes in, INDEX_
+ * output       - none
+ * side effects - the line is added to the mtrie or the D line tables,
+ *                or kept for the rehash thread to add to new ones
+ */
+
+static void add_conf_index(struct ConfItem *aconf, int how)
+{
+#ifdef REHASH_THREAD
+  struct ConfSeed *seed;
+
+  if (conf_loading)
+    {
+      seed = (struct ConfSeed *)MyMalloc(sizeof(struct ConfSeed));
+      seed->next = NULL;
+      seed->aconf = aconf;
+      seed->how = how;
+      *conf_loading->seeds_tail = seed;
+      conf_loading->seeds_tail = &seed->next;
+      return;
+    }
+#endif
+  switch (how)
+    {
+    case INDEX_MTRIE_I:
+      add_mtrie_conf_entry(aconf,CONF_CLIENT);
+      break;
+    case INDEX_IP_I:
+      add_ip_Iline(aconf);
+      break;
+    case INDEX_IP_K:
+      add_ip_Kline(aconf);
+      break;
+    case INDEX_MTRIE_K:
+      add_mtrie_conf_entry(aconf,CONF_KILL);
+      break;
+    case INDEX_DLINE_E:
+      add_dline(aconf);
+      break;
+    default:
+      add_Dline(aconf);
+      break;
+    }
+}
+
 /*
  * commonly used function to split user@host part into user and host fields
  */
@@ -2744,37 +2943,23 @@ struct ConfItem *find_kill(aClient* cptr)
 /*
  * expire_temp_klines
  *
- * inputs        - pointer to root of tkline list
+ * inputs        - none
  * output        - none
- * side effects  -
- *
+ * side effects  - temporary klines whose time is up are removed,
+ *                 called once a pass from the main loop
  */
-static void
-expire_temp_klines(struct ConfItem **tklines)
+void
+expire_temp_klines(void)
 {
   struct ConfItem *cur_p; 
-  struct ConfItem *next_p;
-  struct ConfItem *last_p;
 
-  for (last_p = NULL, cur_p = *tklines; cur_p; cur_p = next_p)
+  while ((cur_p = tline_expired(&temporary_klines)))
   {   
-    next_p = cur_p->next;
-
-    if(cur_p->hold <= CurrentTime)        /* a kline has expired */
-    {
-      if(last_p != NULL)
-        last_p->next = cur_p->next;
-      else
-        *tklines = cur_p->next;
-
-      /* Alert opers that a TKline expired - Hwy */
-      sendto_realops("Temporary K-line for [%s@%s] expired",
-                     (cur_p->user) ? cur_p->user : "*",
-                     (cur_p->host) ? cur_p->host : "*");
-      free_conf(cur_p);
-    }
-    else
-      last_p = cur_p;
+    /* Alert opers that a TKline expired - Hwy */
+    sendto_realops("Temporary K-line for [%s@%s] expired",
+                   (cur_p->user) ? cur_p->user : "*",
+                   (cur_p->host) ? cur_p->host : "*");
+    free_conf(cur_p);
   }
 }
 
@@ -2793,28 +2978,7 @@ expire_temp_klines(struct ConfItem **tklines)
 static struct ConfItem* 
 find_tkline(const char* host, const char* user, unsigned long ip)
 {
-  struct ConfItem *cur_p; 
-  
-  expire_temp_klines(&temporary_klines);
-  for (cur_p = temporary_klines; cur_p; cur_p = cur_p->next)
-  {   
-    if ((cur_p->user
-	 && (!user || match(cur_p->user, user)))
-	&& (cur_p->host
-	    && (!host || match(cur_p->host,host))))
-      return(cur_p);
-  }
-
-  expire_temp_klines(&temporary_ip_klines);
-  for (cur_p = temporary_ip_klines; cur_p; cur_p = cur_p->next)
-  {
-    if ((cur_p->user
-	 && (!user || match(cur_p->user, user)))
-	&& (cur_p->ip
-	    && ((ip & cur_p->ip_mask) == cur_p->ip)))
-      return(cur_p);
-  }
-  return (NULL);
+  return tline_find(&temporary_klines, host, user, ip);
 }
 
 /*
@@ -2886,16 +3050,7 @@ is_klined(const char *host,const char *name, unsigned long ip)
 void
 add_temp_kline(struct ConfItem *aconf)
 {
-  if (aconf->ip == 0)
-    {
-      aconf->next = temporary_klines;
-      temporary_klines = aconf;
-    }
-  else
-    {
-      aconf->next = temporary_ip_klines;
-      temporary_ip_klines = aconf;
-    }
+  tline_add(&temporary_klines, aconf, aconf->user);
 }
 
 /* flush_temp_klines
@@ -2908,27 +3063,7 @@ add_temp_kline(struct ConfItem *aconf)
 void
 flush_temp_klines()
 {
-  struct ConfItem *kill_list_ptr;
-
-  if( (kill_list_ptr = temporary_klines) )
-    {
-      while(kill_list_ptr)
-        {
-          temporary_klines = kill_list_ptr->next;
-          free_conf(kill_list_ptr);
-          kill_list_ptr = temporary_klines;
-        }
-    }
-
-  if( (kill_list_ptr = temporary_ip_klines) )
-    {
-      while(kill_list_ptr)
-        {
-          temporary_ip_klines = kill_list_ptr->next;
-          free_conf(kill_list_ptr);
-          kill_list_ptr = temporary_ip_klines;
-        }
-    }
+  tline_flush(&temporary_klines);
 }
 
 /* report_temp_klines
@@ -2940,33 +3075,30 @@ flush_temp_klines()
  */
 void report_temp_klines(aClient *sptr)
 {
-
-  expire_temp_klines(&temporary_klines);
-  if(temporary_klines)
-      show_temp_klines(sptr, temporary_klines);
-  expire_temp_klines(&temporary_ip_klines);
-  if(temporary_ip_klines)
-      show_temp_klines(sptr, temporary_ip_klines);
-
+  show_temp_klines(sptr, &temporary_klines);
 }
 
 /* show_temp_klines
  *
  * inputs	- aClient pointer, client to report to
- *		- ConfItem pointer, the tkline list to show
+ *		- TempLineList pointer, the tkline list to show
  * outputs	- NONE
  * side effects	- NONE
  */
 void
-show_temp_klines(struct Client *sptr, struct ConfItem * tklist)
+show_temp_klines(struct Client *sptr, struct TempLineList *tklist)
 {
   struct ConfItem *cur_p;
   char *host;
   char *user;
   char *reason;
+  int i;
 
-  for(cur_p = tklist; cur_p; cur_p = cur_p->next)
+  for(i = 0; (cur_p = tline_conf(tklist, i)); i++)
   {
+    if(cur_p->hold <= CurrentTime)
+      continue;
+
     if(cur_p->host != NULL)
       host = cur_p->host;
     else
@@ -3633,6 +3765,806 @@ void get_printable_conf(struct ConfItem *aconf, char **name, char **host,
   *port = (int)aconf->port;
 }
 
+#ifdef REHASH_THREAD
+/*
+ * conf_vnotice - keep a notice until gen is swapped in, level is an
+ * ilog() level or -1 for the opers
+ */
+static void conf_vnotice(struct ConfGen* gen, int level,
+                         const char* pattern, va_list args)
+{
+  char               buf[BUFSIZE];
+  struct ConfNotice* note;
+
+  vsnprintf(buf, sizeof(buf), pattern, args);
+  note = (struct ConfNotice*) MyMalloc(sizeof(struct ConfNotice) +
+                                       strlen(buf));
+  note->next = NULL;
+  note->level = level;
+  strcpy(note->text, buf);
+  *gen->notices_tail = note;
+  gen->notices_tail = &note->next;
+}
+
+static void conf_notice(struct ConfGen* gen, int level,
+                        const char* pattern, ...)
+{
+  va_list args;
+
+  va_start(args, pattern);
+  conf_vnotice(gen, level, pattern, args);
+  va_end(args);
+}
+#endif /* REHASH_THREAD */
+
+/*
+ * conf_report
+ *
+ * inputs       - printf style pattern and arguments
+ * output       - none
+ * side effects - the opers are told, or if it comes from the rehash
+ *                thread, told once the new conf is in use
+ */
+void conf_report(const char* pattern, ...)
+{
+  char    buf[BUFSIZE];
+  va_list args;
+
+  va_start(args, pattern);
+#ifdef REHASH_THREAD
+  if (conf_loading && !pthread_equal(pthread_self(), main_thread))
+    {
+      conf_vnotice(conf_loading, -1, pattern, args);
+      va_end(args);
+      return;
+    }
+#endif
+  vsnprintf(buf, sizeof(buf), pattern, args);
+  va_end(args);
+  sendto_realops("%s", buf);
+}
+
+#ifdef REHASH_THREAD
+/*
+ * new_conf_gen - an empty generation
+ */
+static struct ConfGen* new_conf_gen(void)
+{
+  struct ConfGen* gen;
+
+  gen = (struct ConfGen*) MyMalloc(sizeof(struct ConfGen));
+  memset(gen, 0, sizeof(struct ConfGen));
+  gen->seeds_tail = &gen->seeds;
+  gen->replay_tail = &gen->replay;
+  gen->notices_tail = &gen->notices;
+  return gen;
+}
+
+/*
+ * gen_key - add kind followed by user@host, or by host if user is
+ * NULL, to the keys of gen
+ */
+static void gen_key(struct ConfGen* gen, char kind, const char* user,
+                    const char* host)
+{
+  char             key[BUFSIZE];
+  struct KeyBlock* block = gen->blocks;
+  char*            p;
+  int              len;
+  int              i;
+
+  if (!host)
+    host = "";
+  if (user)
+    snprintf(key, sizeof(key), "%c%s@%s", kind, user, host);
+  else
+    snprintf(key, sizeof(key), "%c%s", kind, host);
+  len = strlen(key) + 1;
+
+  if (!block || block->used + len > KEY_BLOCK_SIZE)
+    {
+      block = (struct KeyBlock*) MyMalloc(sizeof(struct KeyBlock));
+      block->next = gen->blocks;
+      block->used = 0;
+      gen->blocks = block;
+    }
+  p = block->text + block->used;
+  block->used += len;
+  p[0] = kind;
+  for (i = 1; i < len; i++)
+    p[i] = ToLower(key[i]);
+
+  if (gen->nkeys == gen->keys_size)
+    {
+      gen->keys_size = gen->keys_size ? gen->keys_size * 2 : 1024;
+      gen->keys = (char**) MyRealloc(gen->keys,
+                                     gen->keys_size * sizeof(char*));
+    }
+  gen->keys[gen->nkeys++] = p;
+}
+
+/*
+ * conf_key - the key of a ban line, or of an E lined I line, which
+ * K lines don't touch
+ */
+static void conf_key(struct ConfGen* gen, struct ConfItem* aconf, int how)
+{
+  switch (how)
+    {
+    case INDEX_MTRIE_I:
+    case INDEX_IP_I:
+      if (aconf->flags & CONF_FLAGS_E_LINED)
+        gen_key(gen, 'E', aconf->user, aconf->host);
+      break;
+    case INDEX_IP_K:
+    case INDEX_MTRIE_K:
+      gen_key(gen, 'K', aconf->user, aconf->host);
+      break;
+    case INDEX_DLINE_E:
+      gen_key(gen, 'd', NULL, aconf->host);
+      break;
+    default:
+      gen_key(gen, 'D', NULL, aconf->host);
+      break;
+    }
+}
+
+/*
+ * gen_add - add_conf_index() for the mtrie and D line tables of gen;
+ * the key is taken first, as the line can be freed as a duplicate
+ */
+static void gen_add(struct ConfGen* gen, struct ConfItem* aconf, int how)
+{
+  conf_key(gen, aconf, how);
+  switch (how)
+    {
+    case INDEX_MTRIE_I:
+      add_mtrie_conf_entry_to(gen->mtrie, aconf, CONF_CLIENT);
+      break;
+    case INDEX_IP_I:
+      add_ip_Iline_to(gen->mtrie, aconf);
+      break;
+    case INDEX_IP_K:
+      add_ip_Kline_to(gen->dlines, aconf);
+      break;
+    case INDEX_MTRIE_K:
+      add_mtrie_conf_entry_to(gen->mtrie, aconf, CONF_KILL);
+      break;
+    case INDEX_DLINE_E:
+      add_dline_to(gen->dlines, aconf);
+      break;
+    default:
+      add_Dline_to(gen->dlines, aconf);
+      break;
+    }
+}
+
+/*
+ * conf_read_bans
+ *
+ * inputs       - generation being built
+ *              - kline.conf or dline.conf
+ *              - its name
+ * output       - none
+ * side effects - the K, D and d lines in file are added to gen, the
+ *                way initconf() would; there is nothing else in
+ *                these files, anything else is reported and skipped
+ */
+static void conf_read_bans(struct ConfGen* gen, FBFILE* file,
+                           const char* filename)
+{
+  char             line[BUFSIZE];
+  char*            rest;
+  char*            tmp;
+  char*            p;
+  struct ConfItem* aconf;
+  unsigned long    ip;
+  unsigned long    ip_mask;
+
+#ifdef BAN_DB
+  read_ban_image(gen, filename, file);
+#endif
+  while (fbgets(line, sizeof(line), file))
+    {
+      if ((tmp = strchr(line, '\n')))
+        *tmp = '\0';
+
+      unquote_conf_line(line);
+      if (!*line || line[0] == ' ' || line[0] == '\t')
+        continue;
+
+      if (line[1] != ':')
+        {
+          conf_notice(gen, L_ERROR, "Bad config line: %s", line);
+          continue;
+        }
+
+      aconf = make_conf();
+      switch (line[0])
+        {
+        case 'K':
+        case 'k':
+          aconf->status = CONF_KILL;
+          break;
+        case 'd':
+          aconf->status = CONF_DLINE;
+          aconf->flags = CONF_FLAGS_E_LINED;
+          break;
+        case 'D':
+          aconf->status = CONF_DLINE;
+          break;
+        default:
+          conf_notice(gen, L_ERROR, "Error in config file: %s", line);
+          break;
+        }
+      rest = line + 2;
+
+      for (;;) /* host, passwd, user, port, class */
+        {
+          if (IsIllegal(aconf) || (tmp = split_field(&rest)) == NULL)
+            break;
+          DupString(aconf->host, tmp);
+
+          if ((tmp = split_field(&rest)) == NULL)
+            break;
+          if ((p = strchr(tmp, '|')) != NULL)
+            *p = '\0';
+          DupString(aconf->passwd, tmp);
+
+          if ((tmp = split_field(&rest)) == NULL)
+            break;
+          DupString(aconf->user, tmp);
+
+          if ((tmp = split_field(&rest)) == NULL)
+            break;
+          aconf->port = atoi(tmp);
+
+          if ((tmp = split_field(&rest)) == NULL)
+            break;
+          ClassPtr(aconf) = gen->class0;
+          break;
+        }
+
+      if (IsIllegal(aconf) || !aconf->host)
+        {
+          free_conf(aconf);
+          continue;
+        }
+
+      ip = ip_mask = 0;
+      if (aconf->status & CONF_KILL)
+        {
+          if (is_address(aconf->host, &ip, &ip_mask))
+            {
+              aconf->ip = ip & ip_mask;
+              aconf->ip_mask = ip_mask;
+              gen_add(gen, aconf, INDEX_IP_K);
+            }
+          else
+            {
+              (void)collapse(aconf->host);
+              (void)collapse(aconf->user);
+              gen_add(gen, aconf, INDEX_MTRIE_K);
+            }
+        }
+      else
+        {
+          MyFree(aconf->user);
+          DupString(aconf->user, aconf->host);
+          (void)is_address(aconf->host, &ip, &ip_mask);
+          aconf->ip = ip & ip_mask;
+          aconf->ip_mask = ip_mask;
+          gen_add(gen, aconf, (aconf->flags & CONF_FLAGS_E_LINED) ?
+                  INDEX_DLINE_E : INDEX_DLINE);
+        }
+    }
+  fbclose(file);
+}
+
+static int key_cmp(const void* a, const void* b)
+{
+  return strcmp(*(char* const*) a, *(char* const*) b);
+}
+
+/*
+ * sort_keys - sort the keys of gen and drop the duplicates
+ */
+static void sort_keys(struct ConfGen* gen)
+{
+  int i;
+  int n = 0;
+
+  if (gen->nsorted == gen->nkeys)
+    return;
+  qsort(gen->keys, gen->nkeys, sizeof(char*), key_cmp);
+  for (i = 0; i < gen->nkeys; i++)
+    if (!n || strcmp(gen->keys[n - 1], gen->keys[i]))
+      gen->keys[n++] = gen->keys[i];
+  gen->nkeys = gen->nsorted = n;
+}
+
+/*
+ * conf_diff
+ *
+ * inputs       - generation just built
+ * output       - none
+ * side effects - its keys are compared with those in use. Bans that
+ *                are new are kept for check_new_ban(); if there are
+ *                too many, or an exemption has gone, everybody has to
+ *                be looked at. K and E lines are looked at for a
+ *                rehash, D and d lines for REHASH DLINES; new lines
+ *                of the other kind are left out of the keys, so they
+ *                are still new to the rehash that looks at them.
+ *                Nothing but this thread touches live_gen meanwhile.
+ */
+static void conf_diff(struct ConfGen* gen)
+{
+  struct ConfGen* live = live_gen;
+  char            added = gen->dline ? 'D' : 'K';
+  char            other = gen->dline ? 'K' : 'D';
+  char            exempt = gen->dline ? 'd' : 'E';
+  int             i = 0;
+  int             j = 0;
+  int             n = 0;
+  int             cmp;
+
+  sort_keys(gen);
+  if (!live)
+    return;     /* cold start, no clients yet */
+  sort_keys(live);
+
+  while (i < gen->nkeys || j < live->nkeys)
+    {
+      if (i == gen->nkeys)
+        cmp = 1;
+      else if (j == live->nkeys)
+        cmp = -1;
+      else
+        cmp = strcmp(gen->keys[i], live->keys[j]);
+
+      if (cmp < 0)
+        {
+          if (gen->keys[i][0] == added)
+            {
+              if (gen->nbans < NEW_BAN_MAX)
+                gen->bans[gen->nbans++] = gen->keys[i];
+              else
+                gen->sweep = YES;
+            }
+          if (gen->keys[i][0] != other)
+            gen->keys[n++] = gen->keys[i];
+          i++;
+        }
+      else if (cmp > 0)
+        {
+          if (live->keys[j][0] == exempt)
+            gen->sweep = YES;
+          j++;
+        }
+      else
+        {
+          gen->keys[n++] = gen->keys[i];
+          i++;
+          j++;
+        }
+    }
+  gen->nkeys = gen->nsorted = n;
+}
+
+/*
+ * conf_build - fill in the mtrie and D line tables of gen
+ */
+static void conf_build(struct ConfGen* gen)
+{
+  struct ConfSeed* seed;
+  int              i;
+
+  gen->dlines = new_dline_conf();
+  gen->mtrie = new_mtrie_conf(gen->dlines);
+
+  while ((seed = gen->seeds))
+    {
+      gen->seeds = seed->next;
+      gen_add(gen, seed->aconf, seed->how);
+      MyFree(seed);
+    }
+  gen->seeds_tail = &gen->seeds;
+
+  for (i = 0; i < gen->nfiles; i++)
+    conf_read_bans(gen, gen->files[i], gen->names[i]);
+  gen->nfiles = 0;
+#ifdef BAN_JOURNAL
+  /* held since read_conf_files() opened them */
+  journal_release();
+#endif
+
+  conf_diff(gen);
+}
+
+/*
+ * conf_free - free what was swapped out, but for the I lines, which
+ * clients can be attached to
+ */
+static void conf_free(struct ConfGen* gen)
+{
+  struct KeyBlock* block;
+#ifdef BAN_DB
+  struct BanDb*    db;
+#endif
+
+  gen->ilines = free_mtrie_conf(gen->mtrie);
+  free_dline_conf(gen->dlines);
+#ifdef BAN_DB
+  while ((db = gen->images))
+    {
+      gen->images = db->next;
+      ban_db_unmap(db);
+    }
+#endif
+  while ((block = gen->blocks))
+    {
+      gen->blocks = block->next;
+      MyFree(block);
+    }
+  MyFree(gen->keys);
+  gen->keys = NULL;
+  gen->nkeys = gen->nsorted = 0;
+}
+
+static void* conf_load_thread(void* arg)
+{
+  conf_build((struct ConfGen*) arg);
+  pthread_mutex_lock(&conf_lock);
+  conf_done = YES;
+  pthread_mutex_unlock(&conf_lock);
+  return NULL;
+}
+
+static void* conf_free_thread(void* arg)
+{
+  conf_free((struct ConfGen*) arg);
+  pthread_mutex_lock(&conf_lock);
+  conf_done = YES;
+  pthread_mutex_unlock(&conf_lock);
+  return NULL;
+}
+
+/*
+ * conf_thread - run fn(gen) on a thread of its own, -1 if it won't
+ * start
+ */
+static int conf_thread(void* (*fn)(void*), struct ConfGen* gen)
+{
+  int err = ircd_thread_start(fn, gen);
+
+  if (err)
+    {
+      ilog(L_ERROR, "conf_thread: pthread_create: %s", strerror(err));
+      return -1;
+    }
+  return 0;
+}
+
+/*
+ * conf_check_ban - have check_klines() look for the clients a new
+ * K or D line key could match
+ */
+static void conf_check_ban(const char* key, int dline)
+{
+  char          host[HOSTLEN + 1];
+  const char*   p;
+  unsigned long ip = 0;
+  unsigned long ip_mask = 0;
+
+  if (dline || !(p = strrchr(key, '@')))
+    p = key;
+  strncpy_irc(host, p + 1, HOSTLEN);
+  host[HOSTLEN] = '\0';
+
+  if (is_address(host, &ip, &ip_mask))
+    check_new_ban(host, ip & ip_mask, ip_mask, dline);
+  else
+    check_new_ban(host, 0, 0, dline);
+}
+
+/*
+ * conf_finish - the old generation is freed, its I lines can go now
+ * and the classes no longer in use with them
+ */
+static void conf_finish(void)
+{
+  struct ConfGen*  old = conf_freeing;
+  struct ConfItem* aconf;
+
+  while ((aconf = old->ilines))
+    {
+      old->ilines = aconf->next;
+      aconf->next = NULL;
+      if (aconf->clients)
+        aconf->status |= CONF_ILLEGAL;
+      else
+        free_conf(aconf);
+    }
+  MyFree(old);
+  conf_freeing = NULL;
+  check_class();
+
+  if (rehash_again)
+    {
+      rehash_again = NO;
+      dline_in_progress = rehash_again_dlines;
+      rehash_again_dlines = NO;
+      rehash(&me, &me, 0);
+    }
+}
+
+/*
+ * conf_swap
+ *
+ * inputs       - YES to free the old generation on a thread
+ * output       - none
+ * side effects - the generation built is put in use and the clients
+ *                its new bans could match are looked at
+ */
+static void conf_swap(int threaded)
+{
+  struct ConfGen*    gen = conf_loading;
+  struct ConfGen*    old = live_gen;
+  struct ConfSeed*   seed;
+  struct ConfNotice* note;
+  int                i;
+
+  /* K and D lines added meanwhile, the files could have been read
+   * before they were written */
+  quiet_mtrie_conf(gen->mtrie, YES);
+  while ((seed = gen->replay))
+    {
+      gen->replay = seed->next;
+      gen_add(gen, seed->aconf, seed->how);
+      MyFree(seed);
+    }
+  gen->replay_tail = &gen->replay;
+  quiet_mtrie_conf(gen->mtrie, NO);
+
+  if (!old)
+    old = new_conf_gen();       /* the ones in use at boot */
+  old->mtrie = use_mtrie_conf(gen->mtrie);
+  old->dlines = use_dline_conf(gen->dlines);
+  live_gen = gen;
+  conf_loading = NULL;
+
+  while ((note = gen->notices))
+    {
+      gen->notices = note->next;
+      if (note->level < 0)
+        sendto_realops("%s", note->text);
+      else
+        ilog(note->level, "%s", note->text);
+      MyFree(note);
+    }
+  gen->notices_tail = &gen->notices;
+
+  for (i = 0; i < gen->nbans; i++)
+    conf_check_ban(gen->bans[i], gen->dline);
+  gen->nbans = 0;
+  if (gen->sweep)
+    {
+      dline_in_progress = gen->dline;
+      rehashed = YES;
+      gen->sweep = NO;
+    }
+
+  conf_freeing = old;
+  if (!threaded || conf_thread(conf_free_thread, old))
+    {
+      conf_free(old);
+      conf_finish();
+    }
+}
+
+/*
+ * conf_start - build the generation read_conf_files() has set up, on
+ * a thread unless it is the cold start
+ */
+static void conf_start(int cold)
+{
+  main_thread = pthread_self();
+  conf_loading->class0 = find_class(0);
+  if (cold || conf_thread(conf_load_thread, conf_loading))
+    {
+      conf_build(conf_loading);
+      conf_swap(!cold);
+    }
+}
+
+/*
+ * conf_collect - called each pass of the main loop, swaps in the new
+ * conf once it's built, and finishes off the old one once it's freed
+ */
+void conf_collect(void)
+{
+  int done;
+
+  if (!conf_loading && !conf_freeing)
+    return;
+
+  pthread_mutex_lock(&conf_lock);
+  done = conf_done;
+  conf_done = NO;
+  pthread_mutex_unlock(&conf_lock);
+
+  if (!done)
+    return;
+  if (conf_loading)
+    conf_swap(YES);
+  else
+    conf_finish();
+}
+
+/*
+ * conf_new_ban
+ *
+ * inputs       - pointer to a K or D line about to be added by hand
+ * output       - none
+ * side effects - its key is added to those in use, or if a rehash is
+ *                loading, a copy of it is kept to add to the new conf
+ */
+void conf_new_ban(struct ConfItem* aconf)
+{
+  struct ConfItem* bconf;
+  struct ConfSeed* seed;
+  int              how;
+
+  if (aconf->status & CONF_DLINE)
+    how = INDEX_DLINE;
+  else
+    how = aconf->ip_mask ? INDEX_IP_K : INDEX_MTRIE_K;
+
+  if (!conf_loading)
+    {
+      if (live_gen)
+        conf_key(live_gen, aconf, how);
+      return;
+    }
+
+  bconf = make_conf();
+  bconf->status = aconf->status;
+  bconf->flags = aconf->flags;
+  bconf->ip = aconf->ip;
+  bconf->ip_mask = aconf->ip_mask;
+  ClassPtr(bconf) = ClassPtr(aconf);
+  if (aconf->host)
+    DupString(bconf->host, aconf->host);
+  if (aconf->passwd)
+    DupString(bconf->passwd, aconf->passwd);
+  if (aconf->user)
+    DupString(bconf->user, aconf->user);
+
+  seed = (struct ConfSeed*) MyMalloc(sizeof(struct ConfSeed));
+  seed->next = NULL;
+  seed->aconf = bconf;
+  seed->how = how;
+  *conf_loading->replay_tail = seed;
+  conf_loading->replay_tail = &seed->next;
+}
+#endif /* REHASH_THREAD */
+
+#ifdef BAN_DB
+/*
+ * read_ban_image
+ *
+ * inputs       - generation being built, NULL without REHASH_THREAD
+ *              - name of kline.conf or dline.conf
+ *              - the file, just opened
+ * output       - none
+ * side effects - if the file has an image (see ban_db.h) that is up
+ *                to date, its bans are added as they are and file is
+ *                moved past the text it was made from, so only what
+ *                was added since is left to parse. The image stays
+ *                mapped as long as the bans are in use.
+ */
+static void read_ban_image(struct ConfGen* gen, const char* filename,
+                           FBFILE* file)
+{
+  static const int          how[] = { INDEX_MTRIE_K, INDEX_IP_K,
+                                      INDEX_DLINE, INDEX_DLINE_E };
+  struct BanDb*             db;
+  const struct BanDbRecord* rec;
+  struct ConfItem*          aconf;
+  aClass*                   class0;
+  const char*               why;
+  unsigned int              i;
+
+  if (!(db = ban_db_map(filename, &why)))
+    {
+      if (why)
+#ifdef REHASH_THREAD
+        conf_notice(gen, L_NOTICE, "%s%s is %s, reading %s",
+                    filename, BAN_DB_SUFFIX, why, filename);
+#else
+        ilog(L_NOTICE, "%s%s is %s, reading %s",
+             filename, BAN_DB_SUFFIX, why, filename);
+#endif
+      return;
+    }
+  if (fbseek(file, db->head->text_size))
+    {
+      ban_db_unmap(db);
+      return;
+    }
+
+#ifdef REHASH_THREAD
+  class0 = gen->class0;
+#else
+  class0 = find_class(0);
+#endif
+  for (i = 0, rec = db->rec; i < db->head->count; i++, rec++)
+    {
+      aconf = make_conf();
+      if (rec->kind == BAN_DB_KLINE || rec->kind == BAN_DB_IP_KLINE)
+        aconf->status = CONF_KILL;
+      else
+        aconf->status = CONF_DLINE;
+      if (rec->kind == BAN_DB_ELINE)
+        aconf->flags = CONF_FLAGS_E_LINED;
+      aconf->ip = rec->ip;
+      aconf->ip_mask = rec->ip_mask;
+      aconf->port = rec->port;
+      aconf->host = (char*) ban_db_string(db, rec->host);
+      aconf->passwd = (char*) ban_db_string(db, rec->passwd);
+      aconf->user = (char*) ban_db_string(db, rec->user);
+      aconf->in_image = 1;
+      if (rec->has_class)
+        ClassPtr(aconf) = class0;
+#ifdef REHASH_THREAD
+      gen_add(gen, aconf, how[rec->kind]);
+#else
+      add_conf_index(aconf, how[rec->kind]);
+#endif
+    }
+
+#ifdef REHASH_THREAD
+  db->next = gen->images;
+  gen->images = db;
+#else
+  db->next = ban_images;
+  ban_images = db;
+#endif
+}
+#endif /* BAN_DB */
+
+/*
+ * read_ban_file - read the bans in file, or have the rehash thread
+ * read them
+ */
+static void read_ban_file(FBFILE* file, const char* filename)
+{
+#ifdef REHASH_THREAD
+  conf_loading->files[conf_loading->nfiles] = file;
+  conf_loading->names[conf_loading->nfiles++] = filename;
+#else
+#ifdef BAN_DB
+  read_ban_image(NULL, filename, file);
+#endif
+  initconf(file, NO);
+#endif
+}
+
+#ifdef BAN_JOURNAL
+/*
+ * read_journal - read the bans journaled for filename, that aren't in
+ * it yet
+ */
+static void read_journal(const char* filename)
+{
+  const char* name;
+  FBFILE*     file;
+
+  if ((name = journal_name(filename)) && (file = openconf(name)))
+    read_ban_file(file, name);
+}
+#endif
+
 /*
  * read_conf_files
  *
@@ -3662,6 +4594,12 @@ void read_conf_files(int cold)
         }
     }
 
+#ifdef REHASH_THREAD
+  conf_loading = new_conf_gen();
+  conf_loading->dline = dline_in_progress;
+  dline_in_progress = 0;
+#endif
+
   if(!cold)
   {
 #ifdef JUPE_CHANNEL
@@ -3679,6 +4617,12 @@ void read_conf_files(int cold)
    * or *filename == '\0'; and then just ignoring it 
    */
 
+#ifdef BAN_JOURNAL
+  /* bans queued before now are to be read too, none after */
+  journal_flush();
+  journal_hold();
+#endif
+
   kfilename = get_conf_name(KLINE_TYPE);
   if (irccmp(filename,kfilename) != 0)
     {
@@ -3695,7 +4639,7 @@ void read_conf_files(int cold)
             }
         }
       else
-        initconf(file, NO);
+        read_ban_file(file, kfilename);
     }
 
   dfilename = get_conf_name(DLINE_TYPE);
@@ -3714,9 +4658,22 @@ void read_conf_files(int cold)
             }
         }
       else
-        initconf(file, NO);
+        read_ban_file(file, dfilename);
     }
 
+#ifdef BAN_JOURNAL
+  read_journal(kfilename);
+  if (irccmp(kfilename, dfilename) != 0)
+    read_journal(dfilename);
+#ifndef REHASH_THREAD
+  journal_release();
+#endif
+#endif
+
+#ifdef REHASH_THREAD
+  conf_start(cold);
+#endif
+
 }
 
 /*
@@ -3732,6 +4689,9 @@ static void clear_out_old_conf(void)
   struct ConfItem **tmp = &ConfigItemList;
   struct ConfItem *tmp2;
   aClass    *cltmp;
+#if defined(BAN_DB) && !defined(REHASH_THREAD)
+  struct BanDb* db;
+#endif
 
     while ((tmp2 = *tmp))
       {
@@ -3767,9 +4727,18 @@ static void clear_out_old_conf(void)
     for (cltmp = ClassList->next; cltmp; cltmp = cltmp->next)
       MaxLinks(cltmp) = -1;
 
+#ifndef REHASH_THREAD
     clear_mtrie_conf_links();
 
     zap_Dlines();
+#ifdef BAN_DB
+    while ((db = ban_images))
+      {
+        ban_images = db->next;
+        ban_db_unmap(db);
+      }
+#endif
+#endif
     clear_special_conf(&x_conf);
     clear_special_conf(&u_conf);
     clear_q_lines();
@@ -3954,23 +4923,37 @@ get_conf_name(KlineType type)
 static char *getfield(char *newline)
 {
   static char *line = (char *)NULL;
-  char  *end, *field;
         
   if (newline)
     line = newline;
 
-  if (line == (char *)NULL)
+  return(split_field(&line));
+}
+
+/*
+ * split_field
+ *
+ * inputs       - pointer to what is left of a line, NULL at the end
+ * output       - the next field, NULL if there are no more
+ * side effects - *line is moved past the field, getfield() without
+ *                the static so the rehash thread can use it too
+ */
+static char *split_field(char **line)
+{
+  char  *end, *field;
+
+  if (*line == (char *)NULL)
     return((char *)NULL);
 
-  field = line;
-  if ((end = strchr(line,':')) == NULL)
+  field = *line;
+  if ((end = strchr(field,':')) == NULL)
     {
-      line = (char *)NULL;
+      *line = (char *)NULL;
       if ((end = strchr(field,'\n')) == (char *)NULL)
         end = field + strlen(field);
     }
   else
-    line = end + 1;
+    *line = end + 1;
   *end = '\0';
   return(field);
 }
@@ -20,6 +20,7 @@
  *   $Id: s_debug.c,v 1.63 2004/10/13 03:12:37 ievil Exp $
  */
 #include "s_debug.h"
+#include "chanban.h"
 #include "channel.h"
 #include "class.h"
 #include "client.h"
@@ -242,6 +243,10 @@ void count_memory(aClient *cptr,char *nick)
   size_t dbuf_used               = 0;
   size_t dbuf_alloc_count        = 0;
   size_t dbuf_used_count         = 0;
+  int    dbuf_shared_count       = 0;
+  size_t dbuf_shared_mem         = 0;
+  int    dbuf_ref_count          = 0;
+  size_t dbuf_ref_mem            = 0;
 
   size_t client_hash_table_size = 0;
   size_t channel_hash_table_size = 0;
@@ -251,19 +256,24 @@ void count_memory(aClient *cptr,char *nick)
 
   u_long local_client_memory_used = 0;
   u_long local_client_memory_allocated = 0;
+  u_long local_client_memory_fragmented = 0;
 
   u_long remote_client_memory_used = 0;
   u_long remote_client_memory_allocated = 0;
+  u_long remote_client_memory_fragmented = 0;
 
   u_long user_memory_used = 0;
   u_long user_memory_allocated = 0;
+  u_long user_memory_fragmented = 0;
 
   u_long links_memory_used = 0;
   u_long links_memory_allocated = 0;
+  u_long links_memory_fragmented = 0;
 
 #ifdef FLUD
   u_long flud_memory_used = 0;
   u_long flud_memory_allocated = 0;
+  u_long flud_memory_fragmented = 0;
 #endif
 
   u_long tot = 0;
@@ -303,10 +313,14 @@ void count_memory(aClient *cptr,char *nick)
     {
       ch++;
       chm += (strlen(chptr->chname) + sizeof(aChannel));
-      for (gen_link = chptr->members; gen_link; gen_link = gen_link->next)
-        chu++;
+      chm += chptr->memberv_size * sizeof(Link *) +
+        chptr->memberh_size * sizeof(int);
+      chu += chptr->memberc;
       for (gen_link = chptr->invites; gen_link; gen_link = gen_link->next)
         chi++;
+      chbm += ban_index_memory(chptr->banindex);
+      chem += ban_index_memory(chptr->exceptindex) +
+        ban_index_memory(chptr->invexindex);
       for (gen_link = chptr->banlist; gen_link; gen_link = gen_link->next)
         {
           chb++;
@@ -362,6 +376,8 @@ void count_memory(aClient *cptr,char *nick)
   count_dbuf_memory(&dbuf_allocated, &dbuf_used);
   dbuf_alloc_count = DBufCount;
   dbuf_used_count  = DBufUsedCount;
+  count_dbuf_shared(&dbuf_shared_count, &dbuf_shared_mem,
+                    &dbuf_ref_count, &dbuf_ref_mem);
 
   sendto_one(cptr, ":%s %d %s :Client Local %d(%d) Remote %d(%d)",
              me.name, RPL_STATSDEBUG, nick, lc, lcm, rc, rcm);
@@ -404,12 +420,17 @@ void count_memory(aClient *cptr,char *nick)
 
   sendto_one(cptr, ":%s %d %s :Hash: client %d(%d) chan %d(%d)",
              me.name, RPL_STATSDEBUG, nick,
-             U_MAX, client_hash_table_size,
-             CH_MAX, channel_hash_table_size);
+             (int) (client_hash_table_size / sizeof(struct HashEntry)),
+             (int) client_hash_table_size,
+             (int) (channel_hash_table_size / sizeof(struct HashEntry)),
+             (int) channel_hash_table_size);
 
   sendto_one(cptr, ":%s %d %s :Dbuf blocks allocated %d(%d), used %d(%d)",
              me.name, RPL_STATSDEBUG, nick, dbuf_alloc_count, dbuf_allocated,
              dbuf_used_count, dbuf_used);
+  sendto_one(cptr, ":%s %d %s :Dbuf shared blocks %d(%d), references %d(%d)",
+             me.name, RPL_STATSDEBUG, nick, dbuf_shared_count,
+             (int) dbuf_shared_mem, dbuf_ref_count, (int) dbuf_ref_mem);
 
 
   count_scache(&number_servers_cached,&mem_servers_cached);
@@ -436,44 +457,54 @@ void count_memory(aClient *cptr,char *nick)
 
 
   count_local_client_memory((int *)&local_client_memory_used,
-                            (int *)&local_client_memory_allocated);
+                            (int *)&local_client_memory_allocated,
+                            (int *)&local_client_memory_fragmented);
   tot += local_client_memory_allocated;
-  sendto_one(cptr, ":%s %d %s :Local client Memory in use: %d Local client Memory allocated: %d",
+  sendto_one(cptr, ":%s %d %s :Local client Memory in use: %d Local client Memory allocated: %d Fragmented: %d",
              me.name, RPL_STATSDEBUG, nick,
-             local_client_memory_used, local_client_memory_allocated);
+             local_client_memory_used, local_client_memory_allocated,
+             local_client_memory_fragmented);
 
 
   count_remote_client_memory( (int *)&remote_client_memory_used,
-                              (int *)&remote_client_memory_allocated);
+                              (int *)&remote_client_memory_allocated,
+                              (int *)&remote_client_memory_fragmented);
   tot += remote_client_memory_allocated;
-  sendto_one(cptr, ":%s %d %s :Remote client Memory in use: %d Remote client Memory allocated: %d",
+  sendto_one(cptr, ":%s %d %s :Remote client Memory in use: %d Remote client Memory allocated: %d Fragmented: %d",
              me.name, RPL_STATSDEBUG, nick,
-             remote_client_memory_used, remote_client_memory_allocated);
+             remote_client_memory_used, remote_client_memory_allocated,
+             remote_client_memory_fragmented);
 
 
   count_user_memory( (int *)&user_memory_used,
-                    (int *)&user_memory_allocated);
+                    (int *)&user_memory_allocated,
+                    (int *)&user_memory_fragmented);
   tot += user_memory_allocated;
-  sendto_one(cptr, ":%s %d %s :anUser Memory in use: %d anUser Memory allocated: %d",
+  sendto_one(cptr, ":%s %d %s :anUser Memory in use: %d anUser Memory allocated: %d Fragmented: %d",
              me.name, RPL_STATSDEBUG, nick,
              user_memory_used,
-             user_memory_allocated);
+             user_memory_allocated,
+             user_memory_fragmented);
 
 
   count_links_memory( (int *)&links_memory_used,
-                    (int *)&links_memory_allocated);
-  sendto_one(cptr, ":%s %d %s :Links Memory in use: %d Links Memory allocated: %d",
+                    (int *)&links_memory_allocated,
+                    (int *)&links_memory_fragmented);
+  sendto_one(cptr, ":%s %d %s :Links Memory in use: %d Links Memory allocated: %d Fragmented: %d",
              me.name, RPL_STATSDEBUG, nick,
              links_memory_used,
-             links_memory_allocated);
+             links_memory_allocated,
+             links_memory_fragmented);
 
 #ifdef FLUD
   count_flud_memory( (int *)&flud_memory_used,
-                    (int *)&flud_memory_allocated);
-  sendto_one(cptr, ":%s %d %s :FLUD Memory in use: %d FLUD Memory allocated: %d",
+                    (int *)&flud_memory_allocated,
+                    (int *)&flud_memory_fragmented);
+  sendto_one(cptr, ":%s %d %s :FLUD Memory in use: %d FLUD Memory allocated: %d Fragmented: %d",
              me.name, RPL_STATSDEBUG, nick,
              flud_memory_used,
-             flud_memory_allocated);
+             flud_memory_allocated,
+             flud_memory_fragmented);
 
   tot += flud_memory_allocated;
 #endif
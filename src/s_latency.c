@@ -0,0 +1,255 @@
+/************************************************************************
+ *   IRC - Internet Relay Chat, src/s_latency.c
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 1, or (at your option)
+ *   any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ * $Id$
+ */
+#include "s_latency.h"
+#include "client.h"
+#include "irc_string.h"
+#include "ircd.h"
+#include "msg.h"
+#include "numeric.h"
+#include "s_log.h"
+#include "send.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/time.h>
+
+#ifdef LATENCY_STATS
+/*
+ * How long the main loop and each command take. Each pass of the main
+ * loop goes in LAT_LOOP less the time it spent waiting for something
+ * to happen, which goes in LAT_POLL, so a slow pass shows as such
+ * however busy or idle the server is. A command's handler time goes
+ * in a histogram hung off its msgtab entry the first time it's used.
+ */
+struct LatencyHist latency_phase[LAT_PHASES];
+
+static const char* phase_name[LAT_PHASES] = {
+  "loop", "poll", "events", "clients", "timers"
+};
+
+/* time waited in the current pass of the main loop */
+static unsigned long pass_waited = 0;
+
+/*
+ * latency_usec - a monotonic clock in microseconds, or wall clock
+ * time where there is none
+ */
+unsigned long latency_usec(void)
+{
+#ifdef CLOCK_MONOTONIC
+  struct timespec ts;
+
+  if (!clock_gettime(CLOCK_MONOTONIC, &ts))
+    return ts.tv_sec * 1000000UL + ts.tv_nsec / 1000;
+#endif
+  {
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec * 1000000UL + tv.tv_usec;
+  }
+}
+
+/*
+ * lat_bucket - the bucket of usec
+ */
+static int lat_bucket(unsigned long usec)
+{
+  int bits = 0;
+
+  if (usec < LAT_SUB)
+    return (int) usec;
+  if (usec > 0xffffffffUL)
+    return LAT_BUCKETS - 1;
+  while ((usec >> bits) >= 2 * LAT_SUB)
+    ++bits;
+  return (bits + 1) * LAT_SUB + (int) ((usec >> bits) & (LAT_SUB - 1));
+}
+
+/*
+ * lat_top - the largest value that goes in bucket i
+ */
+static unsigned long lat_top(int i)
+{
+  int bits = i / LAT_SUB - 1;
+
+  if (i < LAT_SUB)
+    return (unsigned long) i;
+  return (((unsigned long) (LAT_SUB + i % LAT_SUB) + 1) << bits) - 1;
+}
+
+void latency_add(struct LatencyHist* h, unsigned long usec)
+{
+  h->bucket[lat_bucket(usec)]++;
+  h->count++;
+  h->sum += usec;
+  if (usec > h->max)
+    h->max = usec;
+}
+
+/*
+ * latency_wait - the main loop waited usec for something to happen
+ */
+void latency_wait(unsigned long usec)
+{
+  latency_add(&latency_phase[LAT_POLL], usec);
+  pass_waited += usec;
+}
+
+/*
+ * latency_pass - a pass of the main loop begun at start is over
+ */
+void latency_pass(unsigned long start)
+{
+  unsigned long took = latency_usec() - start;
+
+  latency_add(&latency_phase[LAT_LOOP],
+              took > pass_waited ? took - pass_waited : 0);
+  pass_waited = 0;
+}
+
+/*
+ * latency_command - the handler of mptr took usec
+ */
+void latency_command(struct Message* mptr, unsigned long usec)
+{
+  if (!mptr->latency)
+    {
+      mptr->latency = (struct LatencyHist*) MyMalloc(sizeof(struct LatencyHist));
+      memset(mptr->latency, 0, sizeof(struct LatencyHist));
+    }
+  latency_add(mptr->latency, usec);
+}
+
+/*
+ * lat_percentile - the value pct percent of h are at or below, to
+ * the top of its bucket but no more than the largest seen
+ */
+static unsigned long lat_percentile(struct LatencyHist* h, double pct)
+{
+  unsigned long want;
+  unsigned long seen = 0;
+  unsigned long top;
+  int           i;
+
+  if (!h->count)
+    return 0;
+  want = (unsigned long) (h->count * pct / 100.0 + 0.5);
+  if (want < 1)
+    want = 1;
+  for (i = 0; i < LAT_BUCKETS; i++)
+    if ((seen += h->bucket[i]) >= want)
+      break;
+  top = lat_top(i < LAT_BUCKETS ? i : LAT_BUCKETS - 1);
+  return top < h->max ? top : h->max;
+}
+
+/*
+ * lat_format - h as one line under name
+ */
+static const char* lat_format(const char* name, struct LatencyHist* h)
+{
+  static char buf[BUFSIZE];
+
+  ircsprintf(buf, "%s n %u avg %u p50 %u p90 %u p99 %u p99.9 %u max %u",
+             name, (unsigned int) h->count,
+             (unsigned int) (h->count ? h->sum / h->count : 0),
+             (unsigned int) lat_percentile(h, 50.0),
+             (unsigned int) lat_percentile(h, 90.0),
+             (unsigned int) lat_percentile(h, 99.0),
+             (unsigned int) lat_percentile(h, 99.9),
+             (unsigned int) h->max);
+  return buf;
+}
+
+/* for qsort'ing the commands, worst p99 first */
+static int lat_cmp(const void* a, const void* b)
+{
+  unsigned long pa = lat_percentile((*(struct Message* const*) a)->latency, 99.0);
+  unsigned long pb = lat_percentile((*(struct Message* const*) b)->latency, 99.0);
+
+  return (pa < pb) ? 1 : (pa > pb) ? -1 : 0;
+}
+
+/*
+ * lat_commands - the commands used so far, worst p99 first; returns
+ * how many, the array is only good until the next call
+ */
+static int lat_commands(struct Message*** list)
+{
+  static struct Message** cmds = NULL;
+  static int              size = 0;
+  struct Message*         mptr;
+  int                     n = 0;
+
+  for (mptr = msgtab; mptr->cmd; mptr++)
+    if (mptr->latency && mptr->latency->count)
+      {
+        if (n == size)
+          {
+            size = size ? size * 2 : 64;
+            cmds = (struct Message**) MyRealloc(cmds,
+                                          size * sizeof(struct Message*));
+          }
+        cmds[n++] = mptr;
+      }
+  if (n)
+    qsort(cmds, n, sizeof(struct Message*), lat_cmp);
+  *list = cmds;
+  return n;
+}
+
+/*
+ * report_latency - STATS W, the histograms as percentiles, in
+ * microseconds
+ */
+void report_latency(struct Client* sptr, const char* name)
+{
+  struct Message** cmds;
+  int              n, i;
+
+  sendto_one(sptr, ":%s %d %s :W latency in usec since %s", me.name,
+             RPL_STATSDEBUG, name, myctime(me.since));
+  for (i = 0; i < LAT_PHASES; i++)
+    sendto_one(sptr, ":%s %d %s :W %s", me.name, RPL_STATSDEBUG, name,
+               lat_format(phase_name[i], &latency_phase[i]));
+  n = lat_commands(&cmds);
+  for (i = 0; i < n; i++)
+    sendto_one(sptr, ":%s %d %s :W %s", me.name, RPL_STATSDEBUG, name,
+               lat_format(cmds[i]->cmd, cmds[i]->latency));
+}
+
+/*
+ * dump_latency - write what STATS W shows to the log, on SIGUSR2
+ */
+void dump_latency(void)
+{
+  struct Message** cmds;
+  int              n, i;
+
+  ilog(L_NOTICE, "latency in usec since %s", myctime(me.since));
+  for (i = 0; i < LAT_PHASES; i++)
+    ilog(L_NOTICE, "latency %s", lat_format(phase_name[i], &latency_phase[i]));
+  n = lat_commands(&cmds);
+  for (i = 0; i < n; i++)
+    ilog(L_NOTICE, "latency %s", lat_format(cmds[i]->cmd, cmds[i]->latency));
+}
+#endif /* LATENCY_STATS */
@@ -25,6 +25,7 @@
 #include "s_log.h"
 #include "irc_string.h"
 #include "ircd.h"
+#include "ircd_signal.h"
 #include "s_misc.h"
 
 #include <assert.h>
@@ -36,6 +37,12 @@
 #include <syslog.h>
 #include <unistd.h>
 
+#ifdef LOG_THREAD
+#include <pthread.h>
+#include <stdlib.h>
+#include <time.h>
+#endif
+
 
 #define LOG_BUFSIZE 2000 
 
@@ -67,6 +74,39 @@ static const char *logLevelToString[] =
   "L_DEBUG"
 };
 
+#ifdef LOG_THREAD
+/*
+ * The main thread copies each message into log_ring, and the logger
+ * thread takes them out a batch at a time and writes them. With one
+ * of each, neither needs a lock: the main thread moves log_head past a
+ * record once it is all there, and the logger moves log_tail past
+ * records once they are written, after which they can be reused. A
+ * message that doesn't fit is counted in log_lost instead.
+ */
+#define LOG_RING_SIZE   131072
+#define LOG_BATCH_SIZE  16384
+#define LOG_POLL_USEC   20000   /* the logger looks for more this often */
+#define LOG_FLUSH_WAIT  2       /* seconds log_flush() waits at most */
+
+struct LogRecord {
+  time_t        when;
+  int           priority;
+  int           len;            /* of the text after, with its '\0';
+                                 * -1 for go back to the start */
+};
+
+#define LOG_RECORD_SIZE(len) ((sizeof(struct LogRecord) + (len) + \
+                               sizeof(long) - 1) & ~(sizeof(long) - 1))
+
+static long                   log_ring[LOG_RING_SIZE / sizeof(long)];
+static volatile unsigned long log_head = 0;
+static volatile unsigned long log_tail = 0;
+static volatile unsigned long log_lost = 0;
+static int                    log_running = 0;
+static int                    log_queueing = 0;
+static pthread_t              log_main;
+#endif /* LOG_THREAD */
+
 /*
  * open_log - open ircd logging file
  * returns true (1) if successful, false (0) otherwise
@@ -92,6 +132,9 @@ static int open_log(const char* filename)
 
 void close_log(void)
 {
+#ifdef LOG_THREAD
+  log_flush();
+#endif
 #if defined(USE_LOGFILE) 
   if (-1 < logFile) {
     close(logFile);
@@ -103,14 +146,195 @@ void close_log(void)
 #endif
 }
 
+#ifdef LOG_THREAD
+/*
+ * log_date - smalldate(), for any thread
+ */
+static void log_date(char* buf, time_t when)
+{
+  struct tm lt;
+
+  if (!when)
+    time(&when);
+  localtime_r(&when, &lt);
+  sprintf(buf, "%d/%02d/%02d %02d.%02d", lt.tm_year + 1900, lt.tm_mon + 1,
+          lt.tm_mday, lt.tm_hour, lt.tm_min);
+}
+#endif
+
 #if defined(USE_LOGFILE) 
 static void write_log(const char* message)
 {
   char buf[LOG_BUFSIZE];
+#ifdef LOG_THREAD
+  char date[MAX_DATE_STRING];
+
+  log_date(date, CurrentTime);
+  sprintf(buf, "[%s] %s\n", date, message);
+#else
   sprintf(buf, "[%s] %s\n", smalldate(CurrentTime), message);
+#endif
   write(logFile, buf, strlen(buf));
 }
 #endif
+
+#ifdef LOG_THREAD
+/*
+ * log_queue - copy a message into the ring for the logger, or count
+ * it lost if there is no room; main thread only
+ */
+static void log_queue(int priority, const char* message)
+{
+  struct LogRecord* rec;
+  unsigned long     head = log_head;
+  unsigned long     pos = head % LOG_RING_SIZE;
+  unsigned long     room = LOG_RING_SIZE - pos;
+  unsigned long     need;
+  unsigned long     skip;
+  int               len = strlen(message) + 1;
+
+  need = LOG_RECORD_SIZE(len);
+  skip = room < need ? room : 0;
+  if (head + skip + need - log_tail > LOG_RING_SIZE)
+    {
+      log_lost++;
+      return;
+    }
+  /* the logger is through with the space before it is written over */
+  __sync_synchronize();
+
+  if (skip)
+    {
+      if (room >= sizeof(struct LogRecord))
+        ((struct LogRecord*) ((char*) log_ring + pos))->len = -1;
+      head += skip;
+      pos = 0;
+    }
+  rec = (struct LogRecord*) ((char*) log_ring + pos);
+  rec->when = CurrentTime;
+  rec->priority = priority;
+  rec->len = len;
+  memcpy(rec + 1, message, len);
+
+  /* the record is all there before the logger can see it */
+  __sync_synchronize();
+  log_head = head + need;
+}
+
+/*
+ * log_writer - write out what is in the ring, a batch at a time
+ */
+static void* log_writer(void* unused)
+{
+  char              batch[LOG_BATCH_SIZE];
+  char              date[MAX_DATE_STRING];
+  time_t            date_when = -1;
+  struct LogRecord* rec;
+  unsigned long     head;
+  unsigned long     tail;
+  unsigned long     pos;
+  unsigned long     room;
+  unsigned long     lost;
+  unsigned long     reported = 0;
+  int               len;
+
+  for (;;)
+    {
+      head = log_head;
+      __sync_synchronize();
+      tail = log_tail;
+      len = 0;
+
+      while (tail != head)
+        {
+          pos = tail % LOG_RING_SIZE;
+          room = LOG_RING_SIZE - pos;
+          rec = (struct LogRecord*) ((char*) log_ring + pos);
+          if (room < sizeof(struct LogRecord) || rec->len < 0)
+            {
+              tail += room;
+              continue;
+            }
+          if (len + MAX_DATE_STRING + rec->len + 4 > LOG_BATCH_SIZE)
+            break;
+          if (rec->when != date_when)
+            {
+              log_date(date, rec->when);
+              date_when = rec->when;
+            }
+#ifdef USE_SYSLOG
+          if (rec->priority <= L_DEBUG)
+            syslog(sysLogLevel[rec->priority], "%s", (char*) (rec + 1));
+#endif
+          len += sprintf(batch + len, "[%s] %s\n", date, (char*) (rec + 1));
+          tail += LOG_RECORD_SIZE(rec->len);
+        }
+
+      if ((lost = log_lost) != reported &&
+          len + 2 * MAX_DATE_STRING + 64 <= LOG_BATCH_SIZE)
+        {
+          log_date(date, 0);
+          date_when = -1;
+          len += sprintf(batch + len,
+                         "[%s] %lu log messages lost, the log couldn't keep up\n",
+                         date, lost);
+          reported = lost;
+        }
+
+#ifdef USE_LOGFILE
+      if (len && -1 < logFile)
+        write(logFile, batch, len);
+#endif
+
+      /* written, the main thread can have the space back */
+      __sync_synchronize();
+      log_tail = tail;
+
+      if (tail == log_head)
+        usleep(LOG_POLL_USEC);
+    }
+  return unused;
+}
+
+/*
+ * log_flush - wait (a while at most) for the logger to write out all
+ * that is in the ring
+ */
+void log_flush(void)
+{
+  int i;
+
+  if (!log_running)
+    return;
+  for (i = 0; log_tail != log_head && i < LOG_FLUSH_WAIT * 1000; i++)
+    usleep(1000);
+}
+#endif /* LOG_THREAD */
+
+/*
+ * log_message - log a formatted message, or with LOG_THREAD, hand it
+ * to the logger; other threads, and a signal handler that came in
+ * while a message was being queued, log it themselves
+ */
+static void log_message(int priority, const char* message)
+{
+#ifdef LOG_THREAD
+  if (log_running && !log_queueing && pthread_equal(pthread_self(), log_main))
+    {
+      log_queueing = 1;
+      log_queue(priority, message);
+      log_queueing = 0;
+      return;
+    }
+#endif
+#ifdef USE_SYSLOG
+  if (priority <= L_DEBUG)
+    syslog(sysLogLevel[priority], "%s", message);
+#endif
+#if defined(USE_LOGFILE) 
+  write_log(message);
+#endif
+}
    
 void vlog(int priority, const char *fmt, va_list args)
 {
@@ -121,13 +345,7 @@ void vlog(int priority, const char *fmt, va_list args)
   if(priority > logLevel)
   	return;  
   vsprintf(buf, fmt, args);
-#ifdef USE_SYSLOG
-  if(priority <= L_DEBUG)
-  	syslog(sysLogLevel[priority], "%s", buf);
-#endif
-#ifdef USE_LOGFILE
-   write_log(buf);
-#endif	  		
+  log_message(priority, buf);
 }
 
 void ilog(int priority, const char* fmt, ...)
@@ -144,23 +362,32 @@ void ilog(int priority, const char* fmt, ...)
   vsprintf(buf, fmt, args);
   va_end(args);
 
-#ifdef USE_SYSLOG  
-  if (priority <= L_DEBUG)
-    syslog(sysLogLevel[priority], "%s", buf);
-#endif
-#if defined(USE_LOGFILE) 
-  write_log(buf);
-#endif
+  log_message(priority, buf);
 }
   
 void init_log(const char* filename)
 {
+#ifdef LOG_THREAD
+  int err;
+#endif
+
 #if defined(USE_LOGFILE) 
   open_log(filename);
 #endif
 #ifdef USE_SYSLOG
   openlog("ircd", LOG_PID | LOG_NDELAY, LOG_FACILITY);
 #endif
+#ifdef LOG_THREAD
+  if ((err = ircd_thread_start(log_writer, NULL)))
+    ilog(L_ERROR, "init_log: pthread_create: %s", strerror(err));
+  else
+    {
+      log_main = pthread_self();
+      log_running = 1;
+      /* what is logged on the way out goes out too */
+      atexit(log_flush);
+    }
+#endif
 }
 
 void set_log_level(int level)
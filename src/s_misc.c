@@ -33,6 +33,7 @@
 #include "s_bsd.h"
 #include "s_conf.h"
 #include "s_serv.h"
+#include "s_zip.h"
 #include "send.h"
 #include "struct.h"
 
@@ -160,18 +161,23 @@ void serv_info(aClient *cptr,char *name)
        * on stats ?
        */
       if(IsAnOper(cptr))
-        sendto_one(cptr, Lformat, me.name, RPL_STATSLINKINFO, name,
+        {
+          sendto_one(cptr, Lformat, me.name, RPL_STATSLINKINFO, name,
 #if (defined SERVERHIDE) || (defined HIDE_SERVERS_IPS)
-                   get_client_name(acptr, HIDEME),
+                     get_client_name(acptr, HIDEME),
 #else
-                   get_client_name(acptr, TRUE),
+                     get_client_name(acptr, TRUE),
 #endif
-                   (int)DBufLength(&acptr->sendQ),
-                   (int)acptr->sendM, (int)acptr->sendK,
-                   (int)acptr->receiveM, (int)acptr->receiveK,
-                   CurrentTime - acptr->firsttime,
-                   (CurrentTime > acptr->since) ? (CurrentTime - acptr->since): 0,
-                   IsServer(acptr) ? show_capabilities(acptr) : "-" );
+                     (int)DBufLength(&acptr->sendQ),
+                     (int)acptr->sendM, (int)acptr->sendK,
+                     (int)acptr->receiveM, (int)acptr->receiveK,
+                     CurrentTime - acptr->firsttime,
+                     (CurrentTime > acptr->since) ? (CurrentTime - acptr->since): 0,
+                     IsServer(acptr) ? show_capabilities(acptr) : "-" );
+#ifdef ZIP_LINKS
+          zip_report(cptr, name, acptr);
+#endif
+        }
       else
         {
           sendto_one(cptr, Lformat, me.name, RPL_STATSLINKINFO,
@@ -212,6 +218,7 @@ void show_isupport(aClient *cptr, char *name)
   int  mode_e=0;
   int  mode_I=0;
   int  u_knock=0;
+  int  u_topic=0;
 
 #ifdef CHANMODE_E
   mode_e = 1;
@@ -222,6 +229,9 @@ void show_isupport(aClient *cptr, char *name)
 #ifdef USE_KNOCK
   u_knock = 1;
 #endif
+#ifdef TOPIC_INFO
+  u_topic = 1;
+#endif
 
   ircsprintf(features, "WALLCHOPS%s%s%s MODES=%d MAXCHANNELS=%d MAXBANS=b%s%s:%d "
                        "MAXTARGETS=4 NICKLEN=%d TOPICLEN=%d KICKLEN=%d",
@@ -241,9 +251,10 @@ void show_isupport(aClient *cptr, char *name)
                         mode_e ? "e" : "",
                         mode_I ? "I" : "");
 
-  ircsprintf(features2, "CHANTYPES=#& PREFIX=(ov)@+ %s NETWORK=%s CASEMAPPING=rfc1459 MAP ETRACE SINFO",
+  ircsprintf(features2, "CHANTYPES=#& PREFIX=(ov)@+ %s NETWORK=%s CASEMAPPING=rfc1459 MAP ETRACE SINFO ELIST=CM%sU",
                         cbmodes,
-                        NETWORK_NAME);
+                        NETWORK_NAME,
+                        u_topic ? "T" : "");
 
   sendto_one(cptr, form_str(RPL_ISUPPORT), me.name, name, features);
   sendto_one(cptr, form_str(RPL_ISUPPORT), me.name, name, features2);
@@ -69,6 +69,7 @@ struct Capability captab[] = {
 /*  name        cap     */ 
 #ifdef ZIP_LINKS
   { "ZIP",      CAP_ZIP },
+  { "ZIPD",     CAP_ZIPDICT },
 #endif
   { "QS",       CAP_QS },
   { "EX",       CAP_EX },
@@ -455,6 +456,25 @@ int check_server(struct Client* cptr)
   return 1;
 }
 
+/*
+ * count_downlinks - add up the servers, and users if link_u isn't
+ * NULL, behind each of our links below server, by the fd of the link,
+ * from the per-server lists rather than a walk of every client. A link
+ * counts itself among its servers.
+ */
+void count_downlinks(struct Client* server, int* link_s, int* link_u)
+{
+  struct Client* acptr;
+
+  for (acptr = server->serv->servers; acptr; acptr = acptr->lnext)
+    {
+      ++link_s[acptr->from->fd];
+      if (link_u)
+        link_u[acptr->from->fd] += acptr->serv->usercnt;
+      count_downlinks(acptr, link_s, link_u);
+    }
+}
+
 /*
 ** send the CAPAB line to a server  -orabidoo
 *
@@ -478,7 +498,7 @@ void send_capabilities(struct Client* cptr, int use_zip)
     }
     else
     {
-      if (cap->cap != CAP_ZIP)
+      if (!(cap->cap & (CAP_ZIP | CAP_ZIPDICT)))
       {
         strcat(msgbuf, cap->name);
         strcat(msgbuf, " ");
@@ -560,9 +580,280 @@ const char* show_capabilities(struct Client* acptr)
   return(msgbuf);
 }
 
+/*
+ * The connect burst. server_estab() sends the servers, burst_run()
+ * then sends the clients and the channels a slice at a time from the
+ * main loop, holding off while the link's sendq is over half what its
+ * class allows. Every client goes before any channel, so a channel
+ * only ever names nicks the other side already has.
+ *
+ * Both lists are walked from the top, where new entries go with a
+ * higher serial than any before them. A client or channel added since
+ * the burst started reaches the link the usual way; one further down
+ * the list than the burst has got doesn't exist for the link yet, so
+ * burst_drops() keeps lines from or about it off the link and the
+ * burst sends it as it stands when it gets there. A local client is
+ * moved to the top when it registers, see relink_client().
+ */
+static int bursts;      /* links bursting, recounted by burst_run() */
+
+/*
+ * burst_knows_client - true if acptr exists for link
+ */
+static int burst_knows_client(struct Client* link, struct Client* acptr)
+{
+  struct Client* next = link->serv->burst_client;
+
+  return !next || acptr->from == link || acptr->serial > next->serial;
+}
+
+/*
+ * burst_knows_channel - true if chptr exists for link
+ */
+static int burst_knows_channel(struct Client* link, struct Channel* chptr)
+{
+  struct Channel* next = link->serv->burst_chan;
+
+  if (link->serv->burst_client)
+    return 0;
+  return !next || chptr->serial > next->serial;
+}
+
+/*
+ * burst_word - copy the next space separated word of a line to word
+ */
+static const char* burst_word(const char* p, const char* end,
+                              char* word, size_t size)
+{
+  size_t len = 0;
+
+  while (p < end && *p == ' ')
+    p++;
+  for ( ; p < end && *p != ' ' && *p != '\r' && *p != '\n'; p++)
+    if (len < size - 1)
+      word[len++] = *p;
+  word[len] = '\0';
+  return p;
+}
+
+/*
+ * burst_drops - return 1 if msg, about to be queued for link while its
+ * connect burst is running, comes from a client the link doesn't have
+ * yet or is about a client or channel it doesn't have. The other side
+ * would answer a line from a nick it doesn't know with a KILL.
+ */
+int burst_drops(struct Client* link, const char* msg, int len)
+{
+  char            word[BUFSIZE];
+  const char*     end = msg + len;
+  struct Client*  acptr;
+  struct Channel* chptr;
+  int             sjoin;
+  int             topic;
+
+  if (*msg == ':')
+    {
+      msg = burst_word(msg + 1, end, word, sizeof(word));
+      if ((acptr = hash_find_client(word, NULL)) && IsPerson(acptr) &&
+          !burst_knows_client(link, acptr))
+        return 1;
+    }
+  msg = burst_word(msg, end, word, sizeof(word));
+  sjoin = !irccmp(word, "SJOIN");
+  topic = !irccmp(word, "TOPIC");
+  msg = burst_word(msg, end, word, sizeof(word));
+  if (sjoin)
+    msg = burst_word(msg, end, word, sizeof(word));
+
+  if (*word == '#' || *word == '&')
+    {
+      if (!(chptr = hash_find_channel(word, NULL)) ||
+          burst_knows_channel(link, chptr))
+        return 0;
+      /* the SJOIN doesn't carry the topic, burst_topic() sends it */
+      if (topic)
+        chptr->burst_topic = CurrentTime;
+      return 1;
+    }
+  return (acptr = hash_find_client(word, NULL)) && IsPerson(acptr) &&
+         !burst_knows_client(link, acptr);
+}
+
+/*
+ * burst_del_client - acptr is coming off the client list, or moving to
+ * the top of it; step any burst that was going to send it next
+ */
+void burst_del_client(struct Client* acptr)
+{
+  struct Client* link;
+
+  if (!bursts)
+    return;
+  for (link = serv_cptr_list; link; link = link->next_server_client)
+    if (CBurst(link) && link->serv->burst_client == acptr)
+      link->serv->burst_client = acptr->next;
+}
+
+/*
+ * burst_del_channel - chptr is being freed; step any burst that was
+ * going to send it next
+ */
+void burst_del_channel(struct Channel* chptr)
+{
+  struct Client* link;
+
+  if (!bursts)
+    return;
+  for (link = serv_cptr_list; link; link = link->next_server_client)
+    if (CBurst(link) && link->serv->burst_chan == chptr)
+      link->serv->burst_chan = chptr->nextch;
+}
+
+/*
+ * burst_held - true while cptr has enough queued to be getting on with
+ */
+static int burst_held(struct Client* cptr)
+{
+  size_t queued = DBufLength(&cptr->sendQ);
+
+#ifdef ZIP_THREADS
+  queued += zip_pending(cptr);
+#endif
+  return IsDead(cptr) || queued > get_sendq(cptr) / 2;
+}
+
+/*
+ * burst_done - the burst to cptr is all sent
+ */
+static void burst_done(struct Client* cptr)
+{
+  cptr->flags2 &= ~FLAGS2_CBURST;
+
+#ifdef  ZIP_LINKS
+  /*
+  ** some stats about the connect burst,
+  ** they are slightly incorrect because of cptr->zip->outbuf,
+  ** and with ZIP_THREADS leave out what is still with a worker.
+  */
+  if ((cptr->flags2 & FLAGS2_ZIP) && cptr->zip->total_in)
+    sendto_realops("Connect burst to %s: %lu, compressed: %lu (%3.1f%%)",
+#ifdef HIDE_SERVERS_IPS
+                get_client_name(cptr, MASK_IP),
+#else
+                get_client_name(cptr, TRUE),
+#endif
+                cptr->zip->total_in, cptr->zip->total_out,
+                (100.0*(float)cptr->zip->total_out) /
+                (float)cptr->zip->total_in);
+#endif /* ZIP_LINKS */
+
+  /* Always send a PING after connect burst is done */
+  sendto_one(cptr, "PING :%s", me.name);
+
+#ifdef NEED_SPLITCODE
+#ifdef SPLIT_PONG
+  if (server_was_split)
+    got_server_pong = NO;
+#endif /* SPLIT_PONG */
+#endif /* NEED_SPLITCODE */
+}
+
+/*
+ * burst_topic - chptr has just been sent to link; if a TOPIC for it
+ * was kept off the link since it connected, send the topic as it is
+ * now. It goes from whoever set it if they are still on the channel,
+ * otherwise from a chanop, or any member if the channel isn't +t; the
+ * other side takes a TOPIC only from a member.
+ */
+static void burst_topic(struct Client* link, struct Channel* chptr)
+{
+  struct Client* acptr;
+  struct Client* from = NULL;
+  int            i;
+
+  if (chptr->burst_topic < link->firsttime)
+    return;
+#ifdef TOPIC_INFO
+  if ((acptr = find_person(chptr->topic_nick, NULL)) &&
+      acptr->from != link && IsMember(acptr, chptr))
+    from = acptr;
+#endif
+  for (i = 0; !from && i < chptr->memberc; i++)
+    {
+      acptr = chptr->memberv[i]->value.cptr;
+      if (acptr->from != link &&
+          ((chptr->memberv[i]->flags & CHFL_CHANOP) ||
+           !(chptr->mode.mode & MODE_TOPICLIMIT)))
+        from = acptr;
+    }
+  if (from)
+    sendto_one(link, ":%s TOPIC %s :%s", from->name, chptr->chname,
+               chptr->topic);
+}
+
+/*
+ * burst_run - send the next slice of each connect burst in progress.
+ * The walk steps past a client or channel before sending it, so the
+ * lines sending it get past burst_drops().
+ */
+void burst_run(void)
+{
+  struct Client*  cptr;
+  struct Client*  acptr;
+  struct Channel* chptr;
+  int             count = 0;
+  int             n;
+
+  if (!bursts)
+    return;
+  for (cptr = serv_cptr_list; cptr; cptr = cptr->next_server_client)
+    {
+      if (!CBurst(cptr))
+        continue;
+      for (n = 0; n < BURST_SLICE && !burst_held(cptr); n++)
+        {
+          if ((acptr = cptr->serv->burst_client))
+            {
+              if (!(cptr->serv->burst_client = acptr->next))
+                cptr->serv->burst_chan = channel;
+              if (acptr->from != cptr)
+                sendnick_TS(cptr, acptr);
+            }
+          else if ((chptr = cptr->serv->burst_chan))
+            {
+              cptr->serv->burst_chan = chptr->nextch;
+              send_channel_modes(cptr, chptr);
+              burst_topic(cptr, chptr);
+            }
+          if (!cptr->serv->burst_client && !cptr->serv->burst_chan)
+            {
+              burst_done(cptr);
+              break;
+            }
+        }
+      if (CBurst(cptr))
+        ++count;
+    }
+  bursts = count;
+}
+
+/*
+ * burst_waiting - true if a connect burst could go on right away
+ */
+int burst_waiting(void)
+{
+  struct Client* cptr;
+
+  if (!bursts)
+    return 0;
+  for (cptr = serv_cptr_list; cptr; cptr = cptr->next_server_client)
+    if (CBurst(cptr) && !burst_held(cptr))
+      return 1;
+  return 0;
+}
+
 int server_estab(struct Client *cptr)
 {
-  struct Channel*   chptr;
   struct Client*    acptr;
   struct ConfItem*  n_conf;
   struct ConfItem*  c_conf;
@@ -694,7 +985,7 @@ int server_estab(struct Client *cptr)
       cptr->flags2 |= (FLAGS2_ZIP|FLAGS2_ZIPFIRST);
     }
   else
-    ClearCap(cptr, CAP_ZIP);
+    ClearCap(cptr, CAP_ZIP | CAP_ZIPDICT);
 #endif /* ZIP_LINKS */
 
   sendto_one(cptr,"SVINFO %d %d 0 :%lu", TS_CURRENT, TS_MIN, CurrentTime);
@@ -737,7 +1028,7 @@ int server_estab(struct Client *cptr)
 
   fdlist_add(cptr->fd, FDL_SERVER | FDL_BUSY);
 
-  nextping = CurrentTime;
+  set_client_timer(cptr);
   /* ircd-hybrid-6 can do TS links, and  zipped links*/
   sendto_ops("Link with %s established: (%s) link",
              inpath,show_capabilities(cptr));
@@ -827,80 +1118,13 @@ int server_estab(struct Client *cptr)
     }
   
  
-      /*
-      ** Send it in the shortened format with the TS, if
-      ** it's a TS server; walk the list of channels, sending
-      ** all the nicks that haven't been sent yet for each
-      ** channel, then send the channel itself -- it's less
-      ** obvious than sending all nicks first, but on the
-      ** receiving side memory will be allocated more nicely
-      ** saving a few seconds in the handling of a split
-      ** -orabidoo
-      */
-
-  {
-    struct SLink* l;
-    static char   nickissent = 1;
-      
-    nickissent = 3 - nickissent;
-    /* flag used for each nick to check if we've sent it
-       yet - must be different each time and !=0, so we
-       alternate between 1 and 2 -orabidoo
-       */
-    for (chptr = channel; chptr; chptr = chptr->nextch)
-      {
-        for (l = chptr->members; l; l = l->next)
-          {
-            acptr = l->value.cptr;
-            if (acptr->nicksent != nickissent)
-              {
-                acptr->nicksent = nickissent;
-                if (acptr->from != cptr)
-                  sendnick_TS(cptr, acptr);
-              }
-          }
-	send_channel_modes(cptr, chptr);
-      }
-    /*
-    ** also send out those that are not on any channel
-    */
-    for (acptr = &me; acptr; acptr = acptr->prev)
-      if (acptr->nicksent != nickissent)
-        {
-          acptr->nicksent = nickissent;
-          if (acptr->from != cptr)
-            sendnick_TS(cptr, acptr);
-        }
-    }
-
-  cptr->flags2 &= ~FLAGS2_CBURST;
-
-#ifdef  ZIP_LINKS
   /*
-  ** some stats about the connect burst,
-  ** they are slightly incorrect because of cptr->zip->outbuf.
+  ** The clients and channels follow from the main loop, see
+  ** burst_run()
   */
-  if ((cptr->flags2 & FLAGS2_ZIP) && cptr->zip->out->total_in)
-    sendto_realops("Connect burst to %s: %lu, compressed: %lu (%3.1f%%)",
-#ifdef HIDE_SERVERS_IPS
-                get_client_name(cptr, MASK_IP),
-#else
-                get_client_name(cptr, TRUE),
-#endif
-                cptr->zip->out->total_in,cptr->zip->out->total_out,
-                (100.0*(float)cptr->zip->out->total_out) /
-                (float)cptr->zip->out->total_in);
-#endif /* ZIP_LINKS */
-
-  /* Always send a PING after connect burst is done */
-  sendto_one(cptr, "PING :%s", me.name);
-
-#ifdef NEED_SPLITCODE
-#ifdef SPLIT_PONG
-  if (server_was_split)
-    got_server_pong = NO;
-#endif /* SPLIT_PONG */
-#endif /* NEED_SPLITCODE */
+  cptr->serv->burst_client = GlobalClientList;
+  cptr->serv->burst_chan = NULL;
+  ++bursts;
 
   return 0;
 }
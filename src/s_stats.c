@@ -112,6 +112,12 @@ void tstats(struct Client *cptr, const char *name)
              me.name, RPL_STATSDEBUG, name, sp->is_num, sp->is_fake);
   sendto_one(cptr, ":%s %d %s :auth successes %u fails %u",
              me.name, RPL_STATSDEBUG, name, sp->is_asuc, sp->is_abad);
+#ifdef AUTH_CACHE
+  sendto_one(cptr, ":%s %d %s :dns cache hits %u negative %u misses %u",
+             me.name, RPL_STATSDEBUG, name, sp->is_dch, sp->is_dcn, sp->is_dcm);
+  sendto_one(cptr, ":%s %d %s :ident cache skips %u",
+             me.name, RPL_STATSDEBUG, name, sp->is_ich);
+#endif /* AUTH_CACHE */
   sendto_one(cptr, ":%s %d %s :local connections %u udp packets %u",
              me.name, RPL_STATSDEBUG, name, sp->is_loc, sp->is_udp);
   sendto_one(cptr, ":%s %d %s :Client Server",
@@ -0,0 +1,197 @@
+/************************************************************************
+ *   IRC - Internet Relay Chat, src/s_timer.c
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 1, or (at your option)
+ *   any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ * $Id$
+ */
+#include "s_timer.h"
+#include "ircd.h"
+
+#include <assert.h>
+#include <string.h>
+
+/*
+ * A hierarchical timer wheel. Level 0 has a slot for each of the next
+ * 64 seconds, level 1 a slot for each of the next 64 minutes-ish
+ * (64 second spans), and so on. A timer goes in the finest level that
+ * reaches its due time. Each time level 0 wraps, the next slot of
+ * level 1 is emptied and its timers spread over level 0 again, and so
+ * on up. Adding, moving and removing a timer is O(1) and timer_run()
+ * only ever handles the timers in the slots it passes over.
+ *
+ * Four levels reach 2^24 seconds (194 days); anything further out is
+ * parked in the last slot that does reach and put back when it comes
+ * round early.
+ */
+#define TIMER_BITS   6
+#define TIMER_SLOTS  (1 << TIMER_BITS)
+#define TIMER_MASK   (TIMER_SLOTS - 1)
+#define TIMER_LEVELS 4
+#define TIMER_REACH  ((time_t) 1 << (TIMER_BITS * TIMER_LEVELS))
+
+static struct Timer* wheel[TIMER_LEVELS][TIMER_SLOTS];
+static time_t        timer_now;         /* next second timer_run() does */
+
+static void timer_link(struct Timer* t)
+{
+  struct Timer** slot;
+  time_t         when = t->when;
+  time_t         delta;
+  int            level;
+
+  if (when < timer_now)
+    when = timer_now;
+  delta = when - timer_now;
+  if (delta >= TIMER_REACH)
+    {
+      delta = TIMER_REACH - 1;
+      when = timer_now + delta;
+    }
+
+  for (level = 0; level < TIMER_LEVELS - 1; ++level)
+    if (delta < ((time_t) 1 << (TIMER_BITS * (level + 1))))
+      break;
+
+  slot = &wheel[level][(when >> (TIMER_BITS * level)) & TIMER_MASK];
+  if ((t->next = *slot))
+    t->next->prev = &t->next;
+  t->prev = slot;
+  *slot = t;
+}
+
+static void timer_unlink(struct Timer* t)
+{
+  if ((*t->prev = t->next))
+    t->next->prev = t->prev;
+  t->next = 0;
+  t->prev = 0;
+}
+
+/*
+ * timer_cascade - spread the slot of level that is coming up over the
+ * levels below it. returns the slot index, 0 meaning the level above
+ * has wrapped too.
+ */
+static int timer_cascade(int level)
+{
+  struct Timer*  t;
+  struct Timer** slot;
+  int            index = (timer_now >> (TIMER_BITS * level)) & TIMER_MASK;
+
+  slot = &wheel[level][index];
+  while ((t = *slot))
+    {
+      timer_unlink(t);
+      timer_link(t);
+    }
+  return index;
+}
+
+/*
+ * timer_rebase - the clock jumped; pull every timer off the wheel and
+ * put it back relative to now
+ */
+static void timer_rebase(time_t now)
+{
+  struct Timer* all = 0;
+  struct Timer* t;
+  int           level;
+  int           i;
+
+  for (level = 0; level < TIMER_LEVELS; ++level)
+    for (i = 0; i < TIMER_SLOTS; ++i)
+      while ((t = wheel[level][i]))
+        {
+          timer_unlink(t);
+          t->next = all;
+          all = t;
+        }
+
+  timer_now = now;
+  while ((t = all))
+    {
+      all = t->next;
+      timer_link(t);
+    }
+}
+
+/*
+ * timer_init - set the handler a timer calls, with data, when due
+ */
+void timer_init(struct Timer* t, void (*handler)(void*), void* data)
+{
+  assert(!TimerPending(t));
+  memset(t, 0, sizeof(struct Timer));
+  t->handler = handler;
+  t->data    = data;
+}
+
+/*
+ * timer_add - (re)schedule t for when. A time that has already passed
+ * is run on the next timer_run().
+ */
+void timer_add(struct Timer* t, time_t when)
+{
+  assert(0 != t->handler);
+  if (!timer_now)
+    timer_now = CurrentTime;
+  if (TimerPending(t))
+    timer_unlink(t);
+  t->when = when;
+  timer_link(t);
+}
+
+void timer_del(struct Timer* t)
+{
+  if (TimerPending(t))
+    timer_unlink(t);
+}
+
+/*
+ * timer_run - call the handler of every timer due by now. A timer is
+ * off the wheel by the time its handler runs, so the handler may add
+ * it again or free whatever it is embedded in.
+ */
+void timer_run(time_t now)
+{
+  struct Timer*  t;
+  struct Timer** slot;
+  int            level;
+
+  if (!timer_now)
+    timer_now = now;
+  if (now < timer_now - 1 || now - timer_now > TIMER_SLOTS)
+    timer_rebase(now);
+
+  while (timer_now <= now)
+    {
+      if (!(timer_now & TIMER_MASK))
+        for (level = 1; level < TIMER_LEVELS; ++level)
+          if (timer_cascade(level))
+            break;
+
+      slot = &wheel[0][timer_now & TIMER_MASK];
+      while ((t = *slot))
+        {
+          timer_unlink(t);
+          if (t->when > timer_now)
+            timer_link(t);      /* was parked beyond the reach */
+          else
+            t->handler(t->data);
+        }
+      ++timer_now;
+    }
+}
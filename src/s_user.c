@@ -587,6 +587,7 @@ static int register_user(aClient *cptr, aClient *sptr,
             {
               SetRejectHold(cptr);
               reject_held_fds++;
+              set_client_timer(cptr);
               release_client_dns_reply(cptr);
               return 0;
             }
@@ -800,6 +801,7 @@ static int register_user(aClient *cptr, aClient *sptr,
     }
   add_client_to_llist(&(sptr->servptr->serv->users), sptr);
   sptr->servptr->serv->usercnt++;
+  add_to_user_domain_table(sptr);
 
 /* Increment our total user count here */
   if (++Count.total > Count.max_tot)
@@ -859,10 +861,11 @@ static int register_user(aClient *cptr, aClient *sptr,
         {
           sendto_one(sptr,"NOTICE %s :*** Notice -- server is currently in split-mode",nick);
         }
-
-      nextping = CurrentTime;
 #endif
 
+      add_to_domain_table(sptr);
+      set_client_timer(sptr);
+
 
     }
   else if (IsServer(cptr))
@@ -933,6 +936,7 @@ static int register_user(aClient *cptr, aClient *sptr,
       sptr->previous_local_client = (aClient *)NULL;
       sptr->next_local_client = local_cptr_list;
       local_cptr_list = sptr;
+      relink_client(sptr);
     }
   
   sendto_serv_butone(cptr, "NICK %s %d %lu %s %s %s %s :%s",
@@ -1039,6 +1043,7 @@ tell_user_off(aClient *cptr, char **preason )
     {
       SetRejectHold(cptr);
       reject_held_fds++;
+      set_client_timer(cptr);
 #endif
 
 #ifdef KLINE_WITH_REASON
@@ -1284,6 +1289,10 @@ static int nickkilldone(aClient *cptr, aClient *sptr, int parc,
   strcpy(sptr->name, nick);
   add_to_client_hash_table(nick, sptr);
 
+  /* cached ban verdicts were made against the old nick */
+  if (MyConnect(sptr))
+    memset(sptr->ban_cache, 0, sizeof(sptr->ban_cache));
+
   return 0;
 }
 
@@ -20,7 +20,11 @@
  */
 #include "client.h"
 #include "s_zip.h"
+#include "class.h"
+#include "ircd.h"
 #include "irc_string.h"
+#include "ircd_signal.h"
+#include "numeric.h"
 #include "packet.h"
 #include "s_bsd.h"
 #include "s_serv.h"
@@ -29,6 +33,18 @@
 
 #include <string.h>
 #include <stdlib.h>
+#include <time.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+
+#ifdef ZIP_THREADS
+#include "list.h"
+#include "s_log.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <unistd.h>
+#endif
 
 #ifdef  ZIP_LINKS
 /*
@@ -75,6 +91,616 @@
 static  char    unzipbuf[UNZIP_BUFFER_SIZE];
 static  char    zipbuf[ZIP_BUFFER_SIZE];
 
+/*
+ * The preset dictionary for links that both sent ZIPD in their CAPAB.
+ * It is there so the first lines of a link don't go out as literals:
+ * deflate looks back into it for matches from the first byte, with the
+ * end of it the cheapest to point at, so the commonest strings are last.
+ * Both ends must have the very same bytes, zlib refuses a stream made
+ * with any other dictionary; a different one needs a new capability.
+ */
+static const char zip_dict[] =
+  "SERVER SQUIT GNOTICE WALLOPS OPERWALL LOCOPS ENCAP KLINE GLINE "
+  " 301  311  312  313  317  318 End of /WHOIS list.  319 "
+  "Remote host closed the connection Read error: Connection reset by peer "
+  "Excess Flood Client Quit Ping timeout Quit: "
+  " KILL  INVITE  KICK # AWAY : TOPIC # PING : PONG "
+  " PART # QUIT : SJOIN  NICK  1 +i  MODE # +o  +v  +b "
+  " NOTICE  NOTICE # PRIVMSG  PRIVMSG #";
+
+/*
+ * zip_usec - CPU time used by this thread so far, in microseconds,
+ * or wall clock time where there is no per thread clock
+ */
+static unsigned long zip_usec(void)
+{
+#ifdef CLOCK_THREAD_CPUTIME_ID
+  struct timespec ts;
+
+  if (!clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts))
+    return ts.tv_sec * 1000000UL + ts.tv_nsec / 1000;
+#endif
+  {
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec * 1000000UL + tv.tv_usec;
+  }
+}
+
+/*
+ * inflate_dict - inflate(), handing zlib zip_dict when the stream
+ * asks for it at the start
+ */
+static int inflate_dict(struct Zdata* zd)
+{
+  z_stream* zin = zd->in;
+  int       r = inflate(zin, Z_NO_FLUSH);
+
+  if (Z_NEED_DICT == r && zd->dict)
+    {
+      r = inflateSetDictionary(zin, (const Bytef *) zip_dict,
+                               sizeof(zip_dict) - 1);
+      if (Z_OK == r && zin->avail_in)
+        r = inflate(zin, Z_NO_FLUSH);
+    }
+  return r;
+}
+
+/*
+ * zip_set_level - move zd's deflate stream to zd->want before the next
+ * deflate(). zlib finishes its block at the old level first, so next_out
+ * must already point at the output buffer; if that fails the level
+ * stays as it was and is tried again next time.
+ */
+static void zip_set_level(struct Zdata* zd, int want)
+{
+  z_stream* zout = zd->out;
+
+  zout->avail_in = 0;
+  if (deflateParams(zout, want, Z_DEFAULT_STRATEGY) == Z_OK)
+    zd->level = want;
+}
+
+#ifdef ZIP_THREADS
+/*
+ * Worker threads. A zipped link's data goes to the workers as jobs,
+ * queued on its Zdata in the order they were made. A link with jobs
+ * waits on the run queue until a worker takes it, and that worker has
+ * the link's streams to itself until it is through all the jobs it
+ * took, so a link's data is never worked on out of order, and several
+ * links are worked on at once. Results go on the link's done list and
+ * the link on the done queue, for zip_collect() to put on the sendQ or
+ * parse from the main loop, which is woken through a pipe.
+ *
+ * The job lists, the queues and the busy/queued/finished flags are
+ * under zip_lock; the streams belong to whichever thread has the link.
+ */
+#define ZIP_JOB_OUT     0       /* deflate, the result goes on the sendQ */
+#define ZIP_JOB_IN      1       /* inflate, the result gets parsed */
+#define ZIP_JOB_PLAIN   2       /* result: the input wasn't compressed */
+#define ZIP_JOB_ERROR   3       /* result: the stream failed */
+
+/* room for what a job inflates to at a time, the rest goes in more */
+#define ZIP_JOB_INFLATE (4 * ZIP_BUFFER_SIZE)
+
+struct ZipJob {
+  struct ZipJob* next;
+  int            type;
+  int            len;           /* bytes in data */
+  int            raw;           /* bytes it was before deflating */
+  int            level;         /* deflate level to use */
+  char           data[1];
+};
+
+static pthread_mutex_t zip_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t  zip_work = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t  zip_idle = PTHREAD_COND_INITIALIZER;
+static struct Zdata*   zip_run;         /* links with jobs, no worker */
+static struct Zdata*   zip_run_tail;
+static struct Zdata*   zip_done;        /* links with results */
+static struct Zdata*   zip_done_tail;
+static int             zip_wakeup[2] = { -1, -1 };
+static int             zip_workers;     /* threads running */
+
+/*
+ * zip_job - make a job with room for size bytes, NULL if out of memory
+ */
+static struct ZipJob* zip_job(int type, int size)
+{
+  struct ZipJob* job = malloc(sizeof(struct ZipJob) + size);
+
+  if (job)
+    {
+      job->next = NULL;
+      job->type = type;
+      job->len = 0;
+      job->raw = 0;
+      job->level = 0;
+    }
+  return job;
+}
+
+/*
+ * zip_free_jobs - free a list of jobs
+ */
+static void zip_free_jobs(struct ZipJob* job)
+{
+  struct ZipJob* next;
+
+  for ( ; job; job = next)
+    {
+      next = job->next;
+      free(job);
+    }
+}
+
+/*
+ * zip_deflate - deflate an ZIP_JOB_OUT job in place, by way of buf
+ */
+static void zip_deflate(struct Zdata* zd, struct ZipJob* job, char* buf)
+{
+  z_stream* zout = zd->out;
+
+  zout->next_out = (Bytef *) buf;
+  zout->avail_out = ZIP_BUFFER_SIZE;
+  if (job->level != zd->level)
+    zip_set_level(zd, job->level);
+  zout->next_in = (Bytef *) job->data;
+  zout->avail_in = job->len;
+
+  job->raw = job->len;
+  if (deflate(zout, Z_PARTIAL_FLUSH) != Z_OK || zout->avail_in)
+    {
+      job->type = ZIP_JOB_ERROR;
+      job->len = 0;
+      return;
+    }
+  job->len = ZIP_BUFFER_SIZE - zout->avail_out;
+  memcpy(job->data, buf, job->len);
+}
+
+/*
+ * zip_inflate - inflate a ZIP_JOB_IN job by way of buf, adding what it
+ * comes to onto the list at *tail and its size to *plain. Returns 0
+ * once the stream has failed.
+ */
+static int zip_inflate(struct Zdata* zd, struct ZipJob* job, char* buf,
+                       struct ZipJob*** tail, unsigned long* plain)
+{
+  z_stream*      zin = zd->in;
+  struct ZipJob* res;
+  int            first = 1;
+  int            r;
+  int            len;
+
+  zin->next_in = (Bytef *) job->data;
+  zin->avail_in = job->len;
+
+  for (;;)
+    {
+      zin->next_out = (Bytef *) buf;
+      zin->avail_out = ZIP_JOB_INFLATE;
+      r = inflate_dict(zd);
+      len = ZIP_JOB_INFLATE - zin->avail_out;
+
+      if (r == Z_DATA_ERROR && first && job->len >= 6 &&
+          !strncmp("ERROR ", job->data, 6))
+        {
+          /*
+           * the other server sent an error before it started to
+           * compress, see unzip_packet()
+           */
+          job->type = ZIP_JOB_PLAIN;
+          **tail = job;
+          *tail = &job->next;
+          return 0;
+        }
+      if (r != Z_OK && !(r == Z_BUF_ERROR && !zin->avail_in))
+        break;
+      first = 0;
+
+      if (len)
+        {
+          if (!(res = zip_job(ZIP_JOB_IN, len)))
+            break;
+          memcpy(res->data, buf, len);
+          res->len = len;
+          *plain += len;
+          **tail = res;
+          *tail = &res->next;
+        }
+      /* all of it read, and the last pass had room to spare */
+      if (!zin->avail_in && zin->avail_out)
+        {
+          free(job);
+          return 1;
+        }
+    }
+  job->type = ZIP_JOB_ERROR;
+  job->len = 0;
+  **tail = job;
+  *tail = &job->next;
+  return 0;
+}
+
+/*
+ * zip_worker - take links off the run queue and do their jobs
+ */
+static void* zip_worker(void* unused)
+{
+  static char    bufs[ZIP_THREADS][ZIP_JOB_INFLATE];
+  static int     count;
+  char*          buf;
+  struct Zdata*  zd;
+  struct ZipJob* jobs;
+  struct ZipJob* job;
+  struct ZipJob* results;
+  struct ZipJob** tail;
+  int            failed;
+  unsigned long  in_zipped;
+  unsigned long  in_plain;
+  unsigned long  out_usec;
+  unsigned long  in_usec;
+  unsigned long  start;
+
+  pthread_mutex_lock(&zip_lock);
+  buf = bufs[count++];
+  for (;;)
+    {
+      while (!zip_run)
+        pthread_cond_wait(&zip_work, &zip_lock);
+      zd = zip_run;
+      if (!(zip_run = zd->next_run))
+        zip_run_tail = NULL;
+      zd->next_run = NULL;
+      zd->queued = 0;
+      zd->busy = 1;
+      jobs = zd->todo;
+      zd->todo = zd->todo_tail = NULL;
+      failed = zd->failed;
+      pthread_mutex_unlock(&zip_lock);
+
+      results = NULL;
+      tail = &results;
+      in_zipped = in_plain = out_usec = in_usec = 0;
+      while ((job = jobs))
+        {
+          jobs = job->next;
+          job->next = NULL;
+          start = zip_usec();
+          if (failed)
+            free(job);
+          else if (ZIP_JOB_OUT == job->type)
+            {
+              zip_deflate(zd, job, buf);
+              failed = (ZIP_JOB_ERROR == job->type);
+              *tail = job;
+              tail = &job->next;
+              out_usec += zip_usec() - start;
+            }
+          else
+            {
+              in_zipped += job->len;
+              failed = !zip_inflate(zd, job, buf, &tail, &in_plain);
+              in_usec += zip_usec() - start;
+            }
+        }
+
+      pthread_mutex_lock(&zip_lock);
+      zd->in_zipped += in_zipped;
+      zd->in_plain += in_plain;
+      zd->out_usec += out_usec;
+      zd->in_usec += in_usec;
+      zd->failed = failed;
+      zd->busy = 0;
+      if (results)
+        {
+          if (zd->done_tail)
+            zd->done_tail->next = results;
+          else
+            zd->done = results;
+          for (job = results; job->next; job = job->next)
+            ;
+          zd->done_tail = job;
+          if (!zd->finished)
+            {
+              zd->finished = 1;
+              if (zip_done_tail)
+                zip_done_tail->next_done = zd;
+              else
+                {
+                  zip_done = zd;
+                  write(zip_wakeup[1], "", 1);
+                }
+              zip_done_tail = zd;
+            }
+        }
+      if (zd->todo)
+        {
+          zd->queued = 1;
+          if (zip_run_tail)
+            zip_run_tail->next_run = zd;
+          else
+            zip_run = zd;
+          zip_run_tail = zd;
+        }
+      pthread_cond_broadcast(&zip_idle);
+    }
+  return unused;
+}
+
+/*
+ * zip_threads_init - start the worker threads, zipping stays in the
+ * main loop if none will start
+ */
+void zip_threads_init(void)
+{
+  int i;
+  int err;
+
+  if (pipe(zip_wakeup) == -1)
+    {
+      ilog(L_ERROR, "zip_threads_init: pipe: %s", strerror(errno));
+      return;
+    }
+  set_non_blocking(zip_wakeup[0]);
+  set_non_blocking(zip_wakeup[1]);
+  netio_add(zip_wakeup[0], NETIO_ZIP, NULL, NETIO_READ);
+
+  for (i = 0; i < ZIP_THREADS; i++)
+    {
+      if ((err = ircd_thread_start(zip_worker, NULL)))
+        {
+          ilog(L_ERROR, "zip_threads_init: pthread_create: %s",
+               strerror(err));
+          break;
+        }
+      zip_workers++;
+    }
+}
+
+/*
+ * zip_submit - hand a job for zd to the workers
+ */
+static void zip_submit(struct Zdata* zd, struct ZipJob* job)
+{
+  pthread_mutex_lock(&zip_lock);
+  if (zd->todo_tail)
+    zd->todo_tail->next = job;
+  else
+    zd->todo = job;
+  zd->todo_tail = job;
+  if (!zd->busy && !zd->queued)
+    {
+      zd->queued = 1;
+      if (zip_run_tail)
+        zip_run_tail->next_run = zd;
+      else
+        zip_run = zd;
+      zip_run_tail = zd;
+      pthread_cond_signal(&zip_work);
+    }
+  pthread_mutex_unlock(&zip_lock);
+}
+
+/*
+ * zip_queue_out - hand what is in cptr->zip->outbuf to the workers
+ */
+static void zip_queue_out(struct Client* cptr)
+{
+  struct Zdata*  zd = cptr->zip;
+  struct ZipJob* job;
+
+  if (!zd->outcount)
+    return;
+  if (!(job = zip_job(ZIP_JOB_OUT, ZIP_BUFFER_SIZE)))
+    outofmemory();
+  memcpy(job->data, zd->outbuf, zd->outcount);
+  job->len = zd->outcount;
+  job->level = zd->want;
+  zd->pending += zd->outcount;
+  zd->outcount = 0;
+  zip_submit(zd, job);
+}
+
+/*
+ * zip_queue_in - hand compressed data read from cptr to the workers
+ */
+void zip_queue_in(struct Client* cptr, const char* buffer, int length)
+{
+  struct ZipJob* job;
+
+  if (length <= 0)
+    return;
+  if (!(job = zip_job(ZIP_JOB_IN, length)))
+    outofmemory();
+  memcpy(job->data, buffer, length);
+  job->len = length;
+  zip_submit(cptr->zip, job);
+}
+
+/*
+ * zip_pending - bytes of cptr's output still with the workers. Only
+ * the main loop touches the count, so it needs no lock.
+ */
+size_t zip_pending(struct Client* cptr)
+{
+  return (cptr->flags2 & FLAGS2_ZIP) ? cptr->zip->pending : 0;
+}
+
+/*
+ * zip_unqueue - take zd off the run and done queues, once no worker
+ * has it, and hand back its jobs and results. Called with zip_lock.
+ */
+static void zip_unqueue(struct Zdata* zd, struct ZipJob** todo,
+                        struct ZipJob** done)
+{
+  struct Zdata** p;
+
+  while (zd->busy)
+    pthread_cond_wait(&zip_idle, &zip_lock);
+  if (zd->queued)
+    {
+      for (p = &zip_run; *p != zd; p = &(*p)->next_run)
+        ;
+      if (!(*p = zd->next_run))
+        for (zip_run_tail = zip_run; zip_run_tail && zip_run_tail->next_run; )
+          zip_run_tail = zip_run_tail->next_run;
+      zd->queued = 0;
+    }
+  if (zd->finished)
+    {
+      for (p = &zip_done; *p != zd; p = &(*p)->next_done)
+        ;
+      if (!(*p = zd->next_done))
+        for (zip_done_tail = zip_done;
+             zip_done_tail && zip_done_tail->next_done; )
+          zip_done_tail = zip_done_tail->next_done;
+      zd->finished = 0;
+    }
+  zd->next_run = zd->next_done = NULL;
+  *todo = zd->todo;
+  *done = zd->done;
+  zd->todo = zd->todo_tail = NULL;
+  zd->done = zd->done_tail = NULL;
+}
+
+/*
+ * zip_drain - cptr is closing, put whatever the workers have of its
+ * output on the sendQ, so the last of it goes out before the close.
+ * Anything from here on is zipped in the main loop.
+ */
+void zip_drain(struct Client* cptr)
+{
+  struct Zdata*  zd = cptr->zip;
+  struct ZipJob* todo;
+  struct ZipJob* done;
+  struct ZipJob* job;
+  unsigned long  start;
+
+  if (!zd || zd->closing)
+    return;
+  pthread_mutex_lock(&zip_lock);
+  zip_unqueue(zd, &todo, &done);
+  zd->closing = 1;
+  pthread_mutex_unlock(&zip_lock);
+
+  for (job = done; job; job = job->next)
+    if (ZIP_JOB_OUT == job->type && !zd->failed)
+      dbuf_put(&cptr->sendQ, job->data, job->len);
+  for (job = todo; job; job = job->next)
+    if (ZIP_JOB_OUT == job->type && !zd->failed)
+      {
+        start = zip_usec();
+        zip_deflate(zd, job, zipbuf);
+        zd->out_usec += zip_usec() - start;
+        if (ZIP_JOB_ERROR == job->type)
+          zd->failed = 1;
+        else
+          dbuf_put(&cptr->sendQ, job->data, job->len);
+      }
+  zip_free_jobs(done);
+  zip_free_jobs(todo);
+  zd->pending = 0;
+}
+
+/*
+ * zip_forget - zd is being freed, drop whatever the workers have of it
+ */
+static void zip_forget(struct Zdata* zd)
+{
+  struct ZipJob* todo;
+  struct ZipJob* done;
+
+  if (!zip_workers)
+    return;
+  pthread_mutex_lock(&zip_lock);
+  zip_unqueue(zd, &todo, &done);
+  pthread_mutex_unlock(&zip_lock);
+  zip_free_jobs(todo);
+  zip_free_jobs(done);
+}
+
+/*
+ * zip_collect - take the results the workers have finished, a link at
+ * a time, putting output on the sendQ and parsing input. A link can go
+ * away while its input is parsed, or while another link's is, so each
+ * link's results are taken off its Zdata before any of them are used.
+ */
+void zip_collect(void)
+{
+  struct Client* cptr;
+  struct Zdata*  zd;
+  struct ZipJob* results;
+  struct ZipJob* job;
+  char           buf[64];
+  int            gone;
+
+  if (!zip_workers)
+    return;
+  while (read(zip_wakeup[0], buf, sizeof(buf)) > 0)
+    ;
+  for (;;)
+    {
+      pthread_mutex_lock(&zip_lock);
+      if (!(zd = zip_done))
+        {
+          pthread_mutex_unlock(&zip_lock);
+          break;
+        }
+      if (!(zip_done = zd->next_done))
+        zip_done_tail = NULL;
+      zd->next_done = NULL;
+      zd->finished = 0;
+      results = zd->done;
+      zd->done = zd->done_tail = NULL;
+      pthread_mutex_unlock(&zip_lock);
+
+      cptr = zd->client;
+      for (gone = 0; !gone && (job = results); free(job))
+        {
+          results = job->next;
+          switch (job->type)
+            {
+            case ZIP_JOB_OUT:
+              zd->pending -= job->raw;
+              zd->total_in += job->raw;
+              zd->total_out += job->len;
+              if (!IsDead(cptr) && !dbuf_put(&cptr->sendQ, job->data, job->len))
+                gone = (CLIENT_EXITED == exit_client(cptr, cptr, &me,
+                                            "Buffer allocation error"));
+              break;
+            case ZIP_JOB_IN:
+              gone = (CLIENT_EXITED == dopacket_unzipped(cptr, job->data,
+                                                         job->len));
+              break;
+            case ZIP_JOB_PLAIN:
+              if (IsCapable(cptr, CAP_ZIP))
+                {
+                  cptr->flags2 &= ~FLAGS2_ZIP;
+                  cptr->caps &= ~CAP_ZIP;
+                  gone = (CLIENT_EXITED == dopacket_unzipped(cptr, job->data,
+                                                             job->len));
+                  break;
+                }
+              /* no break */
+            default:
+              sendto_realops("%s error on %s", job->raw ? "deflate()" :
+                             "inflate()", cptr->name);
+              gone = (CLIENT_EXITED == exit_client(cptr, cptr, &me,
+                                 job->raw ? "fatal error in zip_buffer()" :
+                                 "fatal error in unzip_packet(1)"));
+              break;
+            }
+        }
+      zip_free_jobs(results);
+      if (!gone && !IsDead(cptr) && DBufLength(&cptr->sendQ))
+        send_queued(cptr);
+    }
+}
+#endif /* ZIP_THREADS */
+
 /*
 ** zip_init
 **      Initialize compression structures for a server.
@@ -85,6 +711,23 @@ int     zip_init(aClient *cptr)
   cptr->zip  = (aZdata *) MyMalloc(sizeof(aZdata));
   cptr->zip->incount = 0;
   cptr->zip->outcount = 0;
+  cptr->zip->total_in = 0;
+  cptr->zip->total_out = 0;
+  cptr->zip->in_zipped = 0;
+  cptr->zip->in_plain = 0;
+  cptr->zip->out_usec = 0;
+  cptr->zip->in_usec = 0;
+  cptr->zip->dict = IsCapable(cptr, CAP_ZIPDICT) ? 1 : 0;
+  cptr->zip->level = cptr->zip->want = ZIP_LEVEL;
+#ifdef ZIP_THREADS
+  cptr->zip->client = cptr;
+  cptr->zip->todo = cptr->zip->todo_tail = NULL;
+  cptr->zip->done = cptr->zip->done_tail = NULL;
+  cptr->zip->next_run = cptr->zip->next_done = NULL;
+  cptr->zip->busy = cptr->zip->queued = cptr->zip->finished = 0;
+  cptr->zip->failed = cptr->zip->closing = 0;
+  cptr->zip->pending = 0;
+#endif
 
   cptr->zip->in  = (z_stream *) MyMalloc(sizeof(z_stream));
   cptr->zip->in->total_in = 0;
@@ -106,6 +749,10 @@ int     zip_init(aClient *cptr)
   cptr->zip->out->data_type = Z_ASCII;
   if (deflateInit(cptr->zip->out, ZIP_LEVEL) != Z_OK)
     return -1;
+  if (cptr->zip->dict &&
+      deflateSetDictionary(cptr->zip->out, (const Bytef *) zip_dict,
+                           sizeof(zip_dict) - 1) != Z_OK)
+    return -1;
 
   return 0;
 }
@@ -118,6 +765,9 @@ void    zip_free(aClient *cptr)
   cptr->flags2 &= ~FLAGS2_ZIP;
   if (cptr->zip)
     {
+#ifdef ZIP_THREADS
+      zip_forget(cptr->zip);
+#endif
       if (cptr->zip->in)
         inflateEnd(cptr->zip->in);
       MyFree(cptr->zip->in);
@@ -142,6 +792,8 @@ char *unzip_packet(aClient *cptr, char *buffer, int *length)
   z_stream *zin = cptr->zip->in;
   int   r;
   char  *p;
+  int   carried = 0;
+  unsigned long start;
 
   if(cptr->zip->incount)
     {
@@ -151,6 +803,7 @@ char *unzip_packet(aClient *cptr, char *buffer, int *length)
        * -Dianora
        */
       memcpy((void *)unzipbuf,(void *)cptr->zip->inbuf,cptr->zip->incount);
+      carried = cptr->zip->incount;
       zin->avail_out = UNZIP_BUFFER_SIZE - cptr->zip->incount;
       zin->next_out = (Bytef *) (unzipbuf + cptr->zip->incount);
       cptr->zip->incount = 0;
@@ -172,9 +825,13 @@ char *unzip_packet(aClient *cptr, char *buffer, int *length)
       zin->avail_in = *length;
       zin->next_out = (Bytef *) unzipbuf;
       zin->avail_out = UNZIP_BUFFER_SIZE;
+      cptr->zip->in_zipped += *length;
     }
 
-  switch (r = inflate(zin, Z_NO_FLUSH))
+  start = zip_usec();
+  r = inflate_dict(cptr->zip);
+  cptr->zip->in_usec += zip_usec() - start;
+  switch (r)
     {
     case Z_OK:
       if (zin->avail_in)
@@ -255,6 +912,7 @@ char *unzip_packet(aClient *cptr, char *buffer, int *length)
         }
 
       *length = UNZIP_BUFFER_SIZE - zin->avail_out;
+      cptr->zip->in_plain += *length - carried;
       return unzipbuf;
 
     case Z_BUF_ERROR:
@@ -307,6 +965,7 @@ char *zip_buffer(aClient *cptr, char *buffer, int *length, int flush)
 {
   z_stream *zout = cptr->zip->out;
   int   r;
+  unsigned long start;
 
   if (buffer)
     {
@@ -322,12 +981,25 @@ char *zip_buffer(aClient *cptr, char *buffer, int *length, int flush)
                   CBurst(cptr))))
     return((char *)NULL);
 
-  zout->next_in = (Bytef *) cptr->zip->outbuf;
-  zout->avail_in = cptr->zip->outcount;
+#ifdef ZIP_THREADS
+  if (zip_workers && !cptr->zip->closing)
+    {
+      /* the result turns up on the sendQ by way of zip_collect() */
+      zip_queue_out(cptr);
+      return((char *)NULL);
+    }
+#endif
+  start = zip_usec();
   zout->next_out = (Bytef *) zipbuf;
   zout->avail_out = ZIP_BUFFER_SIZE;
+  if (cptr->zip->want != cptr->zip->level)
+    zip_set_level(cptr->zip, cptr->zip->want);
+  zout->next_in = (Bytef *) cptr->zip->outbuf;
+  zout->avail_in = cptr->zip->outcount;
 
-  switch (r = deflate(zout, Z_PARTIAL_FLUSH))
+  r = deflate(zout, Z_PARTIAL_FLUSH);
+  cptr->zip->out_usec += zip_usec() - start;
+  switch (r)
     {
     case Z_OK:
       if (zout->avail_in)
@@ -335,8 +1007,10 @@ char *zip_buffer(aClient *cptr, char *buffer, int *length, int flush)
           /* can this occur?? I hope not... */
           sendto_realops("deflate() didn't process all available data!");
         }
+      cptr->zip->total_in += cptr->zip->outcount;
       cptr->zip->outcount = 0;
       *length = ZIP_BUFFER_SIZE - zout->avail_out;
+      cptr->zip->total_out += *length;
       return zipbuf;
 
     default: /* error ! */
@@ -348,4 +1022,88 @@ char *zip_buffer(aClient *cptr, char *buffer, int *length, int flush)
   return((char *)NULL);
 }
 
+/*
+ * zip_report - tell an oper doing STATS ? how zipping to cptr is going
+ */
+void zip_report(aClient *sptr, const char *name, aClient *cptr)
+{
+  struct Zdata* zd = cptr->zip;
+  unsigned long in_zipped;
+  unsigned long in_plain;
+  unsigned long out_usec;
+  unsigned long in_usec;
+
+  if (!(cptr->flags2 & FLAGS2_ZIP))
+    return;
+#ifdef ZIP_THREADS
+  pthread_mutex_lock(&zip_lock);
+#endif
+  in_zipped = zd->in_zipped;
+  in_plain = zd->in_plain;
+  out_usec = zd->out_usec;
+  in_usec = zd->in_usec;
+#ifdef ZIP_THREADS
+  pthread_mutex_unlock(&zip_lock);
+#endif
+
+  /* ircsprintf() takes %lu for a time_t */
+  sendto_one(sptr, ":%s %d %s :%s zip level %d%s, out %.1fK to %.1fK "
+             "(%.1f%%) %.1fms, in %.1fK from %.1fK (%.1f%%) %.1fms",
+             me.name, RPL_STATSDEBUG, name, cptr->name, zd->want,
+             zd->dict ? " with dictionary" : "",
+             zd->total_in / 1024.0, zd->total_out / 1024.0,
+             zd->total_in ? 100.0 * zd->total_out / zd->total_in : 0.0,
+             out_usec / 1000.0,
+             in_plain / 1024.0, in_zipped / 1024.0,
+             in_plain ? 100.0 * in_zipped / in_plain : 0.0,
+             in_usec / 1000.0);
+}
+
+#ifdef ZIP_ADAPTIVE
+/*
+ * zip_adapt - pick the deflate level of every zipped link again, from
+ * the CPU the ircd used since last time (the worker threads' too) and
+ * how far behind each link is. It is lowered while CPU is short or a
+ * link is bursting, and raised for a link that can't keep up when
+ * there is CPU to spare. Called every ZIP_ADAPT_FREQ seconds.
+ */
+void zip_adapt(void)
+{
+  static struct timeval then;
+  static unsigned long  cpu_then;
+  struct rusage         ru;
+  struct timeval        now;
+  struct Client*        cptr;
+  unsigned long         cpu;
+  unsigned long         wall;
+  unsigned long         load;
+  size_t                queued;
+
+  getrusage(RUSAGE_SELF, &ru);
+  gettimeofday(&now, NULL);
+  cpu = (ru.ru_utime.tv_sec + ru.ru_stime.tv_sec) * 1000000UL +
+        ru.ru_utime.tv_usec + ru.ru_stime.tv_usec;
+  wall = (now.tv_sec - then.tv_sec) * 1000000UL + now.tv_usec - then.tv_usec;
+  load = (then.tv_sec && wall) ? (cpu - cpu_then) / (wall / 100 + 1) : 0;
+  then = now;
+  cpu_then = cpu;
+
+  for (cptr = serv_cptr_list; cptr; cptr = cptr->next_server_client)
+    {
+      if (!(cptr->flags2 & FLAGS2_ZIP))
+        continue;
+      queued = DBufLength(&cptr->sendQ);
+#ifdef ZIP_THREADS
+      queued += zip_pending(cptr);
+#endif
+      if (load >= ZIP_LOAD_HIGH || CBurst(cptr))
+        cptr->zip->want = ZIP_LEVEL_MIN;
+      else if (load < ZIP_LOAD_LOW && queued > get_sendq(cptr) / 8)
+        cptr->zip->want = ZIP_LEVEL_MAX;
+      else
+        cptr->zip->want = ZIP_LEVEL;
+    }
+}
+#endif /* ZIP_ADAPTIVE */
+
 #endif  /* ZIP_LINKS */
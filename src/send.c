@@ -43,20 +43,70 @@
 #include <stdarg.h>
 #include <time.h>
 #include <assert.h>
+#include <limits.h>
+#include <sys/uio.h>
 
 #define NEWLINE "\r\n"
 #define LOG_BUFSIZE 2048
 
+/*
+ * most dbufs send_queued() writes with one writev(), 64 is already
+ * more than a socket buffer usually takes
+ */
+#if defined(IOV_MAX) && (IOV_MAX < 64)
+#define SENDQ_IOV_MAX IOV_MAX
+#else
+#define SENDQ_IOV_MAX 64
+#endif
+
+/*
+ * a va_list can only be walked once, anything that formats the same
+ * arguments more than once has to work on a copy
+ */
+#ifndef va_copy
+#ifdef __va_copy
+#define va_copy(dst, src) __va_copy(dst, src)
+#else
+#define va_copy(dst, src) memcpy(&(dst), &(src), sizeof(va_list))
+#endif
+#endif
+
 static  char    sendbuf[2048];
 static  int     send_message (aClient *, char *, int);
+static  int     queue_message (aClient *, char *, int, struct DBufBlock *);
+static  void    send_shared (aClient *, char *, int, struct DBufBlock **);
 
 static  void vsendto_prefix_one(aClient *, aClient *, const char *, va_list);
+static  int  format_prefix_line(char *, aClient *, int, const char *, va_list);
+static  int  format_prefix_linef(char *, aClient *, int, const char *, ...);
 static  void vsendto_one(aClient *, const char *, va_list);
 static  void vsendto_realops(const char *, va_list);
 
 static  unsigned long sentalong[MAXCONNECTIONS];
 static unsigned long current_serial=0L;
 
+/*
+ * connections with output waiting, so flush_connections() doesn't have
+ * to look at every descriptor. A connection is put here by send_message()
+ * when its queue goes from empty to non-empty, and dropped by
+ * flush_connections() once everything has been written.
+ */
+static  int           sendq_fds[MAXCONNECTIONS];
+static  int           sendq_count = 0;
+static  unsigned char sendq_queued[MAXCONNECTIONS];
+
+#ifdef ZIP_THREADS
+#define HasPendingOutput(x) (DBufLength(&(x)->sendQ) > 0 || \
+                             (((x)->flags2 & FLAGS2_ZIP) && \
+                              ((x)->zip->outcount > 0 || zip_pending(x))))
+#elif defined(ZIP_LINKS)
+#define HasPendingOutput(x) (DBufLength(&(x)->sendQ) > 0 || \
+                             (((x)->flags2 & FLAGS2_ZIP) && \
+                              (x)->zip->outcount > 0))
+#else
+#define HasPendingOutput(x) (DBufLength(&(x)->sendQ) > 0)
+#endif
+
 void vsendto_anywhere(struct Client *, struct Client *, const char *, va_list);
 
 /*
@@ -80,6 +130,9 @@ dead_link(aClient *to, char *notice)
 
 {
   to->flags |= FLAGS_DEADSOCKET;
+  /* have its timer exit it on the next pass of the main loop */
+  if (-1 < to->fd && local[to->fd] == to)
+    timer_add(&to->timer, CurrentTime);
 
   /*
    * If because of BUFFERPOOL problem then clean dbuf's now so that
@@ -107,10 +160,31 @@ void flush_connections(struct Client* cptr)
 {
   if (0 == cptr) {
     int i;
-    for (i = highest_fd; i >= 0; --i) {
-      if ((cptr = local[i]) && DBufLength(&cptr->sendQ) > 0)
-        send_queued(cptr);
+    int fd;
+    int kept = 0;
+    /*
+     * sending can queue output for other connections (notices to
+     * opers), those are appended and picked up by this same pass
+     */
+    for (i = 0; i < sendq_count; ++i) {
+      fd = sendq_fds[i];
+      if ((cptr = local[fd]) && HasPendingOutput(cptr)) {
+#ifdef USE_EPOLL
+        /*
+         * a blocked socket is written from read_message() once
+         * the kernel says it is writable again
+         */
+        if (!(cptr->flags & FLAGS_BLOCKED))
+#endif
+          send_queued(cptr);
+        if (local[fd] == cptr && HasPendingOutput(cptr)) {
+          sendq_fds[kept++] = fd;
+          continue;
+        }
+      }
+      sendq_queued[fd] = 0;
     }
+    sendq_count = kept;
   }
   else if (-1 < cptr->fd && DBufLength(&cptr->sendQ) > 0)
     send_queued(cptr);
@@ -130,6 +204,32 @@ void flush_connections(struct Client* cptr)
 */
 static int
 send_message(aClient *to, char *msg, int len)
+{
+        return queue_message(to, msg, len, NULL);
+} /* send_message() */
+
+/*
+** send_shared
+**      send_message() for a line that goes to many recipients. The
+**      first call makes a shared block of msg in *block, later ones
+**      queue a reference to it instead of another copy. The caller
+**      drops its own reference with dbuf_block_release() when done.
+*/
+static void
+send_shared(aClient *to, char *msg, int len, struct DBufBlock **block)
+{
+        if (*block == NULL)
+                *block = dbuf_block_make(msg, len);
+        (void)queue_message(to, msg, len, *block);
+} /* send_shared() */
+
+/*
+** queue_message
+**      Backend of send_message(). If block is not NULL it holds a copy
+**      of msg that can be queued by reference.
+*/
+static int
+queue_message(aClient *to, char *msg, int len, struct DBufBlock *block)
 {
         static int SQinK;
 
@@ -148,6 +248,15 @@ send_message(aClient *to, char *msg, int len)
         if (IsDead(to))
                 return 0; /* This socket has already been marked as dead */
 
+        if (CBurst(to) && burst_drops(to, msg, len))
+                return 0; /* not for a link still being told about it */
+
+        if (!sendq_queued[to->fd])
+        {
+                sendq_queued[to->fd] = 1;
+                sendq_fds[sendq_count++] = to->fd;
+        }
+
         if (DBufLength(&to->sendQ) > get_sendq(to))
         {
                 if (IsServer(to))
@@ -159,19 +268,9 @@ send_message(aClient *to, char *msg, int len)
 #endif				
                                 DBufLength(&to->sendQ), get_sendq(to));
 
-                if (IsDoingList(to)) {
-      /* Pop the sendq for this message */
-      /*if (!IsAnOper(to))
-        sendto_realops("LIST blocked for %s", get_client_name(to, FALSE)); */
-      SetSendqPop(to);
-      return 0;
-    }
-                else
-      {
-        if (IsClient(to))
-          to->flags |= FLAGS_SENDQEX;
-        return dead_link(to, "Max Sendq exceeded");
-      }
+                if (IsClient(to))
+                        to->flags |= FLAGS_SENDQEX;
+                return dead_link(to, "Max Sendq exceeded");
         }
         else
         {
@@ -184,12 +283,17 @@ send_message(aClient *to, char *msg, int len)
                 ** be empty and to->zip->outbuf not empty.
                 */
                 if (to->flags2 & FLAGS2_ZIP)
+                {
                         msg = zip_buffer(to, msg, &len, 0);
+                        block = NULL;
+                }
 
-                if (len && !dbuf_put(&to->sendQ, msg, len))
+                if (len && !(block ? dbuf_put_block(&to->sendQ, block) :
+                                     dbuf_put(&to->sendQ, msg, len)))
 
         #else /* ZIP_LINKS */
-		if (!dbuf_put(&to->sendQ, msg, len))
+		if (!(block ? dbuf_put_block(&to->sendQ, block) :
+                              dbuf_put(&to->sendQ, msg, len)))
 
         #endif /* ZIP_LINKS */
 
@@ -228,7 +332,7 @@ send_message(aClient *to, char *msg, int len)
                         send_queued(to);
         }
         return 0;
-} /* send_message() */
+} /* queue_message() */
 
 /*
 ** send_queued
@@ -271,33 +375,31 @@ int send_queued(aClient *to)
       if (len == -1)
         return dead_link(to, "fatal error in zip_buffer()");
 
-      if (!dbuf_put(&to->sendQ, msg, len))
+      /* nothing back yet if a zip worker has it */
+      if (len && !dbuf_put(&to->sendQ, msg, len))
         return dead_link(to, "Buffer allocation error for %s");
     }
   } /* if ((to->flags2 & FLAGS2_ZIP) && to->zip->outcount) */
 #endif /* ZIP_LINKS */
 
   while (DBufLength(&to->sendQ) > 0) {
-    msg = dbuf_map(&to->sendQ, (size_t *) &len);
+    struct iovec iov[SENDQ_IOV_MAX];
+    int          count;
+    size_t       mlen;
+
+    /*
+     * hand the kernel as much of the queue as it will take
+     * in one go, rather than one dbuf at a time
+     */
+    count = dbuf_map_iov(&to->sendQ, iov, SENDQ_IOV_MAX, &mlen);
+    len = (int) mlen;
 
     /* Returns always len > 0 */
-    if ((rlen = deliver_it(to, msg, len)) < 0)
+    if ((rlen = deliver_it_iov(to, iov, count)) < 0)
       return dead_link(to,"Write error to %s, closing link");
 
     dbuf_delete(&to->sendQ, rlen);
     to->lastsq = DBufLength(&to->sendQ) / 1024;
-    /* 
-     * sendq is now empty.. if there a blocked list?
-     */
-    if (IsSendqPopped(to) && (DBufLength(&to->sendQ) == 0)) {
-      char* parv[2];
-      char  param[HOSTLEN + 1];
-      ClearSendqPop(to);
-      parv[0] = param;
-      parv[1] = 0;
-      strcpy(param, to->name);
-      m_list(to, to, 1, parv);
-    }
     if (rlen < len) {    
       /* ..or should I continue until rlen==0? */
       /* no... rlen==0 means the send returned EWOULDBLOCK... */
@@ -316,7 +418,7 @@ int send_queued(aClient *to)
       if (len == -1)
         return dead_link(to, "fatal error in zip_buffer()");
 
-      if (!dbuf_put(&to->sendQ, msg, len))
+      if (len && !dbuf_put(&to->sendQ, msg, len))
         return dead_link(to, "Buffer allocation error for %s");
     } /* if (DBufLength(&to->sendQ) == 0 && more) */
 #endif /* ZIP_LINKS */      
@@ -370,7 +472,13 @@ vsendto_one(aClient *to, const char *pattern, va_list args)
       return;
     }
 
-  len = vsprintf_irc(sendbuf, pattern, args);
+  {
+    va_list ap;
+
+    va_copy(ap, args);
+    len = vsprintf_irc(sendbuf, pattern, ap);
+    va_end(ap);
+  }
 
   /*
    * from rfc1459
@@ -417,6 +525,15 @@ vsendto_one(aClient *to, const char *pattern, va_list args)
         (void)send_message(to, sendbuf, len);
 } /* vsendto_one() */
 
+/*
+ * sendto_channel_butone
+ *
+ * Send a message to all members of a channel, except those behind 'one'.
+ * The line is formatted at most twice, once with the full
+ * nick!user@host prefix for our own clients and once for server links,
+ * and then the same buffer is queued for every recipient.
+ */
+
 void
 sendto_channel_butone(aClient *one, aClient *from, aChannel *chptr, 
                       const char *pattern, ...)
@@ -424,16 +541,24 @@ sendto_channel_butone(aClient *one, aClient *from, aChannel *chptr,
 {
   va_list       args;
   Link *lp;
+  int idx;
   aClient *acptr;
   /* index of sentalong[] to flag client as having received message */
   int lindex;
+  char local_buf[1024];
+  char remote_buf[1024];
+  int local_len = 0;
+  int remote_len = 0;
+  struct DBufBlock *local_block = NULL;
+  struct DBufBlock *remote_block = NULL;
 
   va_start(args, pattern);
 
   ++current_serial;
   
-  for (lp = chptr->members; lp; lp = lp->next)
+  for (idx = 0; idx < chptr->memberc; idx++)
     {
+      lp = chptr->memberv[idx];
       acptr = lp->value.cptr;
       
       if (acptr->from == one)
@@ -442,7 +567,9 @@ sendto_channel_butone(aClient *one, aClient *from, aChannel *chptr,
       lindex = acptr->from->fd;
       if (MyConnect(acptr) && IsRegisteredUser(acptr))
         {
-          vsendto_prefix_one(acptr, from, pattern, args);
+          if (0 == local_len)
+            local_len = format_prefix_line(local_buf, from, 1, pattern, args);
+          send_shared(acptr, local_buf, local_len, &local_block);
           sentalong[lindex] = current_serial;
         }
       else
@@ -453,12 +580,30 @@ sendto_channel_butone(aClient *one, aClient *from, aChannel *chptr,
            */
           if(sentalong[lindex] != current_serial)
             {
-              vsendto_prefix_one(acptr, from, pattern, args);
               sentalong[lindex] = current_serial;
+
+              /*
+               * going back the way it came, leave it to
+               * vsendto_prefix_one() to sort out the ghost
+               */
+              if (!MyClient(from) && IsPerson(acptr) &&
+                  (acptr->from == from->from))
+                {
+                  vsendto_prefix_one(acptr, from, pattern, args);
+                  continue;
+                }
+              if (0 == remote_len)
+                remote_len = format_prefix_line(remote_buf, from, 0,
+                                                pattern, args);
+              send_shared(acptr, remote_buf, remote_len, &remote_block);
             }
         }
     }
 
+  if (local_block)
+    dbuf_block_release(local_block);
+  if (remote_block)
+    dbuf_block_release(remote_block);
   va_end(args);
 } /* sendto_channel_butone() */
 
@@ -471,9 +616,16 @@ sendto_channel_type(aClient *one, aClient *from, aChannel *chptr,
 
 {
   Link *lp;
+  int idx;
   aClient *acptr;
   int i;
   char char_type;
+  char local_buf[1024];
+  char remote_buf[1024];
+  int local_len = 0;
+  int remote_len = 0;
+  struct DBufBlock *local_block = NULL;
+  struct DBufBlock *remote_block = NULL;
 
   ++current_serial;
 
@@ -482,8 +634,9 @@ sendto_channel_type(aClient *one, aClient *from, aChannel *chptr,
   else
     char_type = '+';
 
-  for (lp = chptr->members; lp; lp = lp->next)
+  for (idx = 0; idx < chptr->memberc; idx++)
     {
+      lp = chptr->memberv[idx];
       if (!(lp->flags & type))
         continue;
 
@@ -494,13 +647,15 @@ sendto_channel_type(aClient *one, aClient *from, aChannel *chptr,
       i = acptr->from->fd;
       if (MyConnect(acptr) && IsRegisteredUser(acptr))
         {
-          sendto_prefix_one(acptr, from,
+          if (0 == local_len)
+            local_len = format_prefix_linef(local_buf, from, 1,
                   ":%s %s %c%s :%s",
                   from->name,
                   cmd,                    /* PRIVMSG or NOTICE */
                   char_type,              /* @ or + */
                   nick,
                   message);
+          send_shared(acptr, local_buf, local_len, &local_block);
         }
       else
         {
@@ -532,18 +687,34 @@ sendto_channel_type(aClient *one, aClient *from, aChannel *chptr,
                */
               if (sentalong[i] != current_serial)
                 {
-                  sendto_prefix_one(acptr, from,
-                  ":%s NOTICE %c%s :%s",
-                  from->name,
-                  char_type,
-                  nick,
-                  message);
+                  if (!MyClient(from) && (acptr->from == from->from))
+                    sendto_prefix_one(acptr, from,
+                    ":%s NOTICE %c%s :%s",
+                    from->name,
+                    char_type,
+                    nick,
+                    message);
+                  else
+                    {
+                      if (0 == remote_len)
+                        remote_len = format_prefix_linef(remote_buf, from, 0,
+                                ":%s NOTICE %c%s :%s",
+                                from->name,
+                                char_type,
+                                nick,
+                                message);
+                      send_shared(acptr, remote_buf, remote_len, &remote_block);
+                    }
                   sentalong[i] = current_serial;
                 }
             }
         }
-      } /* for (lp = chptr->members; lp; lp = lp->next) */
+      } /* for (idx = 0; idx < chptr->memberc; idx++) */
 
+  if (local_block)
+    dbuf_block_release(local_block);
+  if (remote_block)
+    dbuf_block_release(remote_block);
 } /* sendto_channel_type() */
 
 
@@ -559,11 +730,13 @@ sendto_channel_type_notice(aClient *from, aChannel *chptr, int type, char *messa
 
 {
         Link *lp;
+        int idx;
         aClient *acptr;
         int i;
 
-        for (lp = chptr->members; lp; lp = lp->next)
+        for (idx = 0; idx < chptr->memberc; idx++)
         {
+                lp = chptr->memberv[idx];
                 if (!(lp->flags & type))
                         continue;
 
@@ -588,13 +761,15 @@ send_knock(aClient *sptr, aClient *cptr, aChannel *chptr, int type,
            char *message, char *key)
 {
   Link *lp;
+  int idx;
   aClient *acptr;
   int lindex;
 
   current_serial++;
   
-  for(lp = chptr->members; lp; lp = lp->next)
+  for(idx = 0; idx < chptr->memberc; idx++)
   {
+    lp = chptr->memberv[idx];
     if(!(lp->flags & type))
       continue;
 
@@ -667,8 +842,11 @@ sendto_common_channels(aClient *user, const char *pattern, ...)
 {
   va_list args;
   Link *channels;
-  Link *users;
+  int idx;
   aClient *cptr;
+  char buf[1024];
+  int len = 0;
+  struct DBufBlock *block = NULL;
 
   va_start(args, pattern);
   
@@ -679,9 +857,9 @@ sendto_common_channels(aClient *user, const char *pattern, ...)
   if (user->user)
     {
       for (channels = user->user->channel; channels; channels = channels->next)
-        for(users = channels->value.chptr->members; users; users = users->next)
+        for (idx = 0; idx < channels->value.chptr->memberc; idx++)
           {
-            cptr = users->value.cptr;
+            cptr = channels->value.chptr->memberv[idx]->value.cptr;
           /* "dead" clients i.e. ones with fd == -1 should not be
            * looked at -db
            */
@@ -691,16 +869,71 @@ sendto_common_channels(aClient *user, const char *pattern, ...)
             
             sentalong[cptr->fd] = current_serial;
             
-            vsendto_prefix_one(cptr, user, pattern, args);
+            if (0 == len)
+              len = format_prefix_line(buf, user, 1, pattern, args);
+            send_shared(cptr, buf, len, &block);
           }
     }
 
   if (MyConnect(user))
-    vsendto_prefix_one(user, user, pattern, args);
+    {
+      if (0 == len)
+        len = format_prefix_line(buf, user, 1, pattern, args);
+      send_shared(user, buf, len, &block);
+    }
 
+  if (block)
+    dbuf_block_release(block);
   va_end(args);
 } /* sendto_common_channels() */
 
+/*
+ * sendto_split_channels()
+ *
+ * Sends a message to the local users on the same channels as user, a
+ * remote user leaving in a netsplit, once each. The local members of
+ * each channel are already gathered in locals, see remove_split_users().
+ */
+
+void
+sendto_split_channels(aClient *user, aClient **locals, const char *pattern, ...)
+
+{
+  va_list args;
+  Link *channels;
+  aChannel *chptr;
+  int idx;
+  aClient *cptr;
+  char buf[1024];
+  int len = 0;
+  struct DBufBlock *block = NULL;
+
+  va_start(args, pattern);
+
+  ++current_serial;
+
+  for (channels = user->user->channel; channels; channels = channels->next)
+    {
+      chptr = channels->value.chptr;
+      for (idx = 0; idx < chptr->split_nlocal; idx++)
+        {
+          cptr = locals[chptr->split_local + idx];
+          if (sentalong[cptr->fd] == current_serial)
+            continue;
+
+          sentalong[cptr->fd] = current_serial;
+
+          if (0 == len)
+            len = format_prefix_line(buf, user, 1, pattern, args);
+          send_shared(cptr, buf, len, &block);
+        }
+    }
+
+  if (block)
+    dbuf_block_release(block);
+  va_end(args);
+} /* sendto_split_channels() */
+
 /*
  * sendto_channel_butserv
  *
@@ -715,14 +948,24 @@ sendto_channel_butserv(aChannel *chptr, aClient *from,
 {
   va_list args;
   Link *lp;
+  int idx;
   aClient *acptr;
+  char buf[1024];
+  int len = 0;
+  struct DBufBlock *block = NULL;
 
   va_start(args, pattern);
 
-  for (lp = chptr->members; lp; lp = lp->next)
-    if (MyConnect(acptr = lp->value.cptr))
-      vsendto_prefix_one(acptr, from, pattern, args);
+  for (idx = 0; idx < chptr->memberc; idx++)
+    if (MyConnect(acptr = (lp = chptr->memberv[idx])->value.cptr))
+      {
+        if (0 == len)
+          len = format_prefix_line(buf, from, 1, pattern, args);
+        send_shared(acptr, buf, len, &block);
+      }
   
+  if (block)
+    dbuf_block_release(block);
   va_end(args);
 } /* sendto_channel_butserv() */
 
@@ -740,17 +983,25 @@ sendto_channel_chanops_butserv(aChannel *chptr, aClient *from,
 {
   va_list args;
   Link *lp;
+  int idx;
   aClient *acptr;
+  char buf[1024];
+  int len = 0;
+  struct DBufBlock *block = NULL;
 
   va_start(args, pattern);
 
-  for (lp = chptr->members; lp; lp = lp->next)
-    if (MyConnect(acptr = lp->value.cptr))
-      if(is_chan_op(acptr,chptr))
+  for (idx = 0; idx < chptr->memberc; idx++)
+    if (MyConnect(acptr = (lp = chptr->memberv[idx])->value.cptr))
+      if (lp->flags & CHFL_CHANOP)
 	{
-	  vsendto_prefix_one(acptr, from, pattern, args);
+	  if (0 == len)
+	    len = format_prefix_line(buf, from, 1, pattern, args);
+	  send_shared(acptr, buf, len, &block);
 	}
   
+  if (block)
+    dbuf_block_release(block);
   va_end(args);
 
 } /* sendto_channel_butserv() */
@@ -768,17 +1019,25 @@ sendto_channel_non_chanops_butserv(aChannel *chptr, aClient *from,
 {
   va_list args;
   Link *lp;
+  int idx;
   aClient *acptr;
+  char buf[1024];
+  int len = 0;
+  struct DBufBlock *block = NULL;
 
   va_start(args, pattern);
 
-  for (lp = chptr->members; lp; lp = lp->next)
-    if (MyConnect(acptr = lp->value.cptr))
-      if(!is_chan_op(acptr,chptr))
+  for (idx = 0; idx < chptr->memberc; idx++)
+    if (MyConnect(acptr = (lp = chptr->memberv[idx])->value.cptr))
+      if (!(lp->flags & CHFL_CHANOP))
 	{
-	  vsendto_prefix_one(acptr, from, pattern, args);
+	  if (0 == len)
+	    len = format_prefix_line(buf, from, 1, pattern, args);
+	  send_shared(acptr, buf, len, &block);
 	}
   
+  if (block)
+    dbuf_block_release(block);
   va_end(args);
 
 } /* sendto_channel_butserv() */
@@ -897,7 +1156,13 @@ vsendto_anywhere(struct Client *to, struct Client *from,
   else len = ircsprintf(buffer, ":%s ",
                         from->name);
   ptr+=len;
-  vsprintf(ptr, pattern, args);
+  {
+    va_list ap;
+
+    va_copy(ap, args);
+    vsprintf(ptr, pattern, ap);
+    va_end(ap);
+  }
 
   sendto_one(send_to, "%s", buffer);
 }
@@ -1320,9 +1585,7 @@ vsendto_prefix_one(aClient *to, aClient *from,
                    const char *pattern, va_list args)
 
 {
-  static char sender[HOSTLEN + NICKLEN + USERLEN + 5];
-  char* par = 0;
-  int parlen, len;
+  int len;
   static char outbuf[1024];
 
   assert(0 != to);
@@ -1333,7 +1596,11 @@ vsendto_prefix_one(aClient *to, aClient *from,
     {
       if (IsServer(from))
         {
-          vsprintf_irc(outbuf, pattern, args);
+          va_list ap;
+
+          va_copy(ap, args);
+          vsprintf_irc(outbuf, pattern, ap);
+          va_end(ap);
           
           sendto_realops(
                      "Send message (%s) to %s[%s] dropped from %s(Fake Dir)",
@@ -1362,7 +1629,36 @@ vsendto_prefix_one(aClient *to, aClient *from,
       return;
     } /* if (!MyClient(from) && IsPerson(to) && (to->from == from->from)) */
   
-  par = va_arg(args, char *);
+  len = format_prefix_line(outbuf, from, MyClient(to), pattern, args);
+
+  Debug((DEBUG_SEND,"Sending [%s] to %s",outbuf,to->name));
+
+  send_message(to, outbuf, len);
+} /* vsendto_prefix_one() */
+
+/*
+ * format_prefix_line()
+ * Build the wire form of a ":%s COMMAND <other args>" pattern into buf,
+ * as vsendto_prefix_one() would send it. If the first argument is the
+ * name of 'from' it is expanded to nick!user@host when 'local' is set,
+ * that is for clients connected to us, and left as the bare nick for
+ * server links. args is not consumed, so the caller can build the
+ * other form from the same arguments.
+ * Returns the length of the line including the trailing CR-LF.
+ */
+static int
+format_prefix_line(char *buf, aClient *from, int local,
+                   const char *pattern, va_list args)
+
+{
+  char sender[HOSTLEN + NICKLEN + USERLEN + 5];
+  char* par;
+  int parlen, len;
+  va_list ap;
+
+  va_copy(ap, args);
+
+  par = va_arg(ap, char *);
   if(!irccmp(par, from->name))
     {
       int l = 0;
@@ -1373,7 +1669,7 @@ vsendto_prefix_one(aClient *to, aClient *from,
       l = ircsprintf(cp, "%s", from->name);
       cp += l;
 
-      if(MyClient(to) && IsPerson(from))
+      if(local && IsPerson(from))
       {
         if (*from->username)
   	{
@@ -1391,33 +1687,46 @@ vsendto_prefix_one(aClient *to, aClient *from,
       par = sender;
     } /* if (user) */
 
-  *outbuf = ':';
-  strncpy_irc(outbuf + 1, par, sizeof(sendbuf) - 2);
+  *buf = ':';
+  strncpy_irc(buf + 1, par, sizeof(sender));
 
   parlen = strlen(par) + 1;
-  outbuf[parlen++] = ' ';
+  buf[parlen++] = ' ';
 
   len = parlen;
-  len += vsprintf_irc(outbuf + parlen, &pattern[4], args);
+  len += vsprintf_irc(buf + parlen, &pattern[4], ap);
+  va_end(ap);
 
   if (len > 510)
   {
-    outbuf[510] = '\r';
-    outbuf[511] = '\n';
-    outbuf[512] = '\0';
+    buf[510] = '\r';
+    buf[511] = '\n';
+    buf[512] = '\0';
     len = 512;
   }
   else
   {
-    outbuf[len++] = '\r';
-    outbuf[len++] = '\n';
-    outbuf[len] = '\0';
+    buf[len++] = '\r';
+    buf[len++] = '\n';
+    buf[len] = '\0';
   }
+  return len;
+} /* format_prefix_line() */
 
-  Debug((DEBUG_SEND,"Sending [%s] to %s",outbuf,to->name));
+static int
+format_prefix_linef(char *buf, aClient *from, int local,
+                    const char *pattern, ...)
 
-  send_message(to, outbuf, len);
-} /* vsendto_prefix_one() */
+{
+  va_list args;
+  int len;
+
+  va_start(args, pattern);
+  len = format_prefix_line(buf, from, local, pattern, args);
+  va_end(args);
+
+  return len;
+} /* format_prefix_linef() */
 
 /*
  * sendto_realops
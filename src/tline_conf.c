@@ -0,0 +1,429 @@
+/*
+ * tline_conf.c  -- temporary K-lines and G-lines
+ *
+ * $Id$
+ */
+#include "tline_conf.h"
+#include "irc_string.h"
+#include "ircd.h"
+#include "s_conf.h"
+#include "struct.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Lookups used to walk every temporary line with match(). Now host
+ * masks hang off a tree of the literal characters they end with
+ * (*.aol.com under "moc.loa."), so only masks whose suffix the host
+ * really ends with are tried, and ip masks are hashed on the masked
+ * address, one probe per prefix length in use. match() still has the
+ * last word on host masks, so what matches is unchanged.
+ *
+ * Expiry comes off a heap ordered by conf->hold, driven from the main
+ * loop; lookups just step over a line that is due but not reaped yet.
+ */
+
+struct TempLine {
+  struct TempLine* next;      /* hash chain or tree node list */
+  struct ConfItem* conf;
+  const char*      user;      /* conf->user for K-lines, ->name for G */
+  int              heap_pos;
+};
+
+struct TempLineNode {
+  struct TempLineNode* child;   /* first node one character further in */
+  struct TempLineNode* sibling; /* next node at the same depth */
+  struct TempLine*     lines;   /* masks whose suffix ends here */
+  unsigned char        c;       /* lower cased suffix character */
+};
+
+/*
+ * host_suffix - return the length of the literal tail of host mask
+ */
+static int host_suffix(const char* host)
+{
+  const char* p = host + strlen(host);
+  int         len = 0;
+
+  while (p > host && p[-1] != '*' && p[-1] != '?')
+    {
+      p--;
+      len++;
+    }
+  return len;
+}
+
+static unsigned int ip_hash(unsigned long ip, int bits)
+{
+  return (unsigned int) ((ip >> (32 - (bits ? bits : 32))) * 2654435761UL
+                         + bits) % TLINE_HASH_SIZE;
+}
+
+/*
+ * ip_bits - prefix length of mask, or -1 if it isn't a prefix mask
+ */
+static int ip_bits(unsigned long mask)
+{
+  int bits = 0;
+
+  mask &= 0xffffffffUL;
+  while (mask & 0x80000000UL)
+    {
+      mask = (mask << 1) & 0xffffffffUL;
+      bits++;
+    }
+  return mask ? -1 : bits;
+}
+
+static unsigned long bits_mask(int bits)
+{
+  return bits ? (0xffffffffUL << (32 - bits)) & 0xffffffffUL : 0;
+}
+
+/*
+ * heap_set/heap_up/heap_down - keep list->heap ordered on conf->hold
+ */
+static void heap_set(struct TempLineList* list, int i, struct TempLine* tl)
+{
+  list->heap[i] = tl;
+  tl->heap_pos = i;
+}
+
+static void heap_up(struct TempLineList* list, int i)
+{
+  struct TempLine* tl = list->heap[i];
+  int              parent;
+
+  while (i > 0)
+    {
+      parent = (i - 1) / 2;
+      if (list->heap[parent]->conf->hold <= tl->conf->hold)
+        break;
+      heap_set(list, i, list->heap[parent]);
+      i = parent;
+    }
+  heap_set(list, i, tl);
+}
+
+static void heap_down(struct TempLineList* list, int i)
+{
+  struct TempLine* tl = list->heap[i];
+  int              child;
+
+  while ((child = 2 * i + 1) < list->count)
+    {
+      if (child + 1 < list->count &&
+          list->heap[child + 1]->conf->hold < list->heap[child]->conf->hold)
+        child++;
+      if (tl->conf->hold <= list->heap[child]->conf->hold)
+        break;
+      heap_set(list, i, list->heap[child]);
+      i = child;
+    }
+  heap_set(list, i, tl);
+}
+
+/*
+ * host_node - find, or create, the node for the len character suffix
+ * of host
+ */
+static struct TempLineNode* host_node(struct TempLineNode* node,
+                                      const char* host, int len)
+{
+  struct TempLineNode* child;
+  const char*          p = host + strlen(host);
+  unsigned char        c;
+
+  while (len-- > 0)
+    {
+      c = ToLower(*--p);
+      for (child = node->child; child; child = child->sibling)
+        if (child->c == c)
+          break;
+      if (!child)
+        {
+          child = (struct TempLineNode*) MyMalloc(sizeof(struct TempLineNode));
+          memset(child, 0, sizeof(struct TempLineNode));
+          child->c = c;
+          child->sibling = node->child;
+          node->child = child;
+        }
+      node = child;
+    }
+  return node;
+}
+
+/*
+ * host_del - unhook tl from below node, freeing nodes left empty.
+ * p points just past the next suffix character to follow.
+ */
+static int host_del(struct TempLineNode* node, const char* p, int len,
+                    struct TempLine* tl)
+{
+  struct TempLineNode** cp;
+  struct TempLineNode*  child;
+  struct TempLine**     lp;
+
+  if (0 == len)
+    {
+      for (lp = &node->lines; *lp; lp = &(*lp)->next)
+        if (*lp == tl)
+          {
+            *lp = tl->next;
+            return 1;
+          }
+      return 0;
+    }
+
+  for (cp = &node->child; (child = *cp); cp = &child->sibling)
+    if (child->c == ToLower(p[-1]))
+      break;
+  if (!child || !host_del(child, p - 1, len - 1, tl))
+    return 0;
+
+  if (!child->lines && !child->child)
+    {
+      *cp = child->sibling;
+      MyFree(child);
+    }
+  return 1;
+}
+
+static void host_free(struct TempLineNode* node)
+{
+  struct TempLineNode* child;
+
+  while ((child = node->child))
+    {
+      node->child = child->sibling;
+      host_free(child);
+    }
+  MyFree(node);
+}
+
+/*
+ * line_matches - the tests the old list walk made for each line
+ */
+static int line_matches(struct TempLine* tl, const char* user)
+{
+  return tl->conf->hold > CurrentTime &&
+         tl->user && (!user || match(tl->user, user));
+}
+
+/*
+ * tline_add - index aconf and put it on the expiry heap. user is the
+ * user part of the mask, wherever the caller keeps it.
+ */
+void tline_add(struct TempLineList* list, struct ConfItem* aconf,
+               const char* user)
+{
+  struct TempLine* tl;
+  int              bits;
+
+  tl = (struct TempLine*) MyMalloc(sizeof(struct TempLine));
+  tl->conf = aconf;
+  tl->user = user;
+
+  if (aconf->ip)
+    {
+      if ((bits = ip_bits(aconf->ip_mask)) < 0)
+        {
+          tl->next = list->odd_ips;
+          list->odd_ips = tl;
+        }
+      else
+        {
+          unsigned int h = ip_hash(aconf->ip, bits);
+
+          tl->next = list->ips[h];
+          list->ips[h] = tl;
+          list->ip_bits[bits]++;
+        }
+    }
+  else
+    {
+      struct TempLineNode* node;
+
+      assert(0 != aconf->host);
+      if (!list->hosts)
+        {
+          list->hosts = (struct TempLineNode*) MyMalloc(sizeof(struct TempLineNode));
+          memset(list->hosts, 0, sizeof(struct TempLineNode));
+        }
+      node = host_node(list->hosts, aconf->host, host_suffix(aconf->host));
+      tl->next = node->lines;
+      node->lines = tl;
+    }
+
+  if (list->count == list->size)
+    {
+      list->size = list->size ? list->size * 2 : 64;
+      list->heap = (struct TempLine**) MyRealloc(list->heap,
+                                   list->size * sizeof(struct TempLine*));
+    }
+  heap_set(list, list->count++, tl);
+  heap_up(list, list->count - 1);
+}
+
+/*
+ * tline_unlink - take tl out of the indexes and the heap, and free it
+ */
+static void tline_unlink(struct TempLineList* list, struct TempLine* tl)
+{
+  struct ConfItem*  aconf = tl->conf;
+  struct TempLine** lp;
+  int               bits;
+  int               i;
+
+  if (aconf->ip)
+    {
+      if ((bits = ip_bits(aconf->ip_mask)) < 0)
+        lp = &list->odd_ips;
+      else
+        {
+          lp = &list->ips[ip_hash(aconf->ip, bits)];
+          list->ip_bits[bits]--;
+        }
+      for ( ; *lp; lp = &(*lp)->next)
+        if (*lp == tl)
+          {
+            *lp = tl->next;
+            break;
+          }
+    }
+  else
+    host_del(list->hosts, aconf->host + strlen(aconf->host),
+             host_suffix(aconf->host), tl);
+
+  i = tl->heap_pos;
+  if (i != --list->count)
+    {
+      heap_set(list, i, list->heap[list->count]);
+      heap_down(list, i);
+      heap_up(list, i);
+    }
+  MyFree(tl);
+}
+
+/*
+ * tline_del - take aconf out of list. The conf itself is left for the
+ * caller to free.
+ */
+void tline_del(struct TempLineList* list, struct ConfItem* aconf)
+{
+  int i;
+
+  for (i = 0; i < list->count; i++)
+    if (list->heap[i]->conf == aconf)
+      {
+        tline_unlink(list, list->heap[i]);
+        return;
+      }
+}
+
+/*
+ * tline_find - return the first unexpired line matching user@host or
+ * ip (host order), or NULL. A NULL host or user matches any.
+ */
+struct ConfItem* tline_find(struct TempLineList* list, const char* host,
+                            const char* user, unsigned long ip)
+{
+  struct TempLineNode* node;
+  struct TempLine*     tl;
+  const char*          p;
+  unsigned long        mask;
+  int                  bits;
+  int                  i;
+
+  if (!host)
+    {
+      for (i = 0; i < list->count; i++)
+        {
+          tl = list->heap[i];
+          if (!tl->conf->ip && tl->conf->host && line_matches(tl, user))
+            return tl->conf;
+        }
+    }
+  else if ((node = list->hosts))
+    {
+      p = host + strlen(host);
+      for (;;)
+        {
+          for (tl = node->lines; tl; tl = tl->next)
+            if (line_matches(tl, user) && match(tl->conf->host, host))
+              return tl->conf;
+          if (p == host)
+            break;
+          --p;
+          for (node = node->child; node; node = node->sibling)
+            if (node->c == ToLower(*p))
+              break;
+          if (!node)
+            break;
+        }
+    }
+
+  if (!ip)
+    return NULL;
+
+  for (bits = 32; bits >= 0; bits--)
+    {
+      if (!list->ip_bits[bits])
+        continue;
+      mask = bits_mask(bits);
+      for (tl = list->ips[ip_hash(ip & mask, bits)]; tl; tl = tl->next)
+        if (tl->conf->ip_mask == mask && tl->conf->ip == (ip & mask) &&
+            line_matches(tl, user))
+          return tl->conf;
+    }
+  for (tl = list->odd_ips; tl; tl = tl->next)
+    if ((ip & tl->conf->ip_mask) == tl->conf->ip && line_matches(tl, user))
+      return tl->conf;
+  return NULL;
+}
+
+/*
+ * tline_expired - take the next line whose hold has passed out of list
+ * and return it for the caller to report and free, or NULL
+ */
+struct ConfItem* tline_expired(struct TempLineList* list)
+{
+  struct ConfItem* aconf;
+
+  if (!list->count || list->heap[0]->conf->hold > CurrentTime)
+    return NULL;
+  aconf = list->heap[0]->conf;
+  tline_unlink(list, list->heap[0]);
+  return aconf;
+}
+
+/*
+ * tline_conf - return the i'th line of list, in no particular order,
+ * or NULL past the end
+ */
+struct ConfItem* tline_conf(struct TempLineList* list, int i)
+{
+  return (i < list->count) ? list->heap[i]->conf : NULL;
+}
+
+/*
+ * tline_flush - free every line on list
+ */
+void tline_flush(struct TempLineList* list)
+{
+  struct TempLine* tl;
+  int              i;
+
+  for (i = 0; i < list->count; i++)
+    {
+      tl = list->heap[i];
+      free_conf(tl->conf);
+      MyFree(tl);
+    }
+  MyFree(list->heap);
+  if (list->hosts)
+    host_free(list->hosts);
+  memset(list, 0, sizeof(struct TempLineList));
+}
@@ -0,0 +1,572 @@
+/*
+mkbandb - compile a kline.conf or dline.conf into an image the server
+can map in and use as it is, see include/ban_db.h and BAN_DB in
+config.h
+$Id$
+
+To compile:
+  gcc -I../include -o mkbandb mkbandb.c
+
+Typical usage:
+
+  ./mkbandb kline.conf
+  ./mkbandb dline.conf
+
+  /rehash
+
+kline.conf.db and dline.conf.db are written next to the text files.
+Lines /KLINE and /DLINE add to the text afterwards are still read by
+the server; after an /UNKLINE, or an edit, run it again, until then
+the server reads the whole text file.
+
+The lines are read the way the server reads them, anything but K, k,
+D and d lines is reported and left out. So are K lines that the server
+would find to be duplicates on its list of unsortable K lines (those
+it can't put in the mtrie); it doesn't look for them in an image, on
+a big kline.conf that is most of the time it takes to load.
+*/
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <ctype.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#define BAN_DB_TOOL
+#include "ban_db.h"
+
+#define MAXLINE 512     /* BUFSIZE in the server */
+#define SEEN_HASH 65536
+#define YES 1
+#define NO 0
+
+static struct BanDbRecord* records;
+static unsigned int        nrecords;
+static unsigned int        records_size;
+
+static char*               strings;
+static unsigned int        strings_used;
+static unsigned int        strings_size;
+
+/* user@host of the unsortable K lines so far */
+struct Seen {
+  struct Seen *next;
+  char        key[1];
+};
+static struct Seen*        seen[SEEN_HASH];
+
+static int  compile(const char *,const char *);
+static void parse_line(char *,unsigned int);
+static unsigned int add_string(const char *);
+static int  unsortable(const char *);
+static int  seen_before(const char *,const char *);
+static void unquote_conf_line(char *);
+static char *split_field(char **);
+static int  is_address(char *,unsigned long *,unsigned long *);
+static void collapse(char *);
+
+int main(int argc,char *argv[])
+{
+  char *out;
+
+  if(argc < 2 || argc > 3)
+    {
+      (void)fprintf(stderr,"%s: filein [fileout]\n",argv[0]);
+      (void)fprintf(stderr,"i.e. %s kline.conf kline.conf%s\n",argv[0],
+                    BAN_DB_SUFFIX);
+      exit(-1);
+    }
+
+  if(argc == 3)
+    out = argv[2];
+  else
+    {
+      out = malloc(strlen(argv[1]) + sizeof(BAN_DB_SUFFIX));
+      if(!out)
+        exit(-1);
+      strcpy(out,argv[1]);
+      strcat(out,BAN_DB_SUFFIX);
+    }
+
+  return compile(argv[1],out) ? 0 : -1;
+}
+
+/*
+compile
+
+input		- text file name
+		- image file name
+output		- YES if the image was written
+side effects	- the whole of filein is read and hashed, its bans
+		  compiled and written to a temporary file which is
+		  then renamed to fileout, so the server never maps
+		  half an image
+*/
+static int compile(const char *filein,const char *fileout)
+{
+  FILE *fp;
+  struct stat sb;
+  struct BanDbHeader head;
+  char *text;
+  char *tmpname;
+  char line[MAXLINE];
+  char *p;
+  char c;
+  unsigned int hash = BAN_DB_HASH_INIT;
+  unsigned int i;
+  unsigned int start;
+  unsigned int len;
+
+  if((fp = fopen(filein,"r")) == NULL || fstat(fileno(fp),&sb))
+    {
+      (void)fprintf(stderr,"Can't open %s: %s\n",filein,strerror(errno));
+      return NO;
+    }
+  if((text = malloc(sb.st_size + 1)) == NULL ||
+     fread(text,1,sb.st_size,fp) != (size_t)sb.st_size)
+    {
+      (void)fprintf(stderr,"Can't read %s\n",filein);
+      return NO;
+    }
+  (void)fclose(fp);
+
+  for(i = 0; i < (unsigned int)sb.st_size; i++)
+    hash = BAN_DB_HASH(hash,text[i]);
+
+  add_string("");       /* offset 0 is no string */
+
+  /* split into lines as fbgets() does, a \r ends one too */
+  for(start = 0; start < (unsigned int)sb.st_size; start += len)
+    {
+      p = line;
+      for(len = 0; start + len < (unsigned int)sb.st_size &&
+          p < line + sizeof(line) - 1; )
+        {
+          c = text[start + len++];
+          if(c == '\r')
+            {
+              if(start + len < (unsigned int)sb.st_size &&
+                 text[start + len] == '\n')
+                len++;
+              *p++ = '\n';
+              break;
+            }
+          *p++ = c;
+          if(c == '\n')
+            break;
+        }
+      *p = '\0';
+      parse_line(line,start);
+    }
+
+  memset(&head,0,sizeof(head));
+  head.magic = BAN_DB_MAGIC;
+  head.version = BAN_DB_VERSION;
+  head.text_size = sb.st_size;
+  head.text_hash = hash;
+  head.count = nrecords;
+  head.strings = sizeof(head) + nrecords * sizeof(struct BanDbRecord);
+  head.size = head.strings + strings_used;
+
+  if((tmpname = malloc(strlen(fileout) + sizeof(".tmp"))) == NULL)
+    return NO;
+  strcpy(tmpname,fileout);
+  strcat(tmpname,".tmp");
+
+  if((fp = fopen(tmpname,"w")) == NULL)
+    {
+      (void)fprintf(stderr,"Can't create %s: %s\n",tmpname,strerror(errno));
+      return NO;
+    }
+  if(fwrite(&head,sizeof(head),1,fp) != 1 ||
+     (nrecords &&
+      fwrite(records,sizeof(struct BanDbRecord),nrecords,fp) != nrecords) ||
+     fwrite(strings,1,strings_used,fp) != strings_used ||
+     fclose(fp))
+    {
+      (void)fprintf(stderr,"Can't write %s: %s\n",tmpname,strerror(errno));
+      (void)unlink(tmpname);
+      return NO;
+    }
+  if(rename(tmpname,fileout))
+    {
+      (void)fprintf(stderr,"Can't rename %s to %s: %s\n",tmpname,fileout,
+                    strerror(errno));
+      (void)unlink(tmpname);
+      return NO;
+    }
+
+  (void)printf("%s: %u bans from %lu bytes of %s\n",fileout,nrecords,
+               (unsigned long)sb.st_size,filein);
+  return YES;
+}
+
+/*
+parse_line
+
+input		- a line of the text, as the server's fbgets() gives it
+		- where it starts, for the messages
+output		- none
+side effects	- a K, k, D or d line is added to records, the way
+		  conf_read_bans() in the server adds it
+*/
+static void parse_line(char *line,unsigned int where)
+{
+  struct BanDbRecord rec;
+  char *tmp;
+  char *rest;
+  char *host = NULL;
+  char *passwd = NULL;
+  char *user = NULL;
+  unsigned long ip = 0;
+  unsigned long ip_mask = 0;
+
+  if((tmp = strchr(line,'\n')))
+    *tmp = '\0';
+
+  unquote_conf_line(line);
+  if(!*line || line[0] == ' ' || line[0] == '\t')
+    return;
+
+  memset(&rec,0,sizeof(rec));
+  if(line[1] != ':')
+    {
+      (void)fprintf(stderr,"Bad config line at byte %u: %s\n",where,line);
+      return;
+    }
+  switch(line[0])
+    {
+    case 'K':
+    case 'k':
+      rec.kind = BAN_DB_KLINE;
+      break;
+    case 'd':
+      rec.kind = BAN_DB_ELINE;
+      break;
+    case 'D':
+      rec.kind = BAN_DB_DLINE;
+      break;
+    default:
+      (void)fprintf(stderr,"Not a K or D line at byte %u: %s\n",where,line);
+      return;
+    }
+  rest = line + 2;
+
+  for(;;) /* host, passwd, user, port, class */
+    {
+      if((host = split_field(&rest)) == NULL)
+        break;
+      if((passwd = split_field(&rest)) == NULL)
+        break;
+      if((tmp = strchr(passwd,'|')) != NULL)
+        *tmp = '\0';
+      if((user = split_field(&rest)) == NULL)
+        break;
+      if((tmp = split_field(&rest)) == NULL)
+        break;
+      rec.port = atoi(tmp);
+      if(split_field(&rest) == NULL)
+        break;
+      rec.has_class = YES;
+      break;
+    }
+  if(host == NULL)
+    return;
+
+  if(rec.kind == BAN_DB_KLINE)
+    {
+      if(is_address(host,&ip,&ip_mask))
+        {
+          rec.kind = BAN_DB_IP_KLINE;
+          rec.ip = ip & ip_mask;
+          rec.ip_mask = ip_mask;
+        }
+      else
+        {
+          collapse(host);
+          if(user)
+            collapse(user);
+          if(user && unsortable(host) && seen_before(host,user))
+            {
+              (void)fprintf(stderr,"Duplicate K line at byte %u: %s@%s\n",
+                            where,user,host);
+              return;
+            }
+        }
+      rec.host = add_string(host);
+      rec.user = user ? add_string(user) : 0;
+    }
+  else
+    {
+      (void)is_address(host,&ip,&ip_mask);
+      rec.ip = ip & ip_mask;
+      rec.ip_mask = ip_mask;
+      rec.host = rec.user = add_string(host);
+    }
+  rec.passwd = passwd ? add_string(passwd) : 0;
+
+  if(nrecords == records_size)
+    {
+      records_size = records_size ? records_size * 2 : 1024;
+      records = realloc(records,records_size * sizeof(struct BanDbRecord));
+      if(!records)
+        {
+          (void)fprintf(stderr,"Out of memory\n");
+          exit(-1);
+        }
+    }
+  records[nrecords++] = rec;
+}
+
+/*
+add_string - copy s, with its '\0', to the strings, return its offset
+*/
+static unsigned int add_string(const char *s)
+{
+  unsigned int len = strlen(s) + 1;
+  unsigned int off = strings_used;
+
+  if(strings_used + len > strings_size)
+    {
+      while(strings_used + len > strings_size)
+        strings_size = strings_size ? strings_size * 2 : 65536;
+      strings = realloc(strings,strings_size);
+      if(!strings)
+        {
+          (void)fprintf(stderr,"Out of memory\n");
+          exit(-1);
+        }
+    }
+  memcpy(strings + off,s,len);
+  strings_used += len;
+  return off;
+}
+
+/*
+unsortable - does the server keep the K line for host on its list of
+unsortable K lines, see sortable() in src/mtrie_conf.c
+*/
+static int unsortable(const char *host)
+{
+  return strchr(host,'?') || strcmp(host,"*") == 0 ||
+    (*host && strchr(host + 1,'*'));
+}
+
+/*
+seen_before
+
+input		- host and user of an unsortable K line
+output		- YES if there was one just like it before, as irccmp()
+		  compares them
+side effects	- it is remembered if not
+*/
+static int seen_before(const char *host,const char *user)
+{
+  struct Seen *sp;
+  struct Seen *p;
+  char *d;
+  unsigned int hash = BAN_DB_HASH_INIT;
+  size_t len = strlen(host) + strlen(user) + 2;
+
+  if((sp = malloc(sizeof(struct Seen) + len)) == NULL)
+    {
+      (void)fprintf(stderr,"Out of memory\n");
+      exit(-1);
+    }
+  strcpy(sp->key,user);
+  strcat(sp->key,":");   /* can't be in either */
+  strcat(sp->key,host);
+  for(d = sp->key; *d; d++)
+    {
+      /* the server's ToLower(), {}|~ are the lower case of []\^ */
+      if(*d >= 'A' && *d <= '^')
+        *d += 'a' - 'A';
+      hash = BAN_DB_HASH(hash,*d);
+    }
+  hash &= SEEN_HASH - 1;
+
+  for(p = seen[hash]; p; p = p->next)
+    if(strcmp(p->key,sp->key) == 0)
+      {
+        free(sp);
+        return YES;
+      }
+  sp->next = seen[hash];
+  seen[hash] = sp;
+  return NO;
+}
+
+/*
+The rest are the server's own, from src/s_conf.c and src/match.c, so
+the lines come out here just as the server would read them.
+*/
+
+static void unquote_conf_line(char *line)
+{
+  static char  quotes[] = {
+    0,    /*  */
+    0,    /* a */
+    '\b', /* b */
+    0,    /* c */
+    0,    /* d */
+    0,    /* e */
+    '\f', /* f */
+    0,    /* g */
+    0,    /* h */
+    0,    /* i */
+    0,    /* j */
+    0,    /* k */
+    0,    /* l */
+    0,    /* m */
+    '\n', /* n */
+    0,    /* o */
+    0,    /* p */
+    0,    /* q */
+    '\r', /* r */
+    0,    /* s */
+    '\t', /* t */
+    0,    /* u */
+    '\v', /* v */
+    0,    /* w */
+    0,    /* x */
+    0,    /* y */
+    0,    /* z */
+    0,0,0,0,0,0
+    };
+
+  char *tmp;
+  char *s;
+
+  for (tmp = line; *tmp; tmp++)
+    {
+      if (*tmp == '\\')
+        {
+          if ( *(tmp+1) == '\\' )
+            *tmp = '\\';
+          else
+            *tmp = quotes[ (unsigned int) (*(tmp+1) & 0x1F) ];
+          for (s = tmp; (*s = *(s+1)); s++)
+            ;
+        }
+      else if (*tmp == '#')
+        *tmp = '\0';
+    }
+}
+
+static char *split_field(char **line)
+{
+  char  *end, *field;
+
+  if (*line == (char *)NULL)
+    return((char *)NULL);
+
+  field = *line;
+  if ((end = strchr(field,':')) == NULL)
+    {
+      *line = (char *)NULL;
+      if ((end = strchr(field,'\n')) == (char *)NULL)
+        end = field + strlen(field);
+    }
+  else
+    *line = end + 1;
+  *end = '\0';
+  return(field);
+}
+
+static unsigned long cidr_to_bitmask(unsigned long bits)
+{
+  return bits ? (0xFFFFFFFFUL << (32 - bits)) & 0xFFFFFFFFUL : 0;
+}
+
+static int is_address(char *host,
+                      unsigned long *ip_ptr,
+                      unsigned long *ip_mask_ptr)
+{
+  unsigned long current_ip=0L;
+  unsigned int octet=0;
+  int found_mask=0;
+  int dot_count=0;
+  char c;
+
+  while( (c = *host) )
+    {
+      if(isdigit((unsigned char)c))
+        {
+          octet *= 10;
+          octet += (*host & 0xF);
+        }
+      else if(c == '.')
+        {
+          current_ip <<= 8;
+          current_ip += octet;
+          if( octet > 255 )
+            return( 0 );
+          octet = 0;
+          dot_count++;
+        }
+      else if(c == '/')
+        {
+          if( octet > 255 )
+            return( 0 );
+          found_mask = 1;
+          current_ip <<= 8;
+          current_ip += octet;
+          octet = 0;
+          *ip_ptr = current_ip;
+          current_ip = 0L;
+        }
+      else if(c == '*')
+        {
+          if( (dot_count == 3) && (*(host+1) == '\0') && (*(host-1) == '.'))
+            {
+              current_ip <<= 8;
+              *ip_ptr = current_ip;
+              *ip_mask_ptr = 0xFFFFFF00L;
+              return( 1 );
+            }
+          else
+            return( 0 );
+        }
+      else
+        return( 0 );
+      host++;
+    }
+
+  current_ip <<= 8;
+  current_ip += octet;
+
+  if(found_mask)
+    {
+      if(current_ip>32)
+        return( 0 );
+      *ip_mask_ptr = cidr_to_bitmask(current_ip);
+    }
+  else
+    {
+      *ip_ptr = current_ip;
+      *ip_mask_ptr = 0xFFFFFFFFL;
+    }
+
+  return( 1 );
+}
+
+static void collapse(char *pattern)
+{
+  char* s = pattern;
+  char* s1;
+  char* t;
+
+  for (; *s; s++) {
+    if ('*' == *s) {
+      t = s1 = s + 1;
+      while ('*' == *t)
+        ++t;
+      if (s1 != t) {
+        while ((*s1++ = *t++))
+          ;
+      }
+    }
+  }
+}